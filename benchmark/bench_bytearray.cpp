@@ -0,0 +1,97 @@
+#include "cxk/bytearray.h"
+#include "cxk/logger.h"
+#include "cxk/util.h"
+#include <vector>
+
+static cxk::Logger::ptr g_logger = CXK_LOG_ROOT();
+
+static const size_t COUNT = 1000000;
+static const int ROUND = 10;
+
+
+// 逐个写入/读取和批量写入/读取的耗时对比
+template<class T>
+void bench_varint(const std::string& name, const std::vector<T>& values){
+    uint64_t begin = cxk::GetCurrentUS();
+    size_t size = 0;
+    for(int r = 0; r < ROUND; ++r){
+        cxk::ByteArray::ptr ba(new cxk::ByteArray);
+        for(auto& i : values){
+            if(sizeof(T) == 4){
+                ba->writeUint32(i);
+            } else {
+                ba->writeUint64(i);
+            }
+        }
+        size = ba->getSize();
+        ba->setPosition(0);
+        T sum = 0;
+        for(size_t i = 0; i < values.size(); ++i){
+            sum += sizeof(T) == 4 ? ba->readUint32() : ba->readUint64();
+        }
+    }
+    uint64_t single = cxk::GetCurrentUS() - begin;
+
+    begin = cxk::GetCurrentUS();
+    std::vector<T> out(values.size());
+    for(int r = 0; r < ROUND; ++r){
+        cxk::ByteArray::ptr ba(new cxk::ByteArray);
+        ba->writeVarintArray(&values[0], values.size());
+        ba->setPosition(0);
+        ba->readVarintArray(&out[0], out.size());
+    }
+    uint64_t bulk = cxk::GetCurrentUS() - begin;
+    CXK_LOG_INFO(g_logger) << name << " count=" << values.size() << " bytes=" << size
+                           << " single=" << single / ROUND << "us bulk=" << bulk / ROUND << "us"
+                           << " check=" << (out == values);
+}
+
+
+void bench_fixed(){
+    std::vector<uint32_t> values(COUNT);
+    for(auto& i : values){
+        i = rand();
+    }
+    std::vector<uint32_t> out(COUNT);
+
+    uint64_t begin = cxk::GetCurrentUS();
+    for(int r = 0; r < ROUND; ++r){
+        cxk::ByteArray::ptr ba(new cxk::ByteArray);
+        for(auto& i : values){
+            ba->writeFuint32_t(i);
+        }
+        ba->setPosition(0);
+        for(auto& i : out){
+            i = ba->readFuint32_t();
+        }
+    }
+    uint64_t single = cxk::GetCurrentUS() - begin;
+
+    begin = cxk::GetCurrentUS();
+    for(int r = 0; r < ROUND; ++r){
+        cxk::ByteArray::ptr ba(new cxk::ByteArray);
+        ba->writeFixedArray(&values[0], values.size());
+        ba->setPosition(0);
+        ba->readFixedArray(&out[0], out.size());
+    }
+    uint64_t bulk = cxk::GetCurrentUS() - begin;
+    CXK_LOG_INFO(g_logger) << "fixed32 count=" << COUNT << " single=" << single / ROUND
+                           << "us bulk=" << bulk / ROUND << "us check=" << (out == values);
+}
+
+
+int main(int argc, char* argv[]){
+    std::vector<uint32_t> small(COUNT);
+    std::vector<uint32_t> mixed(COUNT);
+    std::vector<uint64_t> large(COUNT);
+    for(size_t i = 0; i < COUNT; ++i){
+        small[i] = rand() % 128;
+        mixed[i] = rand() % 4 ? rand() % 128 : rand();
+        large[i] = ((uint64_t)rand() << 20) | rand();
+    }
+    bench_varint("varint32 small", small);
+    bench_varint("varint32 mixed", mixed);
+    bench_varint("varint64 large", large);
+    bench_fixed();
+    return 0;
+}
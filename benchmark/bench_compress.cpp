@@ -0,0 +1,80 @@
+#include "cxk/stream/compress_codec.h"
+#include "cxk/logger.h"
+#include "cxk/util.h"
+#include <sstream>
+#include <vector>
+
+static cxk::Logger::ptr g_logger = CXK_LOG_ROOT();
+
+static const int ROUND = 20;
+
+
+// 类似RPC响应的JSON数据
+static std::string make_json(size_t size){
+    std::stringstream ss;
+    ss << "[";
+    for(int i = 0; ss.tellp() < (std::streampos)size; ++i){
+        ss << (i ? "," : "") << "{\"id\":" << i << ",\"name\":\"user_" << rand() % 1000
+           << "\",\"score\":" << rand() % 100000 / 100.0 << ",\"tags\":[\"vip\",\"level" << rand() % 10
+           << "\"],\"active\":" << (rand() % 2 ? "true" : "false") << "}";
+    }
+    ss << "]";
+    return ss.str();
+}
+
+// 访问日志风格的文本
+static std::string make_text(size_t size){
+    std::stringstream ss;
+    for(int i = 0; ss.tellp() < (std::streampos)size; ++i){
+        ss << "2024-01-01 12:00:" << i % 60 << " INFO [http] GET /api/v1/item/" << rand() % 10000
+           << " 200 " << rand() % 1000 << "ms\n";
+    }
+    return ss.str();
+}
+
+
+// 压缩/解压吞吐量(MB/s, 按原始大小计算)和压缩率
+void bench_codec(cxk::CompressCodec::ptr codec, const std::string& name, const std::string& data){
+    std::string compressed;
+    std::string decompressed;
+
+    uint64_t begin = cxk::GetCurrentUS();
+    for(int r = 0; r < ROUND; ++r){
+        codec->compress(data, compressed);
+    }
+    uint64_t compress_us = cxk::GetCurrentUS() - begin;
+
+    begin = cxk::GetCurrentUS();
+    for(int r = 0; r < ROUND; ++r){
+        codec->decompress(compressed, decompressed);
+    }
+    uint64_t decompress_us = cxk::GetCurrentUS() - begin;
+
+    double mb = data.size() * ROUND / 1024.0 / 1024.0;
+    CXK_LOG_INFO(g_logger) << name << " " << codec->getName()
+                           << " size=" << data.size()
+                           << " ratio=" << (double)compressed.size() / data.size()
+                           << " compress=" << mb / (compress_us / 1000000.0) << "MB/s"
+                           << " decompress=" << mb / (decompress_us / 1000000.0) << "MB/s"
+                           << " check=" << (decompressed == data);
+}
+
+
+int main(int argc, char* argv[]){
+    std::vector<std::pair<std::string, std::string>> payloads = {
+        {"json_4k", make_json(4 * 1024)},
+        {"json_256k", make_json(256 * 1024)},
+        {"text_1m", make_text(1024 * 1024)},
+        {"random_64k", cxk::random_string(64 * 1024)}
+    };
+
+    for(auto& p : payloads){
+        for(int i = cxk::CompressCodec::GZIP; i < cxk::CompressCodec::TYPE_COUNT; ++i){
+            auto codec = cxk::CompressCodec::Get((cxk::CompressCodec::Type)i);
+            if(codec){
+                bench_codec(codec, p.first, p.second);
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,96 @@
+#include "cxk/cxk.h"
+
+static cxk::Logger::ptr g_logger = CXK_LOG_ROOT();
+
+static const int PORT = 8092;
+static const int COUNT = 20000;
+// 每批同时发出的请求数
+static const int BATCH = 100;
+
+static cxk::http::HttpServer::ptr s_server;
+
+
+static bool start_server(cxk::IOManager* iom){
+    s_server.reset(new cxk::http::HttpServer(true, iom, iom));
+    s_server->getServletDispatch()->addServlet("/ping", [](cxk::http::HttpRequest::ptr request
+                , cxk::http::HttpResponse::ptr response, cxk::http::HttpSession::ptr session){
+        response->setBody("pong");
+        return 0;
+    });
+    auto addr = cxk::Address::LookupAnyIpAddr("127.0.0.1:" + std::to_string(PORT));
+    return s_server->bind(addr) && s_server->start();
+}
+
+
+static void report(const std::string& name, uint64_t begin, int count, int errors){
+    double sec = (cxk::GetCurrentUS() - begin) / 1000000.0;
+    CXK_LOG_INFO(g_logger) << name << " qps=" << (int)(count / sec) << " errors=" << errors;
+}
+
+
+// 原来的方式: 每个请求新建连接, 串行等待
+void bench_do_get(){
+    std::string url = "http://127.0.0.1:" + std::to_string(PORT) + "/ping";
+    int errors = 0;
+    int count = COUNT / 10;
+    uint64_t begin = cxk::GetCurrentUS();
+    for(int i = 0; i < count; ++i){
+        errors += cxk::http::HttpConnection::DoGet(url, 1000)->result != 0;
+    }
+    report("HttpConnection::DoGet", begin, count, errors);
+}
+
+
+// 连接池, 每批请求同时发出再一起等待
+void bench_pool(const std::string& name, uint32_t connections, uint32_t pipeline){
+    cxk::http::HttpClientPool::Options options;
+    options.max_connections = connections;
+    options.max_pipeline = pipeline;
+    auto pool = std::make_shared<cxk::http::HttpClientPool>("127.0.0.1", PORT, false, options);
+    int errors = 0;
+    uint64_t begin = cxk::GetCurrentUS();
+    std::vector<cxk::http::HttpFuture::ptr> futures;
+    for(int i = 0; i < COUNT; i += BATCH){
+        futures.clear();
+        for(int j = 0; j < BATCH; ++j){
+            futures.push_back(pool->request(cxk::http::HttpMethod::GET, "/ping", 1000));
+        }
+        for(auto& r : cxk::http::HttpFuture::WaitAll(futures)){
+            errors += r->result != 0;
+        }
+    }
+    report(name, begin, COUNT, errors);
+    pool->close();
+}
+
+
+int main(int argc, char* argv[]){
+    CXK_LOG_NAME("system")->setLogLevel(cxk::LogLevel::INFO);
+    cxk::IOManager iom(2, false);
+    std::atomic<int> started{0};
+    iom.schedule([&](){
+        started = start_server(&iom) ? 1 : -1;
+    });
+    while(started == 0){
+        usleep(1000);
+    }
+    if(started < 0){
+        CXK_LOG_ERROR(g_logger) << "bind " << PORT << " fail";
+        return 1;
+    }
+
+    cxk::Semaphore done;
+    iom.schedule([&](){
+        bench_do_get();
+        bench_pool("pool(1 conn)", 1, 1);
+        bench_pool("pool(8 conns)", 8, 1);
+        bench_pool("pool(1 conn, pipeline 16)", 1, 16);
+        bench_pool("pool(8 conns, pipeline 16)", 8, 16);
+        done.notify();
+    });
+    done.wait();
+
+    s_server->stop();
+    iom.stop();
+    return 0;
+}
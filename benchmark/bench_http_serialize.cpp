@@ -0,0 +1,79 @@
+#include "cxk/http/http.h"
+#include "cxk/logger.h"
+#include "cxk/util.h"
+#include <sstream>
+
+static cxk::Logger::ptr g_logger = CXK_LOG_ROOT();
+
+static const size_t COUNT = 1000000;
+
+
+// 典型的小响应: 几个头部, 1K的响应体
+static cxk::http::HttpResponse::ptr make_response(){
+    cxk::http::HttpResponse::ptr rsp(new cxk::http::HttpResponse(0x11, false));
+    rsp->setHeader("Content-Type", "application/json; charset=utf-8");
+    rsp->setHeader("Server", "cxk/1.0.0");
+    rsp->setHeader("Cache-Control", "no-cache");
+    rsp->setHeader("X-Request-Id", "5f0c6a9e-1d2b-4c3a-9e8f-0123456789ab");
+    rsp->setBody(std::string(1024, 'x'));
+    return rsp;
+}
+
+
+// 原来的dumpHeader: 逐项用iostream格式化
+static void dump_header(std::ostream& os, cxk::http::HttpResponse::ptr rsp){
+    os << "HTTP/"
+        << ((uint32_t) (rsp->getVersion() >> 4))
+        << "."
+        << ((uint32_t)(rsp->getVersion() & 0x0F))
+        << " "
+        << (uint32_t)rsp->getStatus()
+        << " "
+        << cxk::http::HttpStatusToString(rsp->getStatus())
+        << "\r\n";
+    for(auto& i : rsp->getHeaders()){
+        os << i.first << ": " << i.second << "\r\n";
+    }
+    os << "connection: " << (rsp->isClose() ? "close" : "keep-alive") << "\r\n";
+    os << "content-length: " << rsp->getBody().size() << "\r\n\r\n";
+}
+
+
+// 原来的方式: 每个响应一个stringstream, 再拷贝成string
+void bench_stringstream(cxk::http::HttpResponse::ptr rsp){
+    size_t total = 0;
+    uint64_t begin = cxk::GetCurrentUS();
+    for(size_t i = 0; i < COUNT; ++i){
+        std::stringstream ss;
+        dump_header(ss, rsp);
+        std::string header = ss.str();
+        total += header.size();
+    }
+    uint64_t us = cxk::GetCurrentUS() - begin;
+    CXK_LOG_INFO(g_logger) << "stringstream: " << us * 1000.0 / COUNT << "ns/response"
+                           << " bytes=" << total;
+}
+
+
+// 直接序列化到复用的缓冲区
+void bench_serialize(cxk::http::HttpResponse::ptr rsp){
+    size_t total = 0;
+    std::string buf;
+    uint64_t begin = cxk::GetCurrentUS();
+    for(size_t i = 0; i < COUNT; ++i){
+        buf.clear();
+        rsp->serializeHeader(buf);
+        total += buf.size();
+    }
+    uint64_t us = cxk::GetCurrentUS() - begin;
+    CXK_LOG_INFO(g_logger) << "serializeHeader: " << us * 1000.0 / COUNT << "ns/response"
+                           << " bytes=" << total;
+}
+
+
+int main(int argc, char* argv[]){
+    auto rsp = make_response();
+    bench_stringstream(rsp);
+    bench_serialize(rsp);
+    return 0;
+}
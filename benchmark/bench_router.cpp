@@ -0,0 +1,111 @@
+#include "cxk/http/servlet.h"
+#include "cxk/logger.h"
+#include "cxk/util.h"
+#include <fnmatch.h>
+#include <vector>
+
+static cxk::Logger::ptr g_logger = CXK_LOG_ROOT();
+
+// 250个资源, 每个资源4条路由, 共1000条
+static const int RESOURCE_COUNT = 250;
+static const size_t LOOKUP_COUNT = 1000000;
+
+
+static int32_t handle(cxk::http::HttpRequest::ptr request, cxk::http::HttpResponse::ptr response,
+        cxk::http::HttpSession::ptr session){
+    return 0;
+}
+
+
+// 请求路径, 覆盖静态、参数和通配路由, 以及不能匹配的路径
+static std::vector<std::string> make_paths(){
+    std::vector<std::string> paths;
+    for(size_t i = 0; i < 4096; ++i){
+        int r = rand() % RESOURCE_COUNT;
+        switch(i % 5){
+            case 0:
+                paths.push_back("/api/v1/res" + std::to_string(r));
+                break;
+            case 1:
+                paths.push_back("/api/v1/res" + std::to_string(r) + "/" + std::to_string(rand()));
+                break;
+            case 2:
+                paths.push_back("/api/v1/res" + std::to_string(r) + "/" + std::to_string(rand()) + "/items/" + std::to_string(rand()));
+                break;
+            case 3:
+                paths.push_back("/static/res" + std::to_string(r) + "/js/app.js");
+                break;
+            default:
+                paths.push_back("/unknown/" + std::to_string(r));
+                break;
+        }
+    }
+    return paths;
+}
+
+
+// 基数树路由
+void bench_router(const std::vector<std::string>& paths){
+    cxk::http::ServletDispatch::ptr dispatch(new cxk::http::ServletDispatch);
+    uint64_t begin = cxk::GetCurrentUS();
+    for(int i = 0; i < RESOURCE_COUNT; ++i){
+        std::string res = "/api/v1/res" + std::to_string(i);
+        dispatch->addServlet(res, handle);
+        dispatch->addServlet(res + "/:id", handle);
+        dispatch->addServlet(res + "/:id/items/:item", handle);
+        dispatch->addServlet("/static/res" + std::to_string(i) + "/*path", handle);
+    }
+    uint64_t build_us = cxk::GetCurrentUS() - begin;
+
+    size_t matched = 0;
+    begin = cxk::GetCurrentUS();
+    cxk::http::RadixRouter::Params params;
+    for(size_t i = 0; i < LOOKUP_COUNT; ++i){
+        params.clear();
+        auto slt = dispatch->getMatchedServlet(paths[i % paths.size()], &params);
+        matched += slt != dispatch->getDefault();
+    }
+    uint64_t us = cxk::GetCurrentUS() - begin;
+    CXK_LOG_INFO(g_logger) << "radix router: routes=" << RESOURCE_COUNT * 4
+                           << " build=" << build_us << "us"
+                           << " lookup=" << us * 1000.0 / LOOKUP_COUNT << "ns"
+                           << " matched=" << matched;
+}
+
+
+// 原来的方式: 等价的模糊匹配按顺序fnmatch, 和ServletDispatch一样不带FNM_PATHNAME
+void bench_glob(const std::vector<std::string>& paths){
+    std::vector<std::string> globs;
+    for(int i = 0; i < RESOURCE_COUNT; ++i){
+        std::string res = "/api/v1/res" + std::to_string(i);
+        globs.push_back(res);
+        globs.push_back(res + "/[!/]*");
+        globs.push_back(res + "/*/items/*");
+        globs.push_back("/static/res" + std::to_string(i) + "/*");
+    }
+
+    size_t matched = 0;
+    size_t count = LOOKUP_COUNT / 100;
+    uint64_t begin = cxk::GetCurrentUS();
+    for(size_t i = 0; i < count; ++i){
+        const std::string& path = paths[i % paths.size()];
+        for(auto& g : globs){
+            if(!fnmatch(g.c_str(), path.c_str(), 0)){
+                ++matched;
+                break;
+            }
+        }
+    }
+    uint64_t us = cxk::GetCurrentUS() - begin;
+    CXK_LOG_INFO(g_logger) << "fnmatch glob: routes=" << globs.size()
+                           << " lookup=" << us * 1000.0 / count << "ns"
+                           << " matched=" << matched;
+}
+
+
+int main(int argc, char* argv[]){
+    auto paths = make_paths();
+    bench_router(paths);
+    bench_glob(paths);
+    return 0;
+}
@@ -0,0 +1,172 @@
+#include "cxk/cxk.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <fstream>
+#include <thread>
+#include <atomic>
+
+static cxk::Logger::ptr g_logger = CXK_LOG_ROOT();
+
+static const int PORT = 8090;
+static const int CONNECTIONS = 4;
+static const size_t SMALL_SIZE = 8 * 1024;
+static const size_t LARGE_SIZE = 4 * 1024 * 1024;
+
+
+// 原来的方式: servlet每次读出整个文件再setBody
+static int32_t read_file(cxk::http::HttpRequest::ptr request, cxk::http::HttpResponse::ptr response,
+        cxk::http::HttpSession::ptr session, const std::string& root){
+    std::ifstream ifs(root + request->getRouteParam("path"), std::ios::binary);
+    if(!ifs){
+        response->setStatus(cxk::http::HttpStatus::NOT_FOUND);
+        return 0;
+    }
+    std::string body;
+    ifs.seekg(0, std::ios::end);
+    body.resize(ifs.tellg());
+    ifs.seekg(0, std::ios::beg);
+    ifs.read(&body[0], body.size());
+    response->setBody(body);
+    return 0;
+}
+
+
+static void make_file(const std::string& path, size_t size){
+    std::string data;
+    while(data.size() < size){
+        data += "<p>static file benchmark " + std::to_string(rand()) + "</p>\n";
+    }
+    data.resize(size);
+    std::ofstream ofs(path, std::ios::binary);
+    ofs << data;
+}
+
+
+// 阻塞socket的keep-alive客户端, 返回收到的响应体总长度, 出错返回-1
+static int64_t run_client(const sockaddr_in& addr, const std::string& path, int count){
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if(connect(fd, (const sockaddr*)&addr, sizeof(addr))){
+        close(fd);
+        return -1;
+    }
+    std::string req = "GET " + path + " HTTP/1.1\r\nHost: bench\r\n\r\n";
+    std::string buf;
+    std::vector<char> tmp(256 * 1024);
+    int64_t total = 0;
+    for(int i = 0; i < count; ++i){
+        if(send(fd, req.c_str(), req.size(), 0) != (ssize_t)req.size()){
+            total = -1;
+            break;
+        }
+        // 读响应头, 按content-length读响应体
+        size_t header_end = std::string::npos;
+        size_t length = 0;
+        while(true){
+            if(header_end == std::string::npos){
+                header_end = buf.find("\r\n\r\n");
+                if(header_end != std::string::npos){
+                    header_end += 4;
+                    size_t pos = buf.find("ength: ");
+                    length = pos < header_end ? strtoull(buf.c_str() + pos + 7, nullptr, 10) : 0;
+                }
+            }
+            if(header_end != std::string::npos && buf.size() >= header_end + length){
+                buf.erase(0, header_end + length);
+                total += length;
+                break;
+            }
+            ssize_t n = recv(fd, &tmp[0], tmp.size(), 0);
+            if(n <= 0){
+                close(fd);
+                return -1;
+            }
+            buf.append(&tmp[0], n);
+        }
+    }
+    close(fd);
+    return total;
+}
+
+
+static void bench(const std::string& name, const sockaddr_in& addr, const std::string& path, int count){
+    std::atomic<int64_t> bytes{0};
+    std::atomic<int> errors{0};
+    uint64_t begin = cxk::GetCurrentUS();
+    std::vector<std::thread> threads;
+    for(int i = 0; i < CONNECTIONS; ++i){
+        threads.emplace_back([&](){
+            int64_t rt = run_client(addr, path, count / CONNECTIONS);
+            rt < 0 ? (void)++errors : (void)(bytes += rt);
+        });
+    }
+    for(auto& t : threads){
+        t.join();
+    }
+    double sec = (cxk::GetCurrentUS() - begin) / 1000000.0;
+    CXK_LOG_INFO(g_logger) << name << " " << path
+                           << " qps=" << (int)(count / sec)
+                           << " throughput=" << bytes / sec / 1024 / 1024 << "MB/s"
+                           << " errors=" << errors;
+}
+
+
+// 用法: bench_static_file [对比服务器地址 ip:port]
+// 对比服务器(如nginx)需要把测试目录/tmp/cxk_bench_static映射到"/static/"
+int main(int argc, char* argv[]){
+    // 服务器的DEBUG日志会输出每个请求和响应
+    CXK_LOG_NAME("system")->setLogLevel(cxk::LogLevel::INFO);
+    std::string root = "/tmp/cxk_bench_static/";
+    cxk::FSUtil::Mkdir(root);
+    make_file(root + "small.html", SMALL_SIZE);
+    make_file(root + "large.html", LARGE_SIZE);
+
+    cxk::IOManager iom(2, false);
+    cxk::http::HttpServer::ptr server(new cxk::http::HttpServer(true, &iom, &iom));
+    auto dispatch = server->getServletDispatch();
+    dispatch->addServlet("/static/*path", std::make_shared<cxk::http::StaticFileServlet>(root, "path"));
+    dispatch->addServlet("/read/*path", [root](cxk::http::HttpRequest::ptr request
+                , cxk::http::HttpResponse::ptr response, cxk::http::HttpSession::ptr session){
+        return read_file(request, response, session, root);
+    });
+    // 在IOManager中创建监听socket, accept才会被hook
+    std::atomic<int> started{0};
+    iom.schedule([&](){
+        auto listen = cxk::Address::LookupAnyIpAddr("127.0.0.1:" + std::to_string(PORT));
+        started = server->bind(listen) && server->start() ? 1 : -1;
+    });
+    while(started == 0){
+        usleep(1000);
+    }
+    if(started < 0){
+        CXK_LOG_ERROR(g_logger) << "bind " << PORT << " fail";
+        return 1;
+    }
+    // 只看响应体大小, 不压缩
+    cxk::Config::Lookup<bool>("http.compress.enable")->setValue(false);
+
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(PORT);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    bench("static_file(cache)", addr, "/static/small.html", 40000);
+    bench("read_file", addr, "/read/small.html", 40000);
+    bench("static_file(sendfile)", addr, "/static/large.html", 2000);
+    bench("read_file", addr, "/read/large.html", 2000);
+
+    if(argc > 1){
+        std::string target = argv[1];
+        size_t colon = target.find(':');
+        sockaddr_in other = addr;
+        other.sin_port = htons(atoi(target.c_str() + colon + 1));
+        inet_pton(AF_INET, target.substr(0, colon).c_str(), &other.sin_addr);
+        bench(target, other, "/static/small.html", 40000);
+        bench(target, other, "/static/large.html", 2000);
+    }
+
+    server->stop();
+    iom.stop();
+    return 0;
+}
@@ -1,8 +1,10 @@
 #include "address.h"
+#include "dns.h"
 #include "endian.h"
 #include "logger.h"
 #include <sstream>
 #include <netdb.h>
+#include <arpa/inet.h>
 #include <vector>
 
 
@@ -47,6 +49,25 @@ Address::ptr Address::Create(const sockaddr* addr, socklen_t addrlen){
     return result;
 }
 
+static bool IsNumeric(const char* str){
+    if(!*str){
+        return false;
+    }
+    for(; *str; ++str){
+        if(!isdigit(*str)){
+            return false;
+        }
+    }
+    return true;
+}
+
+
+static bool IsNumericHost(const std::string& node){
+    in6_addr addr;
+    return inet_pton(AF_INET, node.c_str(), &addr) == 1 || inet_pton(AF_INET6, node.c_str(), &addr) == 1;
+}
+
+
 /* 执行DNS查找，以获取给定主机名（可能是IPv4或IPv6地址）的网络地址信息
     1. 首先，检查主机名是否以[开头，这通常表示一个IPv6地址。如果是，则提取地址和可能的服务名。
     2. 如果不是IPv6地址，则检查是否存在冒号:，这通常用于分隔主机名和服务名（如端口号）。
@@ -94,6 +115,25 @@ bool Address::Lookup(std::vector<Address::ptr>& result, const std::string& host,
         node = host;
     }
 
+    // 协程中解析域名走DnsResolver, getaddrinfo没有被hook, 会阻塞整个线程
+    if((family == AF_UNSPEC || family == AF_INET || family == AF_INET6)
+            && (!service || IsNumeric(service)) && !IsNumericHost(node)
+            && DnsResolver::IsAvailable()){
+        std::vector<IPAddress::ptr> addrs;
+        if(!DnsMgr::GetInstance()->resolve(node, family, addrs)){
+            CXK_LOG_ERROR(g_logger) << "Address::Lookup " << node << " failed";
+            return false;
+        }
+        uint16_t port = service ? atoi(service) : 0;
+        for(auto& i : addrs){
+            // 缓存中的地址是共享的, 复制一份再设置端口
+            IPAddress::ptr addr = std::dynamic_pointer_cast<IPAddress>(Address::Create(i->getAddr(), i->getAddrLen()));
+            addr->setPort(port);
+            result.push_back(addr);
+        }
+        return !result.empty();
+    }
+
     int error = getaddrinfo(node.c_str(), service, &hints, &results);
     if(error) {
         CXK_LOG_ERROR(g_logger)  << "Address::Lookup failed";
@@ -26,6 +26,9 @@ static cxk::ConfigVar<std::string>::ptr g_server_work_path =
 static cxk::ConfigVar<std::string>::ptr g_server_pid_file = cxk::Config::Lookup("server.pid_file", 
     std::string("cxk.pid"), "server pid file");
 
+static cxk::ConfigVar<bool>::ptr g_server_conf_watch = cxk::Config::Lookup("server.conf_watch",
+    false, "watch config dir and reload changed files");
+
 
 static cxk::ConfigVar<std::vector<TcpServerConf>>::ptr g_servers_conf = 
     cxk::Config::Lookup("servers", std::vector<TcpServerConf>(), "http servers conf");
@@ -146,8 +149,13 @@ int Application::main(int argc, char** argv){
     // iom.stop();
 
     m_mainIOManager.reset(new cxk::IOManager(1, true, "main"));
+    if(g_server_conf_watch->getValue()){
+        cxk::Config::WatchConfDir(conf_path, m_mainIOManager.get());
+    }
     m_mainIOManager->schedule(std::bind(&Application::run_fiber, this));
+    // 报告已经不再输出日志的限流调用点被抑制的条数
     m_mainIOManager->addTimer(2000, [](){
+        cxk::LogLimiter::FlushAll();
     }, true);
 
     m_mainIOManager->stop();
@@ -249,6 +257,9 @@ int Application::run_fiber(){
             server->setName(i.name);
         }
 
+        // SO_REUSEPORT等参数在bind时生效
+        server->setConf(i);
+
         std::vector<Address::ptr> fails;
         if(!server->bind(address, fails, i.ssl)){
             for(auto& a : fails){
@@ -262,7 +273,6 @@ int Application::run_fiber(){
                 CXK_LOG_ERROR(g_logger) << "load ssl cert failed, cert_file=" << i.cert_file << ", key_file=" << i.key_file;
             }
         }
-        server->setConf(i);
 
 
         // //===== cxk test ====================
@@ -0,0 +1,515 @@
+#include "binlog.h"
+#include "endian.h"
+#include "config.h"
+#include <stdio.h>
+
+namespace cxk
+{
+
+    const char BinLog::MAGIC[7] = {'C', 'X', 'K', 'B', 'L', 'O', 'G'};
+
+    uint32_t BinLogFormatManager::add(const char *file, int32_t line, const char *fmt)
+    {
+        RWMutexType::WriteLock lock(m_mutex);
+        uint32_t id = m_formats.size() + 1;
+        m_formats.push_back(Format{id, file, line, fmt ? fmt : ""});
+        return id;
+    }
+
+    uint32_t BinLogFormatManager::getTextFormat(const char *file, int32_t line)
+    {
+        auto key = std::make_pair(file, line);
+        {
+            RWMutexType::ReadLock lock(m_mutex);
+            auto it = m_textFormats.find(key);
+            if (it != m_textFormats.end())
+            {
+                return it->second;
+            }
+        }
+        RWMutexType::WriteLock lock(m_mutex);
+        auto it = m_textFormats.find(key);
+        if (it != m_textFormats.end())
+        {
+            return it->second;
+        }
+        uint32_t id = m_formats.size() + 1;
+        m_formats.push_back(Format{id, file ? file : "", line, "%s"});
+        m_textFormats[key] = id;
+        return id;
+    }
+
+    const BinLogFormatManager::Format *BinLogFormatManager::get(uint32_t id)
+    {
+        RWMutexType::ReadLock lock(m_mutex);
+        if (id == 0 || id > m_formats.size())
+        {
+            return nullptr;
+        }
+        return &m_formats[id - 1];
+    }
+
+    void BinLogArgs::PutVarint(std::string &out, uint8_t type, uint64_t v)
+    {
+        char buf[11];
+        size_t i = 0;
+        buf[i++] = type;
+        while (v >= 0x80)
+        {
+            buf[i++] = (v & 0x7F) | 0x80;
+            v >>= 7;
+        }
+        buf[i++] = v;
+        out.append(buf, i);
+    }
+
+    void BinLogArgs::PutDouble(std::string &out, double v)
+    {
+        uint64_t u;
+        memcpy(&u, &v, sizeof(u));
+        u = byteswapOnBigEndian(u);
+        out.append(1, (char)DOUBLE);
+        out.append((const char *)&u, sizeof(u));
+    }
+
+    void BinLogArgs::PutString(std::string &out, const char *str, size_t len)
+    {
+        PutVarint(out, STRING, len);
+        out.append(str, len);
+    }
+
+    namespace
+    {
+
+        // 编码后参数的读取
+        struct ArgReader
+        {
+            const char *ptr;
+            const char *end;
+
+            bool getVarint(uint64_t &v)
+            {
+                v = 0;
+                for (int shift = 0; ptr < end && shift < 64; shift += 7)
+                {
+                    uint8_t b = *ptr++;
+                    v |= (uint64_t)(b & 0x7F) << shift;
+                    if (!(b & 0x80))
+                    {
+                        return true;
+                    }
+                }
+                return false;
+            }
+
+            // 读取下一个参数, 返回参数类型, 失败返回0
+            uint8_t next(uint64_t &i, double &d, std::string &s)
+            {
+                if (ptr >= end)
+                {
+                    return 0;
+                }
+                uint8_t type = *ptr++;
+                switch (type)
+                {
+                case BinLogArgs::INT:
+                    if (!getVarint(i))
+                        return 0;
+                    i = (i >> 1) ^ (~(i & 1) + 1);
+                    return type;
+                case BinLogArgs::UINT:
+                case BinLogArgs::POINTER:
+                    return getVarint(i) ? type : 0;
+                case BinLogArgs::DOUBLE:
+                {
+                    uint64_t u;
+                    if (end - ptr < (ptrdiff_t)sizeof(u))
+                        return 0;
+                    memcpy(&u, ptr, sizeof(u));
+                    ptr += sizeof(u);
+                    u = byteswapOnBigEndian(u);
+                    memcpy(&d, &u, sizeof(d));
+                    return type;
+                }
+                case BinLogArgs::STRING:
+                {
+                    uint64_t len;
+                    if (!getVarint(len) || (uint64_t)(end - ptr) < len)
+                        return 0;
+                    s.assign(ptr, len);
+                    ptr += len;
+                    return type;
+                }
+                default:
+                    return 0;
+                }
+            }
+        };
+
+        template <class T>
+        void AppendFormat(std::string &out, const std::string &spec, T v)
+        {
+            char buf[128];
+            int n = snprintf(buf, sizeof(buf), spec.c_str(), v);
+            if (n < 0)
+            {
+                return;
+            }
+            if (n < (int)sizeof(buf))
+            {
+                out.append(buf, n);
+                return;
+            }
+            std::string tmp(n + 1, '\0');
+            snprintf(&tmp[0], tmp.size(), spec.c_str(), v);
+            out.append(tmp.data(), n);
+        }
+
+    }
+
+    std::string BinLogArgs::Render(const std::string &fmt, const std::string &args)
+    {
+        std::string rt;
+        ArgReader reader{args.data(), args.data() + args.size()};
+        for (size_t i = 0; i < fmt.size(); ++i)
+        {
+            if (fmt[i] != '%')
+            {
+                rt.append(1, fmt[i]);
+                continue;
+            }
+            if (i + 1 < fmt.size() && fmt[i + 1] == '%')
+            {
+                rt.append(1, '%');
+                ++i;
+                continue;
+            }
+
+            // 解析 %[flags][width][.precision][length]conversion, 长度修饰由参数的实际类型决定
+            std::string spec = "%";
+            size_t n = i + 1;
+            while (n < fmt.size() && strchr("-+ #0123456789.*", fmt[n]))
+            {
+                if (fmt[n] == '*')
+                {
+                    // 宽度/精度由参数指定
+                    uint64_t iv = 0;
+                    double dv = 0;
+                    std::string sv;
+                    reader.next(iv, dv, sv);
+                    spec.append(std::to_string((int64_t)iv));
+                    ++n;
+                    continue;
+                }
+                spec.append(1, fmt[n++]);
+            }
+            while (n < fmt.size() && strchr("hlLqjzt", fmt[n]))
+            {
+                ++n;
+            }
+            if (n >= fmt.size())
+            {
+                rt.append(fmt, i, std::string::npos);
+                break;
+            }
+            char conv = fmt[n];
+            i = n;
+
+            uint64_t iv = 0;
+            double dv = 0;
+            std::string sv;
+            uint8_t type = reader.next(iv, dv, sv);
+            if (type == 0)
+            {
+                rt.append("<missing>");
+                continue;
+            }
+
+            bool is_float = strchr("fFeEgGaA", conv) != nullptr;
+            switch (type)
+            {
+            case INT:
+            case UINT:
+                if (is_float)
+                {
+                    AppendFormat(rt, spec + conv, type == INT ? (double)(int64_t)iv : (double)iv);
+                }
+                else if (conv == 'c')
+                {
+                    AppendFormat(rt, spec + conv, (int)iv);
+                }
+                else if (conv == 's')
+                {
+                    AppendFormat(rt, spec + "s", (type == INT ? std::to_string((int64_t)iv) : std::to_string(iv)).c_str());
+                }
+                else if (strchr("uxXo", conv))
+                {
+                    AppendFormat(rt, spec + "ll" + conv, (unsigned long long)iv);
+                }
+                else if (conv == 'p')
+                {
+                    AppendFormat(rt, spec + "p", (void *)(uintptr_t)iv);
+                }
+                else
+                {
+                    AppendFormat(rt, spec + "lld", (long long)iv);
+                }
+                break;
+            case DOUBLE:
+                if (is_float)
+                {
+                    AppendFormat(rt, spec + conv, dv);
+                }
+                else
+                {
+                    AppendFormat(rt, spec + "g", dv);
+                }
+                break;
+            case STRING:
+                AppendFormat(rt, spec + "s", sv.c_str());
+                break;
+            case POINTER:
+                AppendFormat(rt, spec + "p", (void *)(uintptr_t)iv);
+                break;
+            }
+        }
+        return rt;
+    }
+
+    namespace
+    {
+
+        void PutU8(std::string &out, uint8_t v)
+        {
+            out.append(1, (char)v);
+        }
+
+        void PutU32(std::string &out, uint32_t v)
+        {
+            v = byteswapOnBigEndian(v);
+            out.append((const char *)&v, sizeof(v));
+        }
+
+        void PutU64(std::string &out, uint64_t v)
+        {
+            v = byteswapOnBigEndian(v);
+            out.append((const char *)&v, sizeof(v));
+        }
+
+        void PutStr(std::string &out, const std::string &v)
+        {
+            PutU32(out, v.size());
+            out.append(v);
+        }
+
+        // 写入记录头, 返回长度字段的位置, 内容写完后调用FinishRecord回填长度
+        size_t BeginRecord(std::string &out, uint8_t type)
+        {
+            PutU8(out, type);
+            size_t pos = out.size();
+            PutU32(out, 0);
+            return pos;
+        }
+
+        void FinishRecord(std::string &out, size_t pos)
+        {
+            uint32_t len = byteswapOnBigEndian((uint32_t)(out.size() - pos - sizeof(uint32_t)));
+            memcpy(&out[pos], &len, sizeof(len));
+        }
+
+    }
+
+    BinaryFileAppender::BinaryFileAppender(const std::string &filename, RotateType rotate, uint64_t max_size,
+                                           bool compress, uint32_t max_files)
+        : FileAppender(filename, rotate, max_size, compress, max_files)
+    {
+    }
+
+    uint32_t BinaryFileAppender::getNameId(const std::string &name)
+    {
+        auto it = m_names.find(name);
+        if (it != m_names.end())
+        {
+            return it->second;
+        }
+        uint32_t id = m_names.size() + 1;
+        m_names[name] = id;
+        size_t pos = BeginRecord(m_buf, BinLog::NAME);
+        PutU32(m_buf, id);
+        PutStr(m_buf, name);
+        FinishRecord(m_buf, pos);
+        return id;
+    }
+
+    void BinaryFileAppender::log(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event)
+    {
+        if (level < m_level)
+        {
+            return;
+        }
+
+        // 流式写入的日志没有格式串, 按调用位置注册"%s"并把内容作为唯一参数
+        uint32_t fmt_id = event->get_fmtId();
+        std::string text_args;
+        if (!fmt_id)
+        {
+            fmt_id = BinLogFormatMgr::GetInstance()->getTextFormat(event->get_file(), event->get_line());
+            text_args = BinLogArgs::Encode(event->get_content());
+        }
+        const std::string &args = event->get_fmtId() ? event->get_args() : text_args;
+
+        MutexType::Lock lock(m_mutex);
+        checkFile(time(0), args.size() + 32);
+        m_buf.clear();
+        if (getOpenCount() != m_openCount)
+        {
+            // 切换到新文件, 格式串和名称需要重新写入
+            m_openCount = getOpenCount();
+            m_formats.clear();
+            m_names.clear();
+            if (getCurSize() == 0)
+            {
+                m_buf.append(BinLog::MAGIC, sizeof(BinLog::MAGIC));
+                PutU8(m_buf, BinLog::VERSION);
+            }
+        }
+
+        uint32_t logger_id = getNameId(event->get_logger()->getName());
+        uint32_t thread_name_id = getNameId(event->get_threadName());
+        if (m_formats.insert(fmt_id).second)
+        {
+            auto fmt = BinLogFormatMgr::GetInstance()->get(fmt_id);
+            size_t pos = BeginRecord(m_buf, BinLog::FORMAT);
+            PutU32(m_buf, fmt_id);
+            PutU32(m_buf, fmt ? fmt->line : 0);
+            PutStr(m_buf, fmt ? fmt->file : "");
+            PutStr(m_buf, fmt ? fmt->fmt : "");
+            FinishRecord(m_buf, pos);
+        }
+
+        size_t pos = BeginRecord(m_buf, BinLog::EVENT);
+        PutU64(m_buf, event->get_time());
+        PutU8(m_buf, level);
+        PutU32(m_buf, event->get_threadID());
+        PutU32(m_buf, event->get_fiberID());
+        PutU32(m_buf, fmt_id);
+        PutU32(m_buf, logger_id);
+        PutU32(m_buf, thread_name_id);
+        m_buf.append(args);
+        FinishRecord(m_buf, pos);
+
+        if (!writeFile(m_buf.data(), m_buf.size()))
+        {
+            std::cout << "log errror" << std::endl;
+        }
+    }
+
+    std::string BinaryFileAppender::toYamlString()
+    {
+        YAML::Node node = YAML::Load(FileAppender::toYamlString());
+        node["type"] = "BinaryLogAppender";
+        std::stringstream ss;
+        ss << node;
+        return ss.str();
+    }
+
+    BinLogReader::BinLogReader(const std::string &pattern)
+    {
+        m_format.reset(new LogFormat(pattern));
+        m_ba.setIsLittleEndian(true);
+    }
+
+    bool BinLogReader::open(const std::string &filename)
+    {
+        m_ba.clear();
+        m_formats.clear();
+        m_names.clear();
+        if (!m_ba.readFromFile(filename))
+        {
+            return false;
+        }
+        m_ba.setPosition(0);
+
+        char magic[sizeof(BinLog::MAGIC)];
+        if (m_ba.getReadSize() < sizeof(magic) + 1)
+        {
+            return false;
+        }
+        m_ba.read(magic, sizeof(magic));
+        if (memcmp(magic, BinLog::MAGIC, sizeof(magic)) != 0)
+        {
+            return false;
+        }
+        return m_ba.readFuint8_t() == BinLog::VERSION;
+    }
+
+    const std::string &BinLogReader::getName(uint32_t id)
+    {
+        static const std::string s_unknow = "UNKNOW";
+        auto it = m_names.find(id);
+        return it == m_names.end() ? s_unknow : it->second;
+    }
+
+    bool BinLogReader::next(std::string &line)
+    {
+        try
+        {
+            while (m_ba.getReadSize() > 0)
+            {
+                uint8_t type = m_ba.readFuint8_t();
+                uint32_t len = m_ba.readFuint32_t();
+                if (m_ba.getReadSize() < len)
+                {
+                    return false;
+                }
+                size_t end = m_ba.getPosition() + len;
+
+                if (type == BinLog::FORMAT)
+                {
+                    uint32_t id = m_ba.readFuint32_t();
+                    Format &fmt = m_formats[id];
+                    fmt.line = m_ba.readFuint32_t();
+                    fmt.file = m_ba.readStringF32();
+                    fmt.fmt = m_ba.readStringF32();
+                }
+                else if (type == BinLog::NAME)
+                {
+                    uint32_t id = m_ba.readFuint32_t();
+                    m_names[id] = m_ba.readStringF32();
+                }
+                else if (type == BinLog::EVENT)
+                {
+                    uint64_t time = m_ba.readFuint64_t();
+                    LogLevel::Level level = (LogLevel::Level)m_ba.readFuint8_t();
+                    uint32_t thread_id = m_ba.readFuint32_t();
+                    uint32_t fiber_id = m_ba.readFuint32_t();
+                    uint32_t fmt_id = m_ba.readFuint32_t();
+                    const std::string &logger_name = getName(m_ba.readFuint32_t());
+                    const std::string &thread_name = getName(m_ba.readFuint32_t());
+                    std::string args(end - m_ba.getPosition(), '\0');
+                    m_ba.read(&args[0], args.size());
+
+                    Logger::ptr &logger = m_loggers[logger_name];
+                    if (!logger)
+                    {
+                        logger.reset(new Logger(logger_name));
+                    }
+                    const Format &fmt = m_formats[fmt_id];
+                    LogEvent::ptr event(new LogEvent(logger, level, fmt.file.c_str(), fmt.line, 0,
+                                                     thread_id, fiber_id, time, thread_name));
+                    event->getSS() << BinLogArgs::Render(fmt.fmt, args);
+                    line = m_format->format(logger, level, event);
+                    return true;
+                }
+                // 跳过未知类型的记录
+                m_ba.setPosition(end);
+            }
+        }
+        catch (std::exception &e)
+        {
+            // 文件尾部可能有未写完整的记录
+        }
+        return false;
+    }
+
+}
@@ -0,0 +1,227 @@
+#pragma once
+
+#include <deque>
+#include <map>
+#include <string>
+#include <cstring>
+#include <unordered_map>
+#include <unordered_set>
+#include <type_traits>
+#include "logger.h"
+#include "bytearray.h"
+#include "mutex.h"
+#include "Singleton.h"
+
+// 以二进制方式写入日志, 只记录格式串id和原始参数, 格式化推迟到输出文本或离线解码时
+#define CXK_LOG_BIN_LEVEL(logger, level, fmt, ...)                                                                      \
+    do {                                                                                                                \
+        if (logger->getLogLevel() <= level) {                                                                           \
+            static const uint32_t s_cxk_binlog_fmt_id =                                                                 \
+                cxk::BinLogFormatMgr::GetInstance()->add(__FILE__, __LINE__, fmt);                                      \
+            cxk::LogEventWrap(cxk::LogEvent::ptr(new cxk::LogEvent(logger, level, __FILE__, __LINE__, 0,                \
+                                    cxk::getThreadId(), cxk::getFiberId(), time(0), cxk::Thread::GetName())))           \
+                .getEvent()                                                                                             \
+                ->setBinary(s_cxk_binlog_fmt_id, cxk::BinLogArgs::Encode(__VA_ARGS__));                                 \
+        }                                                                                                               \
+    } while (0)
+
+#define CXK_LOG_BIN_DEBUG(logger, fmt, ...) CXK_LOG_BIN_LEVEL(logger, cxk::LogLevel::DEBUG, fmt, ##__VA_ARGS__)
+#define CXK_LOG_BIN_INFO(logger, fmt, ...) CXK_LOG_BIN_LEVEL(logger, cxk::LogLevel::INFO, fmt, ##__VA_ARGS__)
+#define CXK_LOG_BIN_WARN(logger, fmt, ...) CXK_LOG_BIN_LEVEL(logger, cxk::LogLevel::WARN, fmt, ##__VA_ARGS__)
+#define CXK_LOG_BIN_ERROR(logger, fmt, ...) CXK_LOG_BIN_LEVEL(logger, cxk::LogLevel::ERROR, fmt, ##__VA_ARGS__)
+#define CXK_LOG_BIN_FATAL(logger, fmt, ...) CXK_LOG_BIN_LEVEL(logger, cxk::LogLevel::FATAL, fmt, ##__VA_ARGS__)
+
+namespace cxk
+{
+
+    /*
+    二进制日志格式
+    文件头: "CXKBLOG" + 版本号(1字节)
+    之后是若干条记录, 每条记录: 类型(uint8) + 长度(uint32) + 内容, 整数均为小端
+        FORMAT: id(uint32) + 行号(uint32) + 文件名(string) + 格式串(string)
+        NAME:   id(uint32) + 名称(string), 用于日志器名称和线程名称
+        EVENT:  时间(uint64) + 级别(uint8) + 线程id(uint32) + 协程id(uint32) + 格式串id(uint32)
+                + 日志器名称id(uint32) + 线程名称id(uint32) + 参数(见BinLogArgs)
+    string为uint32长度 + 数据. FORMAT/NAME记录在每个文件中第一次用到时写入, 文件可以单独解码
+    */
+    class BinLog
+    {
+    public:
+        enum RecordType
+        {
+            FORMAT = 1,
+            NAME = 2,
+            EVENT = 3
+        };
+
+        static const char MAGIC[7];
+        static const uint8_t VERSION = 1;
+    };
+
+    /// @brief 二进制日志格式串管理, 每个调用点注册一次, 得到进程内唯一的id
+    class BinLogFormatManager
+    {
+    public:
+        using RWMutexType = RWMutex;
+
+        struct Format
+        {
+            uint32_t id;
+            std::string file;
+            int32_t line;
+            std::string fmt;
+        };
+
+        /// @brief 注册格式串
+        /// @return 格式串id, 从1开始
+        uint32_t add(const char *file, int32_t line, const char *fmt);
+
+        /// @brief 获取流式写入的日志位置对应的格式串id(格式串为"%s")
+        uint32_t getTextFormat(const char *file, int32_t line);
+
+        /// @brief 获取格式串, 不存在返回nullptr
+        /// @attention 返回的指针在进程生命周期内有效
+        const Format *get(uint32_t id);
+
+    private:
+        RWMutexType m_mutex;
+        std::deque<Format> m_formats;
+        std::map<std::pair<const char *, int32_t>, uint32_t> m_textFormats;
+    };
+
+    typedef cxk::Singleton<BinLogFormatManager> BinLogFormatMgr;
+
+    /// @brief 二进制日志参数的编码和格式化
+    class BinLogArgs
+    {
+    public:
+        /// @brief 参数类型
+        enum Type
+        {
+            INT = 1,     // 有符号整数, zigzag + varint
+            UINT = 2,    // 无符号整数, varint
+            DOUBLE = 3,  // 浮点数, 8字节
+            STRING = 4,  // 字符串, varint长度 + 数据
+            POINTER = 5  // 指针, varint
+        };
+
+        /// @brief 按顺序编码参数
+        template <class... Args>
+        static std::string Encode(const Args &...args)
+        {
+            std::string rt;
+            (Append(rt, args), ...);
+            return rt;
+        }
+
+        /// @brief 按printf风格的格式串格式化编码后的参数
+        /// @param fmt 格式串
+        /// @param args 编码后的参数
+        static std::string Render(const std::string &fmt, const std::string &args);
+
+    private:
+        static void PutVarint(std::string &out, uint8_t type, uint64_t v);
+        static void PutDouble(std::string &out, double v);
+        static void PutString(std::string &out, const char *str, size_t len);
+
+        template <class T>
+        static void Append(std::string &out, const T &v)
+        {
+            if constexpr (std::is_array<T>::value)
+            {
+                PutString(out, v, strlen(v));
+            }
+            else if constexpr (std::is_same<T, std::string>::value)
+            {
+                PutString(out, v.data(), v.size());
+            }
+            else if constexpr (std::is_same<T, const char *>::value || std::is_same<T, char *>::value)
+            {
+                PutString(out, v ? v : "(null)", v ? strlen(v) : 6);
+            }
+            else if constexpr (std::is_pointer<T>::value)
+            {
+                PutVarint(out, POINTER, (uintptr_t)v);
+            }
+            else if constexpr (std::is_floating_point<T>::value)
+            {
+                PutDouble(out, v);
+            }
+            else if constexpr (std::is_enum<T>::value || (std::is_integral<T>::value && std::is_signed<T>::value))
+            {
+                int64_t i = (int64_t)v;
+                PutVarint(out, INT, ((uint64_t)i << 1) ^ (uint64_t)(i >> 63));
+            }
+            else
+            {
+                static_assert(std::is_integral<T>::value, "unsupported binlog argument type");
+                PutVarint(out, UINT, (uint64_t)v);
+            }
+        }
+    };
+
+    /// @brief 输出二进制日志的appender, 支持FileAppender的滚动配置
+    class BinaryFileAppender : public FileAppender
+    {
+    public:
+        using ptr = std::shared_ptr<BinaryFileAppender>;
+
+        BinaryFileAppender(const std::string &filename, RotateType rotate = NONE, uint64_t max_size = 0,
+                           bool compress = false, uint32_t max_files = 0);
+
+        void log(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) override;
+
+        std::string toYamlString() override;
+
+    private:
+        /// @brief 获取名称id, 本文件第一次出现时写入NAME记录
+        uint32_t getNameId(const std::string &name);
+
+    private:
+        // 当前文件对应的打开次数, 变化后需要重新写入格式串和名称
+        uint32_t m_openCount = 0;
+        // 当前文件已经写入的格式串
+        std::unordered_set<uint32_t> m_formats;
+        // 当前文件已经写入的名称
+        std::unordered_map<std::string, uint32_t> m_names;
+        // 待写入的数据
+        std::string m_buf;
+    };
+
+    /// @brief 二进制日志解码器, 把二进制日志还原为文本
+    class BinLogReader
+    {
+    public:
+        using ptr = std::shared_ptr<BinLogReader>;
+
+        /// @brief 构造函数
+        /// @param pattern 输出文本的格式, 同LogFormat
+        BinLogReader(const std::string &pattern = "%d%T%t%T%N%T%F%T[%p]%T[%c]%T%f:%l%T%m%n");
+
+        /// @brief 打开二进制日志文件
+        bool open(const std::string &filename);
+
+        /// @brief 读取下一条日志并格式化
+        /// @param[out] line 格式化后的文本
+        /// @return 读到文件末尾或者数据损坏返回false
+        bool next(std::string &line);
+
+    private:
+        struct Format
+        {
+            std::string file;
+            int32_t line;
+            std::string fmt;
+        };
+
+        const std::string &getName(uint32_t id);
+
+    private:
+        ByteArray m_ba;
+        LogFormat::ptr m_format;
+        std::unordered_map<uint32_t, Format> m_formats;
+        std::unordered_map<uint32_t, std::string> m_names;
+        std::map<std::string, Logger::ptr> m_loggers;
+    };
+
+}
@@ -0,0 +1,289 @@
+#include "block_pool.h"
+#include "config.h"
+#include <sstream>
+#include <algorithm>
+
+namespace cxk{
+
+static cxk::ConfigVar<uint64_t>::ptr g_block_pool_thread_cache =
+    cxk::Config::Lookup("bytearray.pool.thread_cache_size", (uint64_t)(256 * 1024),
+            "max bytes cached per size class per thread");
+
+static cxk::ConfigVar<uint64_t>::ptr g_block_pool_global_cache =
+    cxk::Config::Lookup("bytearray.pool.global_cache_size", (uint64_t)(16 * 1024 * 1024),
+            "max bytes cached per size class in global free list");
+
+// 静态ByteArray可能在配置初始化之前分配内存块, 使用常量初始化的副本
+// 配置变化时由监听器修改, 在free/fetch中读取, 只需要relaxed
+static std::atomic<uint64_t> s_thread_cache_size{256 * 1024};
+static std::atomic<uint64_t> s_global_cache_size{16 * 1024 * 1024};
+
+struct _BlockPoolIniter{
+    _BlockPoolIniter(){
+        s_thread_cache_size.store(g_block_pool_thread_cache->getValue(), std::memory_order_relaxed);
+        s_global_cache_size.store(g_block_pool_global_cache->getValue(), std::memory_order_relaxed);
+
+        g_block_pool_thread_cache->addListener([](const uint64_t& old_val, const uint64_t& new_val){
+            s_thread_cache_size.store(new_val, std::memory_order_relaxed);
+        });
+        g_block_pool_global_cache->addListener([](const uint64_t& old_val, const uint64_t& new_val){
+            s_global_cache_size.store(new_val, std::memory_order_relaxed);
+        });
+    }
+};
+
+static _BlockPoolIniter s_block_pool_initer;
+
+
+// 从全局空闲链表一次取出的内存块数量
+static const size_t s_batch_count = 16;
+
+/// @brief 线程本地缓存, 线程退出时把缓存的内存块放回全局空闲链表
+struct ThreadCache{
+    ThreadCache();
+    ~ThreadCache();
+
+    std::vector<char*> blocks[BlockPool::CLASS_COUNT];
+    // 统计计数只由所属线程修改, 其他线程在getStats时读取; 计数可能为负(内存块在其他线程分配)
+    std::atomic<int64_t> in_use{0};
+    std::atomic<int64_t> cached{0};
+    std::atomic<int64_t> allocated{0};
+    std::atomic<int64_t> released{0};
+};
+
+// 只有一个线程修改的计数, 用load + store代替原子的读-改-写
+static inline void add(std::atomic<int64_t>& v, int64_t n){
+    v.store(v.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+// 线程本地缓存析构之后, 其他线程局部对象析构时归还的内存块直接放回全局
+static thread_local bool t_cache_destroyed = false;
+
+ThreadCache::ThreadCache(){
+    BlockPool::GetInstance()->addCache(this);
+}
+
+ThreadCache::~ThreadCache(){
+    for(uint32_t i = 0; i < BlockPool::CLASS_COUNT; ++i){
+        BlockPool::GetInstance()->release(i, blocks[i], blocks[i].size());
+    }
+    BlockPool::GetInstance()->delCache(this);
+    t_cache_destroyed = true;
+}
+
+static ThreadCache* GetThreadCache(){
+    if(t_cache_destroyed){
+        return nullptr;
+    }
+    static thread_local ThreadCache s_cache;
+    return &s_cache;
+}
+
+
+/// @brief 把shared_ptr的控制块放在内存块头部的分配器
+/// @details 控制块析构(引用计数和弱引用计数都归零)后deallocate归还整个内存块
+template<class T>
+class BlockAllocator{
+public:
+    using value_type = T;
+
+    BlockAllocator(char* block, int32_t cls) : m_block(block), m_cls(cls){
+    }
+
+    template<class U>
+    BlockAllocator(const BlockAllocator<U>& other) : m_block(other.m_block), m_cls(other.m_cls){
+    }
+
+    T* allocate(size_t n){
+        static_assert(sizeof(T) <= BlockPool::HEADER_SIZE && alignof(T) <= 16, "control block too large");
+        return reinterpret_cast<T*>(m_block);
+    }
+
+    void deallocate(T* p, size_t n){
+        BlockPool::GetInstance()->free(reinterpret_cast<char*>(p), m_cls);
+    }
+
+    template<class U>
+    bool operator==(const BlockAllocator<U>& other) const { return m_block == other.m_block; }
+    template<class U>
+    bool operator!=(const BlockAllocator<U>& other) const { return m_block != other.m_block; }
+
+private:
+    template<class U>
+    friend class BlockAllocator;
+
+    char* m_block;
+    int32_t m_cls;
+};
+
+
+std::string BlockPool::Stats::toString() const{
+    std::stringstream ss;
+    ss << "BlockPool{in_use=" << in_use
+       << ", cached=" << cached
+       << ", allocated=" << allocated
+       << ", released=" << released
+       << "}";
+    return ss.str();
+}
+
+
+BlockPool* BlockPool::GetInstance(){
+    static BlockPool* s_pool = new BlockPool;
+    return s_pool;
+}
+
+
+BlockPool::BlockPool(){
+}
+
+
+int32_t BlockPool::GetClass(size_t size){
+    for(uint32_t i = 0; i < CLASS_COUNT; ++i){
+        if(size <= GetClassSize(i)){
+            return i;
+        }
+    }
+    return -1;
+}
+
+
+std::shared_ptr<char> BlockPool::alloc(size_t size){
+    int32_t cls = GetClass(size);
+    ThreadCache* cache = GetThreadCache();
+    char* block = nullptr;
+    if(cls >= 0 && cache){
+        std::vector<char*>& blocks = cache->blocks[cls];
+        if(blocks.empty()){
+            fetch(cls, blocks);
+        }
+        if(!blocks.empty()){
+            block = blocks.back();
+            blocks.pop_back();
+            add(cache->cached, -1);
+        }
+    }
+    bool is_new = !block;
+    if(is_new){
+        block = new char[HEADER_SIZE + (cls < 0 ? size : GetClassSize(cls))];
+    }
+    if(cache){
+        add(cache->in_use, 1);
+        if(is_new){
+            add(cache->allocated, 1);
+        }
+    } else {
+        m_inUse.fetch_add(1, std::memory_order_relaxed);
+        if(is_new){
+            m_allocated.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    // 删除器什么都不做, 内存块在控制块析构之后由BlockAllocator归还
+    return std::shared_ptr<char>(block + HEADER_SIZE, [](char*){}, BlockAllocator<char>(block, cls));
+}
+
+
+void BlockPool::free(char* block, int32_t cls){
+    ThreadCache* cache = GetThreadCache();
+    if(cls < 0){
+        delete[] block;
+        if(cache){
+            add(cache->in_use, -1);
+            add(cache->released, 1);
+        } else {
+            m_inUse.fetch_sub(1, std::memory_order_relaxed);
+            m_released.fetch_add(1, std::memory_order_relaxed);
+        }
+        return;
+    }
+    if(!cache){
+        m_inUse.fetch_sub(1, std::memory_order_relaxed);
+        m_cached.fetch_add(1, std::memory_order_relaxed);
+        std::vector<char*> blocks{block};
+        release(cls, blocks, 1);
+        return;
+    }
+
+    add(cache->in_use, -1);
+    add(cache->cached, 1);
+    std::vector<char*>& blocks = cache->blocks[cls];
+    blocks.push_back(block);
+    // 超过本地缓存上限时, 把一半的内存块放回全局
+    if(blocks.size() * GetClassSize(cls) > s_thread_cache_size.load(std::memory_order_relaxed)){
+        release(cls, blocks, (blocks.size() + 1) / 2);
+    }
+}
+
+
+void BlockPool::fetch(uint32_t cls, std::vector<char*>& blocks){
+    MutexType::Lock lock(m_mutex);
+    std::vector<char*>& global = m_blocks[cls];
+    size_t count = std::min(global.size(), s_batch_count);
+    blocks.insert(blocks.end(), global.end() - count, global.end());
+    global.resize(global.size() - count);
+}
+
+
+void BlockPool::release(uint32_t cls, std::vector<char*>& blocks, size_t count){
+    if(count == 0){
+        return;
+    }
+    size_t max_count = s_global_cache_size.load(std::memory_order_relaxed) / GetClassSize(cls);
+    std::vector<char*> frees;
+    {
+        MutexType::Lock lock(m_mutex);
+        std::vector<char*>& global = m_blocks[cls];
+        for(size_t i = blocks.size() - count; i < blocks.size(); ++i){
+            if(global.size() < max_count){
+                global.push_back(blocks[i]);
+            } else {
+                frees.push_back(blocks[i]);
+            }
+        }
+    }
+    blocks.resize(blocks.size() - count);
+
+    if(frees.empty()){
+        return;
+    }
+    for(auto& i : frees){
+        delete[] i;
+    }
+    m_cached.fetch_sub(frees.size(), std::memory_order_relaxed);
+    m_released.fetch_add(frees.size(), std::memory_order_relaxed);
+}
+
+
+void BlockPool::addCache(ThreadCache* cache){
+    MutexType::Lock lock(m_cachesMutex);
+    m_caches.push_back(cache);
+}
+
+
+void BlockPool::delCache(ThreadCache* cache){
+    MutexType::Lock lock(m_cachesMutex);
+    m_caches.erase(std::find(m_caches.begin(), m_caches.end(), cache));
+    m_inUse.fetch_add(cache->in_use, std::memory_order_relaxed);
+    m_cached.fetch_add(cache->cached, std::memory_order_relaxed);
+    m_allocated.fetch_add(cache->allocated, std::memory_order_relaxed);
+    m_released.fetch_add(cache->released, std::memory_order_relaxed);
+}
+
+
+BlockPool::Stats BlockPool::getStats() const{
+    Stats rt;
+    MutexType::Lock lock(m_cachesMutex);
+    rt.in_use = m_inUse.load(std::memory_order_relaxed);
+    rt.cached = m_cached.load(std::memory_order_relaxed);
+    rt.allocated = m_allocated.load(std::memory_order_relaxed);
+    rt.released = m_released.load(std::memory_order_relaxed);
+    for(auto i : m_caches){
+        rt.in_use += i->in_use.load(std::memory_order_relaxed);
+        rt.cached += i->cached.load(std::memory_order_relaxed);
+        rt.allocated += i->allocated.load(std::memory_order_relaxed);
+        rt.released += i->released.load(std::memory_order_relaxed);
+    }
+    return rt;
+}
+
+}
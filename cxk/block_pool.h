@@ -0,0 +1,95 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <string>
+#include <atomic>
+#include <stdint.h>
+#include "mutex.h"
+#include "noncopyable.h"
+
+namespace cxk{
+
+struct ThreadCache;
+
+template<class T>
+class BlockAllocator;
+
+/// @brief 按大小分级的内存块池, 为ByteArray的节点和socket读缓冲提供内存
+/// @details 内存块按2的幂分级(256B ~ 64KiB), 每个线程有本地缓存, 分配和归还优先走本地缓存,
+///          本地缓存不足或超出上限时批量和全局空闲链表交换。内存块可以在任意线程归还,
+///          超过上述大小的内存块直接向系统分配和释放。
+///          每个内存块前面预留HEADER_SIZE字节放shared_ptr的控制块, 分配时不再单独分配控制块;
+///          统计计数在各个线程本地缓存中累加, getStats时汇总
+class BlockPool : Noncopyable{
+public:
+    /// @brief 内存块池的统计信息
+    struct Stats{
+        int64_t in_use = 0;     // 正在使用的内存块数量
+        int64_t cached = 0;     // 缓存中的内存块数量(线程本地 + 全局)
+        int64_t allocated = 0;  // 累计向系统新分配的内存块数量
+        int64_t released = 0;   // 累计归还给系统的内存块数量
+
+        std::string toString() const;
+    };
+
+    using MutexType = Spinlock;
+
+    /// @brief 最小的分级大小为 1 << MIN_SHIFT
+    static const uint32_t MIN_SHIFT = 8;
+    /// @brief 分级数量, 最大的分级大小为 1 << (MIN_SHIFT + CLASS_COUNT - 1)
+    static const uint32_t CLASS_COUNT = 9;
+    /// @brief 内存块前面放控制块的字节数, 返回给使用者的地址按16字节对齐
+    static const size_t HEADER_SIZE = 64;
+
+    /// @brief 获取内存块池
+    /// @attention 内存块池不析构, 进程退出时仍然可能有ByteArray归还内存块
+    static BlockPool* GetInstance();
+
+    /// @brief 分配至少size字节的内存块, 引用计数归零时自动归还
+    std::shared_ptr<char> alloc(size_t size);
+
+    /// @brief 获取统计信息
+    Stats getStats() const;
+
+    /// @brief 获取size对应的分级, 超过最大分级返回-1
+    static int32_t GetClass(size_t size);
+
+    /// @brief 获取分级对应的内存块大小
+    static size_t GetClassSize(uint32_t cls) { return (size_t)1 << (cls + MIN_SHIFT); }
+
+    /// @brief 把一批内存块放回全局空闲链表, 超出全局缓存上限的部分释放
+    void release(uint32_t cls, std::vector<char*>& blocks, size_t count);
+
+private:
+    friend struct ThreadCache;
+    template<class T>
+    friend class BlockAllocator;
+
+    BlockPool();
+
+    /// @brief 从全局空闲链表取出一批内存块
+    void fetch(uint32_t cls, std::vector<char*>& blocks);
+
+    /// @brief 归还内存块(包括头部)
+    /// @param cls 分级, -1为直接向系统分配的内存块
+    void free(char* block, int32_t cls);
+
+    /// @brief 线程本地缓存创建和析构时登记, 析构时把计数合并到全局计数
+    void addCache(ThreadCache* cache);
+    void delCache(ThreadCache* cache);
+
+private:
+    MutexType m_mutex;
+    std::vector<char*> m_blocks[CLASS_COUNT];
+    // 线程本地缓存, getStats时汇总它们的计数
+    mutable MutexType m_cachesMutex;
+    std::vector<ThreadCache*> m_caches;
+    // 没有线程本地缓存时的计数, 以及已经退出的线程合并过来的计数
+    std::atomic<int64_t> m_inUse{0};
+    std::atomic<int64_t> m_cached{0};
+    std::atomic<int64_t> m_allocated{0};
+    std::atomic<int64_t> m_released{0};
+};
+
+}
@@ -1,5 +1,6 @@
 #include "bytearray.h"
 #include "endian.h"
+#include "block_pool.h"
 #include <cstdlib>
 #include <cstring>
 #include <string>
@@ -9,19 +10,34 @@
 #include <stdexcept>
 #include "logger.h"
 #include <iomanip>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CXK_VARINT_SIMD 1
+#endif
 
 namespace cxk{
 
 static cxk::Logger::ptr g_logger = CXK_LOG_NAME("system");
 
-ByteArray::Node::Node(size_t s) : ptr(new char[s]), next(nullptr), size(s){
+// 从内存块池分配一个引用计数的内存块
+static std::shared_ptr<char> NewBlock(size_t s){
+    return BlockPool::GetInstance()->alloc(s);
+}
+
+ByteArray::Node::Node(size_t s) : block(NewBlock(s)), ptr(block.get()), next(nullptr), size(s){
+
+}
+
+ByteArray::Node::Node(const std::shared_ptr<char>& b, char* p, size_t s)
+    : block(b), ptr(p), next(nullptr), size(s){
 
 }
    
 ByteArray::Node::~Node(){
-    if(ptr){
-        delete[] ptr;
-    }
 }
 
 
@@ -29,7 +45,7 @@ ByteArray::Node::Node() : ptr(nullptr), next(nullptr), size(0){
 }
 
 ByteArray::ByteArray(size_t base_size) : m_baseSize(base_size), m_position(0), m_capacity(base_size), 
-    m_size(0), m__endian(CXK_BIG_ENDIAN), m_root(new Node(base_size)), m_cur(m_root){
+    m_size(0), m__endian(CXK_BIG_ENDIAN), m_root(new Node(base_size)), m_cur(m_root), m_curBase(0){
 
 }
 
@@ -143,16 +159,28 @@ void ByteArray::writeInt32(int32_t value){
 }
 
 
-// 变长节省内存编码
-void ByteArray::writeUint32(uint32_t value){
-    uint8_t tmp[5];
-    uint8_t i = 0;
+// 变长节省内存编码, 返回占用的字节数
+static inline size_t EncodeVarint(uint8_t* p, uint64_t value){
+    size_t i = 0;
     while(value >= 0x80){
-        tmp[i++] = (value & 0x7F) | 0x80;
+        p[i++] = (value & 0x7F) | 0x80;
         value >>= 7;
     }
-    tmp[i++] = value;
-    write(tmp, i);
+    p[i++] = value;
+    return i;
+}
+
+
+void ByteArray::writeUint32(uint32_t value){
+    // 当前节点剩余空间足够时直接编码到节点中
+    size_t len = 0;
+    uint8_t* p = (uint8_t*)getWritePtr(len);
+    if(len >= 5){
+        advance(EncodeVarint(p, value));
+        return;
+    }
+    uint8_t tmp[5];
+    write(tmp, EncodeVarint(tmp, value));
 }
 
 
@@ -162,14 +190,14 @@ void ByteArray::writeInt64(int64_t value){
 
 
 void ByteArray::writeUint64(uint64_t value){
-    uint8_t tmp[10];
-    uint8_t i = 0;
-    while(value >= 0x80){
-        tmp[i++] = (value & 0x7F) | 0x80;
-        value >>= 7;
+    size_t len = 0;
+    uint8_t* p = (uint8_t*)getWritePtr(len);
+    if(len >= 10){
+        advance(EncodeVarint(p, value));
+        return;
     }
-    tmp[i++] = value;
-    write(tmp, i);
+    uint8_t tmp[10];
+    write(tmp, EncodeVarint(tmp, value));
 }
 
 void ByteArray::writeFloat(float value){
@@ -266,11 +294,140 @@ uint64_t ByteArray::readFuint64_t(){
 }
 
 
+// 用一个64位字解码varint, p至少有8字节可读
+// 返回varint占用的字节数, 超过max_len字节(或者大端主机)返回0, 由逐字节的慢路径处理
+static inline size_t DecodeVarintWord(const uint8_t* p, size_t max_len, uint64_t& v){
+#if CXK_BYTE_ORDER == CXK_LITTLE_ENDIAN
+    uint64_t word;
+    memcpy(&word, p, sizeof(word));
+    uint64_t stop = ~word & 0x8080808080808080ull;
+    if(!stop){
+        return 0;
+    }
+    size_t len = (__builtin_ctzll(stop) >> 3) + 1;
+    if(len > max_len){
+        return 0;
+    }
+    if(len < 8){
+        word &= (1ull << (len * 8)) - 1;
+    }
+    // 每个字节去掉最高位后两两合并: 7位 -> 14位 -> 28位 -> 56位
+    word &= 0x7f7f7f7f7f7f7f7full;
+    word = ((word & 0x7f007f007f007f00ull) >> 1) | (word & 0x007f007f007f007full);
+    word = ((word & 0x3fff00003fff0000ull) >> 2) | (word & 0x00003fff00003fffull);
+    word = ((word & 0x0fffffff00000000ull) >> 4) | (word & 0x000000000fffffffull);
+    v = word;
+    return len;
+#else
+    return 0;
+#endif
+}
+
+
+#ifdef CXK_VARINT_SIMD
+// 16字节都是单字节varint时直接展开, 否则返回开头连续的单字节varint个数
+template<class T>
+static inline size_t DecodeSingleBytesSSE(const uint8_t* p, T* out){
+    __m128i bytes = _mm_loadu_si128((const __m128i*)p);
+    uint32_t mask = _mm_movemask_epi8(bytes);
+    size_t run = mask ? __builtin_ctz(mask) : 16;
+    if(run == 16 && sizeof(T) == sizeof(uint32_t)){
+        __m128i zero = _mm_setzero_si128();
+        __m128i lo = _mm_unpacklo_epi8(bytes, zero);
+        __m128i hi = _mm_unpackhi_epi8(bytes, zero);
+        _mm_storeu_si128((__m128i*)out, _mm_unpacklo_epi16(lo, zero));
+        _mm_storeu_si128((__m128i*)out + 1, _mm_unpackhi_epi16(lo, zero));
+        _mm_storeu_si128((__m128i*)out + 2, _mm_unpacklo_epi16(hi, zero));
+        _mm_storeu_si128((__m128i*)out + 3, _mm_unpackhi_epi16(hi, zero));
+        return 16;
+    }
+    for(size_t i = 0; i < run; ++i){
+        out[i] = p[i];
+    }
+    return run;
+}
+
+// AVX2版本, 一次检查32字节
+__attribute__((target("avx2")))
+static size_t DecodeSingleBytesAVX2(const uint8_t* p, uint32_t* out){
+    __m256i bytes = _mm256_loadu_si256((const __m256i*)p);
+    if(_mm256_movemask_epi8(bytes)){
+        return 0;
+    }
+    for(int i = 0; i < 4; ++i){
+        __m128i v = _mm_loadl_epi64((const __m128i*)(p + i * 8));
+        _mm256_storeu_si256((__m256i*)(out + i * 8), _mm256_cvtepu8_epi32(v));
+    }
+    return 32;
+}
+
+static const bool s_has_avx2 = [](){
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+}();
+#endif
+
+
+// 解码连续内存中的varint数组, 返回消耗的字节数, decoded为解码的个数
+// 只在至少还有8字节可读时解码, 剩下的交给慢路径
+template<class T>
+static size_t DecodeVarintBlock(const uint8_t* p, size_t avail, T* out, size_t count, size_t& decoded){
+    const size_t max_len = sizeof(T) == sizeof(uint32_t) ? 5 : 8;
+    size_t pos = 0;
+    size_t n = 0;
+    // 上一次检查到连续16个单字节varint时才尝试AVX2, 避免混合数据反复失败
+    bool single_run = false;
+    while(n < count && avail - pos >= 8){
+#ifdef CXK_VARINT_SIMD
+        if(sizeof(T) == sizeof(uint32_t) && single_run && s_has_avx2
+                && avail - pos >= 32 && count - n >= 32){
+            size_t run = DecodeSingleBytesAVX2(p + pos, (uint32_t*)(out + n));
+            if(run){
+                pos += run;
+                n += run;
+                continue;
+            }
+        }
+        if(avail - pos >= 16 && count - n >= 16){
+            size_t run = DecodeSingleBytesSSE(p + pos, out + n);
+            pos += run;
+            n += run;
+            single_run = (run == 16);
+            if(single_run || n == count || avail - pos < 8){
+                continue;
+            }
+        }
+#endif
+        uint64_t v = 0;
+        size_t len = DecodeVarintWord(p + pos, max_len, v);
+        if(!len){
+            break;
+        }
+        out[n++] = (T)v;
+        pos += len;
+    }
+    decoded = n;
+    return pos;
+}
+
+
 int32_t ByteArray::readInt32(){
     return DecodeZigzag32(readUint32());
 }
 
 uint32_t ByteArray::readUint32(){
+    // 当前节点至少有8字节可读时按64位字解码
+    size_t len = 0;
+    const uint8_t* p = (const uint8_t*)getReadPtr(len);
+    if(len >= 8){
+        uint64_t v = 0;
+        size_t n = DecodeVarintWord(p, 5, v);
+        if(n){
+            advance(n);
+            return (uint32_t)v;
+        }
+    }
+
     uint32_t result = 0;
     for(int i = 0; i < 32; i+= 7){
         uint8_t b = readFuint8_t();
@@ -289,6 +446,17 @@ int64_t ByteArray::readInt64(){
 }
 
 uint64_t ByteArray::readUint64(){
+    size_t len = 0;
+    const uint8_t* p = (const uint8_t*)getReadPtr(len);
+    if(len >= 8){
+        uint64_t v = 0;
+        size_t n = DecodeVarintWord(p, 8, v);
+        if(n){
+            advance(n);
+            return v;
+        }
+    }
+
     uint64_t result = 0;
     for(int i = 0; i < 64; i+= 7){
         uint8_t b = readFuint8_t();
@@ -347,6 +515,7 @@ std::string ByteArray::readStringVint(){
 // 内部操作
 void ByteArray::clear(){
     m_position = 0;
+    m_size = 0;
     m_capacity = m_baseSize;
     Node* tmp = m_root->next;
 
@@ -355,36 +524,45 @@ void ByteArray::clear(){
         tmp = tmp->next;
         delete m_cur;
     }
-    m_cur = m_root;
     m_root->next = nullptr;
+    // 切片得到的或者和其他ByteArray共享的节点不能直接复用
+    if(m_root->size != m_baseSize || m_root->isShared()){
+        delete m_root;
+        m_root = new Node(m_baseSize);
+    }
+    m_cur = m_root;
+    m_curBase = 0;
 }
 
 void ByteArray::write(const void* buf, size_t size){
     if(size == 0){
         return ;
     }
-    addCapacity(size);
 
-    size_t npos = m_position % m_baseSize;  // 当前的节点位置
-    size_t ncap = m_cur->size - npos;       // 剩余的空间
-    size_t bpos = 0;                        // 已经读取的数据的偏移量
+    size_t npos = m_position - m_curBase;   // 当前节点内的偏移
+    // 快速路径: 当前节点剩余空间足够且没有被共享
+    if(m_cur && npos + size < m_cur->size && !m_cur->isShared()){
+        memcpy(m_cur->ptr + npos, buf, size);
+        m_position += size;
+        if(m_position > m_size) {
+            m_size = m_position;
+        }
+        return;
+    }
+    addCapacity(size);
+    size_t bpos = 0;                        // 已经写入的数据的偏移量
 
     while(size > 0) {
-        if(ncap >= size) {  // 当前节点空间足够
-            memcpy(m_cur->ptr + npos, (const char*)buf + bpos, size);
-            if(m_cur->size == (npos + size)){
-                m_cur = m_cur->next;
-            }
-            m_position += size;
-            bpos += size;
-            size = 0;
-        } else {
-            memcpy(m_cur->ptr + npos,(const char*) buf + bpos, ncap);
-            m_position += ncap;
-            bpos += ncap;
-            size -= ncap;
+        unshare(m_cur);
+        size_t len = std::min(m_cur->size - npos, size);
+        memcpy(m_cur->ptr + npos, (const char*)buf + bpos, len);
+        m_position += len;
+        bpos += len;
+        size -= len;
+        npos += len;
+        if(npos == m_cur->size){
+            m_curBase += m_cur->size;
             m_cur = m_cur->next;
-            ncap = m_cur->size;
             npos = 0;
         }
     }
@@ -398,25 +576,27 @@ void ByteArray::read(void* buf, size_t size){
     if(size > getReadSize() ) {
         throw std::out_of_range("not enough len");
     }
+    if(size == 0){
+        return;
+    }
 
-    size_t npos = m_position % m_baseSize;
-    size_t ncap = m_cur->size - npos;
+    size_t npos = m_position - m_curBase;
+    if(npos + size < m_cur->size){
+        memcpy(buf, m_cur->ptr + npos, size);
+        m_position += size;
+        return;
+    }
     size_t bpos = 0;
 
     while(size > 0){
-        if(ncap >= size){
-            memcpy((char*)buf + bpos, m_cur->ptr + npos, size);
-            if(m_cur->size == npos +  size){
-                m_cur = m_cur->next;
-            }
-            m_position += size;
-            bpos += size;
-            size = 0;
-        } else {
-            memcpy((char*)buf + bpos, m_cur->ptr + npos, ncap);
-            m_position += ncap;
-            bpos += ncap;
-            size -= ncap;
+        size_t len = std::min(m_cur->size - npos, size);
+        memcpy((char*)buf + bpos, m_cur->ptr + npos, len);
+        m_position += len;
+        bpos += len;
+        size -= len;
+        npos += len;
+        if(npos == m_cur->size){
+            m_curBase += m_cur->size;
             m_cur = m_cur->next;
             npos = 0;
         }
@@ -425,31 +605,21 @@ void ByteArray::read(void* buf, size_t size){
 
 
 void ByteArray::read(void* buf, size_t size, size_t position) const{
-    if(size > getReadSize() ) {
+    if(position > m_size || size > m_size - position) {
         throw std::out_of_range("not enough len");
     }
 
-    size_t npos = position % m_baseSize;
-    size_t ncap = m_cur->size - npos;
+    size_t base = 0;
+    Node* cur = findNode(position, base);
+    size_t npos = position - base;
     size_t bpos = 0;
-    Node* cur = m_cur;
     while(size > 0){
-        if(ncap >= size){
-            memcpy((char*)buf + bpos, cur->ptr + npos, size);
-            if(cur->size == npos +  size){
-                cur = cur->next;
-            }
-            position += size;
-            bpos += size;
-            size = 0;
-        } else {
-            memcpy((char*)buf + bpos, cur->ptr + npos, ncap);
-            position += ncap;
-            bpos += ncap;
-            size -= ncap;
-            cur = cur->next;
-            npos = 0;
-        }
+        size_t len = std::min(cur->size - npos, size);
+        memcpy((char*)buf + bpos, cur->ptr + npos, len);
+        bpos += len;
+        size -= len;
+        cur = cur->next;
+        npos = 0;
     }    
 }
 
@@ -460,19 +630,13 @@ void ByteArray::setPosition(size_t v){
         throw std::out_of_range("set_position out of range");
     }
 
+    size_t base = 0;
+    m_cur = findNode(v, base);
+    m_curBase = base;
     m_position = v;
     if(m_position > m_size) {
         m_size = m_position;
     }
-    m_cur = m_root;
-
-    while(v > m_cur->size){
-        v -= m_cur->size;
-        m_cur = m_cur->next; 
-    }
-    if(v == m_cur->size){
-        m_cur = m_cur->next;
-    }
 }
 
 
@@ -484,17 +648,10 @@ bool ByteArray::writeToFile(const std::string& name) const{
         return false;
     }
 
-    int64_t read_size = getReadSize();
-    int64_t pos = m_position;
-    Node* cur = m_cur;
-
-    while(read_size > 0){
-        int diff = pos % m_baseSize;
-        int64_t len = (read_size > (int64_t)m_baseSize ? m_baseSize : read_size) - diff;
-        ofs.write(cur->ptr + diff, len);
-        cur = cur->next;
-        pos += len;
-        read_size -= len;
+    std::vector<iovec> buffers;
+    getReadBuffers(buffers, getReadSize(), m_position);
+    for(auto& i : buffers){
+        ofs.write((const char*)i.iov_base, i.iov_len);
     }
 
     return true;
@@ -521,6 +678,53 @@ bool ByteArray::readFromFile(const std::string& name){
 
 
 
+ByteArray::ptr ByteArray::MapFile(const std::string& name, bool writable, uint64_t offset, uint64_t len){
+    int fd = open(name.c_str(), (writable ? O_RDWR : O_RDONLY) | O_CLOEXEC);
+    if(fd < 0){
+        CXK_LOG_ERROR(g_logger) << "MapFile open " << name << " errno=" << errno
+                                << " errstr=" << strerror(errno);
+        return nullptr;
+    }
+
+    struct stat st;
+    if(fstat(fd, &st) != 0){
+        CXK_LOG_ERROR(g_logger) << "MapFile fstat " << name << " errno=" << errno
+                                << " errstr=" << strerror(errno);
+        ::close(fd);
+        return nullptr;
+    }
+
+    ByteArray::ptr ba(new ByteArray);
+    uint64_t file_size = st.st_size;
+    if(offset >= file_size){
+        ::close(fd);
+        return ba;
+    }
+    len = std::min(len, file_size - offset);
+
+    // mmap的偏移必须按页对齐
+    static const uint64_t s_page_size = sysconf(_SC_PAGESIZE);
+    uint64_t map_offset = offset & ~(s_page_size - 1);
+    size_t map_len = len + (offset - map_offset);
+    void* addr = mmap(nullptr, map_len, PROT_READ | PROT_WRITE,
+                      writable ? MAP_SHARED : MAP_PRIVATE, fd, map_offset);
+    // 映射建立之后可以关闭文件
+    ::close(fd);
+    if(addr == MAP_FAILED){
+        CXK_LOG_ERROR(g_logger) << "MapFile mmap " << name << " len=" << map_len << " errno=" << errno
+                                << " errstr=" << strerror(errno);
+        return nullptr;
+    }
+
+    std::shared_ptr<char> block((char*)addr, [map_len](char* ptr){
+        munmap(ptr, map_len);
+    });
+    ba->appendNodes(new Node(block, block.get() + (offset - map_offset), len), len);
+    ba->setPosition(0);
+    return ba;
+}
+
+
 void ByteArray::addCapacity(size_t size){
     if(size == 0){
         return;
@@ -532,7 +736,7 @@ void ByteArray::addCapacity(size_t size){
     }
 
     size = size - old_cap;
-    size_t count = (size / m_baseSize) + (((size % m_baseSize) > old_cap) ? 1 : 0);
+    size_t count = (size + m_baseSize - 1) / m_baseSize;
     Node* tmp = m_root;
     while(tmp->next){
         tmp = tmp->next;
@@ -554,6 +758,243 @@ void ByteArray::addCapacity(size_t size){
 }
 
 
+ByteArray::Node* ByteArray::findNode(size_t position, size_t& base) const{
+    Node* cur = m_root;
+    base = 0;
+    // 大多数情况下查找的位置在当前节点之后, 从当前节点开始查找
+    if(m_cur && position >= m_curBase){
+        cur = m_cur;
+        base = m_curBase;
+    }
+    while(cur && position >= base + cur->size){
+        base += cur->size;
+        cur = cur->next;
+    }
+    return cur;
+}
+
+
+void ByteArray::unshare(Node* node){
+    if(!node->isShared()){
+        return;
+    }
+    std::shared_ptr<char> block = NewBlock(node->size);
+    memcpy(block.get(), node->ptr, node->size);
+    node->block = block;
+    node->ptr = block.get();
+}
+
+
+void ByteArray::appendNodes(Node* head, size_t len){
+    // 在m_position处截断, 之后的数据和未使用的容量都丢弃
+    Node* prev = nullptr;
+    Node* cur = m_root;
+    size_t base = 0;
+    while(cur && base + cur->size <= m_position){
+        base += cur->size;
+        prev = cur;
+        cur = cur->next;
+    }
+    if(cur && base < m_position){
+        cur->size = m_position - base;
+        prev = cur;
+        cur = cur->next;
+    }
+    while(cur){
+        Node* next = cur->next;
+        delete cur;
+        cur = next;
+    }
+
+    if(prev){
+        prev->next = head;
+    } else {
+        m_root = head;
+    }
+    m_position += len;
+    m_size = m_position;
+    m_capacity = m_position;
+    m_cur = nullptr;
+    m_curBase = m_capacity;
+}
+
+
+void ByteArray::append(ByteArray::ptr ba, uint64_t len){
+    len = len > ba->getReadSize() ? ba->getReadSize() : len;
+    append(ba, len, ba->getPosition());
+}
+
+
+void ByteArray::append(ByteArray::ptr ba, size_t len, uint64_t position){
+    if(len == 0){
+        return;
+    }
+    // 先复制出共享内存块的节点, ba和this相同时也不受影响
+    appendNodes(ba->shareNodes(len, position), len);
+}
+
+
+ByteArray::Node* ByteArray::shareNodes(size_t len, size_t position) const{
+    if(position > m_size || len > m_size - position){
+        throw std::out_of_range("share out of range");
+    }
+
+    size_t base = 0;
+    Node* cur = findNode(position, base);
+    size_t npos = position - base;
+    Node* head = nullptr;
+    Node* tail = nullptr;
+    while(len > 0){
+        size_t n = std::min(cur->size - npos, len);
+        Node* node = new Node(cur->block, cur->ptr + npos, n);
+        if(tail){
+            tail->next = node;
+        } else {
+            head = node;
+        }
+        tail = node;
+        len -= n;
+        cur = cur->next;
+        npos = 0;
+    }
+    return head;
+}
+
+
+void ByteArray::appendBlock(const std::shared_ptr<char>& block, size_t len){
+    if(len == 0){
+        return;
+    }
+    appendNodes(new Node(block, block.get(), len), len);
+}
+
+
+ByteArray::ptr ByteArray::slice(uint64_t len) const{
+    len = len > getReadSize() ? getReadSize() : len;
+    return slice(len, m_position);
+}
+
+
+ByteArray::ptr ByteArray::slice(size_t len, uint64_t position) const{
+    ByteArray::ptr rt(new ByteArray(m_baseSize));
+    rt->m__endian = m__endian;
+    if(len > 0){
+        rt->appendNodes(shareNodes(len, position), len);
+    }
+    rt->setPosition(0);
+    return rt;
+}
+
+
+
+char* ByteArray::getWritePtr(size_t& len){
+    if(!m_cur){
+        addCapacity(1);
+    }
+    unshare(m_cur);
+    size_t npos = m_position - m_curBase;
+    len = m_cur->size - npos;
+    return m_cur->ptr + npos;
+}
+
+
+const char* ByteArray::getReadPtr(size_t& len) const{
+    if(!m_cur || m_position >= m_size){
+        len = 0;
+        return nullptr;
+    }
+    size_t npos = m_position - m_curBase;
+    len = std::min(m_cur->size - npos, m_size - m_position);
+    return m_cur->ptr + npos;
+}
+
+
+void ByteArray::advance(size_t len){
+    m_position += len;
+    if(m_position - m_curBase == m_cur->size){
+        m_curBase += m_cur->size;
+        m_cur = m_cur->next;
+    }
+    if(m_position > m_size) {
+        m_size = m_position;
+    }
+}
+
+
+void ByteArray::writeVarintArray(const uint32_t* values, size_t count){
+    size_t i = 0;
+    while(i < count){
+        size_t len = 0;
+        uint8_t* p = (uint8_t*)getWritePtr(len);
+        size_t pos = 0;
+        while(i < count && len - pos >= 5){
+            pos += EncodeVarint(p + pos, values[i++]);
+        }
+        if(pos){
+            advance(pos);
+        } else {
+            writeUint32(values[i++]);
+        }
+    }
+}
+
+
+void ByteArray::writeVarintArray(const uint64_t* values, size_t count){
+    size_t i = 0;
+    while(i < count){
+        size_t len = 0;
+        uint8_t* p = (uint8_t*)getWritePtr(len);
+        size_t pos = 0;
+        while(i < count && len - pos >= 10){
+            pos += EncodeVarint(p + pos, values[i++]);
+        }
+        if(pos){
+            advance(pos);
+        } else {
+            writeUint64(values[i++]);
+        }
+    }
+}
+
+
+void ByteArray::readVarintArray(uint32_t* values, size_t count){
+    size_t i = 0;
+    while(i < count){
+        size_t len = 0;
+        const uint8_t* p = (const uint8_t*)getReadPtr(len);
+        size_t n = 0;
+        if(len >= 8){
+            size_t used = DecodeVarintBlock(p, len, values + i, count - i, n);
+            if(n){
+                advance(used);
+                i += n;
+                continue;
+            }
+        }
+        // 跨节点或者接近数据末尾的varint逐个读取
+        values[i++] = readUint32();
+    }
+}
+
+
+void ByteArray::readVarintArray(uint64_t* values, size_t count){
+    size_t i = 0;
+    while(i < count){
+        size_t len = 0;
+        const uint8_t* p = (const uint8_t*)getReadPtr(len);
+        size_t n = 0;
+        if(len >= 8){
+            size_t used = DecodeVarintBlock(p, len, values + i, count - i, n);
+            if(n){
+                advance(used);
+                i += n;
+                continue;
+            }
+        }
+        values[i++] = readUint64();
+    }
+}
+
 
 std::string ByteArray::toString(){
     std::string str;
@@ -590,61 +1031,43 @@ uint64_t ByteArray::getReadBuffers(std::vector<iovec>& buffers, uint64_t len){
 
     uint64_t size = len;
 
-    size_t npos = m_position % m_baseSize;
-    size_t ncap = m_cur->size - npos;
+    size_t npos = m_position - m_curBase;
     struct iovec iov;
     Node* cur = m_cur;
 
     while(len > 0){
-        if(ncap >= len){
-            iov.iov_base = cur->ptr + npos;
-            iov.iov_len = len;
-            len = 0;           
-        } else {
-            iov.iov_base = cur->ptr + npos;
-            iov.iov_len = ncap;
-            len -= ncap;
-            cur = cur->next;
-            ncap = cur->size;
-            npos = 0;
-        }
+        iov.iov_base = cur->ptr + npos;
+        iov.iov_len = std::min(cur->size - npos, (size_t)len);
+        len -= iov.iov_len;
+        cur = cur->next;
+        npos = 0;
         buffers.push_back(iov);
     }
     return size;
 }
 
 uint64_t ByteArray::getReadBuffers(std::vector<iovec>& buffers, size_t len, uint64_t position) const{
-    len = len > getReadSize() ? getReadSize() : len;
+    if(position >= m_size){
+        return 0;
+    }
+    len = len > (m_size - position) ? (m_size - position) : len;
     if(len == 0){
         return 0;
     }
 
     uint64_t size = len;
 
-    size_t npos = position % m_baseSize;
-    size_t count = position / m_baseSize;
-    Node* cur = m_root;
-    while(count > 0){
-        cur = cur->next;
-        --count;
-    }
-    size_t ncap = m_cur->size - npos;
+    size_t base = 0;
+    Node* cur = findNode(position, base);
+    size_t npos = position - base;
     struct iovec iov;
-    // Node* cur = m_cur;   // 不确定是否需要
 
     while(len > 0){
-        if(ncap >= len){
-            iov.iov_base = cur->ptr + npos;
-            iov.iov_len = len;
-            len = 0;           
-        } else {
-            iov.iov_base = cur->ptr + npos;
-            iov.iov_len = ncap;
-            len -= ncap;
-            cur = cur->next;
-            ncap = cur->size;
-            npos = 0;
-        }
+        iov.iov_base = cur->ptr + npos;
+        iov.iov_len = std::min(cur->size - npos, len);
+        len -= iov.iov_len;
+        cur = cur->next;
+        npos = 0;
         buffers.push_back(iov);
     }
     return size;    
@@ -659,24 +1082,17 @@ uint64_t ByteArray::getWriteBuffers(std::vector<iovec>& buffers, uint64_t len){
     addCapacity(len);
     uint64_t size = len;
 
-    size_t npos = m_position % m_baseSize;
-    size_t ncap = m_cur->size - npos;
+    size_t npos = m_position - m_curBase;
     struct iovec iov;
     Node* cur = m_cur;
 
     while(len > 0){
-        if(ncap >= len){
-            iov.iov_base = cur->ptr + npos;
-            iov.iov_len = len;
-            len = 0;           
-        } else {
-            iov.iov_base = cur->ptr + npos;
-            iov.iov_len = ncap;
-            len -= ncap;
-            cur = cur->next;
-            ncap = cur->size;
-            npos = 0;
-        }
+        unshare(cur);
+        iov.iov_base = cur->ptr + npos;
+        iov.iov_len = std::min(cur->size - npos, (size_t)len);
+        len -= iov.iov_len;
+        cur = cur->next;
+        npos = 0;
         buffers.push_back(iov);
     }
     return size;
@@ -5,6 +5,9 @@
 #include <string>
 #include <sys/types.h>
 #include <netinet/tcp.h>
+#include <type_traits>
+#include <algorithm>
+#include "endian.h"
 namespace cxk{
 
 
@@ -23,9 +26,20 @@ public:
         /// @brief  析构函数，释放内存
         ~Node();
 
+        /// @brief      构造共享内存块的节点
+        /// @param b    引用计数的内存块
+        /// @param p    节点数据在内存块中的起始地址
+        /// @param s    节点数据大小
+        Node(const std::shared_ptr<char>& b, char* p, size_t s);
+
         /// @brief  无参构造函数
         Node();
 
+        /// @brief  内存块是否同时被其他节点引用, 被共享的内存块只读
+        bool isShared() const { return block.use_count() > 1; }
+
+        std::shared_ptr<char> block;    // 引用计数的内存块, ptr指向其中的一段
+
         char* ptr;      // 内存块地址指针
         Node* next;     // 下一个内存块大小
         size_t size;    // 内存块大小
@@ -248,6 +262,60 @@ public:
     /// @exception  getReadSize() < Varint64实际长度 + size 抛出 std::out_of_range
     std::string readStringVint();
     
+    /// @brief          批量写入无符号Varint32
+    /// @param values   数据
+    /// @param count    个数
+    /// @details        当前节点剩余空间足够时直接编码到节点中, 不经过write()
+    void writeVarintArray(const uint32_t* values, size_t count);
+
+    /// @brief          批量写入无符号Varint64
+    void writeVarintArray(const uint64_t* values, size_t count);
+
+    /// @brief          批量读取无符号Varint32
+    /// @details        x86下用SSE2/AVX2一次识别16/32个单字节varint, 其余按64位字解码
+    /// @exception      如果数据不足 抛出 std::out_of_range
+    void readVarintArray(uint32_t* values, size_t count);
+
+    /// @brief          批量读取无符号Varint64
+    void readVarintArray(uint64_t* values, size_t count);
+
+    /// @brief          批量写入固定长度的整数(大端/小端)
+    template<class T>
+    void writeFixedArray(const T* values, size_t count){
+        static_assert(std::is_integral<T>::value, "writeFixedArray only support integer");
+        if constexpr(sizeof(T) == 1){
+            write(values, count);
+        } else if(m__endian == CXK_BYTE_ORDER){
+            write(values, sizeof(T) * count);
+        } else {
+            // 分段转换字节序后写入
+            T buf[64];
+            for(size_t i = 0; i < count;){
+                size_t n = std::min(count - i, sizeof(buf) / sizeof(T));
+                for(size_t j = 0; j < n; ++j){
+                    buf[j] = byteswap(values[i + j]);
+                }
+                write(buf, n * sizeof(T));
+                i += n;
+            }
+        }
+    }
+
+    /// @brief          批量读取固定长度的整数(大端/小端), 一次拷贝后再统一转换字节序
+    /// @exception      如果getReadSize() < sizeof(T) * count 抛出 std::out_of_range
+    template<class T>
+    void readFixedArray(T* values, size_t count){
+        static_assert(std::is_integral<T>::value, "readFixedArray only support integer");
+        read(values, sizeof(T) * count);
+        if constexpr(sizeof(T) > 1){
+            if(m__endian != CXK_BYTE_ORDER){
+                for(size_t i = 0; i < count; ++i){
+                    values[i] = byteswap(values[i]);
+                }
+            }
+        }
+    }
+
     /// @brief  清空ByteArray
     /// @post   m_positin = 0, m_size = 0;
     void clear();
@@ -291,6 +359,18 @@ public:
     /// @param name 文件名
     bool readFromFile(const std::string& name);
 
+    /// @brief              把文件的一段映射为ByteArray, 不拷贝数据
+    /// @param name         文件名
+    /// @param writable     为true时写入直接修改文件(MAP_SHARED), 否则写入只修改内存中的副本(MAP_PRIVATE)
+    /// @param offset       映射的起始偏移
+    /// @param len          映射长度, 超过文件大小时映射到文件末尾
+    /// @return             位置为0的ByteArray, 失败返回nullptr
+    /// @attention          写入超出映射范围的数据保存在普通内存块中, 不会写入文件;
+    ///                     映射期间文件被截断, 访问截断的部分会触发SIGBUS;
+    ///                     映射的内存块被切片共享时写入会先复制整个节点, 同样不会写入文件
+    static ByteArray::ptr MapFile(const std::string& name, bool writable = false,
+                                  uint64_t offset = 0, uint64_t len = ~0ull);
+
     /// @brief  返回内存块大小
     size_t getBaseSize() const {return m_baseSize;}
 
@@ -335,6 +415,33 @@ public:
     /// @post               如果(m_position + len) > m_capacity 则 m_capacity扩容N个节点以容纳len长度   
     uint64_t getWriteBuffers(std::vector<iovec>& buffers, uint64_t len);
 
+
+    /// @brief              把ba中可读的数据追加到m_position处, 和ba共享内存块, 不拷贝数据
+    /// @param[in] ba       数据来源
+    /// @param[in] len      追加的长度,如果len > ba->getReadSize() 则 len = ba->getReadSize()
+    /// @post               m_position += len, m_size = m_position, 原先m_position之后的数据被丢弃
+    void append(ByteArray::ptr ba, uint64_t len = ~0ull);
+
+    /// @brief              把ba中[position, position + len)的数据追加到m_position处, 和ba共享内存块
+    /// @post               m_position += len, m_size = m_position, 原先m_position之后的数据被丢弃
+    /// @exception          如果ba中的数据不足 抛出 std::out_of_range
+    void append(ByteArray::ptr ba, size_t len, uint64_t position);
+
+    /// @brief              把外部的内存块追加到m_position处, 不拷贝数据
+    /// @param[in] block    引用计数的内存块
+    /// @param[in] len      内存块中数据的长度
+    void appendBlock(const std::shared_ptr<char>& block, size_t len);
+
+    /// @brief              从m_position开始切出len长度的数据, 和当前ByteArray共享内存块
+    /// @param[in] len      切片长度,如果len > getReadSize() 则 len = getReadSize()
+    /// @return             新的ByteArray, 位置为0
+    /// @attention          共享的内存块只读, 任何一方写入时会先复制该节点(写时复制)
+    ByteArray::ptr slice(uint64_t len = ~0ull) const;
+
+    /// @brief              切出[position, position + len)的数据, 和当前ByteArray共享内存块
+    /// @exception          如果数据不足 抛出 std::out_of_range
+    ByteArray::ptr slice(size_t len, uint64_t position) const;
+
 private:
 
     /// @brief  扩容ByteArray，使其可以容纳size歌数据(如果原本可以容纳就不扩容)
@@ -342,6 +449,31 @@ private:
 
     /// @brief  获取当前的可写入容量
     size_t getCapacity() const {return m_capacity - m_position;}
+
+    /// @brief  查找position所在的节点
+    /// @param[out] base    节点的起始位置
+    /// @return             position所在的节点, position等于容量时返回nullptr
+    Node* findNode(size_t position, size_t& base) const;
+
+    /// @brief  节点的内存块被共享时, 复制一份再写入
+    void unshare(Node* node);
+
+    /// @brief  复制[position, position + len)对应的节点, 新节点和原节点共享内存块
+    Node* shareNodes(size_t len, size_t position) const;
+
+    /// @brief  把节点链表接到m_position处
+    void appendNodes(Node* head, size_t len);
+
+    /// @brief  获取当前节点中从m_position开始的连续可写内存, 必要时扩容, 共享的内存块先复制
+    /// @param[out] len 连续可写的长度
+    char* getWritePtr(size_t& len);
+
+    /// @brief  获取当前节点中从m_position开始的连续可读内存, 没有可读数据返回nullptr
+    /// @param[out] len 连续可读的长度
+    const char* getReadPtr(size_t& len) const;
+
+    /// @brief  在当前节点内移动m_position, len不能超过getWritePtr/getReadPtr返回的长度
+    void advance(size_t len);
 private:
     size_t m_baseSize;  // 每一个Node大概有多大 
     size_t m_position;  // 当前的位置
@@ -352,6 +484,7 @@ private:
     int8_t m__endian;
     Node* m_root;
     Node* m_cur;
+    size_t m_curBase;   // m_cur节点的起始位置
 };
 
 }
\ No newline at end of file
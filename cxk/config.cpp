@@ -1,7 +1,13 @@
 #include "config.h"
 #include "env.h"
 #include <sys/stat.h>
+#include <sys/inotify.h>
+#include <dirent.h>
+#include <string.h>
+#include <unistd.h>
+#include <set>
 #include "Thread.h"
+#include "iomanager.h"
 
 namespace cxk{
 static cxk::Logger::ptr g_logger = CXK_LOG_NAME("system");
@@ -41,8 +47,98 @@ void Config::Visit(std::function<void(ConfigVarBase::ptr)> cb){
 
 
 static std::map<std::string, uint64_t> s_file2modifytime;
+// 每个配置文件中已生效的配置项, 配置项名称 -> 序列化后的YAML文本
+static std::map<std::string, std::map<std::string, std::string>> s_file2values;
 static cxk::Mutex s_mutex;
 
+// 把YAML节点展开为 配置项名称 -> 文本, 只保留已注册的配置项
+static void CollectValues(const YAML::Node& root, std::map<std::string, std::string>& values){
+    std::list<std::pair<std::string, const YAML::Node>> all_nodes;
+    ListAllMember("", root, all_nodes);
+
+    for (auto &i : all_nodes){
+        std::string key = i.first;
+        if (key.empty()){
+            continue;
+        }
+
+        std::transform(key.begin(), key.end(), key.begin(), ::tolower);
+        if (!Config::LookupBase(key)){
+            continue;
+        }
+        if (i.second.IsScalar()){
+            values[key] = i.second.Scalar();
+        }
+        else{
+            std::stringstream ss;
+            ss << i.second;
+            values[key] = ss.str();
+        }
+    }
+}
+
+bool Config::LoadFromConfFile(const std::string& file, bool force){
+    struct stat st;
+    if(lstat(file.c_str(), &st) != 0){
+        cxk::Mutex::Lock lock(s_mutex);
+        s_file2modifytime.erase(file);
+        s_file2values.erase(file);
+        return false;
+    }
+    {
+        cxk::Mutex::Lock lock(s_mutex);
+        if(!force && s_file2modifytime[file] == (uint64_t)st.st_mtime){
+            return true;
+        }
+        s_file2modifytime[file] = st.st_mtime;
+    }
+
+    std::map<std::string, std::string> values;
+    try{
+        YAML::Node root = YAML::LoadFile(file);
+        CollectValues(root, values);
+    } catch(...){
+        CXK_LOG_ERROR(g_logger) << "Load config file error: " << file;
+        return false;
+    }
+
+    // 和上次加载的结果比较, 只对文本发生变化的配置项调用fromString
+    std::vector<std::pair<std::string, std::string>> changes;
+    size_t added = 0;
+    size_t removed = 0;
+    {
+        cxk::Mutex::Lock lock(s_mutex);
+        std::map<std::string, std::string>& old_values = s_file2values[file];
+        for(auto& i : values){
+            auto it = old_values.find(i.first);
+            if(it == old_values.end()){
+                ++added;
+            } else if(it->second == i.second){
+                continue;
+            }
+            changes.push_back(i);
+        }
+        for(auto& i : old_values){
+            if(!values.count(i.first)){
+                ++removed;
+            }
+        }
+        old_values.swap(values);
+    }
+
+    std::stringstream ss;
+    for(auto& i : changes){
+        ConfigVarBase::ptr var = LookupBase(i.first);
+        if(var && var->fromString(i.second)){
+            ss << " " << i.first;
+        }
+    }
+    CXK_LOG_INFO(g_logger) << "LoadConfig: " << file << " ok changed=" << (changes.size() - added)
+                           << " added=" << added << " removed=" << removed
+                           << (changes.empty() ? "" : " keys:") << ss.str();
+    return true;
+}
+
 void Config::LoadFromConfDir(const std::string& path, bool force){
     std::string absolute_path = cxk::EnvMgr::GetInstance()->getAbsolutePath(path);
 
@@ -50,25 +146,176 @@ void Config::LoadFromConfDir(const std::string& path, bool force){
     FSUtil::ListAllFile(files, absolute_path, ".yml");
 
     for(auto& i : files){
-        struct stat st;
-        lstat(i.c_str(), &st);
-        {
-            cxk::Mutex::Lock lock(s_mutex);
-            if(!force && s_file2modifytime[i] == st.st_mtime){
-                continue;
+        LoadFromConfFile(i, force);
+    }
+}
+
+
+/// @brief 基于inotify的配置目录监听, 文件写入完成或者被替换后只重新加载该文件
+class ConfWatcher : public std::enable_shared_from_this<ConfWatcher>{
+public:
+    using ptr = std::shared_ptr<ConfWatcher>;
+
+    ConfWatcher(const std::string& path, IOManager* iom)
+        :m_path(path)
+        ,m_iom(iom){
+    }
+
+    ~ConfWatcher(){
+        if(m_fd >= 0){
+            close(m_fd);
+        }
+    }
+
+    bool start(){
+        m_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if(m_fd < 0){
+            CXK_LOG_ERROR(g_logger) << "inotify_init1 error errno=" << errno
+                                    << " errstr=" << strerror(errno);
+            return false;
+        }
+        if(!addWatch(m_path)){
+            return false;
+        }
+        m_iom->schedule(std::bind(&ConfWatcher::waitEvent, shared_from_this()));
+        return true;
+    }
+
+    // 正在执行的回调看到m_stop后不再重新注册事件
+    void stop(){
+        m_stop = true;
+        m_iom->delEvent(m_fd, IOManager::READ);
+    }
+
+private:
+    // 递归监听目录及其子目录
+    bool addWatch(const std::string& dir){
+        int wd = inotify_add_watch(m_fd, dir.c_str(),
+                    IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE | IN_DELETE);
+        if(wd < 0){
+            CXK_LOG_ERROR(g_logger) << "inotify_add_watch " << dir << " error errno=" << errno
+                                    << " errstr=" << strerror(errno);
+            return false;
+        }
+        m_dirs[wd] = dir;
+
+        DIR* d = opendir(dir.c_str());
+        if(d == nullptr){
+            return true;
+        }
+        struct dirent* dp = nullptr;
+        while((dp = readdir(d)) != nullptr){
+            if(dp->d_type == DT_DIR && strcmp(".", dp->d_name) && strcmp("..", dp->d_name)){
+                addWatch(dir + "/" + dp->d_name);
+            }
+        }
+        closedir(d);
+        return true;
+    }
+
+    void waitEvent(){
+        if(m_stop){
+            return;
+        }
+        if(m_iom->addEvent(m_fd, IOManager::READ, std::bind(&ConfWatcher::onEvent, shared_from_this()))){
+            CXK_LOG_ERROR(g_logger) << "watch config dir " << m_path << " addEvent error";
+        }
+    }
+
+    // 读出所有事件, 同一个文件多次变化只加载一次
+    void onEvent(){
+        std::set<std::string> files;
+        char buf[8192] __attribute__((aligned(__alignof__(struct inotify_event))));
+        while(true){
+            ssize_t len = read(m_fd, buf, sizeof(buf));
+            if(len <= 0){
+                break;
             }
-            s_file2modifytime[i] = st.st_mtime;
+            for(char* ptr = buf; ptr < buf + len;){
+                struct inotify_event* ev = (struct inotify_event*)ptr;
+                ptr += sizeof(struct inotify_event) + ev->len;
+                auto it = m_dirs.find(ev->wd);
+                if(it == m_dirs.end()){
+                    continue;
+                }
+                if(ev->mask & IN_IGNORED){
+                    m_dirs.erase(it);
+                    continue;
+                }
+                if(!ev->len){
+                    continue;
+                }
+                std::string name = it->second + "/" + ev->name;
+                if(ev->mask & IN_ISDIR){
+                    if(ev->mask & (IN_CREATE | IN_MOVED_TO)){
+                        addWatch(name);
+                        std::vector<std::string> sub;
+                        FSUtil::ListAllFile(sub, name, ".yml");
+                        files.insert(sub.begin(), sub.end());
+                    }
+                    continue;
+                }
+                if(name.size() > 4 && name.compare(name.size() - 4, 4, ".yml") == 0
+                        && (ev->mask & (IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE))){
+                    files.insert(name);
+                }
+            }
+        }
+
+        for(auto& i : files){
+            // 文件删除时只清理记录, 不回滚配置项的值
+            Config::LoadFromConfFile(i, true);
         }
+        waitEvent();
+    }
+
+private:
+    std::string m_path;
+    IOManager* m_iom;
+    int m_fd = -1;
+    std::atomic<bool> m_stop{false};
+    std::map<int, std::string> m_dirs;
+};
 
-        try{
-            // CXK_LOG_INFO(g_logger) << "LoadConfig: " << i;
-            YAML::Node root = YAML::LoadFile(i);
-            LoadFromYaml(root);
-            CXK_LOG_INFO(g_logger) << "LoadConfig: " << i << " ok";
-        } catch(...){
-            CXK_LOG_ERROR(g_logger) << "Load config file error: " << i;
+static std::map<std::string, ConfWatcher::ptr> s_watchers;
+
+bool Config::WatchConfDir(const std::string& path, IOManager* iom){
+    iom = iom ? iom : IOManager::GetThis();
+    if(!iom){
+        CXK_LOG_ERROR(g_logger) << "WatchConfDir " << path << " no IOManager";
+        return false;
+    }
+    std::string absolute_path = cxk::EnvMgr::GetInstance()->getAbsolutePath(path);
+    ConfWatcher::ptr watcher(new ConfWatcher(absolute_path, iom));
+    {
+        cxk::Mutex::Lock lock(s_mutex);
+        if(s_watchers.count(absolute_path)){
+            return true;
+        }
+        s_watchers[absolute_path] = watcher;
+    }
+    if(!watcher->start()){
+        cxk::Mutex::Lock lock(s_mutex);
+        s_watchers.erase(absolute_path);
+        return false;
+    }
+    CXK_LOG_INFO(g_logger) << "WatchConfDir: " << absolute_path;
+    return true;
+}
+
+void Config::UnwatchConfDir(const std::string& path){
+    std::string absolute_path = cxk::EnvMgr::GetInstance()->getAbsolutePath(path);
+    ConfWatcher::ptr watcher;
+    {
+        cxk::Mutex::Lock lock(s_mutex);
+        auto it = s_watchers.find(absolute_path);
+        if(it == s_watchers.end()){
+            return;
         }
+        watcher = it->second;
+        s_watchers.erase(it);
     }
+    watcher->stop();
 }
 
 
@@ -14,10 +14,15 @@
 #include <list>
 #include <unordered_map>
 #include <unordered_set>
+#include <atomic>
+#include <type_traits>
 #include "Thread.h"
+#include "snapshot.h"
 
 namespace cxk{
 
+class IOManager;
+
 /// @brief 配置变量的基类
 class ConfigVarBase{
 public:
@@ -329,6 +334,10 @@ public:
 
 
 /// @brief 配置参数模板子类，保存对应类型的参数值
+/// @details 参数值保存为不可变的快照(std::shared_ptr<const T>)，放在AtomicSnapshot中，读取时由线程本地的
+///          版本化缓存取得，快速路径不加锁；setValue时生成新的快照整体替换。
+///          算术类型额外保存一份std::atomic<T>，getValue只需一次原子load。
+///          快照和原子副本是先后两次发布的，setValue过程中getValue和getSnapshot可能短暂地不一致
 /// @tparam T           参数的具体类型
 /// @tparam FromStr     从std::string转换为T的仿函数
 /// @tparam ToStr       为YAML格式的字符串
@@ -339,14 +348,19 @@ public:
     using ptr = std::shared_ptr<ConfigVar<T>>;
     using on_change_cb = std::function<void(const T &old_value, const T &new_value)>;
     using RWMutexType = cxk::RWMutex;
+    using SnapshotType = std::shared_ptr<const T>;
 
 
     /// @brief 通过参数名，参数值，描述构造ConfigVar
     /// @param name         参数有效字符为[0-9a-z_.]
     /// @param value        参数的默认值
     /// @param description  参数的描述
-    ConfigVar(const std::string &name, const T &value, const std::string &description = "") : ConfigVarBase(name, description), m_value(value)
+    ConfigVar(const std::string &name, const T &value, const std::string &description = "") : ConfigVarBase(name, description),
+                                                                                                  m_value(std::make_shared<const T>(value))
     {
+        if constexpr (IsScalar){
+            m_scalar.store(value, std::memory_order_relaxed);
+        }
     }
 
 
@@ -357,13 +371,12 @@ public:
         try
         {
             // return boost::lexical_cast<std::string>(m_value);
-            RWMutexType::ReadLock lock(m_mutex);
-            return ToStr()(m_value);
+            return ToStr()(*getSnapshot());
         }
         catch (std::exception &e)
         {
             CXK_LOG_ERROR(CXK_LOG_ROOT()) << "ConfigVar::toString exception" << e.what()
-                                            << "convert: " << typeid(m_value).name() << "to string";
+                                            << "convert: " << typeid(T).name() << "to string";
         }
         return "";
     }
@@ -382,15 +395,26 @@ public:
         catch (std::exception &e)
         {
             CXK_LOG_ERROR(CXK_LOG_ROOT()) << "ConfigVar::toString exception" << e.what()
-                                            << "convert: string to " << typeid(m_value).name();
+                                            << "convert: string to " << typeid(T).name();
         }
         return false;
     }
 
     /// @brief 获取当前参数的值
+    /// @details 不加锁; 算术类型为一次原子load, 其他类型仍然要拷贝一次T, 较大的类型用getSnapshot
     T getValue(){
-        RWMutexType::ReadLock lock(m_mutex);
-        return m_value; 
+        if constexpr (IsScalar){
+            return m_scalar.load(std::memory_order_acquire);
+        } else {
+            return *getSnapshot();
+        }
+    }
+
+
+    /// @brief 获取当前参数值的只读快照
+    /// @details 快速路径不加锁也不拷贝T, 快照在持有期间保持不变, 适合较大的容器类型
+    SnapshotType getSnapshot() const {
+        return m_value.load();
     }
 
 
@@ -399,14 +423,20 @@ public:
     void setValue(const T &value){
         {
             RWMutexType::ReadLock lock(m_mutex);
-            if (m_value == value)
+            SnapshotType old_value = getSnapshot();
+            if (*old_value == value)
                 return;
             for (auto &i : m_cbs){
-                i.second(m_value, value);
+                i.second(*old_value, value);
             }
         }
+        SnapshotType new_value = std::make_shared<const T>(value);
         RWMutexType::WriteLock lock(m_mutex);
-        m_value = value;
+        // 先发布快照再发布原子副本, 两者之间读者可能看到不同的值
+        m_value.store(new_value);
+        if constexpr (IsScalar){
+            m_scalar.store(value, std::memory_order_release);
+        }
     }
 
 
@@ -450,7 +480,14 @@ public:
     }
 
 private:
-    T m_value;
+    static constexpr bool IsScalar = std::is_arithmetic<T>::value;
+    using ScalarType = typename std::conditional<IsScalar, T, char>::type;
+
+    // 参数值的快照, 只整体替换不修改
+    AtomicSnapshot<T> m_value;
+    // 算术类型参数值的副本
+    std::atomic<ScalarType> m_scalar{};
+    // 保护回调函数组
     RWMutexType m_mutex;
     // 变更回调函数组, uint64_t key要求唯一, 一般用hash值
     std::map<uint64_t, on_change_cb> m_cbs;
@@ -525,6 +562,21 @@ public:
      */
     static void LoadFromConfDir(const std::string& path, bool force = false);
 
+    /// @brief 加载单个配置文件
+    /// @param file     配置文件路径
+    /// @param force    为true时忽略修改时间, 总是重新解析
+    /// @return         文件不存在或者解析失败返回false
+    /// @details        只对和上次加载相比文本发生变化的配置项调用fromString, 并输出变化摘要
+    static bool LoadFromConfFile(const std::string& file, bool force = false);
+
+    /// @brief 使用inotify监听配置目录, 文件变化后在iom上增量重新加载
+    /// @param path     配置目录
+    /// @param iom      运行监听的IOManager, 为nullptr时使用当前线程的IOManager
+    static bool WatchConfDir(const std::string& path, IOManager* iom = nullptr);
+
+    /// @brief 停止监听配置目录
+    static void UnwatchConfDir(const std::string& path);
+
 
     /// @brief 使用YAML::Node初始化配置模块
     static void LoadFromYaml(const YAML::Node &root);
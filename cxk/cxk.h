@@ -9,16 +9,24 @@
 #include "logger.h"
 #include "socket.h"
 #include "bytearray.h"
+#include "block_pool.h"
+#include "snapshot.h"
 #include "Thread.h"
 #include "fiber.h"
 #include "timer.h"
 #include "hook.h"
 #include "address.h"
+#include "dns.h"
 #include "tcp_server.h"
 #include "stream.h"
 #include "stream/socket_stream.h"
+#include "stream/buffered_stream.h"
 #include "http/http.h"
 #include "http/http_parser.h"
 #include "http/http_server.h"
 #include "http/http_session.h"
+#include "http/http_compress.h"
+#include "http/static_file_servlet.h"
 #include "http/http_connection.h"
+#include "http/http_client.h"
+#include "http2/http2_session.h"
@@ -0,0 +1,611 @@
+#include "dns.h"
+#include "config.h"
+#include "hook.h"
+#include "iomanager.h"
+#include "logger.h"
+#include "socket.h"
+#include "util.h"
+#include <arpa/inet.h>
+#include <algorithm>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <string.h>
+
+
+namespace cxk{
+
+static cxk::Logger::ptr g_logger = CXK_LOG_NAME("system");
+
+static cxk::ConfigVar<bool>::ptr g_dns_enable =
+    cxk::Config::Lookup("dns.enable", true, "resolve names in fibers with the async dns resolver");
+
+static cxk::ConfigVar<std::string>::ptr g_dns_hosts_file =
+    cxk::Config::Lookup("dns.hosts_file", std::string("/etc/hosts"), "dns hosts file");
+
+static cxk::ConfigVar<std::string>::ptr g_dns_resolv_conf =
+    cxk::Config::Lookup("dns.resolv_conf", std::string("/etc/resolv.conf"), "dns resolv.conf");
+
+static cxk::ConfigVar<std::vector<std::string>>::ptr g_dns_servers =
+    cxk::Config::Lookup("dns.servers", std::vector<std::string>(), "dns nameservers(ip or ip:port), override resolv.conf");
+
+static cxk::ConfigVar<uint32_t>::ptr g_dns_timeout =
+    cxk::Config::Lookup("dns.timeout", (uint32_t)2000, "dns query timeout ms per nameserver");
+
+static cxk::ConfigVar<uint32_t>::ptr g_dns_attempts =
+    cxk::Config::Lookup("dns.attempts", (uint32_t)2, "dns query rounds over all nameservers");
+
+static cxk::ConfigVar<uint32_t>::ptr g_dns_max_ttl =
+    cxk::Config::Lookup("dns.max_ttl", (uint32_t)3600, "dns max cache ttl s");
+
+static cxk::ConfigVar<uint32_t>::ptr g_dns_negative_ttl =
+    cxk::Config::Lookup("dns.negative_ttl", (uint32_t)30, "dns max negative cache ttl s");
+
+static cxk::ConfigVar<uint32_t>::ptr g_dns_cache_size =
+    cxk::Config::Lookup("dns.cache_size", (uint32_t)10000, "dns max cached names");
+
+
+// 监听器在新值生效前调用, 新值要作为参数传入
+struct _DnsIniter{
+    _DnsIniter(){
+        g_dns_hosts_file->addListener([](const std::string& old_value, const std::string& new_value){
+            DnsMgr::GetInstance()->reload(new_value, g_dns_resolv_conf->getValue(), g_dns_servers->getValue());
+        });
+        g_dns_resolv_conf->addListener([](const std::string& old_value, const std::string& new_value){
+            DnsMgr::GetInstance()->reload(g_dns_hosts_file->getValue(), new_value, g_dns_servers->getValue());
+        });
+        g_dns_servers->addListener([](const std::vector<std::string>& old_value, const std::vector<std::string>& new_value){
+            DnsMgr::GetInstance()->reload(g_dns_hosts_file->getValue(), g_dns_resolv_conf->getValue(), new_value);
+        });
+    }
+};
+
+static _DnsIniter s_dns_initer;
+
+
+enum DnsType{
+    DNS_A = 1,
+    DNS_SOA = 6,
+    DNS_AAAA = 28,
+};
+
+enum DnsRcode{
+    DNS_NOERROR = 0,
+    DNS_NXDOMAIN = 3,
+};
+
+
+/// @brief 一个类型(A/AAAA)的查询结果
+struct DnsAnswer{
+    std::vector<IPAddress::ptr> addrs;
+    uint32_t ttl = 0;
+    bool done = false;
+};
+
+
+static std::string Normalize(const std::string& name){
+    std::string rt = name;
+    std::transform(rt.begin(), rt.end(), rt.begin(), ::tolower);
+    while(!rt.empty() && rt.back() == '.'){
+        rt.pop_back();
+    }
+    return rt;
+}
+
+
+/// @brief  生成查询报文, 域名不合法时返回false
+static bool BuildQuery(std::string& buf, uint16_t id, const std::string& name, uint16_t type){
+    buf.clear();
+    uint8_t header[12] = {0};
+    header[0] = id >> 8;
+    header[1] = id & 0xff;
+    header[2] = 0x01;   // RD
+    header[5] = 1;      // QDCOUNT
+    buf.append((const char*)header, sizeof(header));
+
+    size_t begin = 0;
+    while(begin <= name.size()){
+        size_t end = name.find('.', begin);
+        if(end == std::string::npos){
+            end = name.size();
+        }
+        size_t len = end - begin;
+        if(len == 0 || len > 63){
+            return false;
+        }
+        buf.push_back((char)len);
+        buf.append(name, begin, len);
+        begin = end + 1;
+    }
+    buf.push_back(0);
+    if(buf.size() - sizeof(header) > 255){
+        return false;
+    }
+    uint8_t tail[4] = {(uint8_t)(type >> 8), (uint8_t)(type & 0xff), 0, 1};
+    buf.append((const char*)tail, sizeof(tail));
+    return true;
+}
+
+
+static uint16_t Read16(const uint8_t* p){
+    return (p[0] << 8) | p[1];
+}
+
+
+static uint32_t Read32(const uint8_t* p){
+    return ((uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+
+/// @brief  跳过报文中的域名(可能是压缩指针), 返回域名之后的位置, 出错返回0
+static size_t SkipName(const uint8_t* data, size_t size, size_t pos){
+    while(pos < size){
+        uint8_t len = data[pos];
+        if(len == 0){
+            return pos + 1;
+        }
+        if((len & 0xc0) == 0xc0){
+            return pos + 2 <= size ? pos + 2 : 0;
+        }
+        pos += len + 1;
+    }
+    return 0;
+}
+
+
+/// @brief          解析响应报文
+/// @param answer   解析出的A/AAAA地址和TTL; 域名不存在或没有记录时地址为空, TTL取SOA的minimum
+/// @return         是否是可用的响应(NOERROR或NXDOMAIN)
+static bool ParseResponse(const uint8_t* data, size_t size, uint16_t type, DnsAnswer& answer){
+    if(size < 12 || !(data[2] & 0x80)){
+        return false;
+    }
+    int rcode = data[3] & 0x0f;
+    if(rcode != DNS_NOERROR && rcode != DNS_NXDOMAIN){
+        return false;
+    }
+    uint16_t qdcount = Read16(data + 4);
+    uint16_t ancount = Read16(data + 6);
+    uint16_t nscount = Read16(data + 8);
+
+    size_t pos = 12;
+    for(uint16_t i = 0; i < qdcount; ++i){
+        pos = SkipName(data, size, pos);
+        if(!pos || pos + 4 > size){
+            return false;
+        }
+        pos += 4;
+    }
+
+    uint32_t ttl = (uint32_t)-1;
+    uint32_t negative_ttl = g_dns_negative_ttl->getValue();
+    for(uint32_t i = 0; i < (uint32_t)ancount + nscount; ++i){
+        pos = SkipName(data, size, pos);
+        if(!pos || pos + 10 > size){
+            // 截断(TC)的响应, 用已经解析出的记录
+            break;
+        }
+        uint16_t rtype = Read16(data + pos);
+        uint32_t rttl = Read32(data + pos + 4);
+        uint16_t rdlen = Read16(data + pos + 8);
+        pos += 10;
+        if(pos + rdlen > size){
+            break;
+        }
+        const uint8_t* rdata = data + pos;
+        if(i < ancount){
+            // CNAME链的TTL也计入
+            ttl = std::min(ttl, rttl);
+            if(rtype == DNS_A && type == DNS_A && rdlen == 4){
+                sockaddr_in addr;
+                memset(&addr, 0, sizeof(addr));
+                addr.sin_family = AF_INET;
+                memcpy(&addr.sin_addr, rdata, 4);
+                answer.addrs.push_back(std::make_shared<IPv4Address>(addr));
+            } else if(rtype == DNS_AAAA && type == DNS_AAAA && rdlen == 16){
+                sockaddr_in6 addr;
+                memset(&addr, 0, sizeof(addr));
+                addr.sin6_family = AF_INET6;
+                memcpy(&addr.sin6_addr, rdata, 16);
+                answer.addrs.push_back(std::make_shared<IPv6Address>(addr));
+            }
+        } else if(rtype == DNS_SOA){
+            // 负缓存的TTL取SOA记录TTL和minimum中较小的一个(RFC 2308)
+            size_t p = SkipName(data, size, pos);
+            p = p ? SkipName(data, size, p) : 0;
+            if(p && p + 20 <= pos + rdlen){
+                negative_ttl = std::min(negative_ttl, std::min(rttl, Read32(data + p + 16)));
+            }
+        }
+        pos += rdlen;
+    }
+    answer.ttl = answer.addrs.empty() ? negative_ttl : std::min(ttl, g_dns_max_ttl->getValue());
+    answer.done = true;
+    return true;
+}
+
+
+static IPAddress::ptr ParseServer(const std::string& str){
+    IPAddress::ptr addr;
+    size_t pos = str.rfind(':');
+    if(!str.empty() && str[0] == '['){
+        size_t end = str.find(']');
+        if(end != std::string::npos){
+            addr = IPAddress::Create(str.substr(1, end - 1).c_str(), 53);
+            if(addr && end + 1 < str.size() && str[end + 1] == ':'){
+                addr->setPort(atoi(str.c_str() + end + 2));
+            }
+        }
+    } else if(pos != std::string::npos && str.find(':') == pos){
+        addr = IPAddress::Create(str.substr(0, pos).c_str(), atoi(str.c_str() + pos + 1));
+    } else {
+        addr = IPAddress::Create(str.c_str(), 53);
+    }
+    return addr;
+}
+
+
+DnsResolver::DnsResolver()
+    : m_cache(g_dns_cache_size->getValue()){
+    reload();
+}
+
+
+void DnsResolver::reload(){
+    reload(g_dns_hosts_file->getValue(), g_dns_resolv_conf->getValue(), g_dns_servers->getValue());
+}
+
+
+void DnsResolver::reload(const std::string& hosts_file, const std::string& resolv_conf
+        , const std::vector<std::string>& servers){
+    loadHosts(hosts_file);
+    loadResolvConf(resolv_conf);
+
+    if(!servers.empty()){
+        std::vector<IPAddress::ptr> addrs;
+        for(auto& i : servers){
+            auto addr = ParseServer(i);
+            if(addr){
+                addrs.push_back(addr);
+            } else {
+                CXK_LOG_ERROR(g_logger) << "invalid dns server: " << i;
+            }
+        }
+        RWMutexType::WriteLock lock(m_mutex);
+        m_servers.swap(addrs);
+    }
+    clear();
+}
+
+
+void DnsResolver::loadHosts(const std::string& path){
+    std::unordered_map<std::string, std::vector<IPAddress::ptr>> hosts;
+    std::ifstream ifs(path);
+    std::string line;
+    while(std::getline(ifs, line)){
+        size_t pos = line.find('#');
+        if(pos != std::string::npos){
+            line.resize(pos);
+        }
+        std::istringstream iss(line);
+        std::string ip, name;
+        if(!(iss >> ip)){
+            continue;
+        }
+        // 不用IPAddress::Create, 避免无效行打印错误日志
+        IPAddress::ptr addr;
+        sockaddr_in addr4;
+        sockaddr_in6 addr6;
+        memset(&addr4, 0, sizeof(addr4));
+        memset(&addr6, 0, sizeof(addr6));
+        if(inet_pton(AF_INET, ip.c_str(), &addr4.sin_addr) == 1){
+            addr4.sin_family = AF_INET;
+            addr = std::make_shared<IPv4Address>(addr4);
+        } else if(inet_pton(AF_INET6, ip.c_str(), &addr6.sin6_addr) == 1){
+            addr6.sin6_family = AF_INET6;
+            addr = std::make_shared<IPv6Address>(addr6);
+        } else {
+            continue;
+        }
+        while(iss >> name){
+            hosts[Normalize(name)].push_back(addr);
+        }
+    }
+
+    RWMutexType::WriteLock lock(m_mutex);
+    m_hosts.swap(hosts);
+}
+
+
+void DnsResolver::loadResolvConf(const std::string& path){
+    std::vector<IPAddress::ptr> servers;
+    std::vector<std::string> search;
+    uint32_t ndots = 1;
+
+    std::ifstream ifs(path);
+    std::string line;
+    while(std::getline(ifs, line)){
+        size_t pos = line.find_first_of("#;");
+        if(pos != std::string::npos){
+            line.resize(pos);
+        }
+        std::istringstream iss(line);
+        std::string key, value;
+        if(!(iss >> key)){
+            continue;
+        }
+        if(key == "nameserver"){
+            if(iss >> value){
+                auto addr = ParseServer(value);
+                if(addr){
+                    servers.push_back(addr);
+                }
+            }
+        } else if(key == "search" || key == "domain"){
+            // 后出现的search/domain覆盖前面的
+            search.clear();
+            while(iss >> value){
+                search.push_back(Normalize(value));
+            }
+        } else if(key == "options"){
+            while(iss >> value){
+                if(value.compare(0, 6, "ndots:") == 0){
+                    ndots = std::min(atoi(value.c_str() + 6), 15);
+                }
+            }
+        }
+    }
+
+    RWMutexType::WriteLock lock(m_mutex);
+    m_servers.swap(servers);
+    m_search.swap(search);
+    m_ndots = ndots;
+}
+
+
+void DnsResolver::clear(){
+    m_cache.clear();
+}
+
+
+size_t DnsResolver::getCacheSize(){
+    return m_cache.size();
+}
+
+
+std::vector<IPAddress::ptr> DnsResolver::getServers(){
+    RWMutexType::ReadLock lock(m_mutex);
+    return m_servers;
+}
+
+
+bool DnsResolver::IsAvailable(){
+    if(!g_dns_enable->getValue() || !cxk::is_hook_enable() || !IOManager::GetThis()
+            || Fiber::GetThis().get() == Scheduler::GetMainFiber()){
+        return false;
+    }
+    return !DnsMgr::GetInstance()->getServers().empty();
+}
+
+
+bool DnsResolver::lookupHosts(const std::string& name, int family, std::vector<IPAddress::ptr>& result){
+    RWMutexType::ReadLock lock(m_mutex);
+    auto it = m_hosts.find(name);
+    if(it == m_hosts.end()){
+        return false;
+    }
+    bool found = false;
+    for(auto& i : it->second){
+        if(family == AF_UNSPEC || family == i->getFamily()){
+            result.push_back(i);
+            found = true;
+        }
+    }
+    return found;
+}
+
+
+bool DnsResolver::lookupCache(const std::string& key, Entry& entry){
+    if(!m_cache.get(key, entry)){
+        return false;
+    }
+    return entry.expire > GetCurrentMS();
+}
+
+
+std::vector<std::string> DnsResolver::candidates(const std::string& name){
+    RWMutexType::ReadLock lock(m_mutex);
+    std::vector<std::string> names;
+    if(m_search.empty()){
+        names.push_back(name);
+        return names;
+    }
+    // 点的个数达到ndots时先按绝对域名查询, 否则先加search后缀
+    bool absolute = (uint32_t)std::count(name.begin(), name.end(), '.') >= m_ndots;
+    if(absolute){
+        names.push_back(name);
+    }
+    for(auto& i : m_search){
+        names.push_back(name + "." + i);
+    }
+    if(!absolute){
+        names.push_back(name);
+    }
+    return names;
+}
+
+
+bool DnsResolver::query(const std::string& name, int family, Entry& entry){
+    std::vector<uint16_t> types;
+    if(family != AF_INET6){
+        types.push_back(DNS_A);
+    }
+    if(family != AF_INET){
+        types.push_back(DNS_AAAA);
+    }
+
+    static thread_local std::mt19937 s_rand(std::random_device{}());
+    std::vector<uint16_t> ids(types.size());
+    std::vector<std::string> packets(types.size());
+    for(size_t i = 0; i < types.size(); ++i){
+        ids[i] = s_rand();
+        if(!BuildQuery(packets[i], ids[i], name, types[i])){
+            CXK_LOG_ERROR(g_logger) << "dns invalid name: " << name;
+            return false;
+        }
+    }
+
+    std::vector<DnsAnswer> answers(types.size());
+    std::vector<IPAddress::ptr> servers = getServers();
+    uint32_t timeout = g_dns_timeout->getValue();
+    uint32_t attempts = std::max(g_dns_attempts->getValue(), (uint32_t)1);
+    uint8_t buf[1500];
+    size_t remain = types.size();
+
+    for(uint32_t attempt = 0; attempt < attempts && remain; ++attempt){
+        for(auto& server : servers){
+            if(!remain){
+                break;
+            }
+            Socket::ptr sock = Socket::CreateUDP(server);
+            for(size_t i = 0; i < types.size(); ++i){
+                if(!answers[i].done){
+                    ++m_queries;
+                    sock->sendto(packets[i].c_str(), packets[i].size(), server);
+                }
+            }
+            Address::ptr from = Address::Create(server->getAddr(), server->getAddrLen());
+            uint64_t deadline = GetCurrentMS() + timeout;
+            while(remain){
+                uint64_t now = GetCurrentMS();
+                if(now >= deadline){
+                    break;
+                }
+                sock->setRecvTimeout(deadline - now);
+                int rt = sock->recvfrom(buf, sizeof(buf), from);
+                if(rt < 0){
+                    break;
+                }
+                if(rt < 12 || *from != *server){
+                    continue;
+                }
+                uint16_t id = Read16(buf);
+                for(size_t i = 0; i < types.size(); ++i){
+                    if(!answers[i].done && ids[i] == id){
+                        if(ParseResponse(buf, rt, types[i], answers[i])){
+                            --remain;
+                        }
+                        break;
+                    }
+                }
+            }
+            sock->close();
+        }
+    }
+
+    bool ok = false;
+    uint32_t ttl = (uint32_t)-1;
+    uint32_t negative_ttl = (uint32_t)-1;
+    for(auto& i : answers){
+        if(!i.done){
+            continue;
+        }
+        ok = true;
+        if(i.addrs.empty()){
+            negative_ttl = std::min(negative_ttl, i.ttl);
+        } else {
+            ttl = std::min(ttl, i.ttl);
+            entry.addrs.insert(entry.addrs.end(), i.addrs.begin(), i.addrs.end());
+        }
+    }
+    if(!ok){
+        CXK_LOG_ERROR(g_logger) << "dns query " << name << " timeout, servers=" << servers.size();
+        return false;
+    }
+    entry.expire = GetCurrentMS() + (uint64_t)(entry.addrs.empty() ? negative_ttl : ttl) * 1000;
+    return true;
+}
+
+
+bool DnsResolver::resolve(const std::string& name, int family, std::vector<IPAddress::ptr>& result){
+    std::string host = Normalize(name);
+    if(host.empty()){
+        return false;
+    }
+    if(lookupHosts(host, family, result)){
+        return true;
+    }
+
+    std::string key = host + "/" + std::to_string(family);
+    Entry entry;
+    if(lookupCache(key, entry)){
+        result.insert(result.end(), entry.addrs.begin(), entry.addrs.end());
+        return !entry.addrs.empty();
+    }
+
+    // 同一个域名的并发查询合并成一次, 后来的协程等待第一个协程的结果
+    std::shared_ptr<Pending> pending;
+    bool leader = false;
+    {
+        MutexType::Lock lock(m_pendingMutex);
+        auto& p = m_pending[key];
+        if(!p){
+            p = std::make_shared<Pending>();
+            leader = true;
+        }
+        pending = p;
+    }
+
+    if(!leader){
+        bool wait = false;
+        {
+            MutexType::Lock lock(pending->mutex);
+            if(!pending->done){
+                pending->waiters.push_back(Pending::Waiter{Scheduler::GetThis(), Fiber::GetThis(), cxk::getThreadId()});
+                wait = true;
+            }
+        }
+        if(wait){
+            Fiber::YieldToHold();
+        }
+        result.insert(result.end(), pending->entry.addrs.begin(), pending->entry.addrs.end());
+        return !pending->entry.addrs.empty();
+    }
+
+    bool ok = false;
+    for(auto& i : candidates(host)){
+        Entry e;
+        if(!query(i, family, e)){
+            continue;
+        }
+        entry = std::move(e);
+        ok = true;
+        if(!entry.addrs.empty()){
+            break;
+        }
+    }
+    if(ok){
+        m_cache.set(key, entry);
+    }
+
+    {
+        MutexType::Lock lock(m_pendingMutex);
+        m_pending.erase(key);
+    }
+    std::vector<Pending::Waiter> waiters;
+    {
+        MutexType::Lock lock(pending->mutex);
+        pending->entry = entry;
+        pending->done = true;
+        waiters.swap(pending->waiters);
+    }
+    for(auto& i : waiters){
+        i.scheduler->schedule(i.fiber, i.thread);
+    }
+
+    result.insert(result.end(), entry.addrs.begin(), entry.addrs.end());
+    return !entry.addrs.empty();
+}
+
+
+}
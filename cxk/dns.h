@@ -0,0 +1,123 @@
+#pragma once
+
+#include "address.h"
+#include "fiber.h"
+#include "mutex.h"
+#include "scheduler.h"
+#include "Singleton.h"
+#include "ds/lru_cache.h"
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+namespace cxk{
+
+
+/// @brief 在IOManager协程中使用的异步DNS解析
+/// @details 解析顺序: /etc/hosts -> 缓存 -> 通过hook的UDP socket向resolv.conf中的nameserver
+///          查询A/AAAA记录, 等待响应时只挂起当前协程。
+///          结果按记录的TTL缓存; 域名不存在或没有对应记录时按SOA的minimum做负缓存。
+///          同一个域名同时只发出一次查询, 其他协程等待这次查询的结果
+class DnsResolver{
+public:
+    using RWMutexType = RWMutex;
+    using MutexType = Spinlock;
+
+    DnsResolver();
+
+    /// @brief          解析域名
+    /// @param name     域名, 不能是数字形式的IP
+    /// @param family   AF_INET, AF_INET6或AF_UNSPEC
+    /// @param result   解析出的地址, 端口为0
+    /// @return         是否解析到地址
+    /// @pre            IsAvailable()为true
+    bool resolve(const std::string& name, int family, std::vector<IPAddress::ptr>& result);
+
+    /// @brief  按dns.*配置重新读取hosts文件和nameserver, 清空缓存
+    void reload();
+
+    /// @brief              重新读取hosts文件和nameserver, 清空缓存
+    /// @param hosts_file   hosts文件
+    /// @param resolv_conf  resolv.conf文件, 读取nameserver, search/domain和ndots
+    /// @param servers      非空时代替resolv.conf中的nameserver
+    void reload(const std::string& hosts_file, const std::string& resolv_conf
+            , const std::vector<std::string>& servers);
+
+    /// @brief  清空缓存
+    void clear();
+
+    /// @brief  缓存的域名数
+    size_t getCacheSize();
+
+    /// @brief  发出的查询数
+    uint64_t getQueryCount() const { return m_queries;}
+
+    /// @brief  当前使用的nameserver
+    std::vector<IPAddress::ptr> getServers();
+
+    /// @brief  当前线程能否使用DnsResolver(启用且在IOManager的协程中)
+    static bool IsAvailable();
+
+private:
+    /// @brief 缓存项
+    struct Entry{
+        std::vector<IPAddress::ptr> addrs;
+        // 过期时间(ms)
+        uint64_t expire = 0;
+    };
+
+    /// @brief 正在进行的查询, 等待它的协程
+    struct Pending{
+        struct Waiter{
+            Scheduler* scheduler;
+            Fiber::ptr fiber;
+            int thread;
+        };
+        MutexType mutex;
+        bool done = false;
+        std::vector<Waiter> waiters;
+        Entry entry;
+    };
+
+    /// @brief  按resolv.conf的search和ndots展开要查询的域名
+    std::vector<std::string> candidates(const std::string& name);
+
+    /// @brief          向nameserver查询一个域名
+    /// @param name     完整域名
+    /// @param family   AF_INET, AF_INET6或AF_UNSPEC(同时查询A和AAAA)
+    /// @param entry    查询结果, 没有地址时是负缓存
+    /// @return         是否收到了nameserver的有效响应(包括域名不存在)
+    bool query(const std::string& name, int family, Entry& entry);
+
+    /// @brief  查hosts文件
+    bool lookupHosts(const std::string& name, int family, std::vector<IPAddress::ptr>& result);
+
+    /// @brief  查缓存, 过期的项不返回
+    bool lookupCache(const std::string& key, Entry& entry);
+
+    void loadHosts(const std::string& path);
+    void loadResolvConf(const std::string& path);
+
+private:
+    RWMutexType m_mutex;
+    // 域名 -> hosts文件中的地址
+    std::unordered_map<std::string, std::vector<IPAddress::ptr>> m_hosts;
+    std::vector<IPAddress::ptr> m_servers;
+    std::vector<std::string> m_search;
+    uint32_t m_ndots = 1;
+
+    // "域名/family" -> 解析结果
+    ds::LruCache<std::string, Entry> m_cache;
+
+    MutexType m_pendingMutex;
+    std::unordered_map<std::string, std::shared_ptr<Pending>> m_pending;
+
+    std::atomic<uint64_t> m_queries{0};
+};
+
+using DnsMgr = cxk::Singleton<DnsResolver>;
+
+
+}
@@ -69,7 +69,7 @@ public:
         v = it->second->second;
         lock.unlock();
         m_status->incHit();
-        return v;
+        return true;
     }
 
 
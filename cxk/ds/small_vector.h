@@ -0,0 +1,120 @@
+#pragma once
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+
+namespace cxk{
+
+
+namespace ds{
+
+/// @brief 带内联存储的顺序容器, 元素不超过N个时不分配堆内存
+/// @details 只用于可平凡拷贝的小元素(如指针、string_view), 扩容时直接按字节拷贝
+template <class T, size_t N>
+class SmallVector{
+public:
+    static_assert(std::is_trivially_copyable<T>::value, "SmallVector only supports trivially copyable types");
+
+    using value_type = T;
+    using iterator = T*;
+    using const_iterator = const T*;
+
+    SmallVector() {}
+
+    SmallVector(const SmallVector& o){
+        assign(o);
+    }
+
+    SmallVector& operator=(const SmallVector& o){
+        if(this != &o){
+            clear();
+            assign(o);
+        }
+        return *this;
+    }
+
+    ~SmallVector(){
+        if(m_data != m_inline){
+            free(m_data);
+        }
+    }
+
+    void push_back(const T& v){
+        if(m_size == m_capacity){
+            grow(m_capacity * 2);
+        }
+        m_data[m_size++] = v;
+    }
+
+    template<class... Args>
+    T& emplace_back(Args&&... args){
+        push_back(T{std::forward<Args>(args)...});
+        return back();
+    }
+
+    void pop_back() { --m_size; }
+
+    /// @brief 清空元素, 不释放已经分配的内存
+    void clear() { m_size = 0; }
+
+    void reserve(size_t n){
+        if(n > m_capacity){
+            grow(n);
+        }
+    }
+
+    size_t size() const { return m_size; }
+    size_t capacity() const { return m_capacity; }
+    bool empty() const { return m_size == 0; }
+
+    T& operator[](size_t i) { return m_data[i]; }
+    const T& operator[](size_t i) const { return m_data[i]; }
+
+    T& back() { return m_data[m_size - 1]; }
+    const T& back() const { return m_data[m_size - 1]; }
+
+    T* data() { return m_data; }
+    const T* data() const { return m_data; }
+
+    iterator begin() { return m_data; }
+    iterator end() { return m_data + m_size; }
+    const_iterator begin() const { return m_data; }
+    const_iterator end() const { return m_data + m_size; }
+
+private:
+    void grow(size_t n){
+        T* data = (T*)malloc(n * sizeof(T));
+        if(!data){
+            throw std::bad_alloc();
+        }
+        memcpy((void*)data, m_data, m_size * sizeof(T));
+        if(m_data != m_inline){
+            free(m_data);
+        }
+        m_data = data;
+        m_capacity = n;
+    }
+
+    void assign(const SmallVector& o){
+        reserve(o.m_size);
+        memcpy((void*)m_data, o.m_data, o.m_size * sizeof(T));
+        m_size = o.m_size;
+    }
+
+private:
+    T m_inline[N];
+    T* m_data = m_inline;
+    size_t m_size = 0;
+    size_t m_capacity = N;
+};
+
+
+}
+
+
+}
@@ -1,5 +1,6 @@
 #pragma once 
 #include <memory>
+#include <atomic>
 #include "Thread.h"
 #include "iomanager.h"
 #include "Singleton.h"
@@ -34,6 +35,9 @@ public:
     /// @brief  是否关闭
     bool isClose() const {return m_isClosed;}
 
+    /// @brief  标记为已关闭, 在取消句柄上的事件之前调用
+    void setClose() {m_isClosed = true;}
+
 
     /// @brief      设置用户主动设置非阻塞
     /// @param v    是否阻塞
@@ -62,7 +66,7 @@ private:
     bool m_isSocket: 1;
     bool m_sysNoblock: 1;       // 是否hook非阻塞
     bool m_userNoblock: 1;      // 是否用户主动设置非阻塞
-    bool m_isClosed: 1;
+    std::atomic<bool> m_isClosed;   // close时在其他线程设置
     int m_fd;
     
     uint64_t m_recvTimeOut;
@@ -170,7 +170,8 @@ void Fiber::YieldToReady(){
     //协程切换到后台，并设置为Hold状态
 void Fiber::YieldToHold(){
     Fiber::ptr cur = Fiber::GetThis();
-    cur->m_state = HOLD;
+    // 保持EXEC直到切出完成, 由调度器设置为HOLD。
+    // 否则协程在切出前被其他线程唤醒(IO事件、notify), 会同时在两个线程上执行
     cur->swapOut();
 }
 
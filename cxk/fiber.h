@@ -79,7 +79,7 @@ public:
 
 
     /// @brief  将当前协程切换到后台，并设置为HOLD状态
-    /// @post   getState() = HOLD
+    /// @post   切出后由调度器设置 getState() = HOLD
     static void YieldToHold();
 
     /// @brief  返回当前协程的总数量
@@ -7,6 +7,7 @@
 #include <netinet/in.h>
 #include <functional>
 #include <sys/socket.h>
+#include <sys/sendfile.h>
 #include "fd_manager.h"
 #include "macro.h"
 #include "config.h"
@@ -35,6 +36,7 @@ static cxk::ConfigVar<int>::ptr g_tcp_connect_timeout =
     XX(send)         \
     XX(sendto)       \
     XX(sendmsg)      \
+    XX(sendfile)     \
     XX(close)        \
     XX(fcntl)        \
     XX(ioctl)        \
@@ -145,6 +147,10 @@ retry:
             }
             return -1;
         } else {
+            // 其他线程的close在addEvent之前执行了cancelAll时, 这个事件不会再被唤醒, 自己取消
+            if(ctx->isClose()){
+                iom->cancelEvent(fd, (cxk::IOManager::Event)(event));
+            }
             cxk::Fiber::YieldToHold();
             if(timer){
                 timer->cancel();
@@ -153,6 +159,11 @@ retry:
                 errno = tinfo->cancelled;
                 return -1;
             }
+            // 句柄已经关闭, fd可能已经被复用
+            if(ctx->isClose()){
+                errno = EBADF;
+                return -1;
+            }
             goto retry;
         }
     }
@@ -392,6 +403,11 @@ ssize_t sendmsg(int sockfd, const struct msghdr *msg, int flags){
 }
 
 
+ssize_t sendfile(int out_fd, int in_fd, off_t *offset, size_t count){
+    return do_io(out_fd, sendfile_f, "sendfile", cxk::IOManager::WRITE, SO_SNDTIMEO, in_fd, offset, count);
+}
+
+
 int close(int fd){
     if(!cxk::t_hook_enable){
         return close_f(fd);
@@ -399,6 +415,8 @@ int close(int fd){
 
     cxk::FdCtx::ptr ctx = cxk::FdMgr::GetInstance()->get(fd);
     if(ctx){
+        // 先标记关闭, 在其他线程中刚要addEvent的协程能够发现并且不再等待
+        ctx->setClose();
         auto iom = cxk::IOManager::GetThis();
         if(iom){
             iom->cancelAll(fd);
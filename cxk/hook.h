@@ -79,6 +79,10 @@ extern sendto_fun sendto_f;
 typedef ssize_t (*sendmsg_fun)(int sockfd, const struct msghdr *msg, int flags);
 extern sendmsg_fun sendmsg_f;
 
+
+typedef ssize_t (*sendfile_fun)(int out_fd, int in_fd, off_t *offset, size_t count);
+extern sendfile_fun sendfile_f;
+
 typedef int (*close_fun)(int fd);
 extern close_fun close_f;
 
@@ -1,5 +1,9 @@
 #include "http.h"
+#include "cxk/block_pool.h"
 #include <sstream>
+#include <charconv>
+#include <time.h>
+#include <unistd.h>
 
 namespace cxk{
 namespace http{
@@ -60,10 +64,89 @@ const char* HttpStatusToString(const HttpStatus& s){
 }
 
 
+// 预先拼好的状态行, 如"HTTP/1.1 200 OK\r\n", 只有1.0和1.1两个版本
+static std::string_view StatusLine(uint8_t version, HttpStatus s){
+    if(version == 0x11){
+        switch(s){
+#define XX(code, name, msg) \
+            case HttpStatus::name: \
+                return "HTTP/1.1 " #code " " #msg "\r\n";
+
+            HTTP_STATUS_MAP(XX);
+#undef XX
+            default:
+                return std::string_view();
+        }
+    } else if(version == 0x10){
+        switch(s){
+#define XX(code, name, msg) \
+            case HttpStatus::name: \
+                return "HTTP/1.0 " #code " " #msg "\r\n";
+
+            HTTP_STATUS_MAP(XX);
+#undef XX
+            default:
+                return std::string_view();
+        }
+    }
+    return std::string_view();
+}
+
+
+static void AppendUint(std::string& buf, uint64_t v){
+    char tmp[24];
+    auto rt = std::to_chars(tmp, tmp + sizeof(tmp), v);
+    buf.append(tmp, rt.ptr - tmp);
+}
+
+
+static void AppendVersion(std::string& buf, uint8_t version){
+    AppendUint(buf, version >> 4);
+    buf.push_back('.');
+    AppendUint(buf, version & 0x0F);
+}
+
+
+static void AppendHeader(std::string& buf, const std::string& key, const std::string& val){
+    buf.append(key);
+    buf.append(": ", 2);
+    buf.append(val);
+    buf.append("\r\n", 2);
+}
+
+
+// Date头部每秒只格式化一次, 每个线程各缓存一份
+static std::string_view DateLine(){
+    static thread_local time_t s_sec = 0;
+    static thread_local char s_line[64];
+    static thread_local size_t s_length = 0;
+    time_t now = time(0);
+    if(now != s_sec){
+        struct tm tm;
+        gmtime_r(&now, &tm);
+        s_length = strftime(s_line, sizeof(s_line), "date: %a, %d %b %Y %H:%M:%S GMT\r\n", &tm);
+        s_sec = now;
+    }
+    return std::string_view(s_line, s_length);
+}
+
+
 bool CaseInsensitiveLess::operator() (const std::string& lhs, const std::string& rhs) const{
     return strcasecmp(lhs.c_str(), rhs.c_str()) < 0;
 }
 
+// 查找零拷贝解析的头部, 和map一样重复的头部以最后一个为准
+static const HttpRequest::HeaderView* FindHeaderView(const HttpRequest::HeaderViews& views, std::string_view key){
+    for(size_t i = views.size(); i > 0; --i){
+        const HttpRequest::HeaderView& v = views[i - 1];
+        if(v.first.size() == key.size() && strncasecmp(v.first.data(), key.data(), key.size()) == 0){
+            return &v;
+        }
+    }
+    return nullptr;
+}
+
+
 HttpRequest::HttpRequest(uint8_t version, bool close) : m_method(HttpMethod::GET), m_version(version), m_close(close), m_websocket(false), m_path("/"){
 
 } 
@@ -71,11 +154,80 @@ HttpRequest::HttpRequest(uint8_t version, bool close) : m_method(HttpMethod::GET
 
 // 从map中获取key对应的数据
 std::string HttpRequest::getHeader(const std::string& key, const std::string& def) const{
+    if(m_lazy & LAZY_HEADERS){
+        const HeaderView* v = FindHeaderView(m_headerViews, key);
+        return v ? std::string(v->second) : def;
+    }
     auto it = m_headers.find(key);
     return it == m_headers.end() ? def: it->second;
 } 
 
 
+std::string_view HttpRequest::getHeaderView(std::string_view key) const{
+    if(m_lazy & LAZY_HEADERS){
+        const HeaderView* v = FindHeaderView(m_headerViews, key);
+        return v ? v->second : std::string_view();
+    }
+    auto it = m_headers.find(std::string(key));
+    return it == m_headers.end() ? std::string_view() : std::string_view(it->second);
+}
+
+
+void HttpRequest::addHeaderView(std::string_view key, std::string_view val){
+    m_headerViews.push_back(HeaderView{key, val});
+    m_lazy |= LAZY_HEADERS;
+}
+
+
+void HttpRequest::adoptRaw(const char* data, size_t len){
+    // 视图都带长度, 不需要结尾的'\0'; 多分配一个字节会让接近分级大小的请求头落到下一个分级
+    m_raw = BlockPool::GetInstance()->alloc(len);
+    char* raw = m_raw.get();
+    memcpy(raw, data, len);
+
+    auto rebase = [data, len, raw](std::string_view& v){
+        if(v.data() >= data && v.data() + v.size() <= data + len){
+            v = std::string_view(raw + (v.data() - data), v.size());
+        }
+    };
+    rebase(m_pathView);
+    rebase(m_queryView);
+    rebase(m_fragmentView);
+    rebase(m_bodyView);
+    for(auto& i : m_headerViews){
+        rebase(i.first);
+        rebase(i.second);
+    }
+}
+
+
+void HttpRequest::materialize(uint8_t field) const{
+    switch(field){
+        case LAZY_PATH:
+            m_path.assign(m_pathView.data(), m_pathView.size());
+            break;
+        case LAZY_QUERY:
+            m_query.assign(m_queryView.data(), m_queryView.size());
+            break;
+        case LAZY_FRAGMENT:
+            m_fragment.assign(m_fragmentView.data(), m_fragmentView.size());
+            break;
+        case LAZY_BODY:
+            m_body.assign(m_bodyView.data(), m_bodyView.size());
+            break;
+        case LAZY_HEADERS:
+            m_headers.clear();
+            for(auto& i : m_headerViews){
+                m_headers[std::string(i.first)] = std::string(i.second);
+            }
+            break;
+        default:
+            break;
+    }
+    m_lazy &= ~field;
+}
+
+
 std::shared_ptr<HttpResponse> HttpRequest::createResponse(){
     HttpResponse::ptr rsp(new HttpResponse(getVersion(), isClose()));
     return rsp;
@@ -88,6 +240,16 @@ std::string HttpRequest::getParam(const std::string& key, const std::string& def
 }
 
 
+std::string HttpRequest::getRouteParam(std::string_view key, const std::string& def) const{
+    for(auto& i : m_routeParams){
+        if(i.first == key){
+            return i.second;
+        }
+    }
+    return def;
+}
+
+
 std::string HttpRequest::getCookie(const std::string& key, const std::string& def) const{
     auto it = m_cookies.find(key);
     return it == m_cookies.end() ? def: it->second;
@@ -96,6 +258,8 @@ std::string HttpRequest::getCookie(const std::string& key, const std::string& de
 
 
 void HttpRequest::setHeader(const std::string& key, const std::string& val){
+    getHeaders();
+    m_headerViews.clear();
     m_headers[key] = val;
 }
 
@@ -109,6 +273,8 @@ void HttpRequest::setCookie(const std::string& key, const std::string& val){
 }
 
 void HttpRequest::delHeader(const std::string& key){
+    getHeaders();
+    m_headerViews.clear();
     m_headers.erase(key);
 }
 
@@ -126,6 +292,13 @@ void HttpRequest::delCookie(const std::string& key){
 
 // 判断是否存在该键
 bool HttpRequest::hasHeader(const std::string& key, std::string* val){
+    if(m_lazy & LAZY_HEADERS){
+        const HeaderView* v = FindHeaderView(m_headerViews, key);
+        if(v && val){
+            val->assign(v->second.data(), v->second.size());
+        }
+        return v != nullptr;
+    }
     auto it = m_headers.find(key);
     if(it == m_headers.end()){
         return false;
@@ -161,36 +334,46 @@ bool HttpRequest::hasCookie(const std::string& key, std::string* val){
 
 
 std::ostream& HttpRequest::dump(std::ostream& os) const{
-    os << HttpMethodToString(m_method) << " "
-        << m_path
-        << (m_query.empty() ? "" : "?")
-        << m_query
-        << (m_fragment.empty() ? "" : "#")
-        << m_fragment
-        << " HTTP/"
-        << ((uint32_t) (m_version >> 4))
-        << "."
-        << ((uint32_t)(m_version & 0x0F))
-        << "\r\n";
+    std::string buf;
+    serializeHeader(buf);
+    return os << buf << getBodyView();
+}
+
+
+void HttpRequest::serializeHeader(std::string& buf) const{
+    std::string_view query = getQueryView();
+    std::string_view fragment = getFragmentView();
+    buf.append(HttpMethodToString(m_method)).push_back(' ');
+    buf.append(getPathView());
+    if(!query.empty()){
+        buf.push_back('?');
+        buf.append(query);
+    }
+    if(!fragment.empty()){
+        buf.push_back('#');
+        buf.append(fragment);
+    }
+    buf.append(" HTTP/");
+    AppendVersion(buf, m_version);
+    buf.append("\r\n");
 
     if(!m_websocket){
-        os << "connection: " << (m_close ? "close" : "keep-alive") << "\r\n";
+        buf.append(m_close ? "connection: close\r\n" : "connection: keep-alive\r\n");
     }
-    for(auto& i : m_headers){
+    for(auto& i : getHeaders()){
         if(!m_websocket && strcasecmp(i.first.c_str(), "connection") == 0){
             continue;
         }
-        os << i.first << ": " << i.second << "\r\n";
+        AppendHeader(buf, i.first, i.second);
     }
 
-    if(!m_body.empty()){
-        os << "content-length: " << m_body.size() << "\r\n\r\n"
-            << m_body;
-    } else {
-        os << "\r\n";
+    std::string_view body = getBodyView();
+    if(!body.empty()){
+        buf.append("content-length: ");
+        AppendUint(buf, body.size());
+        buf.append("\r\n");
     }
-
-    return os;
+    buf.append("\r\n");
 }
 
 
@@ -200,6 +383,13 @@ std::string HttpRequest::toString() const{
     return ss.str();
 }
 
+HttpFileBody::~HttpFileBody(){
+    if(m_fd >= 0){
+        ::close(m_fd);
+    }
+}
+
+
  HttpResponse::HttpResponse(uint8_t version, bool close):m_status(HttpStatus::OK), m_version(version), m_close(close), m_websocket(false){
 
  }
@@ -222,35 +412,73 @@ void HttpResponse::delHeader(const std::string& key){
 
 
 std::ostream& HttpResponse::dump(std::ostream& os) const{
-    os << "HTTP/"
-        << ((uint32_t) (m_version >> 4))
-        << "."
-        << ((uint32_t)(m_version & 0x0F))
-        << " "
-        <<(uint32_t) m_status
-        << " "
-        << (m_reason.empty() ? HttpStatusToString(m_status) : m_reason)
-        << "\r\n";
+    return dumpHeader(os) << getBody();
+}
+
+
+std::ostream& HttpResponse::dumpHeader(std::ostream& os) const{
+    std::string buf;
+    serializeHeader(buf);
+    return os << buf;
+}
+
+
+void HttpResponse::serializeHeader(std::string& buf) const{
+    std::string_view line = m_reason.empty() ? StatusLine(m_version, m_status) : std::string_view();
+    if(!line.empty()){
+        buf.append(line);
+    } else {
+        buf.append("HTTP/");
+        AppendVersion(buf, m_version);
+        buf.push_back(' ');
+        AppendUint(buf, (uint32_t)m_status);
+        buf.push_back(' ');
+        buf.append(m_reason.empty() ? HttpStatusToString(m_status) : m_reason.c_str());
+        buf.append("\r\n");
+    }
 
+    bool has_date = false;
+    bool has_length = false;
+    bool has_encoding = false;
     for(auto& i : m_headers){
-        if(!m_websocket && strcasecmp(i.first.c_str(), "connection") == 0){
-            continue;
+        const char* key = i.first.c_str();
+        if(strcasecmp(key, "connection") == 0){
+            if(!m_websocket){
+                continue;
+            }
+        } else if(strcasecmp(key, "date") == 0){
+            has_date = true;
+        } else if(strcasecmp(key, "content-length") == 0){
+            has_length = true;
+        } else if(strcasecmp(key, "transfer-encoding") == 0){
+            has_encoding = true;
         }
-        os << i.first << ": " << i.second << "\r\n";
+        AppendHeader(buf, i.first, i.second);
+    }
+    if(!has_date){
+        buf.append(DateLine());
     }
 
     if(!m_websocket){
-        os << "connection: " << (m_close ? "close" : "keep-alive") << "\r\n";
+        buf.append(m_close ? "connection: close\r\n" : "connection: keep-alive\r\n");
     }
 
-    if(!m_body.empty()){
-        os << "content-length: " << m_body.size() << "\r\n\r\n"
-            << m_body;
-    } else {
-        os << "\r\n";
+    // chunked发送时不能带content-length
+    if(m_fileBody){
+        buf.append("content-length: ");
+        AppendUint(buf, m_fileBody->getLength());
+        buf.append("\r\n");
+    } else if(!getBody().empty() && !has_encoding){
+        buf.append("content-length: ");
+        AppendUint(buf, getBody().size());
+        buf.append("\r\n");
+    } else if(getBody().empty() && !m_bodyWriter && !m_websocket && (uint32_t)m_status >= 200
+            && m_status != HttpStatus::NO_CONTENT && m_status != HttpStatus::NOT_MODIFIED
+            && !has_encoding && !has_length){
+        // 长连接上没有响应体也要说明长度, 否则对方会一直等到连接关闭
+        buf.append("content-length: 0\r\n");
     }
-
-    return os;    
+    buf.append("\r\n");
 }
 
 std::string HttpResponse::toString() const{
@@ -2,9 +2,14 @@
 #include <string>
 #include <iostream>
 #include <map>
+#include <vector>
 #include <memory>
+#include <functional>
 #include <boost/lexical_cast.hpp>
 #include <sstream>
+#include <string_view>
+#include "cxk/ds/small_vector.h"
+#include "cxk/stream.h"
 #include "http11_common.h"
 #include "http11_parser.h"
 #include "httpclient_parser.h"
@@ -225,6 +230,14 @@ class HttpRequest{
 public:
     using ptr = std::shared_ptr<HttpRequest>;
     using MapType = std::map<std::string, std::string, CaseInsensitiveLess>;
+    /// @brief  零拷贝解析时的头部, 名字和值指向接收缓冲
+    struct HeaderView{
+        std::string_view first;
+        std::string_view second;
+    };
+    using HeaderViews = cxk::ds::SmallVector<HeaderView, 16>;
+    /// @brief  路由匹配到的路径参数, 参数名 -> 值
+    using RouteParams = std::vector<std::pair<std::string, std::string>>;
 
     /// @brief          构造函数
     /// @param version  版本
@@ -243,17 +256,77 @@ public:
     HttpStatus getStatus() const {return m_status;}
 
     /// @brief  获取请求路径
-    const std::string& getPath() const { return m_path;}
+    const std::string& getPath() const {
+        if(m_lazy & LAZY_PATH) materialize(LAZY_PATH);
+        return m_path;
+    }
 
     /// @brief  返回HTTP请求的查询参数
-    const std::string& getQuery() const { return m_query;}
+    const std::string& getQuery() const {
+        if(m_lazy & LAZY_QUERY) materialize(LAZY_QUERY);
+        return m_query;
+    }
+
+    /// @brief  返回HTTP请求的Fragment
+    const std::string& getFragment() const {
+        if(m_lazy & LAZY_FRAGMENT) materialize(LAZY_FRAGMENT);
+        return m_fragment;
+    }
 
     /// @brief  返回HTTP请求的消息体
-    const std::string& getBody() const { return m_body;}
+    const std::string& getBody() const {
+        if(m_lazy & LAZY_BODY) materialize(LAZY_BODY);
+        return m_body;
+    }
 
 
     /// @brief  返回HTTP请求的头部
-    const MapType& getHeaders() const {return m_headers;}
+    const MapType& getHeaders() const {
+        if(m_lazy & LAZY_HEADERS) materialize(LAZY_HEADERS);
+        return m_headers;
+    }
+
+    /// @brief  请求路径, 零拷贝解析的请求不生成std::string
+    std::string_view getPathView() const { return (m_lazy & LAZY_PATH) ? m_pathView : std::string_view(m_path); }
+
+    /// @brief  查询参数, 零拷贝解析的请求不生成std::string
+    std::string_view getQueryView() const { return (m_lazy & LAZY_QUERY) ? m_queryView : std::string_view(m_query); }
+
+    /// @brief  Fragment, 零拷贝解析的请求不生成std::string
+    std::string_view getFragmentView() const { return (m_lazy & LAZY_FRAGMENT) ? m_fragmentView : std::string_view(m_fragment); }
+
+    /// @brief  消息体, 零拷贝解析的请求不生成std::string
+    std::string_view getBodyView() const { return (m_lazy & LAZY_BODY) ? m_bodyView : std::string_view(m_body); }
+
+    /// @brief  零拷贝解析的头部, 头部被修改或者不是零拷贝解析时为空
+    const HeaderViews& getHeaderViews() const { return m_headerViews; }
+
+    /// @brief      获取头部的值, 不拷贝
+    /// @param key  关键字, 不区分大小写
+    /// @return     不存在返回空, 在请求被修改或者释放前有效
+    std::string_view getHeaderView(std::string_view key) const;
+
+    /// @brief  是否是零拷贝解析的请求, 字段指向请求持有的接收缓冲
+    bool isZeroCopy() const { return m_raw != nullptr; }
+
+    /// @brief  路由匹配到的路径参数, 如路由"/users/:id"中的id
+    const RouteParams& getRouteParams() const { return m_routeParams; }
+
+    /// @brief      获取路径参数
+    /// @param key  参数名
+    /// @param def  默认值
+    /// @return     如果存在则返回对应值，否则返回默认值
+    std::string getRouteParam(std::string_view key, const std::string& def = "") const;
+
+    /// @brief  设置路径参数, 由ServletDispatch匹配路由后设置
+    void setRouteParams(RouteParams&& v) { m_routeParams = std::move(v); }
+
+    /// @brief  流式读取的请求体, 只有声明了流式请求体的servlet才会拿到, 否则为空
+    /// @details 读到的是解除chunked编码后的原始数据(不解压), 返回0表示请求体已经读完
+    Stream::ptr getBodyStream() const { return m_bodyStream; }
+
+    /// @brief  设置流式读取的请求体, 由HttpSession接收请求时设置
+    void setBodyStream(Stream::ptr v) { m_bodyStream = v; }
     
     /// @brief  返回HTTP请求的参数MAP
     const MapType& getParams() const {return m_params;}
@@ -274,19 +347,35 @@ public:
     void setVersion(uint8_t v) { m_version = v;}
 
     /// @brief  设置请求路径
-    void setPath(const std::string& v) { m_path = v;}
+    void setPath(const std::string& v) { m_path = v; m_lazy &= ~LAZY_PATH;}
     
     /// @brief  设置请求路径的查询参数
-    void setQuery(const std::string& v) { m_query = v;}
+    void setQuery(const std::string& v) { m_query = v; m_lazy &= ~LAZY_QUERY;}
 
     /// @brief  设置请求的Fragment
-    void setFragment(const std::string& v) { m_fragment = v;}
+    void setFragment(const std::string& v) { m_fragment = v; m_lazy &= ~LAZY_FRAGMENT;}
 
     /// @brief  设置请求的body
-    void setBody(const std::string& v) {m_body = v;}
+    void setBody(const std::string& v) {m_body = v; m_lazy &= ~LAZY_BODY;}
+
+    /// @brief  设置请求的body, 不拷贝数据
+    void setBody(std::string&& v) {m_body = std::move(v); m_lazy &= ~LAZY_BODY;}
 
     /// @brief  设置HTTP请求的头部
-    void setHeaders(const MapType& v) {m_headers = v;}
+    void setHeaders(const MapType& v) {m_headers = v; m_headerViews.clear(); m_lazy &= ~LAZY_HEADERS;}
+
+    /// @brief      零拷贝解析: 记录指向接收缓冲的字段, 由adoptRaw把缓冲交给请求
+    void setPathView(std::string_view v) { m_pathView = v; m_lazy |= LAZY_PATH;}
+    void setQueryView(std::string_view v) { m_queryView = v; m_lazy |= LAZY_QUERY;}
+    void setFragmentView(std::string_view v) { m_fragmentView = v; m_lazy |= LAZY_FRAGMENT;}
+    void setBodyView(std::string_view v) { m_bodyView = v; m_lazy |= LAZY_BODY;}
+    void addHeaderView(std::string_view key, std::string_view val);
+
+    /// @brief      把零拷贝解析的数据拷贝到请求持有的缓冲中, 所有的view重新指向这个缓冲
+    /// @param data 解析时的数据, 各个view都指向其中
+    /// @param len  数据长度, 包括请求头和已经收到的请求体
+    /// @details    接收缓冲会被后面的请求覆盖, 这里整块拷贝一次, 代替每个字段单独分配
+    void adoptRaw(const char* data, size_t len);
     
     /// @brief  设置HTTP请求的参数
     void setParams(const MapType& v) {m_params = v;}
@@ -375,7 +464,7 @@ public:
     /// @return     如果存在且转换成功，则返回true，否则返回false
     template<class T>
     bool checkGetHeaderAs(const std::string& key, T& val, const T& def = T()){
-        return checkGetAs(m_headers, key, val, def);
+        return checkGetAs(getHeaders(), key, val, def);
     }
 
 
@@ -386,7 +475,7 @@ public:
     /// @return     如果存在则返回对应值，否则返回默认值def
     template<class T>
     T getHeaderAs(const std::string& key, const T& def = T()){
-        return getAs(m_headers, key, def);
+        return getAs(getHeaders(), key, def);
     }
 
 
@@ -440,11 +529,26 @@ public:
     /// @return     输出流
     std::ostream& dump(std::ostream& os) const;
 
+    /// @brief      把请求行和头部(包含结尾的空行)追加到buf末尾, 不输出body
+    /// @param buf  输出缓冲区, 连接上复用同一个, 避免每次分配
+    void serializeHeader(std::string& buf) const;
+
     /// @brief      转成字符串
     /// @return     字符串
     std::string toString() const ;
 
 private:
+    // 还只有view, 需要时才生成std::string的字段
+    enum LazyField{
+        LAZY_PATH = 1,
+        LAZY_QUERY = 2,
+        LAZY_FRAGMENT = 4,
+        LAZY_BODY = 8,
+        LAZY_HEADERS = 16
+    };
+
+    /// @brief  由view生成字段
+    void materialize(uint8_t field) const;
 
 
 private:
@@ -455,24 +559,69 @@ private:
 
     bool m_websocket;     // 是否是websocket
 
-    std::string m_path;
-    std::string m_query;
-    std::string m_fragment;
-    std::string m_body;
+    // 零拷贝解析的字段按需生成
+    mutable uint8_t m_lazy = 0;
 
-    MapType m_headers;
+    mutable std::string m_path;
+    mutable std::string m_query;
+    mutable std::string m_fragment;
+    mutable std::string m_body;
+
+    mutable MapType m_headers;
     MapType m_params;
     MapType m_cookies;
+    RouteParams m_routeParams;
+
+    // 零拷贝解析时持有的接收缓冲
+    std::shared_ptr<char> m_raw;
+    std::string_view m_pathView;
+    std::string_view m_queryView;
+    std::string_view m_fragmentView;
+    std::string_view m_bodyView;
+    HeaderViews m_headerViews;
+
+    // 还没有读取的请求体
+    Stream::ptr m_bodyStream;
 };
 
 
 
+/// @brief  响应体引用的文件区间
+/// @details 发送时用sendfile从文件直接写到socket, 不读入内存; 析构时关闭文件
+class HttpFileBody{
+public:
+    using ptr = std::shared_ptr<HttpFileBody>;
+
+    /// @brief          构造函数
+    /// @param fd       已经打开的文件, 由HttpFileBody关闭
+    /// @param offset   起始偏移
+    /// @param length   长度
+    HttpFileBody(int fd, uint64_t offset, uint64_t length)
+        : m_fd(fd), m_offset(offset), m_length(length){}
+
+    ~HttpFileBody();
+
+    int getFd() const { return m_fd;}
+    uint64_t getOffset() const { return m_offset;}
+    uint64_t getLength() const { return m_length;}
+
+    /// @brief          只发送文件的一段, 用于Range请求
+    void setRange(uint64_t offset, uint64_t length) { m_offset = offset; m_length = length;}
+
+private:
+    int m_fd;
+    uint64_t m_offset;
+    uint64_t m_length;
+};
+
+
 /// @brief  HTTP响应结构体
 class HttpResponse{
 public:
     using ptr = std::shared_ptr<HttpResponse>;
     using MapType = std::map<std::string, std::string, CaseInsensitiveLess> ;
-
+    /// @brief  流式写出响应体的回调, out是响应体的输出流
+    using BodyWriter = std::function<int32_t(Stream::ptr out)>;
 
     /// @brief          构造函数
     /// @param version  HTTP协议版本
@@ -488,8 +637,8 @@ public:
     uint8_t getVersion() const { return m_version;}
 
     /// @brief  返回响应内容消息体
-    /// @return 响应内容
-    const std::string& getBody() const { return m_body;}
+    /// @return 响应内容, 设置了共享的消息体时返回共享的内容
+    const std::string& getBody() const { return m_sharedBody ? *m_sharedBody : m_body;}
 
     /// @brief  返回响应原因
     const std::string& getReason() const { return m_reason;}
@@ -509,7 +658,30 @@ public:
 
     /// @brief      设置响应消息体
     /// @param v    响应内容
-    void setBody(const std::string& v) { m_body = v;}
+    void setBody(const std::string& v) { m_body = v; m_sharedBody.reset();}
+
+    /// @brief      设置响应消息体
+    /// @param v    响应内容
+    void setBody(std::string&& v) { m_body = std::move(v); m_sharedBody.reset();}
+
+    /// @brief      设置共享的响应消息体, 不拷贝内容
+    /// @details    用于缓存中的内容, 发送完之前由响应持有引用, 内容不能再修改
+    /// @param v    响应内容
+    void setSharedBody(std::shared_ptr<const std::string> v) { m_sharedBody = std::move(v);}
+
+    /// @brief      设置流式写出响应体的回调, 设置后忽略body
+    /// @details    发送响应头后调用, 写到out的数据用chunked编码(按Accept-Encoding压缩)发出,
+    ///             响应体的大小不需要事先知道, 也不需要完整地放在内存中。返回非0表示出错, 连接会被关闭
+    void setBodyWriter(BodyWriter v) { m_bodyWriter = std::move(v);}
+
+    /// @brief      流式写出响应体的回调
+    const BodyWriter& getBodyWriter() const { return m_bodyWriter;}
+
+    /// @brief      设置来自文件的响应体, 设置后忽略body, content-length为文件区间的长度
+    void setFileBody(HttpFileBody::ptr v) { m_fileBody = v;}
+
+    /// @brief      来自文件的响应体
+    HttpFileBody::ptr getFileBody() const { return m_fileBody;}
 
     /// @brief      设置响应原因
     /// @param v    响应原因
@@ -573,6 +745,16 @@ public:
     /// @return     输出流
     std::ostream& dump(std::ostream& os)const;
 
+    /// @brief      序列化响应行和头部(包含结尾的空行), 不输出body
+    /// @param os   输出流
+    /// @return     输出流
+    std::ostream& dumpHeader(std::ostream& os) const;
+
+    /// @brief      把响应行和头部(包含结尾的空行)追加到buf末尾, 不输出body
+    /// @details    状态行预先拼好, 没有设置Date头部时加上每秒缓存一次的Date, 数字不经过iostream格式化
+    /// @param buf  输出缓冲区, 连接上复用同一个, 避免每次分配
+    void serializeHeader(std::string& buf) const;
+
     /// @brief      转换为字符串
     std::string toString() const ;
 private:
@@ -583,9 +765,13 @@ private:
     bool m_websocket;
 
     std::string m_body;
+    std::shared_ptr<const std::string> m_sharedBody;
     std::string m_reason;
     
     MapType m_headers;
+
+    BodyWriter m_bodyWriter;
+    HttpFileBody::ptr m_fileBody;
 };
 
 
@@ -0,0 +1,683 @@
+#include "http_client.h"
+#include "cxk/config.h"
+#include "cxk/hook.h"
+#include "cxk/logger.h"
+#include "cxk/util.h"
+#include <algorithm>
+#include <errno.h>
+#include <sys/socket.h>
+
+
+namespace cxk{
+namespace http{
+
+static cxk::Logger::ptr g_logger = CXK_LOG_NAME("system");
+
+static cxk::ConfigVar<uint32_t>::ptr g_http_client_max_connections =
+    cxk::Config::Lookup("http.client.max_connections", (uint32_t)16, "http client max connections per host");
+
+static cxk::ConfigVar<uint32_t>::ptr g_http_client_max_pipeline =
+    cxk::Config::Lookup("http.client.max_pipeline", (uint32_t)1, "http client max in-flight requests per connection");
+
+static cxk::ConfigVar<uint32_t>::ptr g_http_client_max_pending =
+    cxk::Config::Lookup("http.client.max_pending", (uint32_t)10000, "http client max requests waiting for a connection per host");
+
+static cxk::ConfigVar<uint32_t>::ptr g_http_client_max_idle_time =
+    cxk::Config::Lookup("http.client.max_idle_time", (uint32_t)30000, "http client idle connection timeout ms");
+
+static cxk::ConfigVar<uint32_t>::ptr g_http_client_max_alive_time =
+    cxk::Config::Lookup("http.client.max_alive_time", (uint32_t)120000, "http client connection max alive time ms");
+
+static cxk::ConfigVar<uint32_t>::ptr g_http_client_max_request =
+    cxk::Config::Lookup("http.client.max_request", (uint32_t)1000, "http client max requests per connection");
+
+static cxk::ConfigVar<uint32_t>::ptr g_http_client_connect_timeout =
+    cxk::Config::Lookup("http.client.connect_timeout", (uint32_t)3000, "http client connect timeout ms");
+
+static cxk::ConfigVar<uint32_t>::ptr g_http_client_check_interval =
+    cxk::Config::Lookup("http.client.check_interval", (uint32_t)5000, "http client idle connection check interval ms");
+
+
+HttpResult::ptr HttpFuture::get(){
+    Semaphore sem;
+    // 调度协程不能挂起, 和普通线程一样阻塞等待
+    bool in_fiber = Scheduler::GetThis() && Fiber::GetThis().get() != Scheduler::GetMainFiber();
+    {
+        MutexType::Lock lock(m_mutex);
+        if(m_result){
+            return m_result;
+        }
+        if(in_fiber){
+            m_fibers.push_back(Waiter{Scheduler::GetThis(), Fiber::GetThis(), cxk::getThreadId()});
+        } else {
+            m_sems.push_back(&sem);
+        }
+    }
+    if(in_fiber){
+        Fiber::YieldToHold();
+    } else {
+        sem.wait();
+    }
+    MutexType::Lock lock(m_mutex);
+    return m_result;
+}
+
+
+bool HttpFuture::isReady(){
+    MutexType::Lock lock(m_mutex);
+    return m_result != nullptr;
+}
+
+
+void HttpFuture::set(HttpResult::ptr result){
+    std::vector<Waiter> fibers;
+    std::vector<Semaphore*> sems;
+    {
+        MutexType::Lock lock(m_mutex);
+        if(m_result){
+            return;
+        }
+        m_result = result;
+        fibers.swap(m_fibers);
+        sems.swap(m_sems);
+    }
+    for(auto& i : fibers){
+        i.scheduler->schedule(i.fiber, i.thread);
+    }
+    for(auto i : sems){
+        i->notify();
+    }
+}
+
+
+std::vector<HttpResult::ptr> HttpFuture::WaitAll(const std::vector<HttpFuture::ptr>& futures){
+    std::vector<HttpResult::ptr> results;
+    results.reserve(futures.size());
+    for(auto& i : futures){
+        results.push_back(i->get());
+    }
+    return results;
+}
+
+
+HttpClientPool::Options::Options()
+    : max_connections(g_http_client_max_connections->getValue())
+    , max_pipeline(g_http_client_max_pipeline->getValue())
+    , max_pending(g_http_client_max_pending->getValue())
+    , max_idle_time(g_http_client_max_idle_time->getValue())
+    , max_alive_time(g_http_client_max_alive_time->getValue())
+    , max_request(g_http_client_max_request->getValue())
+    , connect_timeout(g_http_client_connect_timeout->getValue())
+    , check_interval(g_http_client_check_interval->getValue()){
+}
+
+
+HttpClientPool::HttpClientPool(const std::string& host, uint32_t port, bool is_https
+        , const Options& options, IOManager* iom)
+    : m_host(host)
+    , m_port(port ? port : (is_https ? 443 : 80))
+    , m_isHttps(is_https)
+    , m_options(options)
+    , m_iom(iom ? iom : IOManager::GetThis()){
+    m_options.max_connections = std::max(m_options.max_connections, 1u);
+    m_options.max_pipeline = std::max(m_options.max_pipeline, 1u);
+    m_options.max_request = std::max(m_options.max_request, 1u);
+}
+
+
+HttpClientPool::~HttpClientPool(){
+    if(m_timer){
+        m_timer->cancel();
+    }
+    for(auto& i : m_conns){
+        if(i->conn){
+            i->conn->close();
+        }
+    }
+}
+
+
+HttpFuture::ptr HttpClientPool::request(HttpMethod method, const std::string& path, uint64_t timeout_ms
+        , const std::map<std::string, std::string>& headers, const std::string& body){
+    HttpRequest::ptr req = std::make_shared<HttpRequest>();
+    size_t pos = path.find_first_of("?#");
+    req->setPath(path.substr(0, pos));
+    if(pos != std::string::npos){
+        size_t frag = path.find('#', pos);
+        if(path[pos] == '?'){
+            req->setQuery(path.substr(pos + 1, frag == std::string::npos ? std::string::npos : frag - pos - 1));
+        }
+        if(frag != std::string::npos){
+            req->setFragment(path.substr(frag + 1));
+        }
+    }
+    req->setMethod(method);
+    req->setClose(false);
+    for(auto& i : headers){
+        if(strcasecmp(i.first.c_str(), "connection") == 0){
+            req->setClose(strcasecmp(i.second.c_str(), "close") == 0);
+            continue;
+        }
+        req->setHeader(i.first, i.second);
+    }
+    req->setBody(body);
+    return request(req, timeout_ms);
+}
+
+
+HttpFuture::ptr HttpClientPool::request(HttpRequest::ptr req, uint64_t timeout_ms){
+    HttpFuture::ptr future = std::make_shared<HttpFuture>();
+    if(!m_iom){
+        future->set(std::make_shared<HttpResult>((int)HttpResult::Error::POOL_GET_CONNECTION
+                    , nullptr, "http client pool without iomanager: " + m_host));
+        return future;
+    }
+    if(req->getHeader("Host").empty()){
+        bool default_port = m_port == (m_isHttps ? 443u : 80u);
+        req->setHeader("Host", default_port ? m_host : m_host + ":" + std::to_string(m_port));
+    }
+
+    std::vector<Connection::ptr> to_connect;
+    std::vector<Connection::ptr> to_write;
+    {
+        MutexType::Lock lock(m_mutex);
+        if(m_waiting.size() >= m_options.max_pending){
+            lock.unlock();
+            future->set(std::make_shared<HttpResult>((int)HttpResult::Error::POOL_GET_CONNECTION
+                        , nullptr, "too many pending requests: " + m_host));
+            return future;
+        }
+        if(!m_timer && m_options.check_interval){
+            // 定时器不持有连接池, 连接池释放后不再触发
+            m_timer = m_iom->addConditionTimer(m_options.check_interval
+                    , std::bind(&HttpClientPool::checkIdle, this), weak_from_this(), true);
+        }
+        Task task{req, future, timeout_ms, nullptr};
+        if(timeout_ms && timeout_ms != ~0ull){
+            task.timer = m_iom->addConditionTimer(timeout_ms
+                    , std::bind(&HttpClientPool::expire, this, future, timeout_ms), weak_from_this());
+        }
+        m_waiting.push_back(std::move(task));
+        assign(to_connect, to_write);
+    }
+    start(to_connect, to_write);
+    return future;
+}
+
+
+void HttpClientPool::assign(std::vector<Connection::ptr>& to_connect, std::vector<Connection::ptr>& to_write){
+    uint64_t now = cxk::GetCurrentMS();
+    while(!m_waiting.empty()){
+        Connection::ptr best;
+        for(auto it = m_conns.begin(); it != m_conns.end();){
+            auto& c = *it;
+            if(c->requests >= m_options.max_request || c->createTime + m_options.max_alive_time <= now
+                    || c->load() >= m_options.max_pipeline){
+                ++it;
+                continue;
+            }
+            // 复用空闲连接前探测一下, 对方可能已经关闭了它
+            if(c->load() == 0 && !c->connecting && !IsAlive(c)){
+                c->closed = true;
+                c->conn->close();
+                it = m_conns.erase(it);
+                continue;
+            }
+            if(!best || c->load() < best->load()){
+                best = c;
+            }
+            ++it;
+        }
+        if(!best || (best->load() > 0 && m_conns.size() < m_options.max_connections)){
+            // 没有空闲连接时优先新建连接, 而不是排在在途请求后面
+            if(m_conns.size() < m_options.max_connections){
+                best = std::make_shared<Connection>();
+                best->createTime = now;
+                best->activeTime = now;
+                m_conns.push_back(best);
+                to_connect.push_back(best);
+            }
+        }
+        if(!best){
+            break;
+        }
+        best->pending.push_back(std::move(m_waiting.front()));
+        m_waiting.pop_front();
+        ++best->requests;
+        if(!best->connecting && !best->writing){
+            best->writing = true;
+            to_write.push_back(best);
+        }
+    }
+}
+
+
+void HttpClientPool::start(const std::vector<Connection::ptr>& to_connect, const std::vector<Connection::ptr>& to_write){
+    auto self = shared_from_this();
+    for(auto& i : to_connect){
+        m_iom->schedule(std::bind(&HttpClientPool::doConnect, self, i));
+    }
+    for(auto& i : to_write){
+        m_iom->schedule(std::bind(&HttpClientPool::doWrite, self, i));
+    }
+}
+
+
+void HttpClientPool::doConnect(Connection::ptr c){
+    IPAddress::ptr addr = Address::LookupAnyIpAddr(m_host);
+    if(!addr){
+        fail(c, HttpResult::Error::INVALID_HOST, "get addr fail: " + m_host);
+        return;
+    }
+    addr->setPort(m_port);
+    Socket::ptr sock = m_isHttps ? SSLSocket::CreateTCP(addr) : Socket::CreateTCP(addr);
+    if(!sock){
+        fail(c, HttpResult::Error::CREATE_SOCKET_ERROR, "create sock fail: " + addr->toString());
+        return;
+    }
+    if(!sock->connect(addr, m_options.connect_timeout)){
+        fail(c, HttpResult::Error::CONNECT_FALT, "connect fail: " + addr->toString());
+        return;
+    }
+    {
+        MutexType::Lock lock(m_mutex);
+        c->conn = std::make_shared<HttpConnection>(sock);
+        c->connecting = false;
+        c->activeTime = cxk::GetCurrentMS();
+        if(c->writing || c->pending.empty()){
+            return;
+        }
+        c->writing = true;
+    }
+    doWrite(c);
+}
+
+
+void HttpClientPool::doWrite(Connection::ptr c){
+    std::vector<HttpRequest::ptr> reqs;
+    while(true){
+        bool start_read = false;
+        {
+            MutexType::Lock lock(m_mutex);
+            if(c->closed || c->pending.empty()){
+                c->writing = false;
+                return;
+            }
+            // 先放入在途队列再发送, 读协程按这个顺序匹配响应
+            reqs.clear();
+            for(auto& i : c->pending){
+                reqs.push_back(i.request);
+                c->inflight.push_back(std::move(i));
+            }
+            c->pending.clear();
+            if(!c->reading){
+                c->reading = true;
+                start_read = true;
+            }
+        }
+        if(start_read){
+            m_iom->schedule(std::bind(&HttpClientPool::doRead, shared_from_this(), c));
+        }
+        int rt = c->conn->sendRequests(reqs);
+        if(rt <= 0){
+            fail(c, rt == 0 ? HttpResult::Error::SEND_CLOSE_BY_PEER : HttpResult::Error::SEND_SOCKET_ERROR
+                    , "send request error errno=" + std::to_string(errno));
+            return;
+        }
+    }
+}
+
+
+void HttpClientPool::doRead(Connection::ptr c){
+    while(true){
+        uint64_t timeout_ms = 0;
+        {
+            MutexType::Lock lock(m_mutex);
+            if(c->closed || c->inflight.empty()){
+                c->reading = false;
+                return;
+            }
+            timeout_ms = c->inflight.front().timeout_ms;
+        }
+        // 0和~0表示不超时, 超时由请求的定时器负责
+        int64_t recv_timeout = (timeout_ms == 0 || timeout_ms == ~0ull) ? -1 : (int64_t)timeout_ms;
+        c->conn->getSocket()->setRecvTimeout(recv_timeout);
+        HttpResponse::ptr rsp = c->conn->recvResponse();
+        if(!rsp){
+            recvFail(c, c->conn->getRecvError(), "recv response fail, error="
+                    + std::to_string((int)c->conn->getRecvError()) + " timeout: " + std::to_string(timeout_ms));
+            return;
+        }
+
+        Task task;
+        bool close = false;
+        // 连接关闭时丢弃的非幂等请求
+        std::vector<Task> unsent;
+        std::vector<Connection::ptr> to_connect;
+        std::vector<Connection::ptr> to_write;
+        {
+            MutexType::Lock lock(m_mutex);
+            if(c->closed){
+                c->reading = false;
+                return;
+            }
+            uint64_t now = cxk::GetCurrentMS();
+            task = std::move(c->inflight.front());
+            c->inflight.pop_front();
+            c->activeTime = now;
+            close = rsp->isClose() || task.request->isClose()
+                || (c->load() == 0 && (c->requests >= m_options.max_request
+                        || c->createTime + m_options.max_alive_time <= now));
+            if(close){
+                // 对方要关闭连接, 之后的请求重新排队
+                c->reading = false;
+                requeue(c, unsent);
+            }
+            // 连接上空出了位置, 分配等待的请求
+            assign(to_connect, to_write);
+        }
+        if(close){
+            c->conn->close();
+        }
+        Finish(task, std::make_shared<HttpResult>((int)HttpResult::Error::OK, rsp, "ok"));
+        for(auto& i : unsent){
+            Finish(i, std::make_shared<HttpResult>((int)HttpResult::Error::SEND_CLOSE_BY_PEER
+                        , nullptr, "connection closed by peer before response"));
+        }
+        start(to_connect, to_write);
+        if(close){
+            return;
+        }
+    }
+}
+
+
+void HttpClientPool::fail(Connection::ptr c, HttpResult::Error error, const std::string& msg){
+    std::vector<Task> tasks;
+    std::vector<Connection::ptr> to_connect;
+    std::vector<Connection::ptr> to_write;
+    {
+        MutexType::Lock lock(m_mutex);
+        if(c->closed){
+            return;
+        }
+        c->closed = true;
+        tasks.insert(tasks.end(), std::make_move_iterator(c->inflight.begin())
+                , std::make_move_iterator(c->inflight.end()));
+        tasks.insert(tasks.end(), std::make_move_iterator(c->pending.begin())
+                , std::make_move_iterator(c->pending.end()));
+        c->inflight.clear();
+        c->pending.clear();
+        remove(c);
+        assign(to_connect, to_write);
+    }
+    CXK_LOG_LIMIT_ERROR(g_logger, 10) << "http client " << m_host << ":" << m_port << " " << msg;
+    if(c->conn){
+        // 唤醒另一个方向上等待的协程
+        c->conn->close();
+    }
+    for(auto& i : tasks){
+        Finish(i, std::make_shared<HttpResult>((int)error, nullptr, msg));
+    }
+    start(to_connect, to_write);
+}
+
+
+void HttpClientPool::recvFail(Connection::ptr c, HttpResult::Error error, const std::string& msg){
+    std::vector<Task> tasks;
+    std::vector<Connection::ptr> to_connect;
+    std::vector<Connection::ptr> to_write;
+    {
+        MutexType::Lock lock(m_mutex);
+        if(c->closed){
+            return;
+        }
+        c->reading = false;
+        if(!c->inflight.empty()){
+            // 对方在响应前关闭了连接, 通常是复用了对方刚刚因为空闲关闭的连接, 幂等的请求换一个连接重发;
+            // 超时和响应不合法时重发没有意义
+            Task& front = c->inflight.front();
+            if(error == HttpResult::Error::SEND_CLOSE_BY_PEER && !front.retried
+                    && IsIdempotent(front.request->getMethod())){
+                front.retried = true;
+            } else {
+                tasks.push_back(std::move(front));
+                c->inflight.pop_front();
+            }
+        }
+        requeue(c, tasks);
+        assign(to_connect, to_write);
+    }
+    CXK_LOG_LIMIT_ERROR(g_logger, 10) << "http client " << m_host << ":" << m_port << " " << msg;
+    c->conn->close();
+    for(auto& i : tasks){
+        Finish(i, std::make_shared<HttpResult>((int)error, nullptr, msg));
+    }
+    start(to_connect, to_write);
+}
+
+
+void HttpClientPool::requeue(Connection::ptr c, std::vector<Task>& dropped){
+    // 之后的请求还没有被处理, 重新排队;
+    // 已经发出的请求对方可能处理过了, 非幂等的方法不能重发
+    c->closed = true;
+    m_waiting.insert(m_waiting.begin(), std::make_move_iterator(c->pending.begin())
+            , std::make_move_iterator(c->pending.end()));
+    for(auto it = c->inflight.rbegin(); it != c->inflight.rend(); ++it){
+        if(IsIdempotent(it->request->getMethod())){
+            m_waiting.push_front(std::move(*it));
+        } else {
+            dropped.push_back(std::move(*it));
+        }
+    }
+    c->pending.clear();
+    c->inflight.clear();
+    remove(c);
+}
+
+
+void HttpClientPool::remove(Connection::ptr c){
+    auto it = std::find(m_conns.begin(), m_conns.end(), c);
+    if(it != m_conns.end()){
+        m_conns.erase(it);
+    }
+}
+
+
+void HttpClientPool::expire(HttpFuture::ptr future, uint64_t timeout_ms){
+    std::string msg = "request timeout: " + std::to_string(timeout_ms);
+    Connection::ptr timed_out;
+    {
+        MutexType::Lock lock(m_mutex);
+        auto pred = [&future](const Task& t){ return t.future == future;};
+        auto it = std::find_if(m_waiting.begin(), m_waiting.end(), pred);
+        if(it != m_waiting.end()){
+            m_waiting.erase(it);
+        } else {
+            for(auto& c : m_conns){
+                auto pit = std::find_if(c->pending.begin(), c->pending.end(), pred);
+                if(pit != c->pending.end()){
+                    c->pending.erase(pit);
+                    break;
+                }
+                // 正在等待的响应超时, 和读超时一样关闭连接, 后面的请求重新排队
+                if(!c->inflight.empty() && c->inflight.front().future == future){
+                    timed_out = c;
+                    break;
+                }
+            }
+        }
+        // 排在后面的在途请求留在队列中, 保持和响应的对应关系, 响应到达后丢弃
+    }
+    if(timed_out){
+        recvFail(timed_out, HttpResult::Error::TIMEOUT, msg);
+    }
+    future->set(std::make_shared<HttpResult>((int)HttpResult::Error::TIMEOUT, nullptr, msg));
+}
+
+
+void HttpClientPool::Finish(Task& task, HttpResult::ptr result){
+    if(task.timer){
+        task.timer->cancel();
+    }
+    task.future->set(result);
+}
+
+
+bool HttpClientPool::IsIdempotent(HttpMethod method){
+    switch(method){
+        case HttpMethod::GET:
+        case HttpMethod::HEAD:
+        case HttpMethod::OPTIONS:
+        case HttpMethod::TRACE:
+        case HttpMethod::PUT:
+        case HttpMethod::DELETE:
+            return true;
+        default:
+            return false;
+    }
+}
+
+
+bool HttpClientPool::IsAlive(Connection::ptr c){
+    if(!c->conn || !c->conn->isConnected()){
+        return false;
+    }
+    // 空闲连接上不应该有数据, 可读说明对方已经关闭(或者发来了408之类的响应)
+    char tmp;
+    int rt = recv_f(c->conn->getSocket()->getSocket(), &tmp, 1, MSG_PEEK | MSG_DONTWAIT);
+    return rt < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+}
+
+
+void HttpClientPool::checkIdle(){
+    uint64_t now = cxk::GetCurrentMS();
+    std::vector<Connection::ptr> closed;
+    {
+        MutexType::Lock lock(m_mutex);
+        for(auto it = m_conns.begin(); it != m_conns.end();){
+            auto& c = *it;
+            if(c->connecting || c->load() > 0 || (c->activeTime + m_options.max_idle_time > now
+                    && c->createTime + m_options.max_alive_time > now && IsAlive(c))){
+                ++it;
+                continue;
+            }
+            c->closed = true;
+            closed.push_back(c);
+            it = m_conns.erase(it);
+        }
+    }
+    for(auto& i : closed){
+        i->conn->close();
+    }
+}
+
+
+void HttpClientPool::close(){
+    std::vector<Connection::ptr> conns;
+    std::deque<Task> waiting;
+    Timer::ptr timer;
+    {
+        MutexType::Lock lock(m_mutex);
+        conns = m_conns;
+        waiting.swap(m_waiting);
+        timer.swap(m_timer);
+    }
+    if(timer){
+        timer->cancel();
+    }
+    for(auto& i : conns){
+        fail(i, HttpResult::Error::POOL_INVALID_CONNECTION, "http client pool closed");
+    }
+    for(auto& i : waiting){
+        Finish(i, std::make_shared<HttpResult>((int)HttpResult::Error::POOL_INVALID_CONNECTION
+                    , nullptr, "http client pool closed"));
+    }
+}
+
+
+size_t HttpClientPool::getConnectionCount(){
+    MutexType::Lock lock(m_mutex);
+    return m_conns.size();
+}
+
+
+size_t HttpClientPool::getPendingCount(){
+    MutexType::Lock lock(m_mutex);
+    return m_waiting.size();
+}
+
+
+HttpClientPool::ptr HttpClientManager::getPool(const std::string& scheme, const std::string& host, uint32_t port){
+    bool is_https = scheme == "https";
+    if(!port){
+        port = is_https ? 443 : 80;
+    }
+    std::string key = scheme + "://" + host + ":" + std::to_string(port);
+    {
+        RWMutexType::ReadLock lock(m_mutex);
+        auto it = m_pools.find(key);
+        if(it != m_pools.end()){
+            return it->second;
+        }
+    }
+    RWMutexType::WriteLock lock(m_mutex);
+    auto& pool = m_pools[key];
+    if(!pool){
+        pool = std::make_shared<HttpClientPool>(host, port, is_https, HttpClientPool::Options(), m_iom);
+    }
+    return pool;
+}
+
+
+HttpFuture::ptr HttpClientManager::request(HttpRequest::ptr req, Uri::ptr uri, uint64_t timeout_ms){
+    return getPool(uri->getScheme(), uri->getHost(), uri->getPort())->request(req, timeout_ms);
+}
+
+
+HttpFuture::ptr HttpClientManager::request(HttpMethod method, const std::string& url, uint64_t timeout_ms
+        , const std::map<std::string, std::string>& headers, const std::string& body){
+    Uri::ptr uri = Uri::Create(url);
+    if(!uri){
+        HttpFuture::ptr future = std::make_shared<HttpFuture>();
+        future->set(std::make_shared<HttpResult>((int)HttpResult::Error::INVALID_URL, nullptr, "invalid url: " + url));
+        return future;
+    }
+    std::string path = uri->getPath().empty() ? "/" : uri->getPath();
+    if(!uri->getQuery().empty()){
+        path += "?" + uri->getQuery();
+    }
+    if(!uri->getFragment().empty()){
+        path += "#" + uri->getFragment();
+    }
+    return getPool(uri->getScheme(), uri->getHost(), uri->getPort())
+        ->request(method, path, timeout_ms, headers, body);
+}
+
+
+HttpFuture::ptr HttpClientManager::get(const std::string& url, uint64_t timeout_ms
+        , const std::map<std::string, std::string>& headers){
+    return request(HttpMethod::GET, url, timeout_ms, headers);
+}
+
+
+HttpFuture::ptr HttpClientManager::post(const std::string& url, uint64_t timeout_ms
+        , const std::map<std::string, std::string>& headers, const std::string& body){
+    return request(HttpMethod::POST, url, timeout_ms, headers, body);
+}
+
+
+void HttpClientManager::close(){
+    std::unordered_map<std::string, HttpClientPool::ptr> pools;
+    {
+        RWMutexType::WriteLock lock(m_mutex);
+        pools.swap(m_pools);
+    }
+    for(auto& i : pools){
+        i.second->close();
+    }
+}
+
+
+}
+}
@@ -0,0 +1,251 @@
+#pragma once
+
+#include "http_connection.h"
+#include "cxk/iomanager.h"
+#include "cxk/Singleton.h"
+#include <deque>
+#include <unordered_map>
+
+
+namespace cxk{
+namespace http{
+
+
+/// @brief 异步HTTP请求的结果
+/// @details 在协程中get()只挂起当前协程, 在普通线程中阻塞线程。
+///          多个请求可以先全部发出, 再依次get(), 总耗时约等于最慢的一个
+class HttpFuture{
+public:
+    using ptr = std::shared_ptr<HttpFuture>;
+    using MutexType = Spinlock;
+
+    /// @brief  等待并返回结果, 可以多次调用
+    HttpResult::ptr get();
+
+    /// @brief  结果是否已经返回
+    bool isReady();
+
+    /// @brief  设置结果并唤醒等待者, 只有第一次设置有效
+    void set(HttpResult::ptr result);
+
+    /// @brief  等待一组请求全部完成, 结果和futures一一对应
+    static std::vector<HttpResult::ptr> WaitAll(const std::vector<HttpFuture::ptr>& futures);
+
+private:
+    MutexType m_mutex;
+    HttpResult::ptr m_result;
+    // 等待的协程和它所在的线程, 在原线程上唤醒, 避免协程还没有切出就在其他线程上被执行
+    struct Waiter{
+        Scheduler* scheduler;
+        Fiber::ptr fiber;
+        int thread;
+    };
+    std::vector<Waiter> m_fibers;
+    // 等待的线程
+    std::vector<Semaphore*> m_sems;
+};
+
+
+/// @brief 单个主机(scheme/host/port)的异步连接池
+/// @details 请求先进入等待队列, 分配给在途请求最少、且未达到max_pipeline的连接;
+///          连接都满时在max_connections以内新建连接, 否则继续排队。
+///          每个连接有一个写协程和一个读协程: 写协程把分配到的请求一次writev发出(pipelining),
+///          读协程按顺序读取响应并唤醒对应的HttpFuture。
+///          空闲连接在复用前和定时检查时探测是否已被对方关闭。
+///          每个请求有一个超时定时器, 还在排队或者还没有发出时超时会被移出队列;
+///          对方关闭连接时, 还没有收到响应的请求只有幂等的方法会重新排队
+class HttpClientPool : public std::enable_shared_from_this<HttpClientPool>{
+public:
+    using ptr = std::shared_ptr<HttpClientPool>;
+    using MutexType = Mutex;
+
+    /// @brief 连接池参数, 默认值来自http.client.*配置
+    struct Options{
+        Options();
+
+        uint32_t max_connections;       // 最多的连接数
+        uint32_t max_pipeline;          // 每个连接最多的在途请求数, 1表示不使用pipelining
+        uint32_t max_pending;           // 等待队列最大长度, 超过时直接返回错误
+        uint32_t max_idle_time;         // 连接最长空闲时间(ms)
+        uint32_t max_alive_time;        // 连接最长存活时间(ms)
+        uint32_t max_request;           // 每个连接最多处理的请求数
+        uint32_t connect_timeout;       // 建立连接的超时时间(ms)
+        uint32_t check_interval;        // 检查空闲连接的间隔(ms)
+    };
+
+    /// @brief          构造函数
+    /// @param host     主机
+    /// @param port     端口, 0表示按scheme的默认端口
+    /// @param is_https 是否https
+    /// @param options  连接池参数
+    /// @param iom      执行读写协程的IOManager, 为空时使用当前线程的IOManager
+    HttpClientPool(const std::string& host, uint32_t port, bool is_https
+            , const Options& options = Options(), IOManager* iom = nullptr);
+
+    ~HttpClientPool();
+
+    /// @brief              发出请求, 立即返回
+    /// @param req          请求, 没有Host头部时使用连接池的主机
+    /// @param timeout_ms   等待响应的超时时间
+    HttpFuture::ptr request(HttpRequest::ptr req, uint64_t timeout_ms);
+
+    /// @brief              发出请求, 立即返回
+    /// @param method       请求方法
+    /// @param path         路径(可以带query和fragment)
+    /// @param timeout_ms   等待响应的超时时间
+    /// @param headers      请求头部
+    /// @param body         请求体
+    HttpFuture::ptr request(HttpMethod method, const std::string& path, uint64_t timeout_ms
+            , const std::map<std::string, std::string>& headers = {}, const std::string& body = "");
+
+    /// @brief  关闭空闲超时、存活超时和已被对方关闭的空闲连接
+    void checkIdle();
+
+    /// @brief  关闭所有连接, 停止检查定时器, 未完成的请求返回错误
+    void close();
+
+    /// @brief  当前连接数
+    size_t getConnectionCount();
+
+    /// @brief  等待分配连接的请求数
+    size_t getPendingCount();
+
+    const std::string& getHost() const { return m_host;}
+    uint32_t getPort() const { return m_port;}
+    bool isHttps() const { return m_isHttps;}
+    const Options& getOptions() const { return m_options;}
+
+private:
+    /// @brief 一个请求
+    struct Task{
+        HttpRequest::ptr request;
+        HttpFuture::ptr future;
+        uint64_t timeout_ms;
+        // 整个请求的超时定时器, 返回结果时取消
+        Timer::ptr timer;
+        // 对方在响应前关闭连接后已经重发过一次
+        bool retried = false;
+    };
+
+    /// @brief 一个连接和分配给它的请求
+    struct Connection{
+        using ptr = std::shared_ptr<Connection>;
+
+        size_t load() const { return pending.size() + inflight.size();}
+
+        HttpConnection::ptr conn;
+        // 已分配还没有发出的请求
+        std::deque<Task> pending;
+        // 已经发出等待响应的请求
+        std::deque<Task> inflight;
+        uint64_t createTime = 0;
+        uint64_t activeTime = 0;
+        // 已分配的请求数
+        uint32_t requests = 0;
+        bool connecting = true;
+        bool writing = false;
+        bool reading = false;
+        bool closed = false;
+    };
+
+    /// @brief  把等待队列中的请求分配给连接, 需要持有锁
+    /// @param  to_connect  新建的连接
+    /// @param  to_write    需要启动写协程的连接
+    void assign(std::vector<Connection::ptr>& to_connect, std::vector<Connection::ptr>& to_write);
+
+    /// @brief  在IOManager上启动assign返回的连接的协程
+    void start(const std::vector<Connection::ptr>& to_connect, const std::vector<Connection::ptr>& to_write);
+
+    /// @brief  建立连接, 成功后转入写协程
+    void doConnect(Connection::ptr c);
+
+    /// @brief  写协程, 发出连接上所有待发送的请求
+    void doWrite(Connection::ptr c);
+
+    /// @brief  读协程, 读取在途请求的响应
+    void doRead(Connection::ptr c);
+
+    /// @brief  连接出错, 关闭连接, 所有分配给它的请求返回错误
+    void fail(Connection::ptr c, HttpResult::Error error, const std::string& msg);
+
+    /// @brief  读响应失败, 关闭连接。等待响应的请求返回错误, 对方关闭连接时幂等的请求重发一次;
+    ///         其他请求和连接正常关闭时一样重新排队
+    void recvFail(Connection::ptr c, HttpResult::Error error, const std::string& msg);
+
+    /// @brief  连接不再使用, 未发出的请求和在途的幂等请求放回等待队列头部, 需要持有锁
+    /// @param  dropped 在途的非幂等请求, 对方可能已经处理过, 不能重发
+    void requeue(Connection::ptr c, std::vector<Task>& dropped);
+
+    /// @brief  从连接列表中去掉, 需要持有锁
+    void remove(Connection::ptr c);
+
+    /// @brief  请求超时, 还没有发出时从队列中去掉, 返回超时错误
+    void expire(HttpFuture::ptr future, uint64_t timeout_ms);
+
+    /// @brief  取消超时定时器并设置结果
+    static void Finish(Task& task, HttpResult::ptr result);
+
+    /// @brief  连接被关闭时已经发出的请求能否在其他连接上重发
+    static bool IsIdempotent(HttpMethod method);
+
+    /// @brief  空闲连接是否还可用(没有被对方关闭)
+    static bool IsAlive(Connection::ptr c);
+
+private:
+    std::string m_host;
+    uint32_t m_port;
+    bool m_isHttps;
+    Options m_options;
+    IOManager* m_iom;
+    Timer::ptr m_timer;
+
+    MutexType m_mutex;
+    std::vector<Connection::ptr> m_conns;
+    // 等待分配连接的请求
+    std::deque<Task> m_waiting;
+};
+
+
+/// @brief HTTP客户端, 按scheme/host/port管理多个HttpClientPool
+class HttpClientManager{
+public:
+    using RWMutexType = RWMutex;
+
+    /// @brief      设置连接池使用的IOManager, 为空时使用创建连接池的线程的IOManager
+    void setIOManager(IOManager* iom) { m_iom = iom;}
+
+    /// @brief      获取连接池, 不存在时按默认参数创建
+    HttpClientPool::ptr getPool(const std::string& scheme, const std::string& host, uint32_t port);
+
+    /// @brief              发出请求, 立即返回
+    /// @param req          请求, 路径由调用者设置
+    /// @param uri          按它的scheme/host/port选择连接池
+    /// @param timeout_ms   等待响应的超时时间
+    HttpFuture::ptr request(HttpRequest::ptr req, Uri::ptr uri, uint64_t timeout_ms);
+
+    HttpFuture::ptr request(HttpMethod method, const std::string& url, uint64_t timeout_ms
+            , const std::map<std::string, std::string>& headers = {}, const std::string& body = "");
+
+    /// @brief  发出GET请求, 立即返回
+    HttpFuture::ptr get(const std::string& url, uint64_t timeout_ms
+            , const std::map<std::string, std::string>& headers = {});
+
+    /// @brief  发出POST请求, 立即返回
+    HttpFuture::ptr post(const std::string& url, uint64_t timeout_ms
+            , const std::map<std::string, std::string>& headers = {}, const std::string& body = "");
+
+    /// @brief  关闭并移除所有连接池, IOManager停止前调用
+    void close();
+
+private:
+    RWMutexType m_mutex;
+    IOManager* m_iom = nullptr;
+    // "scheme://host:port" -> 连接池
+    std::unordered_map<std::string, HttpClientPool::ptr> m_pools;
+};
+
+using HttpClientMgr = cxk::Singleton<HttpClientManager>;
+
+
+}
+}
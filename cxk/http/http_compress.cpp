@@ -0,0 +1,282 @@
+#include "http_compress.h"
+#include "cxk/config.h"
+#include "cxk/logger.h"
+#include "cxk/ds/lru_cache.h"
+#include <strings.h>
+#include <string.h>
+#include <stdlib.h>
+#include <atomic>
+
+
+namespace cxk{
+namespace http{
+
+static cxk::Logger::ptr g_logger = CXK_LOG_NAME("system");
+
+static cxk::ConfigVar<bool>::ptr g_http_compress_enable =
+    cxk::Config::Lookup("http.compress.enable", true, "http response compress enable");
+
+static cxk::ConfigVar<uint32_t>::ptr g_http_compress_min_length =
+    cxk::Config::Lookup("http.compress.min_length", (uint32_t)1024, "http response min body length to compress");
+
+static cxk::ConfigVar<uint32_t>::ptr g_http_compress_stream_length =
+    cxk::Config::Lookup("http.compress.stream_length", (uint32_t)(64 * 1024), "http response min body length to compress as chunked stream");
+
+static cxk::ConfigVar<std::vector<std::string>>::ptr g_http_compress_encodings =
+    cxk::Config::Lookup("http.compress.encodings", std::vector<std::string>{"zstd", "gzip", "deflate"}, "http response content-encodings in preference order");
+
+static cxk::ConfigVar<std::vector<std::string>>::ptr g_http_compress_skip_types =
+    cxk::Config::Lookup("http.compress.skip_types", std::vector<std::string>{"image/", "video/", "audio/", "font/woff"
+            , "application/zip", "application/gzip", "application/x-gzip", "application/zstd"
+            , "application/x-7z-compressed", "application/x-rar-compressed", "application/octet-stream"}
+            , "http response content-type prefixes which are already compressed");
+
+static cxk::ConfigVar<uint32_t>::ptr g_http_compress_cache_size =
+    cxk::Config::Lookup("http.compress.cache_size", (uint32_t)1024, "http compressed static response cache count");
+
+static cxk::ConfigVar<uint32_t>::ptr g_http_compress_cache_max_length =
+    cxk::Config::Lookup("http.compress.cache_max_length", (uint32_t)(1024 * 1024), "http static response max body length to cache");
+
+static bool s_compress_enable = true;
+static uint32_t s_compress_min_length = 0;
+static uint32_t s_compress_stream_length = 0;
+static uint32_t s_compress_cache_size = 0;
+static uint32_t s_compress_cache_max_length = 0;
+
+// 列表类型的配置可能在请求处理中被修改, 整体替换
+using CodecList = std::vector<CompressCodec::ptr>;
+using TypeList = std::vector<std::string>;
+static std::shared_ptr<const CodecList> s_compress_codecs;
+static std::shared_ptr<const TypeList> s_compress_skip_types;
+
+// 键: 路径 ETag 编码
+using CompressCache = cxk::ds::LruCache<std::string, std::shared_ptr<std::string>>;
+
+static CompressCache& GetCompressCache(){
+    static CompressCache s_cache(s_compress_cache_size);
+    return s_cache;
+}
+
+
+static void SetCompressEncodings(const std::vector<std::string>& names){
+    auto codecs = std::make_shared<CodecList>();
+    for(auto& i : names){
+        auto codec = CompressCodec::Get(i);
+        if(codec){
+            codecs->push_back(codec);
+        } else {
+            CXK_LOG_WARN(g_logger) << "http.compress.encodings unsupported encoding: " << i;
+        }
+    }
+    std::atomic_store(&s_compress_codecs, std::shared_ptr<const CodecList>(codecs));
+}
+
+
+namespace {
+struct _HttpCompressIniter{
+    _HttpCompressIniter(){
+        s_compress_enable = g_http_compress_enable->getValue();
+        s_compress_min_length = g_http_compress_min_length->getValue();
+        s_compress_stream_length = g_http_compress_stream_length->getValue();
+        s_compress_cache_size = g_http_compress_cache_size->getValue();
+        s_compress_cache_max_length = g_http_compress_cache_max_length->getValue();
+        SetCompressEncodings(g_http_compress_encodings->getValue());
+        s_compress_skip_types = std::make_shared<const TypeList>(g_http_compress_skip_types->getValue());
+
+        g_http_compress_enable->addListener([](const bool& ov, const bool& nv){
+            s_compress_enable = nv;
+        });
+
+        g_http_compress_min_length->addListener([](const uint32_t& ov, const uint32_t& nv){
+            s_compress_min_length = nv;
+        });
+
+        g_http_compress_stream_length->addListener([](const uint32_t& ov, const uint32_t& nv){
+            s_compress_stream_length = nv;
+        });
+
+        g_http_compress_cache_size->addListener([](const uint32_t& ov, const uint32_t& nv){
+            s_compress_cache_size = nv;
+            GetCompressCache().setMaxSize(nv);
+        });
+
+        g_http_compress_cache_max_length->addListener([](const uint32_t& ov, const uint32_t& nv){
+            s_compress_cache_max_length = nv;
+        });
+
+        g_http_compress_encodings->addListener([](const std::vector<std::string>& ov, const std::vector<std::string>& nv){
+            SetCompressEncodings(nv);
+        });
+
+        g_http_compress_skip_types->addListener([](const std::vector<std::string>& ov, const std::vector<std::string>& nv){
+            std::atomic_store(&s_compress_skip_types, std::make_shared<const TypeList>(nv));
+        });
+    }
+};
+
+static _HttpCompressIniter s_http_compress_initer;
+}
+
+
+static std::string_view TrimView(std::string_view v){
+    while(!v.empty() && (v.front() == ' ' || v.front() == '\t')){
+        v.remove_prefix(1);
+    }
+    while(!v.empty() && (v.back() == ' ' || v.back() == '\t')){
+        v.remove_suffix(1);
+    }
+    return v;
+}
+
+
+CompressCodec::ptr HttpCompress::Negotiate(const std::string& accept_encoding){
+    auto codecs = std::atomic_load(&s_compress_codecs);
+    if(accept_encoding.empty() || !codecs || codecs->empty()){
+        return nullptr;
+    }
+
+    // 每个可用编码的q值, 没有列出的为-1, 由"*"决定
+    std::vector<float> qs(codecs->size(), -1);
+    float other = 0;
+    std::string_view accept(accept_encoding);
+    while(!accept.empty()){
+        size_t end = accept.find(',');
+        std::string_view item = accept.substr(0, end);
+        accept.remove_prefix(end == std::string_view::npos ? accept.size() : end + 1);
+
+        float q = 1;
+        size_t semi = item.find(';');
+        std::string_view name = TrimView(item.substr(0, semi));
+        if(semi != std::string_view::npos){
+            std::string_view param = TrimView(item.substr(semi + 1));
+            if(param.size() > 2 && (param[0] == 'q' || param[0] == 'Q') && param[1] == '='){
+                q = strtof(std::string(param.substr(2)).c_str(), nullptr);
+            }
+        }
+
+        if(name == "*"){
+            other = q;
+            continue;
+        }
+        for(size_t i = 0; i < codecs->size(); ++i){
+            const std::string& n = (*codecs)[i]->getName();
+            if(n.size() == name.size() && strncasecmp(n.c_str(), name.data(), n.size()) == 0){
+                qs[i] = q;
+            }
+        }
+    }
+
+    CompressCodec::ptr rt;
+    float best = 0;
+    for(size_t i = 0; i < codecs->size(); ++i){
+        float q = qs[i] < 0 ? other : qs[i];
+        if(q > best){
+            best = q;
+            rt = (*codecs)[i];
+        }
+    }
+    return rt;
+}
+
+
+bool HttpCompress::IsCompressibleType(const std::string& content_type){
+    auto skip_types = std::atomic_load(&s_compress_skip_types);
+    for(auto& i : *skip_types){
+        if(strncasecmp(content_type.c_str(), i.c_str(), i.size()) == 0){
+            return false;
+        }
+    }
+    return true;
+}
+
+
+bool HttpCompress::IsCompressible(const std::string& content_type, size_t length){
+    return s_compress_enable && length >= s_compress_min_length && IsCompressibleType(content_type);
+}
+
+
+CompressCodec::ptr HttpCompress::Select(HttpRequest::ptr req, HttpResponse::ptr rsp){
+    // 流式写出的响应体长度未知, 按大响应处理
+    if(!s_compress_enable || req->getMethod() == HttpMethod::HEAD
+            || (!rsp->getBodyWriter() && rsp->getBody().size() < s_compress_min_length)){
+        return nullptr;
+    }
+    // 分段响应按原始内容计算偏移, 不能压缩
+    if(rsp->getStatus() == HttpStatus::PARTIAL_CONTENT
+            || !rsp->getHeader("Content-Encoding").empty()
+            || !rsp->getHeader("Content-Range").empty()){
+        return nullptr;
+    }
+
+    if(!IsCompressibleType(rsp->getHeader("Content-Type"))){
+        return nullptr;
+    }
+
+    // 缓存需要按Accept-Encoding区分
+    std::string vary = rsp->getHeader("Vary");
+    if(vary.empty()){
+        rsp->setHeader("Vary", "Accept-Encoding");
+    } else if(strcasestr(vary.c_str(), "accept-encoding") == nullptr){
+        rsp->setHeader("Vary", vary + ", Accept-Encoding");
+    }
+    return Negotiate(req->getHeader("Accept-Encoding"));
+}
+
+
+static bool IsCacheable(HttpResponse::ptr rsp){
+    return s_compress_cache_size > 0
+        && rsp->getBody().size() <= s_compress_cache_max_length
+        && !rsp->getHeader("ETag").empty();
+}
+
+
+bool HttpCompress::IsStream(HttpResponse::ptr rsp){
+    if(rsp->getBodyWriter()){
+        return true;
+    }
+    return rsp->getVersion() >= 0x11
+        && rsp->getBody().size() >= s_compress_stream_length
+        && !IsCacheable(rsp);
+}
+
+
+bool HttpCompress::Compress(HttpRequest::ptr req, HttpResponse::ptr rsp, CompressCodec::ptr codec){
+    std::string etag = rsp->getHeader("ETag");
+    bool cacheable = IsCacheable(rsp);
+    std::string key;
+    std::shared_ptr<std::string> data;
+    if(cacheable){
+        key = req->getPath() + " " + etag + " " + codec->getName();
+        GetCompressCache().get(key, data);
+    }
+
+    if(!data){
+        data = std::make_shared<std::string>();
+        if(!codec->compress(rsp->getBody(), *data)){
+            CXK_LOG_ERROR(g_logger) << "compress http response body error, content-encoding: "
+                << codec->getName();
+            return false;
+        }
+        if(cacheable){
+            GetCompressCache().set(key, data);
+        }
+    }
+
+    rsp->setBody(*data);
+    SetEncoding(rsp, codec);
+    return true;
+}
+
+
+void HttpCompress::SetEncoding(HttpResponse::ptr rsp, CompressCodec::ptr codec){
+    rsp->setHeader("Content-Encoding", codec->getName());
+    // 压缩后的内容和原始内容字节不同, 强ETag改为弱ETag
+    std::string etag = rsp->getHeader("ETag");
+    if(!etag.empty() && etag.compare(0, 2, "W/") != 0){
+        rsp->setHeader("ETag", "W/" + etag);
+    }
+}
+
+
+}
+}
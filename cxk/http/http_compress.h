@@ -0,0 +1,46 @@
+#pragma once
+
+#include "http.h"
+#include "cxk/stream/compress_codec.h"
+
+
+namespace cxk{
+namespace http{
+
+
+/// @brief HTTP响应压缩策略
+/// @details 按请求的Accept-Encoding和配置的编码优先级(http.compress.encodings)选择编码,
+///          跳过太小的响应体、已经压缩过的类型(http.compress.skip_types)和分段响应。
+///          带ETag的响应认为是静态内容, 压缩结果按ETag和编码缓存
+class HttpCompress{
+public:
+    /// @brief          选择响应的压缩编码, 响应可以压缩时设置Vary: Accept-Encoding
+    /// @return         不需要压缩返回nullptr
+    static CompressCodec::ptr Select(HttpRequest::ptr req, HttpResponse::ptr rsp);
+
+    /// @brief          这种类型和长度的内容是否需要压缩, 用于预先压缩静态内容
+    static bool IsCompressible(const std::string& content_type, size_t length);
+
+    /// @brief          Content-Type是否不在http.compress.skip_types中
+    static bool IsCompressibleType(const std::string& content_type);
+
+    /// @brief          解析Accept-Encoding, 返回q值最大的可用编码, q值相同时按配置的优先级
+    /// @return         没有可用的编码返回nullptr
+    static CompressCodec::ptr Negotiate(const std::string& accept_encoding);
+
+    /// @brief          是否边压缩边用chunked发送
+    /// @details        HTTP/1.1中不能缓存并且响应体不小于http.compress.stream_length时流式压缩,
+    ///                 不需要等整个响应体压缩完才开始发送; 设置了BodyWriter的响应总是流式发送
+    static bool IsStream(HttpResponse::ptr rsp);
+
+    /// @brief          压缩整个响应体并设置Content-Encoding, 带ETag的响应先查缓存
+    /// @return         是否成功, 失败时响应不变
+    static bool Compress(HttpRequest::ptr req, HttpResponse::ptr rsp, CompressCodec::ptr codec);
+
+    /// @brief          设置Content-Encoding, 强ETag改为弱ETag
+    static void SetEncoding(HttpResponse::ptr rsp, CompressCodec::ptr codec);
+};
+
+
+}
+}
@@ -1,6 +1,6 @@
 #include "http_connection.h"
 #include "http_parser.h"
-#include "cxk/stream/zlib_stream.h"
+#include "cxk/stream/compress_codec.h"
 
 
 namespace cxk{
@@ -20,128 +20,121 @@ std::string HttpResult::toString(){
 
 
 HttpConnection::HttpConnection(Socket::ptr sock, bool owner) : SocketStream(sock, owner){
-
+    m_reader.reset(new BufferedStream(std::make_shared<SocketStream>(sock, false),
+                HttpResponseParser::GetHttpResponseBufferSize()));
 }
 
-HttpResponse::ptr HttpConnection::recvResponse(){
-    HttpResponseParser::ptr parser(new HttpResponseParser);
-    uint64_t buff_size = HttpRequestParser::GetHttpRequestBufferSize();
-
-    std::shared_ptr<char> buffer(new char[buff_size + 1], [](char* ptr){
-        delete[] ptr;
-    });
+// 读取返回rt(<=0)时失败的原因
+static HttpResult::Error ReadError(int rt){
+    if(rt == 0){
+        return HttpResult::Error::SEND_CLOSE_BY_PEER;
+    }
+    return errno == ETIMEDOUT ? HttpResult::Error::TIMEOUT : HttpResult::Error::SEND_SOCKET_ERROR;
+}
 
-    char* data = buffer.get();
-    int offset = 0;
+// 在读缓冲上解析响应头或chunk头, 解析器每次从头解析, 完成后才丢弃已解析的数据
+static HttpResult::Error ParseHead(BufferedStream::ptr reader, HttpResponseParser::ptr parser, bool chunck){
     do{
-        int len = read(data + offset, buff_size - offset);
-        if(len <= 0){
-            return nullptr;
-        }
-
-        len += offset;
-        data[len] = 0;
-        size_t nparse = parser->execute(data + offset, len, true);
+        std::string_view data = reader->peek();
+        size_t nparse = parser->parse(data.data(), data.size(), chunck);
         if(parser->hasError()){
-            return nullptr;
+            return HttpResult::Error::INVALID_RESPONSE;
         }
-
-        offset = len - nparse;
-        if(offset == (int)buff_size){
-            return nullptr;
-        }
-
         if(parser->isFinished()){
-            break;
-        } 
+            reader->consume(nparse);
+            return HttpResult::Error::OK;
+        }
+        // 头部超过缓冲区大小
+        if(reader->isFull()){
+            return HttpResult::Error::INVALID_RESPONSE;
+        }
+        int rt = reader->fill();
+        if(rt <= 0){
+            return ReadError(rt);
+        }
     } while(true);
+}
+
+HttpResponse::ptr HttpConnection::recvResponse(){
+    HttpResponseParser::ptr parser(new HttpResponseParser);
+    m_recvError = ParseHead(m_reader, parser, true);
+    if(m_recvError != HttpResult::Error::OK){
+        close();
+        return nullptr;
+    }
 
     auto& client_parser = parser->getParser();
     std::string body;
 
+    // 按版本和Connection头部判断对方是否会关闭连接
+    HttpResponse::ptr rsp = parser->getData();
+    std::string connection = rsp->getHeader("connection");
+    rsp->setClose(strcasecmp(connection.c_str(), "close") == 0
+            || (rsp->getVersion() == 0x10 && strcasecmp(connection.c_str(), "keep-alive") != 0));
+
+    // 长度来自对方, 分配之前检查, 避免超大的响应耗尽内存
+    uint64_t max_body_size = HttpResponseParser::GetHttpResponseMaxBodySize();
     if(client_parser.chunked){
-        int len = offset;   // offset为剩余数据长度
         do{
-            bool begin = true;
-            do{
-                if(!begin || len == 0){
-                    int rt = read(data + len, buff_size - len);
-                    if(rt <= 0){
-                        close();
-                        return nullptr;
-                    }
-                    len += rt;
-                }
-                data[len] = '\0';
-                size_t nparse = parser->execute(data, len, true);
-                if(parser->hasError()){
-                    return nullptr;
-                }
-                len -= nparse;
-                if(len == (int)buff_size){
-                    return nullptr;         // 数据读完了，但还没解析完成
-                }
-                begin = false;
-            } while(!parser->isFinished());
-
-            // len -= 2;
-
-            if(client_parser.content_len + 2 <= len){
-                body.append(data, client_parser.content_len);
-                memmove(data, data + client_parser.content_len + 2, len - client_parser.content_len + 2);
-                len -= client_parser.content_len + 2;
-            } else {
-                body.append(data, len);
-                int left = client_parser.content_len - len + 2;
-                while(left > 0){
-                    int rt = read(data, left > (int)buff_size ? (int)buff_size : left);
-                    if(rt <= 0){
-                        return nullptr;
-                    } 
-
-                    body.append(data, rt);
-                    left -= rt;
-                }
-                body.resize(body.size() - 2);
-                len = 0; 
+            m_recvError = ParseHead(m_reader, parser, true);
+            if(m_recvError != HttpResult::Error::OK){
+                close();
+                return nullptr;
             }
 
+            // chunk数据和结尾的\r\n
+            size_t len = client_parser.content_len;
+            size_t old_size = body.size();
+            if(len > max_body_size || old_size + len > max_body_size){
+                CXK_LOG_WARN(g_logger) << "response body too large, size=" << old_size << " chunk=" << len
+                    << " max=" << max_body_size;
+                m_recvError = HttpResult::Error::INVALID_RESPONSE;
+                close();
+                return nullptr;
+            }
+            body.resize(old_size + len + 2);
+            int rt = readFixSize(&body[old_size], len + 2);
+            if(rt <= 0){
+                m_recvError = ReadError(rt);
+                close();
+                return nullptr;
+            }
+            body.resize(old_size + len);
         } while(!client_parser.chunks_done);
     }else {
         uint64_t length = parser->getContentLength();
-        if(length > 0){
-        body.resize(length);
-
-        int len = 0;
-        if(length >= (uint64_t)offset){
-            memcpy(&body[0], data, offset);
-            len = offset;
-        } else {
-            memcpy(&body[0], data, length);
-            len = length;
+        if(length > max_body_size){
+            CXK_LOG_WARN(g_logger) << "response body too large, content-length=" << length
+                << " max=" << max_body_size;
+            m_recvError = HttpResult::Error::INVALID_RESPONSE;
+            close();
+            return nullptr;
         }
-        length -= offset;
         if(length > 0){
-            if(readFixSize(&body[len], length) <= 0){
+            body.resize(length);
+            int rt = readFixSize(&body[0], length);
+            if(rt <= 0){
+                m_recvError = ReadError(rt);
+                close();
                 return nullptr;
             }
         }
-        }
     }
 
     if(!body.empty()){
         auto content_encoding = parser->getData()->getHeader("content-encoding");
         CXK_LOG_DEBUG(g_logger) << "content_encoding = " << content_encoding << " size = " << body.size();
-        if(strcasecmp(content_encoding.c_str(), "gzip") == 0){
-            auto zs = ZlibStream::CreateGzip(false);
-            zs->write(body.c_str(), body.size());
-            zs->flush();
-            zs->getResult().swap(body);
-        } else if(strcasecmp(content_encoding.c_str(), "deflate") == 0){
-            auto zs = ZlibStream::CreateDeflate(false);
-            zs->write(body.c_str(), body.size());
-            zs->flush();
-            zs->getResult().swap(body);
+        if(!content_encoding.empty()){
+            auto codec = CompressCodec::Get(content_encoding);
+            if(codec){
+                std::string data;
+                if(!codec->decompress(body, data, HttpResponseParser::GetHttpResponseMaxBodySize())){
+                    m_recvError = HttpResult::Error::INVALID_RESPONSE;
+                    close();
+                    return nullptr;
+                }
+                body.swap(data);
+            }
         }
         parser->getData()->setBody(body);
     }
@@ -150,13 +143,56 @@ HttpResponse::ptr HttpConnection::recvResponse(){
 }
     
     
-int HttpConnection::sendRequest(HttpRequest::ptr rsp){
-     std::stringstream ss;
-     ss << *rsp;
-     std::string data = ss.str();
-     std::cout << ss.str() << std::endl;
-     writeFixSize(data.c_str(), data.size());
-     return data.size();
+int HttpConnection::read(void* buffer, size_t length){
+    return m_reader->read(buffer, length);
+}
+
+
+int HttpConnection::read(ByteArray::ptr ba, size_t length){
+    return m_reader->read(ba, length);
+}
+
+
+int HttpConnection::readv(const iovec* buffers, size_t count){
+    return m_reader->readv(buffers, count);
+}
+
+
+int HttpConnection::sendRequest(HttpRequest::ptr req){
+    m_headerBuf.clear();
+    req->serializeHeader(m_headerBuf);
+    std::string_view body = req->getBodyView();
+    // 头部和body一次writev写出, 避免拷贝body
+    iovec iovs[2];
+    iovs[0].iov_base = (void*)m_headerBuf.c_str();
+    iovs[0].iov_len = m_headerBuf.size();
+    iovs[1].iov_base = (void*)body.data();
+    iovs[1].iov_len = body.size();
+    return writevFixSize(iovs, body.empty() ? 1 : 2);
+}
+
+
+int HttpConnection::sendRequests(const std::vector<HttpRequest::ptr>& reqs){
+    m_headerBuf.clear();
+    std::vector<size_t> offsets;
+    offsets.reserve(reqs.size() + 1);
+    for(auto& i : reqs){
+        offsets.push_back(m_headerBuf.size());
+        i->serializeHeader(m_headerBuf);
+    }
+    offsets.push_back(m_headerBuf.size());
+
+    // 所有请求的头部和body一次writev写出
+    std::vector<iovec> iovs;
+    iovs.reserve(reqs.size() * 2);
+    for(size_t i = 0; i < reqs.size(); ++i){
+        iovs.push_back({(void*)(m_headerBuf.c_str() + offsets[i]), offsets[i + 1] - offsets[i]});
+        std::string_view body = reqs[i]->getBodyView();
+        if(!body.empty()){
+            iovs.push_back({(void*)body.data(), body.size()});
+        }
+    }
+    return iovs.empty() ? 1 : writevFixSize(iovs.data(), iovs.size());
 }
 
 
@@ -268,7 +304,7 @@ HttpResult::ptr HttpConnection::DoRequest(HttpRequest::ptr req, Uri::ptr url, ui
 
     auto rsp = conn->recvResponse();
     if(!rsp){
-        return std::make_shared<HttpResult>((int)HttpResult::Error::TIMEOUT, nullptr, "recv response timemout: "+std::to_string(timeout_ms));
+        return std::make_shared<HttpResult>((int)conn->getRecvError(), nullptr, "recv response fail, timeout: "+std::to_string(timeout_ms));
     }
     return std::make_shared<HttpResult>((int)HttpResult::Error::OK, rsp, "ok");
 }
@@ -476,7 +512,7 @@ HttpResult::ptr HttpConnectionPool::doRequest(HttpRequest::ptr req, uint64_t tim
 
     auto rsp = conn->recvResponse();
     if(!rsp){
-        return std::make_shared<HttpResult>((int)HttpResult::Error::TIMEOUT, nullptr, "recv response timemout: "+std::to_string(timeout_ms));
+        return std::make_shared<HttpResult>((int)conn->getRecvError(), nullptr, "recv response fail, timeout: "+std::to_string(timeout_ms));
     }
     return std::make_shared<HttpResult>((int)HttpResult::Error::OK, rsp, "ok");
 }
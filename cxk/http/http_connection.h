@@ -1,6 +1,7 @@
 #pragma once
 
 #include "cxk/stream/socket_stream.h"
+#include "cxk/stream/buffered_stream.h"
 #include "http.h"
 #include "http_parser.h"
 #include "cxk/uri.h"
@@ -24,6 +25,7 @@ struct HttpResult{
         CREATE_SOCKET_ERROR = 7,
         POOL_GET_CONNECTION = 8,
         POOL_INVALID_CONNECTION = 9,
+        INVALID_RESPONSE = 10,
     };
 
     HttpResult(int _result, HttpResponse::ptr _response, const std::string& _error): 
@@ -91,17 +93,37 @@ public:
     HttpConnection(Socket::ptr sock, bool owner = true);
 
     /// @brief 接受http响应
+    /// @return 失败返回nullptr并关闭连接, 原因由getRecvError获取
     HttpResponse::ptr recvResponse();
 
+    /// @brief 上一次recvResponse失败的原因: 对方关闭、超时、socket错误或者响应不合法
+    HttpResult::Error getRecvError() const { return m_recvError;}
+
     /// @brief 发送http请求
     /// @param req HTTP请求结构
-    /// @return 是否成功
+    /// @return >0 成功, =0 对方关闭, <0 socket错误
     int sendRequest(HttpRequest::ptr req);
 
+    /// @brief 一次发送多个请求(pipelining), 不等待响应
+    /// @param reqs HTTP请求, 响应按相同的顺序返回
+    /// @return >0 成功, =0 对方关闭, <0 socket错误
+    int sendRequests(const std::vector<HttpRequest::ptr>& reqs);
+
+    /// @brief 读数据, 优先读取解析响应时多读到的数据
+    virtual int read(void* buffer, size_t length) override;
+
+    virtual int read(ByteArray::ptr ba, size_t length) override;
+
+    virtual int readv(const iovec* buffers, size_t count) override;
+
 private:
     uint64_t m_createTime = 0;
     uint64_t m_request = 0;
-
+    HttpResult::Error m_recvError = HttpResult::Error::OK;
+    // 读缓冲, 连接复用时多读到的数据留给下一个响应
+    BufferedStream::ptr m_reader;
+    // 序列化请求头的缓冲区, 连接上一直复用
+    std::string m_headerBuf;
 };
 
 class HttpConnectionPool{
@@ -2,6 +2,7 @@
 #include "cxk/cxk.h"
 #include "http.h"
 #include <cstring>
+#include <charconv>
 
 
 namespace cxk{
@@ -17,12 +18,16 @@ static cxk::ConfigVar<unsigned long long>::ptr g_http_response_buffer_size = cxk
 
 static cxk::ConfigVar<unsigned long long>::ptr g_http_response_max_body_size = cxk::Config::Lookup("http.response.max_body_size", 64 * 1024 * 1024ull, "http response max buffer size");
 
+static cxk::ConfigVar<bool>::ptr g_http_request_zero_copy = cxk::Config::Lookup("http.request.zero_copy", true, "http server parse request without copying fields");
+
 static uint64_t s_http_request_buffer_size = 0;
 static uint64_t s_http_request_max_body_size = 0;
 
 static uint64_t s_http_response_buffer_size = 0;
 static uint64_t s_http_response_max_body_size = 0;
 
+static bool s_http_request_zero_copy = true;
+
 uint64_t HttpRequestParser::GetHttpRequestBufferSize(){
     return s_http_request_buffer_size;
 }
@@ -32,6 +37,10 @@ uint64_t HttpRequestParser::GetHttpRequestMaxBodySize(){
     return s_http_request_max_body_size;
 }
 
+bool HttpRequestParser::IsHttpRequestZeroCopy(){
+    return s_http_request_zero_copy;
+}
+
 uint64_t HttpResponseParser::GetHttpResponseBufferSize(){
     return s_http_response_buffer_size;
 }
@@ -49,6 +58,7 @@ struct _RequestSizeIniter{
         s_http_request_max_body_size = g_http_request_max_body_size->getValue();
         s_http_response_buffer_size = g_http_response_buffer_size->getValue();
         s_http_response_max_body_size = g_http_response_max_body_size->getValue();
+        s_http_request_zero_copy = g_http_request_zero_copy->getValue();
 
         g_http_request_buffer_size->addListener([](const uint64_t& ov, const uint64_t& nv){
             s_http_request_buffer_size = nv;
@@ -65,6 +75,10 @@ struct _RequestSizeIniter{
         g_http_response_max_body_size->addListener([](const uint64_t& ov, const uint64_t& nv){
             s_http_response_max_body_size = nv;
         });
+
+        g_http_request_zero_copy->addListener([](const bool& ov, const bool& nv){
+            s_http_request_zero_copy = nv;
+        });
     }
 };
 
@@ -90,17 +104,29 @@ void on_request_uri(void* data, const char* at, size_t length){
 
 void on_request_fragment(void* data, const char* at, size_t length){
     HttpRequestParser* parser = static_cast<HttpRequestParser*>(data);
-    parser->getData()->setFragment(std::string(at, length));
+    if(parser->isZeroCopy()){
+        parser->getData()->setFragmentView(std::string_view(at, length));
+    } else {
+        parser->getData()->setFragment(std::string(at, length));
+    }
 }
 
 void on_request_query(void* data, const char* at, size_t length){
     HttpRequestParser* parser = static_cast<HttpRequestParser*>(data);
-    parser->getData()->setQuery(std::string(at, length));
+    if(parser->isZeroCopy()){
+        parser->getData()->setQueryView(std::string_view(at, length));
+    } else {
+        parser->getData()->setQuery(std::string(at, length));
+    }
 }
 
 void on_request_path(void* data, const char* at, size_t length){
     HttpRequestParser* parser = static_cast<HttpRequestParser*>(data);
-    parser->getData()->setPath(std::string(at, length));
+    if(parser->isZeroCopy()){
+        parser->getData()->setPathView(std::string_view(at, length));
+    } else {
+        parser->getData()->setPath(std::string(at, length));
+    }
 }
 
 void on_request_version(void* data, const char* at, size_t length){
@@ -130,11 +156,15 @@ void on_request_http_field(void* data, const char* field, size_t flen, const cha
         return;
     }
 
-    parser->getData()->setHeader(std::string(field, flen), std::string(value, vlen));
+    if(parser->isZeroCopy()){
+        parser->getData()->addHeaderView(std::string_view(field, flen), std::string_view(value, vlen));
+    } else {
+        parser->getData()->setHeader(std::string(field, flen), std::string(value, vlen));
+    }
 }
 
 
-HttpRequestParser::HttpRequestParser() : m_error(0){
+HttpRequestParser::HttpRequestParser(bool zero_copy) : m_error(0), m_zeroCopy(zero_copy){
     m_data.reset(new cxk::http::HttpRequest);
     http_parser_init(&m_parser);
     m_parser.request_method = on_request_method;
@@ -157,6 +187,11 @@ size_t HttpRequestParser::execute(char* data, size_t len){
 }
 
 
+size_t HttpRequestParser::parse(const char* data, size_t len){
+    return http_parser_execute(&m_parser, data, len, 0);
+}
+
+
 int HttpRequestParser::isFinished(){
     return http_parser_finish(&m_parser);
 }
@@ -167,9 +202,16 @@ int HttpRequestParser::hasError(){
 }
 
 
-  uint64_t HttpRequestParser::getContentLength(){
-    return m_data->getHeaderAs<uint64_t>("Content-Length", 0);
-  }
+uint64_t HttpRequestParser::getContentLength(){
+    // 不生成头部map, 零拷贝解析时也可以直接取值
+    std::string_view v = m_data->getHeaderView("Content-Length");
+    uint64_t length = 0;
+    auto rt = std::from_chars(v.data(), v.data() + v.size(), length);
+    if(rt.ec != std::errc() || rt.ptr != v.data() + v.size()){
+        return 0;
+    }
+    return length;
+}
 
 
 void on_response_reason(void* data, const char* at, size_t length){
@@ -221,7 +263,7 @@ void on_response_last_chunk(void* data, const char* at, size_t length){
 
 
 
-HttpResponseParser::HttpResponseParser(){
+HttpResponseParser::HttpResponseParser() : m_error(0){
     m_data.reset(new cxk::http::HttpResponse);
     httpclient_parser_init(&m_parser);
     m_parser.reason_phrase = on_response_reason;
@@ -244,6 +286,14 @@ size_t HttpResponseParser::execute(char* data, size_t len, bool chunck){
 }
 
 
+size_t HttpResponseParser::parse(const char* data, size_t len, bool chunck){
+    if(chunck){
+        httpclient_parser_init(&m_parser);
+    }
+    return httpclient_parser_execute(&m_parser, data, len, 0);
+}
+
+
 int HttpResponseParser::isFinished(){
     return httpclient_parser_is_finished(&m_parser);
 }
@@ -12,8 +12,10 @@ class HttpRequestParser{
 public:
     using ptr = std::shared_ptr<HttpRequestParser>;
 
-    /// @brief  构造函数
-    HttpRequestParser();
+    /// @brief              构造函数
+    /// @param zero_copy    零拷贝解析, 请求的字段先记录为指向解析数据的string_view,
+    ///                     解析完成后需要调用HttpRequest::adoptRaw把数据交给请求
+    HttpRequestParser(bool zero_copy = false);
 
     /// @brief      解析协议
     /// @param data 协议文本内存
@@ -21,6 +23,13 @@ public:
     /// @return     返回实际解析的长度，并且将已解析的数据移除
     size_t execute(char* data, size_t len);
 
+    /// @brief      解析协议, 不移动未解析的数据
+    /// @param data 协议文本内存
+    /// @param len  协议文本长度
+    /// @return     返回实际解析的长度
+    /// @attention  解析器记录的字段位置是相对data的, 数据不完整时应该用新的解析器从头解析
+    size_t parse(const char* data, size_t len);
+
     /// @brief  是否解析完成
     int isFinished();
 
@@ -33,6 +42,9 @@ public:
     /// @brief  设置错误码
     void setError(int v){ m_error = v; }
 
+    /// @brief  是否是零拷贝解析
+    bool isZeroCopy() const { return m_zeroCopy; }
+
     /// @brief  返回Content-Length
     uint64_t getContentLength() ;
 
@@ -46,6 +58,9 @@ public:
     /// @brief  返回HttpRequest协议解析的最大缓存大小
     static uint64_t GetHttpRequestMaxBodySize();
 
+    /// @brief  服务端是否零拷贝解析请求
+    static bool IsHttpRequestZeroCopy();
+
 private:
     http_parser m_parser;
     HttpRequest::ptr m_data;
@@ -53,6 +68,7 @@ private:
     // 1000:invaild method
     // 1001:invalid version 
     int m_error;
+    bool m_zeroCopy;
 };
 
 
@@ -71,6 +87,13 @@ public:
     /// @return         返回实际解析的长度，并且将已解析的数据移除
     size_t execute(char* data, size_t len, bool chunck);
 
+    /// @brief          解析HTTP响应协议, 不移动未解析的数据
+    /// @param data     协议数据内存, data[len]必须为'\0'
+    /// @param len      协议数据长度
+    /// @param chunck   是否在解析chunck
+    /// @return         返回实际解析的长度
+    size_t parse(const char* data, size_t len, bool chunck);
+
     /// @brief  是否解析完成
     int isFinished() ;
 
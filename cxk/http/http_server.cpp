@@ -1,12 +1,22 @@
 #include "http_server.h"
+#include "http_compress.h"
+#include "cxk/config.h"
+#include "cxk/http2/http2_session.h"
 
 namespace cxk{
 namespace http{
 
 static cxk::Logger::ptr g_logger = CXK_LOG_NAME("system");
 
+// 流水线中最多合并发送的响应数量
+static const size_t s_max_batch_responses = 16;
+
+static cxk::ConfigVar<bool>::ptr g_http_server_http2 =
+    cxk::Config::Lookup("http.server.http2", true, "http server support http2 (h2c prior knowledge and h2 over tls)");
+
 HttpServer::HttpServer(bool isKeepAlive , cxk::IOManager* worker, 
-        cxk::IOManager* accept_worker) : TcpServer(worker, accept_worker) ,m_isKeepAlive(isKeepAlive){
+        cxk::IOManager* accept_worker) : TcpServer(worker, accept_worker) ,m_isKeepAlive(isKeepAlive)
+        ,m_http2(g_http_server_http2->getValue()){
     m_dispatch.reset(new ServletDispatch());
     m_type = "http";
 }
@@ -18,21 +28,108 @@ void HttpServer::setName(const std::string& v){
 }
 
 
+bool HttpServer::start(){
+    if(m_http2){
+        for(auto& i : m_socks){
+            auto ssl = std::dynamic_pointer_cast<SSLSocket>(i);
+            if(ssl){
+                ssl->setAlpnProtocols({"h2", "http/1.1"});
+            }
+        }
+    }
+    return TcpServer::start();
+}
+
+
+void HttpServer::handleOverload(Socket::ptr client){
+    // ALPN已经选择h2时对方不认识HTTP/1.1响应
+    auto ssl = std::dynamic_pointer_cast<SSLSocket>(client);
+    if(!ssl || ssl->getAlpnProtocol() != "h2"){
+        HttpResponse::ptr rsp(new HttpResponse(0x11, true));
+        rsp->setStatus(HttpStatus::SERVICE_UNAVAILABLE);
+        rsp->setHeader("Server", getName());
+        rsp->setHeader("Retry-After", "1");
+        std::string data;
+        rsp->serializeHeader(data);
+        // 新连接的发送缓冲是空的, 不会阻塞
+        client->send(data.c_str(), data.size());
+    }
+    client->close();
+}
+
+
+void HttpServer::handleHttp2(HttpSession::ptr session){
+    auto self = std::static_pointer_cast<HttpServer>(shared_from_this());
+    auto h2 = std::make_shared<http2::Http2Session>(session, false, m_worker);
+    h2->serve([self](http2::Http2Stream::ptr stream){
+        HttpRequest::ptr req = stream->getRequest();
+        HttpResponse::ptr rsp(new HttpResponse(0x20, false));
+        rsp->setHeader("Server", self->getName());
+        auto slt = self->m_dispatch->route(req);
+        if(!slt || !slt->isStreamBody()){
+            if(!stream->recvBody()){
+                CXK_LOG_WARN(g_logger) << "recv http2 request body fail";
+                return;
+            }
+        }
+        if(slt){
+            slt->handle(req, rsp, nullptr);
+        }
+
+        // 按Accept-Encoding压缩响应体, 规则和HTTP/1.1相同
+        auto codec = HttpCompress::Select(req, rsp);
+        if(codec && !rsp->getBodyWriter() && !HttpCompress::IsStream(rsp)){
+            HttpCompress::Compress(req, rsp, codec);
+            codec = nullptr;
+        }
+        stream->sendResponse(rsp, codec);
+    });
+    session->close();
+}
+
+
 void HttpServer::handleClient(Socket::ptr client){
     CXK_LOG_DEBUG(g_logger) << "new client ";
     cxk::http::HttpSession::ptr session (new HttpSession(client));
+    if(m_http2){
+        // TLS通过ALPN协商, 明文连接按前言识别
+        auto ssl = std::dynamic_pointer_cast<SSLSocket>(client);
+        if((ssl && ssl->getAlpnProtocol() == "h2") || session->isHttp2Preface()){
+            handleHttp2(session);
+            return;
+        }
+    }
     do{
-        auto req = session->recvRequest();
+        // 请求体在匹配到servlet后按需读取
+        auto req = session->recvRequest(false);
         if(!req){
             CXK_LOG_WARN(g_logger)  << "recv http request fail, errno="
                 << errno << " errstr=" << strerror(errno);
+            session->flushResponses();
             break;
         }
 
 
         HttpResponse::ptr rsp(new HttpResponse(req->getVersion(), req->isClose() || !m_isKeepAlive));
         rsp->setHeader("Server", getName());
-        m_dispatch->handle(req, rsp, session);
+        auto slt = m_dispatch->route(req);
+        if(!slt || !slt->isStreamBody()){
+            if(!session->recvBody(req)){
+                CXK_LOG_WARN(g_logger) << "recv http request body fail";
+                session->flushResponses();
+                break;
+            }
+        }
+        if(slt){
+            slt->handle(req, rsp, session);
+        }
+
+        bool close = !m_isKeepAlive || req->isClose();
+        // servlet没有读完的请求体
+        if(!session->discardBody()){
+            close = true;
+            rsp->setClose(true);
+        }
 
 
         CXK_LOG_DEBUG(g_logger) << "request: " << std::endl
@@ -40,9 +137,29 @@ void HttpServer::handleClient(Socket::ptr client){
         CXK_LOG_DEBUG(g_logger) << "response: " << std::endl
             << * rsp;
 
-        session->sendResponse(rsp);
+        // 按Accept-Encoding压缩响应体
+        auto codec = HttpCompress::Select(req, rsp);
+        if(rsp->getBodyWriter() || (codec && HttpCompress::IsStream(rsp))){
+            if(session->flushResponses() <= 0 || session->sendResponse(rsp, codec) <= 0){
+                break;
+            }
+            // HTTP/1.0不能用chunked, 流式响应靠关闭连接结束
+            close = close || rsp->isClose();
+        } else {
+            if(codec){
+                HttpCompress::Compress(req, rsp, codec);
+            }
+            // 流水线中后面的请求已经收到时先不发送, 处理完后合并成一次writev
+            session->queueResponse(rsp);
+            if(close || session->getQueuedResponseCount() >= s_max_batch_responses
+                    || !session->hasBufferedRequest()){
+                if(session->flushResponses() <= 0){
+                    break;
+                }
+            }
+        }
 
-        if(!m_isKeepAlive || req->isClose()){
+        if(close){
             break;
         }
     } while(true);
@@ -30,11 +30,27 @@ public:
 
     virtual void setName(const std::string& v) override;
 
+    /// @brief  是否支持HTTP/2, 默认取http.server.http2
+    bool isHttp2() const { return m_http2; }
+
+    /// @brief  设置是否支持HTTP/2, 在start之前调用
+    void setHttp2(bool v) { m_http2 = v; }
+
+    /// @brief  开始监听, 支持HTTP/2时在SSL监听socket上通过ALPN提供h2
+    virtual bool start() override;
+
 protected:
     virtual void handleClient(Socket::ptr client) override;
 
+    /// @brief  过载时不读取请求, 直接返回503并关闭连接
+    virtual void handleOverload(Socket::ptr client) override;
+
+    /// @brief  处理HTTP/2连接, 每个流在单独的协程中交给servlet
+    void handleHttp2(HttpSession::ptr session);
+
 private:
     bool m_isKeepAlive;
+    bool m_http2;
     ServletDispatch::ptr m_dispatch;
 
 };
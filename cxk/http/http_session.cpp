@@ -1,98 +1,630 @@
 #include "http_session.h"
 #include "http_parser.h"
+#include "http_compress.h"
+#include "cxk/http2/frame.h"
+#include <charconv>
+#include <string.h>
 
 namespace cxk{
 namespace http{
 
 static Logger::ptr g_logger = CXK_LOG_NAME("system");
 
-HttpSession::HttpSession(Socket::ptr sock, bool owner) : SocketStream(sock, owner){
+HttpBodyStream::HttpBodyStream(BufferedStream::ptr reader, uint64_t length, bool chunked)
+    : m_reader(reader)
+    , m_left(chunked ? 0 : length)
+    , m_chunked(chunked)
+    , m_finished(!chunked && length == 0){
+}
+
+
+int HttpBodyStream::prepare(){
+    if(m_finished){
+        return 0;
+    }
+    if(m_left > 0){
+        return 1;
+    }
 
+    // chunk头部: 十六进制长度, 后面可能有";扩展"
+    std::string_view line = m_reader->readUntil("\r\n");
+    if(line.empty()){
+        return -1;
+    }
+    uint64_t size = 0;
+    auto rt = std::from_chars(line.data(), line.data() + line.size() - 2, size, 16);
+    if(rt.ec != std::errc() || rt.ptr == line.data()
+            || (*rt.ptr != ';' && *rt.ptr != ' ' && *rt.ptr != '\t' && *rt.ptr != '\r')){
+        CXK_LOG_LIMIT_ERROR(g_logger, 10) << "invalid http chunk size";
+        return -1;
+    }
+    if(size > 0){
+        m_left = size;
+        return 1;
+    }
+
+    // 最后一个chunk, 丢弃trailer直到空行
+    do{
+        line = m_reader->readUntil("\r\n");
+        if(line.empty()){
+            return -1;
+        }
+    } while(line.size() > 2);
+    m_finished = true;
+    return 0;
 }
 
-HttpRequest::ptr HttpSession::recvRequest(){
 
-    HttpRequestParser::ptr parser(new HttpRequestParser);
-    uint64_t buff_size = HttpRequestParser::GetHttpRequestBufferSize();
-    CXK_LOG_DEBUG(g_logger) << "HttpSession::recvRequest() call" << " buff_size:" << buff_size;
+bool HttpBodyStream::advance(size_t len){
+    m_left -= len;
+    if(m_left > 0){
+        return true;
+    }
+    if(!m_chunked){
+        m_finished = true;
+        return true;
+    }
+    // chunk数据后面的CRLF
+    std::string_view crlf = m_reader->peek(2);
+    if(crlf.size() < 2 || crlf[0] != '\r' || crlf[1] != '\n'){
+        CXK_LOG_LIMIT_ERROR(g_logger, 10) << "invalid http chunk end";
+        return false;
+    }
+    m_reader->consume(2);
+    return true;
+}
 
-    std::shared_ptr<char> buffer(new char[buff_size], [](char* ptr){
-        delete[] ptr;
-    });
 
-    char* data = buffer.get();
-    int offset = 0;
+int HttpBodyStream::read(void* buffer, size_t length){
+    int rt = prepare();
+    if(rt <= 0 || length == 0){
+        return rt;
+    }
+    // 不超过剩余长度, 不会读到下一个请求的数据
+    int len = m_reader->read(buffer, std::min<uint64_t>(length, m_left));
+    if(len <= 0){
+        return -1;
+    }
+    return advance(len) ? len : -1;
+}
+
 
-    // 循环读取数据
+int HttpBodyStream::read(ByteArray::ptr ba, size_t length){
+    int rt = prepare();
+    if(rt <= 0 || length == 0){
+        return rt;
+    }
+    int len = m_reader->read(ba, std::min<uint64_t>(length, m_left));
+    if(len <= 0){
+        return -1;
+    }
+    return advance(len) ? len : -1;
+}
+
+
+bool HttpBodyStream::drain(){
+    char buffer[4096];
+    int rt = 0;
     do{
-        int len = read(data + offset, buff_size - offset);
-        CXK_LOG_DEBUG(g_logger) << "HttpSession::recvRequest() read len:" << len;
-        if(len <= 0){
+        rt = read(buffer, sizeof(buffer));
+    } while(rt > 0);
+    return rt == 0;
+}
+
+
+HttpSession::HttpSession(Socket::ptr sock, bool owner) : SocketStream(sock, owner){
+    m_reader.reset(new BufferedStream(std::make_shared<SocketStream>(sock, false),
+                HttpRequestParser::GetHttpRequestBufferSize()));
+}
+
+
+// Transfer-Encoding的最后一个编码是否是chunked
+static bool IsChunked(std::string_view transfer_encoding){
+    while(!transfer_encoding.empty() && (transfer_encoding.back() == ' ' || transfer_encoding.back() == '\t')){
+        transfer_encoding.remove_suffix(1);
+    }
+    return transfer_encoding.size() >= 7
+        && strncasecmp(transfer_encoding.data() + transfer_encoding.size() - 7, "chunked", 7) == 0;
+}
+
+
+HttpRequest::ptr HttpSession::recvRequest(bool read_body){
+    // 上一个请求没有读完的请求体
+    if(!discardBody()){
+        close();
+        return nullptr;
+    }
+
+    HttpRequestParser::ptr parser;
+    bool zero_copy = HttpRequestParser::IsHttpRequestZeroCopy();
+    // 请求体是否已经在读缓冲中, 和请求头一起交给请求
+    bool body_buffered = false;
+    bool chunked = false;
+
+    // 在读缓冲上解析请求头, 缓冲区中可能已经有上一次多读的数据。
+    // 解析器记录的字段位置是相对本次数据的, 请求头不完整时读到更多数据后从头重新解析
+    do{
+        std::string_view data = m_reader->peek();
+        parser.reset(new HttpRequestParser(zero_copy));
+        size_t nparse = parser->parse(data.data(), data.size());
+        if(parser->hasError()){
+            CXK_LOG_LIMIT_ERROR(g_logger, 10) << "parse http request error";
             close();
             return nullptr;
         }
 
-        len += offset;
-        size_t nparse = parser->execute(data, len);
-        if(parser->hasError()){
-            CXK_LOG_ERROR(g_logger) << "parse http request error";
+        if(parser->isFinished()){
+            chunked = IsChunked(parser->getData()->getHeaderView("Transfer-Encoding"));
+            if(zero_copy){
+                // 请求头和已经收到的请求体一次拷贝给请求, 字段不再单独分配
+                uint64_t length = parser->getContentLength();
+                size_t len = nparse;
+                if(read_body && !chunked && length > 0 && length <= data.size() - nparse){
+                    parser->getData()->setBodyView(data.substr(nparse, length));
+                    len += length;
+                    body_buffered = true;
+                }
+                parser->getData()->adoptRaw(data.data(), len);
+                m_reader->consume(len);
+            } else {
+                m_reader->consume(nparse);
+            }
+            break;
+        }
+
+        // 请求头超过缓冲区大小
+        if(m_reader->isFull()){
             close();
             return nullptr;
         }
 
-        offset = len - nparse;
-        if(offset == (int)buff_size){
+        int len = m_reader->fill();
+        CXK_LOG_DEBUG(g_logger) << "HttpSession::recvRequest() read len:" << len;
+        if(len <= 0){
             close();
             return nullptr;
         }
-
-        if(parser->isFinished()){
-            break;
-        } 
     } while(true);
 
 
-    // 处理请求体
+    // 还没有收到的请求体从读缓冲中流式读取, 有Transfer-Encoding时忽略Content-Length
+    HttpRequest::ptr req = parser->getData();
     uint64_t length = parser->getContentLength();
-    if(length > 0){
-        std::string body;
-        body.resize(length);
+    if(chunked || (length > 0 && !body_buffered)){
+        m_bodyStream = std::make_shared<HttpBodyStream>(m_reader, length, chunked);
+        req->setBodyStream(m_bodyStream);
+    }
+    if(read_body && !recvBody(req)){
+        return nullptr;
+    }
+
+    // 处理连接状态, HTTP/1.1默认保持连接, HTTP/1.0默认关闭
+    std::string_view connection = req->getHeaderView("Connection");
+    if(req->getVersion() >= 0x11){
+        req->setClose(connection.size() == 5 && strncasecmp(connection.data(), "close", 5) == 0);
+    } else if(connection.size() == 10 && strncasecmp(connection.data(), "keep-alive", 10) == 0){
+        req->setClose(false);
+    }
+    return req;
+}
+
+
+// 解压请求体, 不支持的编码原样交给servlet
+bool HttpSession::DecodeBody(HttpRequest::ptr req){
+    std::string_view content_encoding = req->getHeaderView("Content-Encoding");
+    std::string_view body = req->getBodyView();
+    if(body.empty() || content_encoding.empty()){
+        return true;
+    }
+    auto codec = CompressCodec::Get(std::string(content_encoding));
+    if(!codec){
+        return true;
+    }
 
-        int len = 0;
-        // 将已读取的数据复制到body中
-        if(length >= (uint64_t)offset){
-            memcpy(&body[0], data, offset);
-            len = offset;
+    iovec iov;
+    iov.iov_base = (void*)body.data();
+    iov.iov_len = body.size();
+    ByteArray::ptr ba(new ByteArray);
+    // 解压后的大小同样受http.reauest.max_body_size限制
+    if(!codec->decompress(&iov, 1, ba, HttpRequestParser::GetHttpRequestMaxBodySize())){
+        CXK_LOG_LIMIT_ERROR(g_logger, 10) << "decompress http request body error, content-encoding: "
+            << content_encoding;
+        return false;
+    }
+    ba->setPosition(0);
+    req->setBody(ba->toString());
+    req->delHeader("Content-Encoding");
+    return true;
+}
+
+
+bool HttpSession::recvBody(HttpRequest::ptr req){
+    if(m_bodyStream){
+        uint64_t max_size = HttpRequestParser::GetHttpRequestMaxBodySize();
+        std::string body;
+        if(!m_bodyStream->isChunked()){
+            uint64_t length = m_bodyStream->getLeft();
+            if(length > max_size){
+                CXK_LOG_LIMIT_ERROR(g_logger, 10) << "http request body too large, content-length: " << length;
+                close();
+                return false;
+            }
+            body.resize(length);
+            if(length > 0 && m_bodyStream->readFixSize(&body[0], length) <= 0){
+                close();
+                return false;
+            }
         } else {
-            memcpy(&body[0], data, length);
-            len = length;
-        }
-        // 读取剩余的数据
-        length -= offset;
-        if(length > 0){
-            if(readFixSize(&body[len], length) <= 0){
+            // chunked请求体的长度事先不知道, 分段追加
+            static const size_t s_step = 16 * 1024;
+            int rt = 0;
+            do{
+                size_t pos = body.size();
+                body.resize(pos + s_step);
+                rt = m_bodyStream->read(&body[pos], s_step);
+                body.resize(pos + std::max(rt, 0));
+                if(body.size() > max_size){
+                    CXK_LOG_LIMIT_ERROR(g_logger, 10) << "http request chunked body too large";
+                    rt = -1;
+                }
+            } while(rt > 0);
+            if(rt < 0){
                 close();
-                return nullptr;
+                return false;
             }
         }
-        // 设置请求体
-        parser->getData()->setBody(body);
+        m_bodyStream.reset();
+        req->setBodyStream(nullptr);
+        req->setBody(std::move(body));
     }
 
-    // 处理连接状态
-    std::string keep_alive = parser->getData()->getHeader("Connection");
-    if(strcasecmp(keep_alive.c_str(), "keep-alive") == 0){
-        parser->getData()->setClose(false);
+    if(!DecodeBody(req)){
+        close();
+        return false;
     }
-    return parser->getData();
+    return true;
 }
-    
-    
+
+
+bool HttpSession::discardBody(){
+    if(!m_bodyStream){
+        return true;
+    }
+    bool rt = m_bodyStream->drain();
+    m_bodyStream.reset();
+    return rt;
+}
+
+
+// 用sendfile发送文件区间
+static int SendFile(Socket::ptr sock, HttpFileBody::ptr file){
+    off_t offset = file->getOffset();
+    uint64_t left = file->getLength();
+    while(left > 0){
+        int rt = sock->sendFile(file->getFd(), &offset, std::min<uint64_t>(left, 1 << 30));
+        if(rt <= 0){
+            // 文件在发送过程中被截短
+            return rt == 0 ? -1 : rt;
+        }
+        left -= rt;
+    }
+    return 1;
+}
+
+
 int HttpSession::sendResponse(HttpResponse::ptr rsp){
-     std::stringstream ss;
-     ss << *rsp;
-     std::string data = ss.str();
-     return writeFixSize(data.c_str(), data.size());
+     if(rsp->getBodyWriter()){
+         return sendResponse(rsp, nullptr);
+     }
+     // 追加在排队的响应头后面, 发出后去掉
+     size_t offset = m_headerBuf.size();
+     rsp->serializeHeader(m_headerBuf);
+     const char* header = m_headerBuf.c_str() + offset;
+     size_t header_len = m_headerBuf.size() - offset;
+     int rt = 0;
+     if(rsp->getFileBody()){
+         rt = writeFixSize(header, header_len);
+         if(rt > 0){
+             rt = SendFile(getSocket(), rsp->getFileBody());
+         }
+     } else {
+         const std::string& body = rsp->getBody();
+         // 头部和body一次writev写出, 避免拷贝body
+         iovec iovs[2];
+         iovs[0].iov_base = (void*)header;
+         iovs[0].iov_len = header_len;
+         iovs[1].iov_base = (void*)body.c_str();
+         iovs[1].iov_len = body.size();
+         rt = writevFixSize(iovs, body.empty() ? 1 : 2);
+     }
+     m_headerBuf.resize(offset);
+     return rt;
+}
+
+
+void HttpSession::queueResponse(HttpResponse::ptr rsp){
+    size_t offset = m_headerBuf.size();
+    rsp->serializeHeader(m_headerBuf);
+    m_queued.push_back(rsp);
+    m_queuedHeaders.push_back(std::make_pair(offset, m_headerBuf.size() - offset));
+}
+
+
+int HttpSession::flushResponses(){
+    if(m_queued.empty()){
+        return 1;
+    }
+    // 头部和body都不拷贝, 一次writev写出; 文件响应体在之前的数据写出后用sendfile发送
+    std::vector<iovec> iovs;
+    iovs.reserve(m_queued.size() * 2);
+    int rt = 1;
+    for(size_t i = 0; i < m_queued.size() && rt > 0; ++i){
+        const std::string& body = m_queued[i]->getBody();
+        auto file = m_queued[i]->getFileBody();
+        iovs.push_back({(void*)(m_headerBuf.c_str() + m_queuedHeaders[i].first), m_queuedHeaders[i].second});
+        if(file){
+            rt = writevFixSize(iovs.data(), iovs.size());
+            iovs.clear();
+            if(rt > 0){
+                rt = SendFile(getSocket(), file);
+            }
+        } else if(!body.empty()){
+            iovs.push_back({(void*)body.c_str(), body.size()});
+        }
+    }
+    if(rt > 0 && !iovs.empty()){
+        rt = writevFixSize(iovs.data(), iovs.size());
+    }
+    m_queued.clear();
+    m_queuedHeaders.clear();
+    // 保留容量给后面的响应复用
+    m_headerBuf.clear();
+    return rt;
+}
+
+
+bool HttpSession::hasBufferedRequest(){
+    // 不读取新数据, 只看缓冲区中已有的
+    if(m_bodyStream && !m_bodyStream->isFinished()){
+        return false;
+    }
+    std::string_view data = m_reader->peek();
+    if(data.empty()){
+        return false;
+    }
+    HttpRequestParser parser(true);
+    size_t nparse = parser.parse(data.data(), data.size());
+    if(parser.hasError()){
+        // 交给recvRequest处理错误
+        return true;
+    }
+    // chunked请求体是否完整需要解码才知道, 按不完整处理
+    return parser.isFinished() && !IsChunked(parser.getData()->getHeaderView("Transfer-Encoding"))
+        && parser.getContentLength() <= data.size() - nparse;
+}
+
+
+bool HttpSession::isHttp2Preface(){
+    while(true){
+        std::string_view data = m_reader->peek();
+        size_t len = std::min(data.size(), http2::CONNECTION_PREFACE_SIZE);
+        if(memcmp(data.data(), http2::CONNECTION_PREFACE, len) != 0){
+            return false;
+        }
+        if(len == http2::CONNECTION_PREFACE_SIZE){
+            return true;
+        }
+        if(m_reader->fill() <= 0){
+            return false;
+        }
+    }
+}
+
+
+// 发送一个chunk, prefix是要一起发出的数据(响应头), 发出后清空; last为true时追加结束块
+static int SendChunk(Stream* stream, std::string_view& prefix, const void* data, size_t len, bool last){
+    char size[24];
+    int size_len = len == 0 ? 0 : snprintf(size, sizeof(size), "%zx\r\n", len);
+    static const char s_crlf[] = "\r\n";
+    static const char s_last[] = "0\r\n\r\n";
+
+    iovec iovs[5];
+    size_t count = 0;
+    auto add = [&iovs, &count](const void* base, size_t len){
+        if(len > 0){
+            iovs[count].iov_base = (void*)base;
+            iovs[count].iov_len = len;
+            ++count;
+        }
+    };
+    add(prefix.data(), prefix.size());
+    add(size, size_len);
+    add(data, len);
+    add(s_crlf, len == 0 ? 0 : 2);
+    add(s_last, last ? 5 : 0);
+    if(count == 0){
+        return 1;
+    }
+    int rt = stream->writevFixSize(iovs, count);
+    prefix = std::string_view();
+    return rt;
+}
+
+
+/// @brief  响应体的输出流, 交给HttpResponse::BodyWriter
+/// @details 写入的数据经过压缩器(可选)后作为chunk发出, 响应头和第一个chunk一起发送。
+///          不使用chunked时(HTTP/1.0)直接写出数据, 由关闭连接表示响应体结束
+class HttpChunkedStream : public Stream{
+public:
+    HttpChunkedStream(Stream* stream, std::string_view header, CompressCodec::Compressor::ptr compressor, bool chunked)
+        : m_stream(stream)
+        , m_header(header)
+        , m_compressor(compressor)
+        , m_chunked(chunked){
+    }
+
+    virtual int read(void* buffer, size_t length) override { return -1; }
+
+    virtual int read(ByteArray::ptr ba, size_t length) override { return -1; }
+
+    virtual int write(const void* buffer, size_t length) override{
+        if(m_finished){
+            return -1;
+        }
+        if(length == 0){
+            return 0;
+        }
+        if(!m_compressor){
+            int rt = send(buffer, length, false);
+            return rt <= 0 ? -1 : length;
+        }
+        m_out.clear();
+        if(!m_compressor->update(buffer, length, m_out)){
+            return -1;
+        }
+        if(!m_out.empty() && send(m_out.c_str(), m_out.size(), false) <= 0){
+            return -1;
+        }
+        return length;
+    }
+
+    virtual int write(ByteArray::ptr ba, size_t length) override{
+        std::vector<iovec> iovs;
+        ba->getReadBuffers(iovs, length);
+        size_t total = 0;
+        for(auto& i : iovs){
+            if(write(i.iov_base, i.iov_len) < 0){
+                return -1;
+            }
+            total += i.iov_len;
+        }
+        ba->setPosition(ba->getPosition() + total);
+        return total;
+    }
+
+    /// @brief  不关闭连接
+    virtual void close() override {}
+
+    /// @brief  写出压缩器剩余的数据和结束块
+    int finish(){
+        if(m_finished){
+            return -1;
+        }
+        m_finished = true;
+        m_out.clear();
+        if(m_compressor && !m_compressor->finish(m_out)){
+            return -1;
+        }
+        return send(m_out.c_str(), m_out.size(), true);
+    }
+
+private:
+    int send(const void* data, size_t len, bool last){
+        if(m_chunked){
+            return SendChunk(m_stream, m_header, data, len, last);
+        }
+        iovec iovs[2];
+        size_t count = 0;
+        if(!m_header.empty()){
+            iovs[count++] = {(void*)m_header.data(), m_header.size()};
+        }
+        if(len > 0){
+            iovs[count++] = {(void*)data, len};
+        }
+        if(count == 0){
+            return 1;
+        }
+        int rt = m_stream->writevFixSize(iovs, count);
+        m_header = std::string_view();
+        return rt;
+    }
+
+private:
+    Stream* m_stream;
+    // 还没有发出的响应头, 指向HttpSession的头部缓冲区
+    std::string_view m_header;
+    CompressCodec::Compressor::ptr m_compressor;
+    bool m_chunked;
+    bool m_finished = false;
+    std::string m_out;
+};
+
+
+int HttpSession::sendResponse(HttpResponse::ptr rsp, CompressCodec::ptr codec){
+    CompressCodec::Compressor::ptr compressor = codec ? codec->createCompressor() : nullptr;
+    const HttpResponse::BodyWriter& writer = rsp->getBodyWriter();
+    if(!writer && !compressor){
+        // 不支持流式压缩, 压缩完整的响应体
+        if(codec){
+            std::string data;
+            if(!codec->compress(rsp->getBody(), data)){
+                CXK_LOG_ERROR(g_logger) << "compress http response body error, content-encoding: "
+                    << codec->getName();
+                return sendResponse(rsp);
+            }
+            rsp->setBody(std::move(data));
+            HttpCompress::SetEncoding(rsp, codec);
+        }
+        return sendResponse(rsp);
+    }
+
+    if(compressor){
+        HttpCompress::SetEncoding(rsp, codec);
+    }
+    bool chunked = rsp->getVersion() >= 0x11;
+    if(chunked){
+        rsp->setHeader("Transfer-Encoding", "chunked");
+    } else {
+        rsp->setClose(true);
+    }
+    size_t offset = m_headerBuf.size();
+    rsp->serializeHeader(m_headerBuf);
+    // 响应头和第一个chunk一起发送
+    auto out = std::make_shared<HttpChunkedStream>(this
+            , std::string_view(m_headerBuf).substr(offset), compressor, chunked);
+
+    int rt = 0;
+    if(writer){
+        if(writer(out) != 0){
+            // 响应头可能已经发出, 只能断开连接
+            CXK_LOG_LIMIT_ERROR(g_logger, 10) << "write http response body error";
+            rt = -1;
+        }
+    } else {
+        // 每次交给压缩器的数据长度
+        static const size_t s_step = 32 * 1024;
+        const std::string& body = rsp->getBody();
+        for(size_t pos = 0; pos < body.size(); pos += s_step){
+            if(out->write(body.c_str() + pos, std::min(s_step, body.size() - pos)) < 0){
+                rt = -1;
+                break;
+            }
+        }
+    }
+
+    if(rt == 0){
+        rt = out->finish();
+    }
+    m_headerBuf.resize(offset);
+    if(rt < 0){
+        close();
+    }
+    return rt;
+}
+
+
+int HttpSession::read(void* buffer, size_t length){
+    return m_reader->read(buffer, length);
+}
+
+
+int HttpSession::read(ByteArray::ptr ba, size_t length){
+    return m_reader->read(ba, length);
+}
+
+
+int HttpSession::readv(const iovec* buffers, size_t count){
+    return m_reader->readv(buffers, count);
 }
 
 }
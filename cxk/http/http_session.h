@@ -1,13 +1,72 @@
 #pragma once
 
 #include "cxk/stream/socket_stream.h"
+#include "cxk/stream/buffered_stream.h"
 #include "http.h"
 #include "http_parser.h"
+#include "cxk/stream/compress_codec.h"
 
 namespace cxk{
 namespace http{
 
 
+/// @brief  HTTP请求体的只读流
+/// @details 从连接的读缓冲中按Content-Length或者chunked编码读取请求体, 不会读到下一个请求。
+///          chunked编码在读取时解除, 读到的是原始数据; 读完后返回0
+class HttpBodyStream : public Stream{
+public:
+    using ptr = std::shared_ptr<HttpBodyStream>;
+
+    /// @brief          构造函数
+    /// @param reader   连接的读缓冲
+    /// @param length   Content-Length, chunked时忽略
+    /// @param chunked  是否是chunked编码
+    HttpBodyStream(BufferedStream::ptr reader, uint64_t length, bool chunked);
+
+    /// @brief          读请求体
+    /// @return         @retval > 0  读到的数据大小, @retval = 0  请求体已经读完, @retval < 0  出错或者连接提前关闭
+    virtual int read(void* buffer, size_t length) override;
+
+    virtual int read(ByteArray::ptr ba, size_t length) override;
+
+    /// @brief          只读, 返回-1
+    virtual int write(const void* buffer, size_t length) override { return -1; }
+
+    virtual int write(ByteArray::ptr ba, size_t length) override { return -1; }
+
+    /// @brief          不关闭连接, 没有读完的请求体由HttpSession丢弃
+    virtual void close() override {}
+
+    /// @brief          读取并丢弃剩余的请求体
+    /// @return         是否成功读到请求体结尾
+    bool drain();
+
+    /// @brief          请求体是否已经读完
+    bool isFinished() const { return m_finished; }
+
+    /// @brief          是否是chunked编码
+    bool isChunked() const { return m_chunked; }
+
+    /// @brief          剩余的长度, chunked时是当前chunk剩余的长度
+    uint64_t getLeft() const { return m_left; }
+
+private:
+    /// @brief          准备好可以读的数据, chunked时读取下一个chunk的头部
+    /// @return         @retval > 0  成功, @retval = 0  请求体已经读完, @retval < 0  出错
+    int prepare();
+
+    /// @brief          读取了len字节数据
+    /// @return         chunk结尾的CRLF是否正确
+    bool advance(size_t len);
+
+private:
+    BufferedStream::ptr m_reader;
+    uint64_t m_left;
+    bool m_chunked;
+    bool m_finished;
+};
+
+
 /// @brief  HTTP Session封装
 class HttpSession : public SocketStream{
 public:
@@ -19,13 +78,73 @@ public:
     HttpSession(Socket::ptr sock, bool owner = true);
 
     /// @brief          接收HTTP请求
-    HttpRequest::ptr recvRequest();
+    /// @param read_body 是否读取完整的请求体, 为false时请求体通过HttpRequest::getBodyStream流式读取
+    HttpRequest::ptr recvRequest(bool read_body = true);
+
+    /// @brief          读取流式接收的请求中剩余的请求体, 按Content-Encoding解压后设置到请求
+    /// @details        请求体超过http.reauest.max_body_size时失败
+    /// @return         是否成功, 失败时连接被关闭
+    bool recvBody(HttpRequest::ptr req);
+
+    /// @brief          丢弃流式请求中servlet没有读取的请求体, 使连接可以接收下一个请求
+    /// @return         是否成功
+    bool discardBody();
 
     /// @brief          发送HTTP响应
     /// @param rsp      HTTP响应
     /// @return         -1: 发送失败, 0: 对方关闭连接, >0: 发送成功
     int sendResponse(HttpResponse::ptr rsp);
 
+    /// @brief          边压缩边用chunked发送HTTP响应
+    /// @details        响应体按块交给流式压缩器, 有压缩输出就作为一个chunk发出,
+    ///                 不需要等整个响应体压缩完。编解码器不支持流式压缩时压缩完整响应体后发送。
+    ///                 设置了HttpResponse::setBodyWriter时由回调写出响应体; HTTP/1.0不支持chunked,
+    ///                 响应体写完后关闭连接
+    /// @param rsp      HTTP响应, 响应体是未压缩的数据
+    /// @param codec    压缩编码, 为空时不压缩
+    /// @return         同sendResponse
+    int sendResponse(HttpResponse::ptr rsp, CompressCodec::ptr codec);
+
+    /// @brief          缓存HTTP响应, 和之后的响应一起用一次writev发送
+    /// @details        HTTP/1.1流水线中客户端连续发来多个请求时, 处理完全部已经收到的请求后再统一发送
+    /// @param rsp      HTTP响应, 发送前不能再修改
+    void queueResponse(HttpResponse::ptr rsp);
+
+    /// @brief          发送缓存的全部响应
+    /// @return         同sendResponse, 没有缓存的响应时返回1
+    int flushResponses();
+
+    /// @brief          缓存的响应数量
+    size_t getQueuedResponseCount() const { return m_queued.size(); }
+
+    /// @brief          读缓冲中是否已经有一个完整的请求(包括请求体), 接收它不需要等待网络数据
+    bool hasBufferedRequest();
+
+    /// @brief          连接是否以HTTP/2前言开始(h2c prior knowledge)
+    /// @details        只在连接开始时调用。逐步读取, 和前言不一致时立即返回, 读到的数据留给recvRequest
+    bool isHttp2Preface();
+
+    /// @brief          按Content-Encoding解压请求体, 不支持的编码原样保留
+    /// @return         解压失败或者解压后超过http.reauest.max_body_size返回false, 调用方关闭连接或者重置流
+    static bool DecodeBody(HttpRequest::ptr req);
+
+    /// @brief          读数据, 优先读取解析请求时多读到的数据
+    virtual int read(void* buffer, size_t length) override;
+
+    virtual int read(ByteArray::ptr ba, size_t length) override;
+
+    virtual int readv(const iovec* buffers, size_t count) override;
+
+private:
+    // 读缓冲, 多读到的数据留给请求体、下一个请求或者升级后的协议
+    BufferedStream::ptr m_reader;
+    // 当前请求还没有读取的请求体
+    HttpBodyStream::ptr m_bodyStream;
+    // 等待发送的响应和它们的头部在m_headerBuf中的位置(偏移, 长度)
+    std::vector<HttpResponse::ptr> m_queued;
+    std::vector<std::pair<size_t, size_t>> m_queuedHeaders;
+    // 序列化响应头的缓冲区, 连接上一直复用
+    std::string m_headerBuf;
 };
 
 
@@ -108,7 +108,6 @@ int httpclient_parser_execute(httpclient_parser *parser, const char *buffer, siz
     p = buffer+off;
     pe = buffer+len;
 
-    assert(*pe == '\0' && "pointer does not end on NUL");
     assert(pe - p == (int)len - (int)off && "pointers aren't same distance");
 
 
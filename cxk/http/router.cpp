@@ -0,0 +1,219 @@
+#include "router.h"
+#include "servlet.h"
+
+
+namespace cxk{
+namespace http{
+
+
+struct RadixRouter::Node{
+    enum Type{
+        STATIC,
+        PARAM,
+        CATCHALL
+    };
+
+    Type type = STATIC;
+    // STATIC: 压缩后的静态前缀; PARAM/CATCHALL: 参数名
+    std::string prefix;
+    // 静态子节点前缀的首字符, 和children一一对应
+    std::string indices;
+    std::vector<std::shared_ptr<const Node>> children;
+    std::shared_ptr<const Node> param;
+    std::shared_ptr<const Node> catchall;
+    Servlet::ptr servlet;
+};
+
+using Node = RadixRouter::Node;
+
+
+// 静态部分的长度, 到段首的':'或者'*'为止
+static size_t StaticLength(std::string_view path, bool seg_start){
+    for(size_t i = 0; i < path.size(); ++i){
+        bool start = i == 0 ? seg_start : path[i - 1] == '/';
+        if(start && (path[i] == ':' || path[i] == '*')){
+            return i;
+        }
+    }
+    return path.size();
+}
+
+
+// 在n下插入剩余的路由, n是新复制的节点, 可以修改
+// seg_start表示path是否从一个路径段的开头开始
+static bool Insert(Node& n, std::string_view path, bool seg_start, const Servlet::ptr& slt){
+    if(path.empty()){
+        n.servlet = slt;
+        return true;
+    }
+
+    if(seg_start && path[0] == ':'){
+        std::string_view name = path.substr(1, path.find('/') - 1);
+        if(n.param && n.param->prefix != name){
+            return false;
+        }
+        auto p = n.param ? std::make_shared<Node>(*n.param) : std::make_shared<Node>();
+        p->type = Node::PARAM;
+        p->prefix = std::string(name);
+        if(!Insert(*p, path.substr(name.size() + 1), false, slt)){
+            return false;
+        }
+        n.param = p;
+        return true;
+    }
+
+    if(seg_start && path[0] == '*'){
+        std::string_view name = path.substr(1);
+        if(name.find('/') != std::string_view::npos){
+            return false;
+        }
+        auto c = std::make_shared<Node>();
+        c->type = Node::CATCHALL;
+        c->prefix = std::string(name);
+        c->servlet = slt;
+        n.catchall = c;
+        return true;
+    }
+
+    size_t idx = n.indices.find(path[0]);
+    if(idx == std::string::npos){
+        auto c = std::make_shared<Node>();
+        c->prefix = std::string(path.substr(0, StaticLength(path, seg_start)));
+        if(!Insert(*c, path.substr(c->prefix.size()), c->prefix.back() == '/', slt)){
+            return false;
+        }
+        n.indices.push_back(path[0]);
+        n.children.push_back(c);
+        return true;
+    }
+
+    auto c = std::make_shared<Node>(*n.children[idx]);
+    size_t i = 0;
+    while(i < c->prefix.size() && i < path.size() && c->prefix[i] == path[i]){
+        ++i;
+    }
+    if(i < c->prefix.size()){
+        // 拆分前缀, 原来的节点成为后半段
+        auto tail = std::make_shared<Node>(*c);
+        tail->prefix = c->prefix.substr(i);
+        std::string head = c->prefix.substr(0, i);
+        *c = Node();
+        c->prefix = head;
+        c->indices.push_back(tail->prefix[0]);
+        c->children.push_back(tail);
+    }
+    if(!Insert(*c, path.substr(i), c->prefix.back() == '/', slt)){
+        return false;
+    }
+    n.children[idx] = c;
+    return true;
+}
+
+
+// 在n的子节点中匹配剩余的路径, 静态段优先, 然后是参数段和通配段
+static const Servlet::ptr* Match(const Node* n, std::string_view path, RadixRouter::Params* params){
+    if(path.empty()){
+        if(n->servlet){
+            return &n->servlet;
+        }
+        if(n->catchall){
+            if(params){
+                params->emplace_back(n->catchall->prefix, std::string());
+            }
+            return &n->catchall->servlet;
+        }
+        return nullptr;
+    }
+
+    size_t idx = n->indices.find(path[0]);
+    if(idx != std::string::npos){
+        const Node* c = n->children[idx].get();
+        if(path.compare(0, c->prefix.size(), c->prefix) == 0){
+            const Servlet::ptr* rt = Match(c, path.substr(c->prefix.size()), params);
+            if(rt){
+                return rt;
+            }
+        }
+    }
+
+    if(n->param){
+        size_t len = std::min(path.find('/'), path.size());
+        if(len > 0){
+            size_t mark = params ? params->size() : 0;
+            if(params){
+                params->emplace_back(n->param->prefix, std::string(path.substr(0, len)));
+            }
+            const Servlet::ptr* rt = Match(n->param.get(), path.substr(len), params);
+            if(rt){
+                return rt;
+            }
+            if(params){
+                params->resize(mark);
+            }
+        }
+    }
+
+    if(n->catchall){
+        if(params){
+            params->emplace_back(n->catchall->prefix, std::string(path));
+        }
+        return &n->catchall->servlet;
+    }
+    return nullptr;
+}
+
+
+RadixRouter::RadixRouter()
+    : m_root(std::make_shared<const Node>()){
+}
+
+
+bool RadixRouter::add(const std::string& route, Servlet::ptr slt){
+    MutexType::Lock lock(m_mutex);
+    auto root = std::make_shared<Node>(*m_root.load());
+    if(!Insert(*root, route, true, slt)){
+        return false;
+    }
+    m_routes[route] = slt;
+    m_root.store(root);
+    return true;
+}
+
+
+bool RadixRouter::del(const std::string& route){
+    MutexType::Lock lock(m_mutex);
+    if(!m_routes.erase(route)){
+        return false;
+    }
+    // 删除很少发生, 直接重建
+    auto root = std::make_shared<Node>();
+    for(auto& i : m_routes){
+        Insert(*root, i.first, true, i.second);
+    }
+    m_root.store(root);
+    return true;
+}
+
+
+Servlet::ptr RadixRouter::get(const std::string& route){
+    MutexType::Lock lock(m_mutex);
+    auto it = m_routes.find(route);
+    return it == m_routes.end() ? nullptr : it->second;
+}
+
+
+Servlet::ptr RadixRouter::match(std::string_view path, Params* params) const{
+    auto root = m_root.load();
+    const Servlet::ptr* rt = Match(root.get(), path, params);
+    return rt ? *rt : nullptr;
+}
+
+
+size_t RadixRouter::size(){
+    MutexType::Lock lock(m_mutex);
+    return m_routes.size();
+}
+
+
+}
+}
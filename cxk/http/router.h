@@ -0,0 +1,64 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <map>
+#include "cxk/mutex.h"
+#include "cxk/snapshot.h"
+
+
+namespace cxk{
+
+namespace http{
+
+class Servlet;
+
+
+/// @brief 基数树路由
+/// @details 路由由静态段、":name"参数段和结尾的"*name"通配段组成, 如"/users/:id/posts"、"/static/*filepath",
+///          参数段匹配到下一个'/'为止, 通配段匹配剩余的全部路径(可以为空), 名字可以省略。
+///          匹配优先级: 静态段 > 参数段 > 通配段, 匹配失败时回溯。
+///          树是不可变的, 修改时复制从根到修改位置的节点后整体替换(copy-on-write), 查找通过AtomicSnapshot读取当前的树, 不加锁
+class RadixRouter{
+public:
+    using ptr = std::shared_ptr<RadixRouter>;
+    using MutexType = cxk::Mutex;
+    /// @brief 匹配到的参数, 参数名 -> 值
+    using Params = std::vector<std::pair<std::string, std::string>>;
+
+    struct Node;
+
+    RadixRouter();
+
+    /// @brief          添加路由, 已经存在时替换
+    /// @return         路由格式错误(通配段不在结尾)或者同一位置的参数名不同时返回false
+    bool add(const std::string& route, std::shared_ptr<Servlet> slt);
+
+    /// @brief          删除路由
+    /// @return         路由是否存在
+    bool del(const std::string& route);
+
+    /// @brief          按添加时的路由获取servlet
+    std::shared_ptr<Servlet> get(const std::string& route);
+
+    /// @brief          匹配请求路径
+    /// @param path     请求路径
+    /// @param params   非空时输出匹配到的参数
+    /// @return         没有匹配的路由返回nullptr
+    std::shared_ptr<Servlet> match(std::string_view path, Params* params = nullptr) const;
+
+    /// @brief          路由数量
+    size_t size();
+
+private:
+    MutexType m_mutex;
+    // 全部路由, 删除时用来重建树
+    std::map<std::string, std::shared_ptr<Servlet>> m_routes;
+    AtomicSnapshot<Node> m_root;
+};
+
+
+}
+}
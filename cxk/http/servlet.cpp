@@ -1,9 +1,13 @@
 #include "servlet.h"
+#include "cxk/logger.h"
 #include <fnmatch.h>
+#include <string.h>
 
 namespace cxk{
 namespace http{
 
+static cxk::Logger::ptr g_logger = CXK_LOG_NAME("system");
+
 
 FunctionServlet::FunctionServlet(callback cb) : Servlet("FunctionServlet") ,m_cb(cb){
 
@@ -18,12 +22,13 @@ int32_t FunctionServlet::handle(cxk::http::HttpRequest::ptr request,
 
 ServletDispatch::ServletDispatch() : Servlet("ServletDispatch") {
     m_default.reset(new NotFoundServlet("cxk/1.1"));
+    m_globs.store(std::make_shared<const GlobList>());
 }
 
 
 int32_t ServletDispatch::handle(cxk::http::HttpRequest::ptr request,
     cxk::http::HttpResponse::ptr response, cxk::http::HttpSession::ptr session) {
-    auto slt = getMatchedServlet(request->getPath());
+    auto slt = route(request);
     if(slt){
         slt->handle(request, response, session);
     }
@@ -33,27 +38,46 @@ int32_t ServletDispatch::handle(cxk::http::HttpRequest::ptr request,
 
 
 void ServletDispatch::addServlet(const std::string& uri, Servlet::ptr slt){
-    RWMutexType::WriteLock lock(m_mutex);
-    m_datas[uri] = slt;
+    if(!m_router.add(uri, slt)){
+        CXK_LOG_ERROR(g_logger) << "ServletDispatch::addServlet invalid route: " << uri;
+    }
 }
 
 
 void ServletDispatch::addServlet(const std::string& uri, FunctionServlet::callback cb){
-    RWMutexType::WriteLock lock(m_mutex);
-    m_datas[uri].reset(new FunctionServlet(cb));
+    addServlet(uri, std::make_shared<FunctionServlet>(cb));
+}
+
+
+// 只有结尾是"/*"的模糊匹配可以放进基数树, 其他字符和路由的语法相同
+static bool IsRouterGlob(const std::string& uri){
+    if(uri.size() < 2 || uri.compare(uri.size() - 2, 2, "/*") != 0){
+        return false;
+    }
+    return strpbrk(uri.c_str(), "?[\\") == nullptr
+        && uri.find('*') == uri.size() - 1
+        && uri.find("/:") == std::string::npos
+        && uri[0] != ':';
 }
 
 
 void ServletDispatch::addGlobServlet(const std::string& uri, Servlet::ptr slt){
+    if(IsRouterGlob(uri)){
+        addServlet(uri, slt);
+        return;
+    }
+
     RWMutexType::WriteLock lock(m_mutex);
-    for(auto it = m_globs.begin(); it != m_globs.end(); ++it){
+    auto globs = std::make_shared<GlobList>(*m_globs.load());
+    for(auto it = globs->begin(); it != globs->end(); ++it){
         if(it->first == uri){
-            m_globs.erase(it);
+            globs->erase(it);
             break;
         }
     }
 
-    m_globs.push_back(std::make_pair(uri, slt));
+    globs->push_back(std::make_pair(uri, slt));
+    m_globs.store(globs);
 }
 
 
@@ -63,32 +87,40 @@ void ServletDispatch::addGlobServlet(const std::string& uri, FunctionServlet::ca
 
 
 void ServletDispatch::delServlet(const std::string& uri){
-    RWMutexType::WriteLock lock(m_mutex);
-    m_datas.erase(uri);
+    m_router.del(uri);
 }
 
 
 void ServletDispatch::delGlobServlet(const std::string& uri){
+    if(IsRouterGlob(uri)){
+        m_router.del(uri);
+        return;
+    }
+
     RWMutexType::WriteLock lock(m_mutex);
-    for(auto it = m_globs.begin(); it != m_globs.end(); ++it){
+    auto globs = std::make_shared<GlobList>(*m_globs.load());
+    for(auto it = globs->begin(); it != globs->end(); ++it){
         if(it->first == uri){
-            m_globs.erase(it);
+            globs->erase(it);
             break;
         }
     }
+    m_globs.store(globs);
 }
 
 
 Servlet::ptr ServletDispatch::getServlet(const std::string& uri){
-    RWMutexType::ReadLock lock(m_mutex);
-    auto it = m_datas.find(uri);
-    return it == m_datas.end() ? nullptr : it->second;
+    return m_router.get(uri);
 }
 
 
 Servlet::ptr ServletDispatch::getGlobServlet(const std::string& uri){
-    RWMutexType::ReadLock lock(m_mutex);
-    for(auto it = m_globs.begin(); it != m_globs.end(); ++it){
+    if(IsRouterGlob(uri)){
+        return m_router.get(uri);
+    }
+
+    auto globs = m_globs.load();
+    for(auto it = globs->begin(); it != globs->end(); ++it){
         if(it->first == uri){
             return it->second;
         }
@@ -96,14 +128,35 @@ Servlet::ptr ServletDispatch::getGlobServlet(const std::string& uri){
     return nullptr;
 }
 
+
 Servlet::ptr ServletDispatch::getMatchedServlet(const std::string& uri){
-    RWMutexType::ReadLock lock(m_mutex);
-    auto mit = m_datas.find(uri);
-    if(mit != m_datas.end()) return mit->second;
+    return getMatchedServlet(uri, nullptr);
+}
 
-    for(auto it = m_globs.begin(); it != m_globs.end(); ++it){
-        if(!fnmatch(it->first.c_str(), uri.c_str(), 0)){
-            return it->second;
+
+Servlet::ptr ServletDispatch::route(cxk::http::HttpRequest::ptr request){
+    RadixRouter::Params params;
+    auto slt = getMatchedServlet(request->getPathView(), &params);
+    if(!params.empty()){
+        request->setRouteParams(std::move(params));
+    }
+    return slt;
+}
+
+
+Servlet::ptr ServletDispatch::getMatchedServlet(std::string_view path, RadixRouter::Params* params){
+    auto slt = m_router.match(path, params);
+    if(slt){
+        return slt;
+    }
+
+    auto globs = m_globs.load();
+    if(!globs->empty()){
+        std::string uri(path);
+        for(auto it = globs->begin(); it != globs->end(); ++it){
+            if(!fnmatch(it->first.c_str(), uri.c_str(), 0)){
+                return it->second;
+            }
         }
     }
     return m_default;
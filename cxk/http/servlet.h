@@ -7,6 +7,7 @@
 #include <unordered_map>
 #include "http.h"
 #include "http_session.h"
+#include "router.h"
 
 namespace cxk{
 
@@ -27,7 +28,7 @@ public:
     /// @brief          处理请求
     /// @param request  请求
     /// @param response 响应
-    /// @param session  HTTP连接会话
+    /// @param session  HTTP连接会话, HTTP/2请求没有独占的连接, 为nullptr
     /// @return         是否处理成功
     virtual int32_t handle(cxk::http::HttpRequest::ptr request,
         cxk::http::HttpResponse::ptr response, cxk::http::HttpSession::ptr session) = 0;
@@ -35,8 +36,17 @@ public:
     /// @brief          获取名称
     const std::string& getName() const { return m_name; }
 
+    /// @brief          是否流式读取请求体
+    /// @details        为true时HttpServer不预先读取请求体, servlet通过HttpRequest::getBodyStream读取,
+    ///                 请求体不受http.reauest.max_body_size限制, 也不会被解压; 没有读完的部分在处理后丢弃
+    bool isStreamBody() const { return m_streamBody; }
+
+    /// @brief          设置是否流式读取请求体
+    void setStreamBody(bool v) { m_streamBody = v; }
+
 protected:
     std::string m_name;
+    bool m_streamBody = false;
 };
 
 
@@ -62,6 +72,9 @@ private:
 
 
 /// @brief Servlet分发器
+/// @details 精确路径和带参数的路由(如"/users/:id"、"/static/*")存放在基数树中,
+///          只有结尾是"/*"的模糊匹配也放进基数树, 其他模糊匹配按添加顺序用fnmatch逐个匹配。
+///          路由和模糊匹配列表都是copy-on-write的, 分发请求时不加锁
 class ServletDispatch : public Servlet{
 public:
     using ptr = std::shared_ptr<ServletDispatch>;
@@ -76,7 +89,7 @@ public:
 
 
     /// @brief          添加Servlet
-    /// @param uri      uri
+    /// @param uri      uri, 可以包含":name"参数段和结尾的"*name"通配段, 匹配到的参数设置到HttpRequest::getRouteParams
     /// @param slt      servlet
     void addServlet(const std::string& uri, Servlet::ptr slt);
 
@@ -124,12 +137,27 @@ public:
     /// @param uri      uri
     /// @return         优先精准匹配，其次进行模糊匹配，最后是默认的servlet
     Servlet::ptr getMatchedServlet(const std::string& uri);
+
+    /// @brief          为请求匹配servlet, 并把路由匹配到的参数设置到请求
+    /// @param request  请求
+    /// @return         同getMatchedServlet
+    Servlet::ptr route(cxk::http::HttpRequest::ptr request);
+
+    /// @brief          根据请求路径获取匹配的servlet
+    /// @param path     请求路径
+    /// @param params   非空时输出路由匹配到的参数
+    /// @return         优先路由匹配，其次进行模糊匹配，最后是默认的servlet
+    Servlet::ptr getMatchedServlet(std::string_view path, RadixRouter::Params* params);
+
 private:
+    using GlobList = std::vector<std::pair<std::string, Servlet::ptr>>;
+
+    // 修改模糊匹配列表时加锁
     RWMutexType m_mutex;
-    // uri -> servlet
-    std::unordered_map<std::string, Servlet::ptr> m_datas;
+    // 路由 -> servlet
+    RadixRouter m_router;
     // 模糊匹配
-    std::vector<std::pair<std::string, Servlet::ptr>> m_globs;
+    AtomicSnapshot<GlobList> m_globs;
 
     Servlet::ptr m_default; // 默认的servlet， 所有的路径都无法匹配时
 };
@@ -0,0 +1,492 @@
+#include "static_file_servlet.h"
+#include "http_compress.h"
+#include "cxk/config.h"
+#include "cxk/logger.h"
+#include "cxk/util.h"
+#include "cxk/ds/lru_cache.h"
+#include <atomic>
+#include <charconv>
+#include <unordered_map>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <time.h>
+
+
+namespace cxk{
+namespace http{
+
+static cxk::Logger::ptr g_logger = CXK_LOG_NAME("system");
+
+static cxk::ConfigVar<uint32_t>::ptr g_http_static_cache_size =
+    cxk::Config::Lookup("http.static.cache_size", (uint32_t)1024, "http static file cache count");
+
+static cxk::ConfigVar<uint32_t>::ptr g_http_static_cache_max_length =
+    cxk::Config::Lookup("http.static.cache_max_length", (uint32_t)(256 * 1024), "http static file max length to cache in memory");
+
+static cxk::ConfigVar<uint32_t>::ptr g_http_static_check_interval =
+    cxk::Config::Lookup("http.static.check_interval", (uint32_t)1000, "http static file cache check interval ms");
+
+static uint32_t s_static_cache_size = 0;
+static uint32_t s_static_cache_max_length = 0;
+static uint32_t s_static_check_interval = 0;
+
+
+/// @brief 缓存的文件, 大文件只有元信息
+struct StaticFile{
+    using ptr = std::shared_ptr<StaticFile>;
+
+    /// @brief  按编码获取压缩后的内容, 第一次获取时压缩
+    /// @return 压缩失败或者没有变小时返回nullptr
+    std::shared_ptr<const std::string> getVariant(CompressCodec::ptr codec);
+
+    // 小文件的内容, 直接作为响应体共享, 不再修改
+    std::shared_ptr<const std::string> content;
+    std::string etag;
+    std::string lastModified;
+    std::string contentType;
+    time_t mtime = 0;
+    off_t size = 0;
+    ino_t ino = 0;
+    // 上一次检查文件是否修改的时间(ms)
+    std::atomic<uint64_t> checkTime{0};
+
+    cxk::Mutex mutex;
+    // 编码 -> 压缩后的内容
+    std::map<std::string, std::shared_ptr<const std::string>> variants;
+};
+
+
+std::shared_ptr<const std::string> StaticFile::getVariant(CompressCodec::ptr codec){
+    cxk::Mutex::Lock lock(mutex);
+    auto it = variants.find(codec->getName());
+    if(it != variants.end()){
+        return it->second;
+    }
+    lock.unlock();
+
+    auto data = std::make_shared<std::string>();
+    if(!codec->compress(*content, *data) || data->size() >= content->size()){
+        data.reset();
+    }
+    lock.lock();
+    variants[codec->getName()] = data;
+    return data;
+}
+
+
+// 键: 文件路径
+using StaticFileCache = cxk::ds::LruCache<std::string, StaticFile::ptr>;
+
+static StaticFileCache& GetStaticFileCache(){
+    static StaticFileCache s_cache(s_static_cache_size);
+    return s_cache;
+}
+
+
+namespace {
+struct _StaticFileIniter{
+    _StaticFileIniter(){
+        s_static_cache_size = g_http_static_cache_size->getValue();
+        s_static_cache_max_length = g_http_static_cache_max_length->getValue();
+        s_static_check_interval = g_http_static_check_interval->getValue();
+
+        g_http_static_cache_size->addListener([](const uint32_t& ov, const uint32_t& nv){
+            s_static_cache_size = nv;
+            GetStaticFileCache().setMaxSize(nv);
+        });
+
+        g_http_static_cache_max_length->addListener([](const uint32_t& ov, const uint32_t& nv){
+            s_static_cache_max_length = nv;
+        });
+
+        g_http_static_check_interval->addListener([](const uint32_t& ov, const uint32_t& nv){
+            s_static_check_interval = nv;
+        });
+    }
+};
+
+static _StaticFileIniter s_static_file_initer;
+}
+
+
+static std::string_view TrimView(std::string_view v){
+    while(!v.empty() && (v.front() == ' ' || v.front() == '\t')){
+        v.remove_prefix(1);
+    }
+    while(!v.empty() && (v.back() == ' ' || v.back() == '\t')){
+        v.remove_suffix(1);
+    }
+    return v;
+}
+
+
+static int HexValue(char c){
+    if(c >= '0' && c <= '9') return c - '0';
+    if(c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if(c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+
+// 解码%XX并去掉空段和"."段, 结果以'/'开头, 原路径以'/'结尾时保留结尾的'/'
+// 包含".."段、'\0'或者错误的编码时返回false
+static bool NormalizePath(std::string_view path, std::string& out){
+    std::string decoded;
+    decoded.reserve(path.size());
+    for(size_t i = 0; i < path.size(); ++i){
+        char c = path[i];
+        if(c == '%'){
+            int h = i + 2 < path.size() ? HexValue(path[i + 1]) : -1;
+            int l = h >= 0 ? HexValue(path[i + 2]) : -1;
+            if(l < 0){
+                return false;
+            }
+            c = (char)(h * 16 + l);
+            i += 2;
+        }
+        if(c == '\0'){
+            return false;
+        }
+        decoded.push_back(c);
+    }
+
+    out.clear();
+    std::string_view rest(decoded);
+    while(!rest.empty()){
+        size_t end = std::min(rest.find('/'), rest.size());
+        std::string_view seg = rest.substr(0, end);
+        rest.remove_prefix(std::min(end + 1, rest.size()));
+        if(seg == ".."){
+            return false;
+        }
+        if(!seg.empty() && seg != "."){
+            out.push_back('/');
+            out.append(seg);
+        }
+    }
+    if(decoded.empty() || decoded.back() == '/'){
+        out.push_back('/');
+    }
+    return true;
+}
+
+
+static bool ParseUint(std::string_view v, uint64_t& n){
+    auto rt = std::from_chars(v.data(), v.data() + v.size(), n);
+    return rt.ec == std::errc() && rt.ptr == v.data() + v.size() && !v.empty();
+}
+
+
+// 解析单个区间的Range, 区间是闭区间[begin, end]
+// @return 1: 有效区间, 0: 忽略(格式不支持或者多个区间), -1: 区间不能满足
+static int ParseRange(std::string_view range, uint64_t size, uint64_t& begin, uint64_t& end){
+    range = TrimView(range);
+    if(range.compare(0, 6, "bytes=") != 0){
+        return 0;
+    }
+    range.remove_prefix(6);
+    if(range.find(',') != std::string_view::npos){
+        return 0;
+    }
+    size_t dash = range.find('-');
+    if(dash == std::string_view::npos){
+        return 0;
+    }
+    std::string_view first = TrimView(range.substr(0, dash));
+    std::string_view last = TrimView(range.substr(dash + 1));
+
+    // 最后n个字节
+    if(first.empty()){
+        uint64_t n = 0;
+        if(!ParseUint(last, n)){
+            return 0;
+        }
+        if(n == 0 || size == 0){
+            return -1;
+        }
+        begin = n >= size ? 0 : size - n;
+        end = size - 1;
+        return 1;
+    }
+
+    if(!ParseUint(first, begin)){
+        return 0;
+    }
+    if(last.empty()){
+        end = UINT64_MAX;
+    } else if(!ParseUint(last, end) || end < begin){
+        return 0;
+    }
+    if(begin >= size){
+        return -1;
+    }
+    end = std::min(end, size - 1);
+    return 1;
+}
+
+
+// If-None-Match用弱比较, 忽略W/前缀
+static bool MatchETag(std::string_view header, std::string_view etag){
+    auto strip = [](std::string_view v){
+        v = TrimView(v);
+        if(v.compare(0, 2, "W/") == 0){
+            v.remove_prefix(2);
+        }
+        return v;
+    };
+    etag = strip(etag);
+    while(!header.empty()){
+        size_t comma = header.find(',');
+        std::string_view item = strip(header.substr(0, comma));
+        header.remove_prefix(comma == std::string_view::npos ? header.size() : comma + 1);
+        if(item == "*" || item == etag){
+            return true;
+        }
+    }
+    return false;
+}
+
+
+static std::string HttpDate(time_t t){
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    char buf[64];
+    strftime(buf, sizeof(buf), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    return buf;
+}
+
+
+static bool IsModified(const StaticFile::ptr& file, const struct stat& st){
+    return st.st_mtime != file->mtime || st.st_size != file->size || st.st_ino != file->ino;
+}
+
+
+// 获取文件, 小文件优先从缓存中获取, 大文件打开后通过body返回
+// @return 0: 成功, 否则是错误码, 目录返回EISDIR
+static int LoadFile(const std::string& filename, StaticFile::ptr& file, HttpFileBody::ptr& body){
+    uint64_t now = cxk::GetCurrentMS();
+    if(GetStaticFileCache().get(filename, file)){
+        if(now < file->checkTime + s_static_check_interval){
+            return 0;
+        }
+        struct stat st;
+        if(stat(filename.c_str(), &st) == 0 && !IsModified(file, st)){
+            file->checkTime = now;
+            return 0;
+        }
+        GetStaticFileCache().del(filename);
+        file.reset();
+    }
+
+    int fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0){
+        return errno;
+    }
+    struct stat st;
+    if(fstat(fd, &st) != 0){
+        int rt = errno;
+        close(fd);
+        return rt;
+    }
+    if(!S_ISREG(st.st_mode)){
+        int rt = S_ISDIR(st.st_mode) ? EISDIR : ENOENT;
+        close(fd);
+        return rt;
+    }
+
+    file = std::make_shared<StaticFile>();
+    file->mtime = st.st_mtime;
+    file->size = st.st_size;
+    file->ino = st.st_ino;
+    file->checkTime = now;
+    file->etag = StringUtil::format("\"%lx-%lx\"", (unsigned long)st.st_mtime, (unsigned long)st.st_size);
+    file->lastModified = HttpDate(st.st_mtime);
+    file->contentType = StaticFileServlet::GetContentType(filename);
+
+    if(s_static_cache_size == 0 || (uint64_t)st.st_size > s_static_cache_max_length){
+        body = std::make_shared<HttpFileBody>(fd, 0, st.st_size);
+        return 0;
+    }
+
+    auto content = std::make_shared<std::string>(st.st_size, '\0');
+    size_t offset = 0;
+    while(offset < content->size()){
+        ssize_t n = pread(fd, &(*content)[offset], content->size() - offset, offset);
+        if(n <= 0){
+            int rt = n == 0 ? EIO : errno;
+            close(fd);
+            return rt;
+        }
+        offset += n;
+    }
+    close(fd);
+    file->content = content;
+    GetStaticFileCache().set(filename, file);
+    return 0;
+}
+
+
+StaticFileServlet::StaticFileServlet(const std::string& root, const std::string& param, const std::string& index)
+    : Servlet("StaticFileServlet")
+    , m_root(root)
+    , m_param(param)
+    , m_index(index){
+    while(!m_root.empty() && m_root.back() == '/'){
+        m_root.pop_back();
+    }
+}
+
+
+std::string StaticFileServlet::GetContentType(const std::string& path){
+    static const std::unordered_map<std::string, std::string> s_types = {
+        {"html", "text/html; charset=utf-8"},
+        {"htm", "text/html; charset=utf-8"},
+        {"css", "text/css; charset=utf-8"},
+        {"js", "application/javascript; charset=utf-8"},
+        {"mjs", "application/javascript; charset=utf-8"},
+        {"json", "application/json"},
+        {"map", "application/json"},
+        {"xml", "application/xml"},
+        {"txt", "text/plain; charset=utf-8"},
+        {"md", "text/markdown; charset=utf-8"},
+        {"csv", "text/csv; charset=utf-8"},
+        {"svg", "image/svg+xml"},
+        {"png", "image/png"},
+        {"jpg", "image/jpeg"},
+        {"jpeg", "image/jpeg"},
+        {"gif", "image/gif"},
+        {"webp", "image/webp"},
+        {"ico", "image/x-icon"},
+        {"woff", "font/woff"},
+        {"woff2", "font/woff2"},
+        {"ttf", "font/ttf"},
+        {"wasm", "application/wasm"},
+        {"pdf", "application/pdf"},
+        {"zip", "application/zip"},
+        {"gz", "application/gzip"},
+        {"mp3", "audio/mpeg"},
+        {"mp4", "video/mp4"},
+        {"webm", "video/webm"}
+    };
+    size_t dot = path.rfind('.');
+    if(dot == std::string::npos || path.find('/', dot) != std::string::npos){
+        return "application/octet-stream";
+    }
+    std::string ext = path.substr(dot + 1);
+    for(auto& c : ext){
+        c = tolower(c);
+    }
+    auto it = s_types.find(ext);
+    return it == s_types.end() ? "application/octet-stream" : it->second;
+}
+
+
+int32_t StaticFileServlet::handle(cxk::http::HttpRequest::ptr request,
+        cxk::http::HttpResponse::ptr response, cxk::http::HttpSession::ptr session){
+    HttpMethod method = request->getMethod();
+    if(method != HttpMethod::GET && method != HttpMethod::HEAD){
+        response->setStatus(HttpStatus::METHOD_NOT_ALLOWED);
+        response->setHeader("Allow", "GET, HEAD");
+        return 0;
+    }
+
+    std::string path;
+    std::string raw = m_param.empty() ? std::string(request->getPathView()) : request->getRouteParam(m_param);
+    if(!NormalizePath(raw, path)){
+        response->setStatus(HttpStatus::BAD_REQUEST);
+        return 0;
+    }
+    bool is_dir = path.back() == '/';
+    std::string filename = m_root + path + (is_dir ? m_index : "");
+
+    StaticFile::ptr file;
+    HttpFileBody::ptr body;
+    int rt = LoadFile(filename, file, body);
+    if(rt == EISDIR && !is_dir){
+        // 目录重定向到带'/'的路径, 页面中的相对路径才能正确解析
+        std::string location = std::string(request->getPathView()) + "/";
+        std::string_view query = request->getQueryView();
+        if(!query.empty()){
+            location.append("?").append(query);
+        }
+        response->setStatus(HttpStatus::MOVED_PERMANENTLY);
+        response->setHeader("Location", location);
+        return 0;
+    }
+    if(rt != 0){
+        response->setStatus(rt == EACCES ? HttpStatus::FORBIDDEN : HttpStatus::NOT_FOUND);
+        return 0;
+    }
+
+    response->setHeader("Content-Type", file->contentType);
+    response->setHeader("ETag", file->etag);
+    response->setHeader("Last-Modified", file->lastModified);
+    response->setHeader("Accept-Ranges", "bytes");
+
+    // 条件请求, 有If-None-Match时忽略If-Modified-Since
+    std::string_view if_none_match = request->getHeaderView("If-None-Match");
+    bool not_modified = !if_none_match.empty() ? MatchETag(if_none_match, file->etag)
+        : request->getHeaderView("If-Modified-Since") == file->lastModified;
+    if(not_modified){
+        response->setStatus(HttpStatus::NOT_MODIFIED);
+        return 0;
+    }
+
+    uint64_t size = file->size;
+    uint64_t begin = 0;
+    uint64_t end = 0;
+    bool partial = false;
+    std::string_view range = request->getHeaderView("Range");
+    std::string_view if_range = request->getHeaderView("If-Range");
+    // If-Range不匹配时返回完整内容
+    if(!range.empty() && (if_range.empty() || if_range == file->etag || if_range == file->lastModified)){
+        int rt = ParseRange(range, size, begin, end);
+        if(rt < 0){
+            response->setStatus(HttpStatus::RANGE_NOT_SATISFIABLE);
+            response->setHeader("Content-Range", "bytes */" + std::to_string(size));
+            return 0;
+        }
+        partial = rt > 0;
+    }
+    uint64_t length = partial ? end - begin + 1 : size;
+    if(partial){
+        response->setStatus(HttpStatus::PARTIAL_CONTENT);
+        response->setHeader("Content-Range", StringUtil::format("bytes %lu-%lu/%lu"
+                    , (unsigned long)begin, (unsigned long)end, (unsigned long)size));
+    }
+
+    if(method == HttpMethod::HEAD){
+        response->setHeader("Content-Length", std::to_string(length));
+        return 0;
+    }
+
+    if(body){
+        body->setRange(begin, length);
+        response->setFileBody(body);
+        return 0;
+    }
+
+    if(partial){
+        response->setBody(file->content->substr(begin, length));
+        return 0;
+    }
+
+    // 预先压缩的内容按编码保存在缓存项中
+    if(HttpCompress::IsCompressible(file->contentType, size)){
+        response->setHeader("Vary", "Accept-Encoding");
+        auto codec = HttpCompress::Negotiate(request->getHeader("Accept-Encoding"));
+        auto data = codec ? file->getVariant(codec) : nullptr;
+        if(data){
+            response->setSharedBody(data);
+            HttpCompress::SetEncoding(response, codec);
+            return 0;
+        }
+    }
+    response->setSharedBody(file->content);
+    return 0;
+}
+
+
+}
+}
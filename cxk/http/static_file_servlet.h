@@ -0,0 +1,46 @@
+#pragma once
+
+#include "servlet.h"
+
+
+namespace cxk{
+namespace http{
+
+
+/// @brief 静态文件Servlet
+/// @details 把请求路径映射到根目录下的文件。
+///          小文件(不超过http.static.cache_max_length)连同预先计算的ETag、Last-Modified读入内存,
+///          按路径放在LRU缓存中, 压缩后的内容按编码保存在缓存项中, 每个编码只压缩一次;
+///          文件修改后最迟http.static.check_interval毫秒重新读取。
+///          大文件每次打开, 用sendfile发送, 不读入内存, 也不压缩。
+///          支持If-None-Match/If-Modified-Since条件请求和单个区间的Range/If-Range请求
+class StaticFileServlet : public Servlet{
+public:
+    using ptr = std::shared_ptr<StaticFileServlet>;
+
+    /// @brief          构造函数
+    /// @param root     根目录
+    /// @param param    路由中表示文件路径的参数名, 如路由"/static/*filepath"中的filepath,
+    ///                 为空时使用完整的请求路径
+    /// @param index    请求目录时返回的文件
+    StaticFileServlet(const std::string& root, const std::string& param = ""
+            , const std::string& index = "index.html");
+
+    virtual int32_t handle(cxk::http::HttpRequest::ptr request,
+        cxk::http::HttpResponse::ptr response, cxk::http::HttpSession::ptr session) override;
+
+    /// @brief          根目录
+    const std::string& getRoot() const { return m_root; }
+
+    /// @brief          按扩展名获取Content-Type, 未知类型返回application/octet-stream
+    static std::string GetContentType(const std::string& path);
+
+private:
+    std::string m_root;
+    std::string m_param;
+    std::string m_index;
+};
+
+
+}
+}
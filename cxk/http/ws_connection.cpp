@@ -82,8 +82,8 @@ std::pair<HttpResult::ptr, WSConnection::ptr> WSConnection::Create(Uri::ptr uri,
     }
     auto rsp = conn->recvResponse();
     if(!rsp){
-        return std::make_pair(std::make_shared<HttpResult>((int)HttpResult::Error::TIMEOUT, 
-            nullptr, "recv response timeout: " + addr->toString() + "timeout_ms: "
+        return std::make_pair(std::make_shared<HttpResult>((int)conn->getRecvError(), 
+            nullptr, "recv response fail: " + addr->toString() + "timeout_ms: "
             + std::to_string(timeout_ms)), nullptr);
     }
 
@@ -234,23 +234,22 @@ int32_t WSSendMessage(Stream* stream, WSFrameMessage::ptr msg, bool client, bool
             ws_head.payload = 127;
         }
 
-        // 写入帧头
-        if(stream->writeFixSize(&ws_head, sizeof(ws_head)) <= 0){
-            break;
-        }
+        // 帧头、扩展的负载长度和掩码放在一块缓冲区中, 和数据一起写出
+        char head[sizeof(ws_head) + sizeof(uint64_t) + 4];
+        size_t head_len = 0;
+        memcpy(head, &ws_head, sizeof(ws_head));
+        head_len += sizeof(ws_head);
 
-        // 写入扩展的负载长度
+        // 扩展的负载长度
         if(ws_head.payload == 126){
             uint16_t len = size;
             len = cxk::byteswapOnLittleEndian(len);
-            if(stream->writeFixSize(&len, sizeof(len)) <= 0){
-                break;
-            }
+            memcpy(head + head_len, &len, sizeof(len));
+            head_len += sizeof(len);
         } else if(ws_head.payload == 127){
             uint64_t len = cxk::byteswapOnLittleEndian(size);
-            if(stream->writeFixSize(&len, sizeof(len)) <= 0){
-                break;
-            }
+            memcpy(head + head_len, &len, sizeof(len));
+            head_len += sizeof(len);
         }
 
 
@@ -264,13 +263,16 @@ int32_t WSSendMessage(Stream* stream, WSFrameMessage::ptr msg, bool client, bool
                 data[i] ^= mask[i % 4];
             }
 
-            if(stream->writeFixSize(mask, sizeof(mask)) <= 0){
-                break;
-            }
+            memcpy(head + head_len, mask, sizeof(mask));
+            head_len += sizeof(mask);
         }
 
-        // 写入数据
-        if(stream->writeFixSize(msg->getData().c_str(), size) <= 0){
+        iovec iovs[2];
+        iovs[0].iov_base = head;
+        iovs[0].iov_len = head_len;
+        iovs[1].iov_base = (void*)msg->getData().c_str();
+        iovs[1].iov_len = size;
+        if(stream->writevFixSize(iovs, 2) <= 0){
             break;
         }
 
@@ -0,0 +1,51 @@
+#include "frame.h"
+
+
+namespace cxk{
+namespace http2{
+
+
+const char* Http2ErrorToString(Http2Error e){
+    switch(e){
+#define XX(name) \
+        case Http2Error::name: return #name;
+        XX(NO_ERROR)
+        XX(PROTOCOL_ERROR)
+        XX(INTERNAL_ERROR)
+        XX(FLOW_CONTROL_ERROR)
+        XX(SETTINGS_TIMEOUT)
+        XX(STREAM_CLOSED)
+        XX(FRAME_SIZE_ERROR)
+        XX(REFUSED_STREAM)
+        XX(CANCEL)
+        XX(COMPRESSION_ERROR)
+        XX(CONNECT_ERROR)
+        XX(ENHANCE_YOUR_CALM)
+        XX(INADEQUATE_SECURITY)
+        XX(HTTP_1_1_REQUIRED)
+#undef XX
+    }
+    return "UNKNOWN";
+}
+
+
+void FrameHeader::parse(const uint8_t* data){
+    length = ((uint32_t)data[0] << 16) | ((uint32_t)data[1] << 8) | data[2];
+    type = (FrameType)data[3];
+    flags = data[4];
+    streamId = ReadUint32(data + 5) & 0x7fffffff;
+}
+
+
+void FrameHeader::write(std::string& out) const{
+    out.push_back((char)(length >> 16));
+    out.push_back((char)(length >> 8));
+    out.push_back((char)length);
+    out.push_back((char)type);
+    out.push_back((char)flags);
+    AppendUint32(out, streamId & 0x7fffffff);
+}
+
+
+}
+}
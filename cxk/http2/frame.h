@@ -0,0 +1,122 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+
+
+namespace cxk{
+namespace http2{
+
+
+/// @brief 客户端连接前言(RFC 7540 3.5)
+static const char CONNECTION_PREFACE[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+static const size_t CONNECTION_PREFACE_SIZE = sizeof(CONNECTION_PREFACE) - 1;
+
+/// @brief 帧头长度
+static const size_t FRAME_HEADER_SIZE = 9;
+
+/// @brief 协议规定的默认值和上限
+static const uint32_t DEFAULT_WINDOW_SIZE = 65535;
+static const uint32_t MAX_WINDOW_SIZE = 0x7fffffff;
+static const uint32_t DEFAULT_MAX_FRAME_SIZE = 16384;
+static const uint32_t MAX_MAX_FRAME_SIZE = 16777215;
+
+
+/// @brief 帧类型
+enum class FrameType : uint8_t{
+    DATA            = 0x0,
+    HEADERS         = 0x1,
+    PRIORITY        = 0x2,
+    RST_STREAM      = 0x3,
+    SETTINGS        = 0x4,
+    PUSH_PROMISE    = 0x5,
+    PING            = 0x6,
+    GOAWAY          = 0x7,
+    WINDOW_UPDATE   = 0x8,
+    CONTINUATION    = 0x9,
+};
+
+
+/// @brief 帧标志
+enum FrameFlag : uint8_t{
+    FLAG_END_STREAM     = 0x1,
+    FLAG_ACK            = 0x1,
+    FLAG_END_HEADERS    = 0x4,
+    FLAG_PADDED         = 0x8,
+    FLAG_PRIORITY       = 0x20,
+};
+
+
+/// @brief SETTINGS参数
+enum class SettingsId : uint16_t{
+    HEADER_TABLE_SIZE       = 0x1,
+    ENABLE_PUSH             = 0x2,
+    MAX_CONCURRENT_STREAMS  = 0x3,
+    INITIAL_WINDOW_SIZE     = 0x4,
+    MAX_FRAME_SIZE          = 0x5,
+    MAX_HEADER_LIST_SIZE    = 0x6,
+};
+
+
+/// @brief 错误码, 用于RST_STREAM和GOAWAY
+enum class Http2Error : uint32_t{
+    NO_ERROR            = 0x0,
+    PROTOCOL_ERROR      = 0x1,
+    INTERNAL_ERROR      = 0x2,
+    FLOW_CONTROL_ERROR  = 0x3,
+    SETTINGS_TIMEOUT    = 0x4,
+    STREAM_CLOSED       = 0x5,
+    FRAME_SIZE_ERROR    = 0x6,
+    REFUSED_STREAM      = 0x7,
+    CANCEL              = 0x8,
+    COMPRESSION_ERROR   = 0x9,
+    CONNECT_ERROR       = 0xa,
+    ENHANCE_YOUR_CALM   = 0xb,
+    INADEQUATE_SECURITY = 0xc,
+    HTTP_1_1_REQUIRED   = 0xd,
+};
+
+const char* Http2ErrorToString(Http2Error e);
+
+
+/// @brief 帧头
+struct FrameHeader{
+    uint32_t length = 0;
+    FrameType type = FrameType::DATA;
+    uint8_t flags = 0;
+    uint32_t streamId = 0;
+
+    bool hasFlag(uint8_t flag) const { return flags & flag;}
+
+    /// @brief  从9字节的帧头解析
+    void parse(const uint8_t* data);
+
+    /// @brief  序列化追加到out
+    void write(std::string& out) const;
+};
+
+
+/// @brief  按大端序读写整数
+inline uint16_t ReadUint16(const uint8_t* p){
+    return ((uint16_t)p[0] << 8) | p[1];
+}
+
+inline uint32_t ReadUint32(const uint8_t* p){
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+inline void AppendUint16(std::string& out, uint16_t v){
+    out.push_back((char)(v >> 8));
+    out.push_back((char)v);
+}
+
+inline void AppendUint32(std::string& out, uint32_t v){
+    out.push_back((char)(v >> 24));
+    out.push_back((char)(v >> 16));
+    out.push_back((char)(v >> 8));
+    out.push_back((char)v);
+}
+
+
+}
+}
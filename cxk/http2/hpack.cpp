@@ -0,0 +1,543 @@
+#include "hpack.h"
+#include <string.h>
+#include <unordered_map>
+
+
+namespace cxk{
+namespace http2{
+
+
+/// @brief Huffman码表, 下标是字节值, 256是EOS
+static const struct{
+    uint32_t code;
+    uint8_t bits;
+} s_huffman[257] = {
+    {0x1ff8, 13}, {0x7fffd8, 23}, {0xfffffe2, 28}, {0xfffffe3, 28},
+    {0xfffffe4, 28}, {0xfffffe5, 28}, {0xfffffe6, 28}, {0xfffffe7, 28},
+    {0xfffffe8, 28}, {0xffffea, 24}, {0x3ffffffc, 30}, {0xfffffe9, 28},
+    {0xfffffea, 28}, {0x3ffffffd, 30}, {0xfffffeb, 28}, {0xfffffec, 28},
+    {0xfffffed, 28}, {0xfffffee, 28}, {0xfffffef, 28}, {0xffffff0, 28},
+    {0xffffff1, 28}, {0xffffff2, 28}, {0x3ffffffe, 30}, {0xffffff3, 28},
+    {0xffffff4, 28}, {0xffffff5, 28}, {0xffffff6, 28}, {0xffffff7, 28},
+    {0xffffff8, 28}, {0xffffff9, 28}, {0xffffffa, 28}, {0xffffffb, 28},
+    {0x14, 6}, {0x3f8, 10}, {0x3f9, 10}, {0xffa, 12},
+    {0x1ff9, 13}, {0x15, 6}, {0xf8, 8}, {0x7fa, 11},
+    {0x3fa, 10}, {0x3fb, 10}, {0xf9, 8}, {0x7fb, 11},
+    {0xfa, 8}, {0x16, 6}, {0x17, 6}, {0x18, 6},
+    {0x0, 5}, {0x1, 5}, {0x2, 5}, {0x19, 6},
+    {0x1a, 6}, {0x1b, 6}, {0x1c, 6}, {0x1d, 6},
+    {0x1e, 6}, {0x1f, 6}, {0x5c, 7}, {0xfb, 8},
+    {0x7ffc, 15}, {0x20, 6}, {0xffb, 12}, {0x3fc, 10},
+    {0x1ffa, 13}, {0x21, 6}, {0x5d, 7}, {0x5e, 7},
+    {0x5f, 7}, {0x60, 7}, {0x61, 7}, {0x62, 7},
+    {0x63, 7}, {0x64, 7}, {0x65, 7}, {0x66, 7},
+    {0x67, 7}, {0x68, 7}, {0x69, 7}, {0x6a, 7},
+    {0x6b, 7}, {0x6c, 7}, {0x6d, 7}, {0x6e, 7},
+    {0x6f, 7}, {0x70, 7}, {0x71, 7}, {0x72, 7},
+    {0xfc, 8}, {0x73, 7}, {0xfd, 8}, {0x1ffb, 13},
+    {0x7fff0, 19}, {0x1ffc, 13}, {0x3ffc, 14}, {0x22, 6},
+    {0x7ffd, 15}, {0x3, 5}, {0x23, 6}, {0x4, 5},
+    {0x24, 6}, {0x5, 5}, {0x25, 6}, {0x26, 6},
+    {0x27, 6}, {0x6, 5}, {0x74, 7}, {0x75, 7},
+    {0x28, 6}, {0x29, 6}, {0x2a, 6}, {0x7, 5},
+    {0x2b, 6}, {0x76, 7}, {0x2c, 6}, {0x8, 5},
+    {0x9, 5}, {0x2d, 6}, {0x77, 7}, {0x78, 7},
+    {0x79, 7}, {0x7a, 7}, {0x7b, 7}, {0x7ffe, 15},
+    {0x7fc, 11}, {0x3ffd, 14}, {0x1ffd, 13}, {0xffffffc, 28},
+    {0xfffe6, 20}, {0x3fffd2, 22}, {0xfffe7, 20}, {0xfffe8, 20},
+    {0x3fffd3, 22}, {0x3fffd4, 22}, {0x3fffd5, 22}, {0x7fffd9, 23},
+    {0x3fffd6, 22}, {0x7fffda, 23}, {0x7fffdb, 23}, {0x7fffdc, 23},
+    {0x7fffdd, 23}, {0x7fffde, 23}, {0xffffeb, 24}, {0x7fffdf, 23},
+    {0xffffec, 24}, {0xffffed, 24}, {0x3fffd7, 22}, {0x7fffe0, 23},
+    {0xffffee, 24}, {0x7fffe1, 23}, {0x7fffe2, 23}, {0x7fffe3, 23},
+    {0x7fffe4, 23}, {0x1fffdc, 21}, {0x3fffd8, 22}, {0x7fffe5, 23},
+    {0x3fffd9, 22}, {0x7fffe6, 23}, {0x7fffe7, 23}, {0xffffef, 24},
+    {0x3fffda, 22}, {0x1fffdd, 21}, {0xfffe9, 20}, {0x3fffdb, 22},
+    {0x3fffdc, 22}, {0x7fffe8, 23}, {0x7fffe9, 23}, {0x1fffde, 21},
+    {0x7fffea, 23}, {0x3fffdd, 22}, {0x3fffde, 22}, {0xfffff0, 24},
+    {0x1fffdf, 21}, {0x3fffdf, 22}, {0x7fffeb, 23}, {0x7fffec, 23},
+    {0x1fffe0, 21}, {0x1fffe1, 21}, {0x3fffe0, 22}, {0x1fffe2, 21},
+    {0x7fffed, 23}, {0x3fffe1, 22}, {0x7fffee, 23}, {0x7fffef, 23},
+    {0xfffea, 20}, {0x3fffe2, 22}, {0x3fffe3, 22}, {0x3fffe4, 22},
+    {0x7ffff0, 23}, {0x3fffe5, 22}, {0x3fffe6, 22}, {0x7ffff1, 23},
+    {0x3ffffe0, 26}, {0x3ffffe1, 26}, {0xfffeb, 20}, {0x7fff1, 19},
+    {0x3fffe7, 22}, {0x7ffff2, 23}, {0x3fffe8, 22}, {0x1ffffec, 25},
+    {0x3ffffe2, 26}, {0x3ffffe3, 26}, {0x3ffffe4, 26}, {0x7ffffde, 27},
+    {0x7ffffdf, 27}, {0x3ffffe5, 26}, {0xfffff1, 24}, {0x1ffffed, 25},
+    {0x7fff2, 19}, {0x1fffe3, 21}, {0x3ffffe6, 26}, {0x7ffffe0, 27},
+    {0x7ffffe1, 27}, {0x3ffffe7, 26}, {0x7ffffe2, 27}, {0xfffff2, 24},
+    {0x1fffe4, 21}, {0x1fffe5, 21}, {0x3ffffe8, 26}, {0x3ffffe9, 26},
+    {0xffffffd, 28}, {0x7ffffe3, 27}, {0x7ffffe4, 27}, {0x7ffffe5, 27},
+    {0xfffec, 20}, {0xfffff3, 24}, {0xfffed, 20}, {0x1fffe6, 21},
+    {0x3fffe9, 22}, {0x1fffe7, 21}, {0x1fffe8, 21}, {0x7ffff3, 23},
+    {0x3fffea, 22}, {0x3fffeb, 22}, {0x1ffffee, 25}, {0x1ffffef, 25},
+    {0xfffff4, 24}, {0xfffff5, 24}, {0x3ffffea, 26}, {0x7ffff4, 23},
+    {0x3ffffeb, 26}, {0x7ffffe6, 27}, {0x3ffffec, 26}, {0x3ffffed, 26},
+    {0x7ffffe7, 27}, {0x7ffffe8, 27}, {0x7ffffe9, 27}, {0x7ffffea, 27},
+    {0x7ffffeb, 27}, {0xffffffe, 28}, {0x7ffffec, 27}, {0x7ffffed, 27},
+    {0x7ffffee, 27}, {0x7ffffef, 27}, {0x7fffff0, 27}, {0x3ffffee, 26},
+    {0x3fffffff, 30},
+};
+
+
+/// @brief 解码用的二叉树, 按位从根走到叶子
+class HuffmanTree{
+public:
+    struct Node{
+        int16_t child[2] = {-1, -1};
+        // 叶子节点的符号, 中间节点为-1
+        int16_t symbol = -1;
+    };
+
+    HuffmanTree(){
+        m_nodes.emplace_back();
+        for(int i = 0; i < 257; ++i){
+            int16_t cur = 0;
+            for(int b = s_huffman[i].bits - 1; b >= 0; --b){
+                int bit = (s_huffman[i].code >> b) & 1;
+                if(m_nodes[cur].child[bit] < 0){
+                    m_nodes[cur].child[bit] = m_nodes.size();
+                    m_nodes.emplace_back();
+                }
+                cur = m_nodes[cur].child[bit];
+            }
+            m_nodes[cur].symbol = i;
+        }
+    }
+
+    const Node& operator[](size_t i) const { return m_nodes[i];}
+
+private:
+    std::vector<Node> m_nodes;
+};
+
+static const HuffmanTree s_tree;
+
+
+size_t Huffman::EncodedLength(std::string_view data){
+    size_t bits = 0;
+    for(unsigned char c : data){
+        bits += s_huffman[c].bits;
+    }
+    return (bits + 7) / 8;
+}
+
+
+void Huffman::Encode(std::string_view data, std::string& out){
+    uint64_t acc = 0;
+    int bits = 0;
+    for(unsigned char c : data){
+        acc = (acc << s_huffman[c].bits) | s_huffman[c].code;
+        bits += s_huffman[c].bits;
+        while(bits >= 8){
+            bits -= 8;
+            out.push_back((char)(acc >> bits));
+        }
+    }
+    if(bits > 0){
+        out.push_back((char)((acc << (8 - bits)) | (0xff >> bits)));
+    }
+}
+
+
+bool Huffman::Decode(const uint8_t* data, size_t len, std::string& out){
+    int16_t cur = 0;
+    // 当前符号已经读了多少位, 是否全是1, 用于检查结尾的填充
+    int depth = 0;
+    bool ones = true;
+    for(size_t i = 0; i < len; ++i){
+        for(int b = 7; b >= 0; --b){
+            int bit = (data[i] >> b) & 1;
+            cur = s_tree[cur].child[bit];
+            if(cur < 0){
+                return false;
+            }
+            ++depth;
+            ones = ones && bit;
+            int16_t symbol = s_tree[cur].symbol;
+            if(symbol >= 0){
+                if(symbol == 256){
+                    return false;
+                }
+                out.push_back((char)symbol);
+                cur = 0;
+                depth = 0;
+                ones = true;
+            }
+        }
+    }
+    return depth < 8 && ones;
+}
+
+
+static const std::pair<std::string, std::string> s_static_table[DynamicTable::STATIC_SIZE] = {
+    {":authority", ""},
+    {":method", "GET"},
+    {":method", "POST"},
+    {":path", "/"},
+    {":path", "/index.html"},
+    {":scheme", "http"},
+    {":scheme", "https"},
+    {":status", "200"},
+    {":status", "204"},
+    {":status", "206"},
+    {":status", "304"},
+    {":status", "400"},
+    {":status", "404"},
+    {":status", "500"},
+    {"accept-charset", ""},
+    {"accept-encoding", "gzip, deflate"},
+    {"accept-language", ""},
+    {"accept-ranges", ""},
+    {"accept", ""},
+    {"access-control-allow-origin", ""},
+    {"age", ""},
+    {"allow", ""},
+    {"authorization", ""},
+    {"cache-control", ""},
+    {"content-disposition", ""},
+    {"content-encoding", ""},
+    {"content-language", ""},
+    {"content-length", ""},
+    {"content-location", ""},
+    {"content-range", ""},
+    {"content-type", ""},
+    {"cookie", ""},
+    {"date", ""},
+    {"etag", ""},
+    {"expect", ""},
+    {"expires", ""},
+    {"from", ""},
+    {"host", ""},
+    {"if-match", ""},
+    {"if-modified-since", ""},
+    {"if-none-match", ""},
+    {"if-range", ""},
+    {"if-unmodified-since", ""},
+    {"last-modified", ""},
+    {"link", ""},
+    {"location", ""},
+    {"max-forwards", ""},
+    {"proxy-authenticate", ""},
+    {"proxy-authorization", ""},
+    {"range", ""},
+    {"referer", ""},
+    {"refresh", ""},
+    {"retry-after", ""},
+    {"server", ""},
+    {"set-cookie", ""},
+    {"strict-transport-security", ""},
+    {"transfer-encoding", ""},
+    {"user-agent", ""},
+    {"vary", ""},
+    {"via", ""},
+    {"www-authenticate", ""},
+};
+
+
+/// @brief 静态表的反向索引
+struct StaticIndex{
+    StaticIndex(){
+        for(uint32_t i = DynamicTable::STATIC_SIZE; i > 0; --i){
+            auto& entry = s_static_table[i - 1];
+            names[entry.first] = i;
+            if(!entry.second.empty()){
+                fields[entry.first + '\0' + entry.second] = i;
+            }
+        }
+    }
+
+    // 名字 -> 第一个索引
+    std::unordered_map<std::string, uint32_t> names;
+    // "名字\0值" -> 索引
+    std::unordered_map<std::string, uint32_t> fields;
+};
+
+static const StaticIndex s_static_index;
+
+
+static uint32_t EntrySize(const std::string& name, const std::string& value){
+    return name.size() + value.size() + 32;
+}
+
+
+DynamicTable::DynamicTable(uint32_t max_size)
+    :m_maxSize(max_size){
+}
+
+
+const std::pair<std::string, std::string>* DynamicTable::get(uint32_t index) const{
+    if(index == 0){
+        return nullptr;
+    }
+    if(index <= STATIC_SIZE){
+        return &s_static_table[index - 1];
+    }
+    index -= STATIC_SIZE + 1;
+    return index < m_entries.size() ? &m_entries[index] : nullptr;
+}
+
+
+uint32_t DynamicTable::find(std::string_view name, std::string_view value, bool& exact) const{
+    exact = false;
+    uint32_t name_index = 0;
+    std::string key(name);
+    auto it = s_static_index.names.find(key);
+    if(it != s_static_index.names.end()){
+        name_index = it->second;
+        key.push_back('\0');
+        key.append(value);
+        auto fit = s_static_index.fields.find(key);
+        if(fit != s_static_index.fields.end()){
+            exact = true;
+            return fit->second;
+        }
+    }
+    for(size_t i = 0; i < m_entries.size(); ++i){
+        if(m_entries[i].first == name){
+            if(m_entries[i].second == value){
+                exact = true;
+                return STATIC_SIZE + 1 + i;
+            }
+            if(!name_index){
+                name_index = STATIC_SIZE + 1 + i;
+            }
+        }
+    }
+    return name_index;
+}
+
+
+void DynamicTable::insert(std::string name, std::string value){
+    uint32_t size = EntrySize(name, value);
+    if(size > m_maxSize){
+        evict(0);
+        return;
+    }
+    evict(m_maxSize - size);
+    m_size += size;
+    m_entries.emplace_front(std::move(name), std::move(value));
+}
+
+
+void DynamicTable::setMaxSize(uint32_t v){
+    m_maxSize = v;
+    evict(v);
+}
+
+
+void DynamicTable::evict(uint32_t max_size){
+    while(m_size > max_size && !m_entries.empty()){
+        m_size -= EntrySize(m_entries.back().first, m_entries.back().second);
+        m_entries.pop_back();
+    }
+}
+
+
+/// @brief  解码prefix位前缀的整数(RFC 7541 5.1)
+static bool DecodeInt(const uint8_t*& p, const uint8_t* end, int prefix, uint32_t& v){
+    if(p >= end){
+        return false;
+    }
+    uint32_t max = (1u << prefix) - 1;
+    v = *p++ & max;
+    if(v < max){
+        return true;
+    }
+    uint64_t rt = v;
+    for(int shift = 0; p < end && shift <= 28; shift += 7){
+        uint8_t b = *p++;
+        rt += (uint64_t)(b & 0x7f) << shift;
+        if(!(b & 0x80)){
+            if(rt > 0xffffffffull){
+                return false;
+            }
+            v = rt;
+            return true;
+        }
+    }
+    return false;
+}
+
+
+/// @brief  编码整数, flags是第一个字节中前缀之前的位
+static void EncodeInt(std::string& out, uint8_t flags, int prefix, uint32_t v){
+    uint32_t max = (1u << prefix) - 1;
+    if(v < max){
+        out.push_back((char)(flags | v));
+        return;
+    }
+    out.push_back((char)(flags | max));
+    v -= max;
+    while(v >= 0x80){
+        out.push_back((char)((v & 0x7f) | 0x80));
+        v >>= 7;
+    }
+    out.push_back((char)v);
+}
+
+
+static bool DecodeString(const uint8_t*& p, const uint8_t* end, std::string& out){
+    if(p >= end){
+        return false;
+    }
+    bool huffman = *p & 0x80;
+    uint32_t len = 0;
+    if(!DecodeInt(p, end, 7, len) || len > (size_t)(end - p)){
+        return false;
+    }
+    if(huffman){
+        if(!Huffman::Decode(p, len, out)){
+            return false;
+        }
+    } else {
+        out.assign((const char*)p, len);
+    }
+    p += len;
+    return true;
+}
+
+
+static void EncodeString(std::string& out, std::string_view str){
+    size_t len = Huffman::EncodedLength(str);
+    if(len < str.size()){
+        EncodeInt(out, 0x80, 7, len);
+        Huffman::Encode(str, out);
+    } else {
+        EncodeInt(out, 0, 7, str.size());
+        out.append(str);
+    }
+}
+
+
+HPackDecoder::HPackDecoder(uint32_t max_table_size)
+    :m_table(max_table_size)
+    ,m_maxTableSize(max_table_size){
+}
+
+
+bool HPackDecoder::decode(const uint8_t* data, size_t len, HeaderList& headers, size_t max_size){
+    const uint8_t* p = data;
+    const uint8_t* end = data + len;
+    size_t size = 0;
+    bool first = true;
+    while(p < end){
+        uint8_t b = *p;
+        uint32_t index = 0;
+        if(b & 0x80){
+            // 索引表示
+            if(!DecodeInt(p, end, 7, index)){
+                return false;
+            }
+            auto entry = m_table.get(index);
+            if(!entry){
+                return false;
+            }
+            headers.push_back(*entry);
+        } else if((b & 0xe0) == 0x20){
+            // 动态表大小更新, 只能在头部块开头
+            if(!first || !DecodeInt(p, end, 5, index) || index > m_maxTableSize){
+                return false;
+            }
+            m_table.setMaxSize(index);
+            continue;
+        } else {
+            // 字面值: 01 加入动态表, 0000 不加入, 0001 永不加入
+            bool indexing = (b & 0xc0) == 0x40;
+            if(!DecodeInt(p, end, indexing ? 6 : 4, index)){
+                return false;
+            }
+            std::pair<std::string, std::string> field;
+            if(index){
+                auto entry = m_table.get(index);
+                if(!entry){
+                    return false;
+                }
+                field.first = entry->first;
+            } else if(!DecodeString(p, end, field.first)){
+                return false;
+            }
+            if(!DecodeString(p, end, field.second)){
+                return false;
+            }
+            if(indexing){
+                m_table.insert(field.first, field.second);
+            }
+            headers.push_back(std::move(field));
+        }
+        first = false;
+        size += EntrySize(headers.back().first, headers.back().second);
+        if(size > max_size){
+            return false;
+        }
+    }
+    return true;
+}
+
+
+HPackEncoder::HPackEncoder(uint32_t max_table_size)
+    :m_table(max_table_size)
+    ,m_limit(max_table_size)
+    ,m_target(max_table_size)
+    ,m_minSize(max_table_size){
+}
+
+
+void HPackEncoder::setMaxTableSize(uint32_t v){
+    v = std::min(v, m_limit);
+    if(v == m_target && !m_sizeUpdate){
+        return;
+    }
+    m_target = v;
+    m_minSize = std::min(m_minSize, v);
+    m_sizeUpdate = true;
+}
+
+
+void HPackEncoder::start(std::string& out){
+    if(!m_sizeUpdate){
+        return;
+    }
+    if(m_minSize < m_target){
+        EncodeInt(out, 0x20, 5, m_minSize);
+    }
+    EncodeInt(out, 0x20, 5, m_target);
+    m_table.setMaxSize(m_target);
+    m_minSize = m_target;
+    m_sizeUpdate = false;
+}
+
+
+void HPackEncoder::encode(std::string_view name, std::string_view value, std::string& out){
+    bool exact = false;
+    uint32_t index = m_table.find(name, value, exact);
+    if(exact){
+        EncodeInt(out, 0x80, 7, index);
+        return;
+    }
+    // 授权信息永不加入动态表, 很长的值加入后会挤掉其他条目
+    if(name == "authorization" || name == "proxy-authorization"){
+        EncodeInt(out, 0x10, 4, index);
+    } else if(value.size() + name.size() + 32 > m_table.getMaxSize() / 2){
+        EncodeInt(out, 0x00, 4, index);
+    } else {
+        EncodeInt(out, 0x40, 6, index);
+        m_table.insert(std::string(name), std::string(value));
+    }
+    if(!index){
+        EncodeString(out, name);
+    }
+    EncodeString(out, value);
+}
+
+
+void HPackEncoder::encode(const HeaderList& headers, std::string& out){
+    start(out);
+    for(auto& i : headers){
+        encode(i.first, i.second, out);
+    }
+}
+
+
+}
+}
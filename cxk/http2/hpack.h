@@ -0,0 +1,133 @@
+#pragma once
+
+#include <stdint.h>
+#include <deque>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+
+namespace cxk{
+namespace http2{
+
+
+/// @brief  头部列表, 名字都是小写
+using HeaderList = std::vector<std::pair<std::string, std::string>>;
+
+
+/// @brief HPACK的Huffman编码(RFC 7541 附录B)
+class Huffman{
+public:
+    /// @brief  编码后的长度
+    static size_t EncodedLength(std::string_view data);
+
+    /// @brief  编码后追加到out, 最后不足一个字节的部分用EOS的前缀(全1)补齐
+    static void Encode(std::string_view data, std::string& out);
+
+    /// @brief  解码后追加到out
+    /// @return 是否成功, 包含EOS或者填充不合法时失败
+    static bool Decode(const uint8_t* data, size_t len, std::string& out);
+};
+
+
+/// @brief HPACK动态表(RFC 7541 2.3)
+/// @details 索引从1开始, 1~61是静态表, 之后是动态表, 最新插入的条目索引最小。
+///          条目大小是名字和值的长度加32, 总大小超过上限时淘汰最老的条目
+class DynamicTable{
+public:
+    /// @brief 静态表的条目数
+    static const uint32_t STATIC_SIZE = 61;
+
+    DynamicTable(uint32_t max_size = 4096);
+
+    /// @brief          按索引查找
+    /// @return         索引无效返回nullptr
+    const std::pair<std::string, std::string>* get(uint32_t index) const;
+
+    /// @brief          查找头部
+    /// @param exact    是否名字和值都匹配
+    /// @return         匹配的索引, 优先完全匹配, 没有匹配返回0
+    uint32_t find(std::string_view name, std::string_view value, bool& exact) const;
+
+    /// @brief          插入条目, 比上限大的条目会清空整个表
+    void insert(std::string name, std::string value);
+
+    /// @brief          设置大小上限, 淘汰超出的条目
+    void setMaxSize(uint32_t v);
+
+    uint32_t getMaxSize() const { return m_maxSize;}
+    uint32_t getSize() const { return m_size;}
+    size_t getCount() const { return m_entries.size();}
+
+private:
+    void evict(uint32_t max_size);
+
+private:
+    // 最新的条目在前面
+    std::deque<std::pair<std::string, std::string>> m_entries;
+    uint32_t m_size = 0;
+    uint32_t m_maxSize;
+};
+
+
+/// @brief HPACK解码器, 每个连接接收方向一个
+class HPackDecoder{
+public:
+    /// @param max_table_size   本端SETTINGS_HEADER_TABLE_SIZE, 对方更新动态表大小不能超过它
+    HPackDecoder(uint32_t max_table_size = 4096);
+
+    /// @brief          解码一个完整的头部块
+    /// @param headers  解码出的头部追加到headers
+    /// @param max_size 头部列表的大小上限(名字和值的长度加32), 超过时失败
+    /// @return         是否成功, 失败是连接错误(COMPRESSION_ERROR), 动态表状态已经不可用
+    bool decode(const uint8_t* data, size_t len, HeaderList& headers, size_t max_size = (size_t)-1);
+
+    /// @brief  设置本端SETTINGS_HEADER_TABLE_SIZE
+    void setMaxTableSize(uint32_t v) { m_maxTableSize = v;}
+
+    const DynamicTable& getTable() const { return m_table;}
+
+private:
+    DynamicTable m_table;
+    uint32_t m_maxTableSize;
+};
+
+
+/// @brief HPACK编码器, 每个连接发送方向一个
+/// @details 静态表和动态表中有的头部用索引表示, 其他头部的值加入动态表;
+///          授权信息和很长的值不加入动态表。字符串在Huffman编码更短时使用Huffman编码
+class HPackEncoder{
+public:
+    HPackEncoder(uint32_t max_table_size = 4096);
+
+    /// @brief          开始一个头部块, 有待发送的动态表大小更新时先写到out
+    void start(std::string& out);
+
+    /// @brief          编码一个头部追加到out
+    /// @param name     头部名字, 必须是小写
+    void encode(std::string_view name, std::string_view value, std::string& out);
+
+    /// @brief          编码整个头部块追加到out
+    void encode(const HeaderList& headers, std::string& out);
+
+    /// @brief          对方SETTINGS_HEADER_TABLE_SIZE变化, 在下一个头部块开头通知对方
+    void setMaxTableSize(uint32_t v);
+
+    const DynamicTable& getTable() const { return m_table;}
+
+private:
+    DynamicTable m_table;
+    // 本端使用的动态表大小上限, 对方允许的更大时也不超过它
+    uint32_t m_limit;
+    // 下一个头部块开始时生效的大小
+    uint32_t m_target;
+    // 两个头部块之间出现过的最小值, 比m_target小时要先通知它(RFC 7541 4.2)
+    uint32_t m_minSize;
+    bool m_sizeUpdate = false;
+};
+
+
+}
+}
@@ -0,0 +1,1184 @@
+#include "http2_session.h"
+#include "cxk/config.h"
+#include "cxk/logger.h"
+#include "cxk/socket.h"
+#include "cxk/stream/socket_stream.h"
+#include "cxk/http/http_parser.h"
+#include "cxk/util.h"
+#include <errno.h>
+#include <string.h>
+
+
+namespace cxk{
+namespace http2{
+
+static cxk::Logger::ptr g_logger = CXK_LOG_NAME("system");
+
+static cxk::ConfigVar<uint32_t>::ptr g_http2_max_concurrent_streams =
+    cxk::Config::Lookup("http2.max_concurrent_streams", (uint32_t)100, "http2 max concurrent streams per connection");
+
+static cxk::ConfigVar<uint32_t>::ptr g_http2_initial_window_size =
+    cxk::Config::Lookup("http2.initial_window_size", (uint32_t)(1024 * 1024), "http2 stream receive window size");
+
+static cxk::ConfigVar<uint32_t>::ptr g_http2_connection_window_size =
+    cxk::Config::Lookup("http2.connection_window_size", (uint32_t)(16 * 1024 * 1024), "http2 connection receive window size");
+
+static cxk::ConfigVar<uint32_t>::ptr g_http2_max_frame_size =
+    cxk::Config::Lookup("http2.max_frame_size", (uint32_t)DEFAULT_MAX_FRAME_SIZE, "http2 max frame size to receive");
+
+static cxk::ConfigVar<uint32_t>::ptr g_http2_max_header_list_size =
+    cxk::Config::Lookup("http2.max_header_list_size", (uint32_t)(64 * 1024), "http2 max header list size to receive");
+
+static cxk::ConfigVar<uint32_t>::ptr g_http2_header_table_size =
+    cxk::Config::Lookup("http2.header_table_size", (uint32_t)4096, "http2 hpack dynamic table size");
+
+static cxk::ConfigVar<uint32_t>::ptr g_http2_max_reset_streams =
+    cxk::Config::Lookup("http2.max_reset_streams", (uint32_t)200, "http2 max streams reset by peer or refused per second");
+
+static cxk::ConfigVar<uint32_t>::ptr g_http2_max_control_buffer =
+    cxk::Config::Lookup("http2.max_control_buffer", (uint32_t)(64 * 1024), "http2 max unsent control frame bytes");
+
+
+Http2Session::Http2Session(Stream::ptr stream, bool is_client, IOManager* iom)
+    : m_stream(stream)
+    , m_isClient(is_client)
+    , m_iom(iom)
+    , m_encoder(g_http2_header_table_size->getValue())
+    , m_decoder(g_http2_header_table_size->getValue())
+    , m_maxControlBuf(g_http2_max_control_buffer->getValue())
+    , m_maxResets(g_http2_max_reset_streams->getValue()){
+    m_local.headerTableSize = g_http2_header_table_size->getValue();
+    m_local.enablePush = 0;
+    m_local.maxConcurrentStreams = g_http2_max_concurrent_streams->getValue();
+    m_local.initialWindowSize = std::min(g_http2_initial_window_size->getValue(), MAX_WINDOW_SIZE);
+    m_local.maxFrameSize = std::min(std::max(g_http2_max_frame_size->getValue(), DEFAULT_MAX_FRAME_SIZE)
+                , MAX_MAX_FRAME_SIZE);
+    m_local.maxHeaderListSize = g_http2_max_header_list_size->getValue();
+    m_connectionWindow = std::min(std::max(g_http2_connection_window_size->getValue(), DEFAULT_WINDOW_SIZE)
+                , MAX_WINDOW_SIZE);
+    m_nextStreamId = is_client ? 1 : 2;
+    // 读缓冲要能放下一个完整的帧
+    m_reader = std::make_shared<BufferedStream>(stream, FRAME_HEADER_SIZE + m_local.maxFrameSize);
+}
+
+
+Http2Session::~Http2Session(){
+    CXK_LOG_DEBUG(g_logger) << "Http2Session::~Http2Session";
+}
+
+
+// 本端的SETTINGS和连接的WINDOW_UPDATE, 需要持有锁
+static void AppendSettings(std::string& out, SettingsId id, uint32_t value){
+    AppendUint16(out, (uint16_t)id);
+    AppendUint32(out, value);
+}
+
+
+void Http2Session::serve(RequestHandler handler){
+    m_handler = handler;
+    std::string_view preface = m_reader->peek(CONNECTION_PREFACE_SIZE).substr(0, CONNECTION_PREFACE_SIZE);
+    if(preface != std::string_view(CONNECTION_PREFACE, CONNECTION_PREFACE_SIZE)){
+        CXK_LOG_LIMIT_ERROR(g_logger, 10) << "invalid http2 connection preface";
+        m_stream->close();
+        return;
+    }
+    m_reader->consume(CONNECTION_PREFACE_SIZE);
+    {
+        MutexType::Lock lock(m_mutex);
+        writeSettings();
+    }
+    doRead();
+
+    // 调用者随后关闭连接, 先等写协程写出GOAWAY等剩余的帧, 对方不读取时超时后关闭
+    static const uint64_t s_flush_timeout = 1000;
+    MutexType::Lock lock(m_mutex);
+    if(m_writing){
+        std::weak_ptr<Stream> weak_stream(m_stream);
+        Timer::ptr timer = m_iom->addTimer(s_flush_timeout, [weak_stream](){
+            auto stream = weak_stream.lock();
+            if(stream){
+                stream->close();
+            }
+        });
+        while(m_writing){
+            m_sendCond.wait(lock);
+        }
+        timer->cancel();
+    }
+}
+
+
+bool Http2Session::start(){
+    {
+        MutexType::Lock lock(m_mutex);
+        m_sendBuf.append(CONNECTION_PREFACE, CONNECTION_PREFACE_SIZE);
+        writeSettings();
+    }
+    m_iom->schedule(std::bind(&Http2Session::doRead, shared_from_this()));
+    return true;
+}
+
+
+void Http2Session::writeSettings(){
+    std::string payload;
+    AppendSettings(payload, SettingsId::HEADER_TABLE_SIZE, m_local.headerTableSize);
+    AppendSettings(payload, SettingsId::ENABLE_PUSH, m_local.enablePush);
+    AppendSettings(payload, SettingsId::MAX_CONCURRENT_STREAMS, m_local.maxConcurrentStreams);
+    AppendSettings(payload, SettingsId::INITIAL_WINDOW_SIZE, m_local.initialWindowSize);
+    AppendSettings(payload, SettingsId::MAX_FRAME_SIZE, m_local.maxFrameSize);
+    AppendSettings(payload, SettingsId::MAX_HEADER_LIST_SIZE, m_local.maxHeaderListSize);
+    writeFrame(FrameType::SETTINGS, 0, 0, payload.c_str(), payload.size());
+    // 连接的初始窗口只能通过WINDOW_UPDATE扩大
+    if(m_connectionWindow > DEFAULT_WINDOW_SIZE){
+        writeWindowUpdate(0, m_connectionWindow - DEFAULT_WINDOW_SIZE);
+        m_recvWindow = m_connectionWindow;
+    }
+}
+
+
+void Http2Session::writeWindowUpdate(uint32_t stream_id, uint32_t increment){
+    std::string payload;
+    AppendUint32(payload, increment);
+    writeFrame(FrameType::WINDOW_UPDATE, 0, stream_id, payload.c_str(), payload.size());
+}
+
+
+http::HttpFuture::ptr Http2Session::request(http::HttpRequest::ptr req, uint64_t timeout_ms){
+    auto future = std::make_shared<http::HttpFuture>();
+    MutexType::Lock lock(m_mutex);
+    if(m_closed || m_goawaySent || m_goawayReceived){
+        future->set(std::make_shared<http::HttpResult>((int)http::HttpResult::Error::POOL_INVALID_CONNECTION
+                    , nullptr, "http2 connection closed"));
+        return future;
+    }
+    Task task{req, future, timeout_ms};
+    if(m_streams.size() >= m_remote.maxConcurrentStreams){
+        m_waiting.push_back(task);
+    } else {
+        startRequest(task);
+    }
+    return future;
+}
+
+
+Http2Session::ptr Http2Session::Connect(Uri::ptr uri, uint64_t timeout_ms, IOManager* iom){
+    Address::ptr addr = uri->createAddress();
+    if(!addr){
+        CXK_LOG_ERROR(g_logger) << "http2 connect get addr fail: " << uri->getHost();
+        return nullptr;
+    }
+    bool https = uri->getScheme() == "https";
+    Socket::ptr sock;
+    SSLSocket::ptr ssl;
+    if(https){
+        ssl = SSLSocket::CreateTCP(addr);
+        ssl->setAlpnProtocols({"h2"});
+        sock = ssl;
+    } else {
+        sock = Socket::CreateTCP(addr);
+    }
+    if(!sock->connect(addr, timeout_ms)){
+        CXK_LOG_ERROR(g_logger) << "http2 connect fail: " << *addr;
+        return nullptr;
+    }
+    if(ssl && ssl->getAlpnProtocol() != "h2"){
+        CXK_LOG_ERROR(g_logger) << "http2 connect: server does not support h2: " << *addr;
+        return nullptr;
+    }
+
+    auto session = std::make_shared<Http2Session>(std::make_shared<SocketStream>(sock), true, iom);
+    std::string host = uri->getHost();
+    if(uri->getPort() != (https ? 443 : 80)){
+        host += ":" + std::to_string(uri->getPort());
+    }
+    session->m_host = host;
+    session->m_isHttps = https;
+    session->start();
+    return session;
+}
+
+
+void Http2Session::shutdown(Http2Error error){
+    MutexType::Lock lock(m_mutex);
+    writeGoaway(error);
+}
+
+
+void Http2Session::close(){
+    MutexType::Lock lock(m_mutex);
+    if(m_closed || m_closing){
+        return;
+    }
+    writeGoaway(Http2Error::NO_ERROR);
+    closeLocked();
+}
+
+
+void Http2Session::closeLocked(){
+    m_closing = true;
+    // 写协程写完GOAWAY等剩余的帧后关闭, 读协程读取失败后重置所有流
+    if(!m_writing){
+        m_stream->close();
+    }
+}
+
+
+bool Http2Session::isActive(){
+    MutexType::Lock lock(m_mutex);
+    return !m_closed && !m_goawaySent && !m_goawayReceived;
+}
+
+
+size_t Http2Session::getStreamCount(){
+    MutexType::Lock lock(m_mutex);
+    return m_streams.size();
+}
+
+
+void Http2Session::doRead(){
+    auto self = shared_from_this();
+    while(true){
+        errno = 0;
+        std::string_view data = m_reader->peek(FRAME_HEADER_SIZE);
+        if(data.size() < FRAME_HEADER_SIZE){
+            // 空闲连接读超时后关闭, 还有请求在处理时继续等待
+            if(errno == ETIMEDOUT && getStreamCount() > 0){
+                continue;
+            }
+            break;
+        }
+        FrameHeader header;
+        header.parse((const uint8_t*)data.data());
+        if(header.length > m_local.maxFrameSize){
+            connectionError(Http2Error::FRAME_SIZE_ERROR, "frame too large: " + std::to_string(header.length));
+            break;
+        }
+        errno = 0;
+        data = m_reader->peek(FRAME_HEADER_SIZE + header.length);
+        if(data.size() < FRAME_HEADER_SIZE + header.length){
+            if(errno == ETIMEDOUT && getStreamCount() > 0){
+                continue;
+            }
+            break;
+        }
+        bool rt = handleFrame(header, (const uint8_t*)data.data() + FRAME_HEADER_SIZE);
+        m_reader->consume(FRAME_HEADER_SIZE + header.length);
+        if(!rt){
+            break;
+        }
+    }
+    onClose();
+}
+
+
+void Http2Session::doWrite(){
+    auto self = shared_from_this();
+    std::string buf;
+    while(true){
+        {
+            MutexType::Lock lock(m_mutex);
+            buf.clear();
+            if(m_sendBuf.empty()){
+                m_writing = false;
+                if(m_closing){
+                    m_stream->close();
+                }
+                m_sendCond.notifyAll();
+                return;
+            }
+            // 交换缓冲, 写出期间其他协程继续追加帧
+            buf.swap(m_sendBuf);
+            m_controlBufSize = 0;
+            m_sendCond.notifyAll();
+        }
+        if(m_stream->writeFixSize(buf.c_str(), buf.size()) <= 0){
+            CXK_LOG_DEBUG(g_logger) << "http2 write fail, errno=" << errno << " errstr=" << strerror(errno);
+            {
+                MutexType::Lock lock(m_mutex);
+                m_writing = false;
+                m_sendBuf.clear();
+                m_controlBufSize = 0;
+                m_sendCond.notifyAll();
+            }
+            // 唤醒读协程, 由它重置所有流
+            m_stream->close();
+            return;
+        }
+    }
+}
+
+
+bool Http2Session::handleFrame(const FrameHeader& header, const uint8_t* payload){
+    // 头部块必须连续(RFC 7540 6.10)
+    if(m_headerStreamId && header.type != FrameType::CONTINUATION){
+        return connectionError(Http2Error::PROTOCOL_ERROR, "expect CONTINUATION");
+    }
+    switch(header.type){
+        case FrameType::DATA:
+            return handleData(header, payload);
+        case FrameType::HEADERS:
+            return handleHeaders(header, payload);
+        case FrameType::PRIORITY:
+            if(header.streamId == 0){
+                return connectionError(Http2Error::PROTOCOL_ERROR, "PRIORITY on stream 0");
+            }
+            if(header.length != 5){
+                streamError(header.streamId, Http2Error::FRAME_SIZE_ERROR);
+            }
+            // 不支持优先级, 按到达顺序处理
+            return true;
+        case FrameType::RST_STREAM:
+            return handleRstStream(header, payload);
+        case FrameType::SETTINGS:
+            return handleSettings(header, payload);
+        case FrameType::PUSH_PROMISE:
+            // 本端SETTINGS_ENABLE_PUSH为0
+            return connectionError(Http2Error::PROTOCOL_ERROR, "unexpected PUSH_PROMISE");
+        case FrameType::PING:
+            return handlePing(header, payload);
+        case FrameType::GOAWAY:
+            return handleGoaway(header, payload);
+        case FrameType::WINDOW_UPDATE:
+            return handleWindowUpdate(header, payload);
+        case FrameType::CONTINUATION:
+            return handleContinuation(header, payload);
+        default:
+            // 忽略未知类型的帧
+            return true;
+    }
+}
+
+
+// 去掉填充, 返回false时填充长度不合法
+static bool StripPadding(const FrameHeader& header, const uint8_t*& payload, size_t& length){
+    length = header.length;
+    if(!header.hasFlag(FLAG_PADDED)){
+        return true;
+    }
+    if(length < 1){
+        return false;
+    }
+    size_t pad = payload[0];
+    ++payload;
+    --length;
+    if(pad > length){
+        return false;
+    }
+    length -= pad;
+    return true;
+}
+
+
+bool Http2Session::handleData(const FrameHeader& header, const uint8_t* payload){
+    uint32_t id = header.streamId;
+    if(id == 0){
+        return connectionError(Http2Error::PROTOCOL_ERROR, "DATA on stream 0");
+    }
+    size_t length = 0;
+    if(!StripPadding(header, payload, length)){
+        return connectionError(Http2Error::PROTOCOL_ERROR, "invalid padding");
+    }
+
+    MutexType::Lock lock(m_mutex);
+    // 流量控制按整个帧的长度计算, 包括填充
+    if(header.length > m_recvWindow){
+        return connectionError(Http2Error::FLOW_CONTROL_ERROR, "connection window exceeded");
+    }
+    m_recvWindow -= header.length;
+    m_recvUnacked += header.length;
+    // 连接窗口不限制单个流, 数据到达就归还, 流的缓存由流窗口限制
+    if(m_recvUnacked >= m_connectionWindow / 2){
+        writeWindowUpdate(0, m_recvUnacked);
+        m_recvWindow += m_recvUnacked;
+        m_recvUnacked = 0;
+    }
+
+    auto it = m_streams.find(id);
+    if(it == m_streams.end()){
+        if(isIdle(id)){
+            return connectionError(Http2Error::PROTOCOL_ERROR, "DATA on idle stream");
+        }
+        // 已经关闭或者重置的流, 对方发出RST_STREAM之前的数据直接忽略
+        return true;
+    }
+    auto stream = it->second;
+    if(stream->m_remoteClosed){
+        resetStream(stream, Http2Error::STREAM_CLOSED, true);
+        return true;
+    }
+    if(header.length > stream->m_recvWindow){
+        resetStream(stream, Http2Error::FLOW_CONTROL_ERROR, true);
+        return true;
+    }
+    stream->m_recvWindow -= header.length;
+
+    if(m_isClient){
+        // 响应体直接收下, 大小由max_body_size限制
+        if(!stream->m_response){
+            resetStream(stream, Http2Error::PROTOCOL_ERROR, true);
+            return true;
+        }
+        stream->m_recvBuf.append((const char*)payload, length);
+        consume(stream, header.length);
+        if(stream->m_recvBuf.size() > stream->m_maxBodySize){
+            finishRequest(stream, http::HttpResult::Error::SEND_CLOSE_BY_PEER, "http2 response body too large");
+            resetStream(stream, Http2Error::CANCEL, true);
+            return true;
+        }
+    } else {
+        stream->m_recvBuf.append((const char*)payload, length);
+        // 填充不会被读取, 直接归还
+        if(header.length > length){
+            consume(stream, header.length - length);
+        }
+        stream->m_cond.notifyAll();
+    }
+    if(header.hasFlag(FLAG_END_STREAM)){
+        onRemoteEnd(stream);
+    }
+    return true;
+}
+
+
+bool Http2Session::handleHeaders(const FrameHeader& header, const uint8_t* payload){
+    uint32_t id = header.streamId;
+    if(id == 0){
+        return connectionError(Http2Error::PROTOCOL_ERROR, "HEADERS on stream 0");
+    }
+    size_t length = 0;
+    if(!StripPadding(header, payload, length)){
+        return connectionError(Http2Error::PROTOCOL_ERROR, "invalid padding");
+    }
+    if(header.hasFlag(FLAG_PRIORITY)){
+        if(length < 5){
+            return connectionError(Http2Error::FRAME_SIZE_ERROR, "invalid HEADERS priority");
+        }
+        payload += 5;
+        length -= 5;
+    }
+    m_headerBlock.assign((const char*)payload, length);
+    if(header.hasFlag(FLAG_END_HEADERS)){
+        return handleHeaderBlock(id, header.hasFlag(FLAG_END_STREAM));
+    }
+    m_headerStreamId = id;
+    m_headerEndStream = header.hasFlag(FLAG_END_STREAM);
+    return true;
+}
+
+
+bool Http2Session::handleContinuation(const FrameHeader& header, const uint8_t* payload){
+    if(header.streamId == 0 || header.streamId != m_headerStreamId){
+        return connectionError(Http2Error::PROTOCOL_ERROR, "unexpected CONTINUATION");
+    }
+    m_headerBlock.append((const char*)payload, header.length);
+    // 压缩后的头部块已经超过上限, 不用等解码
+    if(m_headerBlock.size() > m_local.maxHeaderListSize){
+        return connectionError(Http2Error::ENHANCE_YOUR_CALM, "header block too large");
+    }
+    if(header.hasFlag(FLAG_END_HEADERS)){
+        m_headerStreamId = 0;
+        return handleHeaderBlock(header.streamId, m_headerEndStream);
+    }
+    return true;
+}
+
+
+bool Http2Session::handleHeaderBlock(uint32_t stream_id, bool end_stream){
+    // 解码器只在读协程中使用, 不需要加锁
+    HeaderList headers;
+    if(!m_decoder.decode((const uint8_t*)m_headerBlock.c_str(), m_headerBlock.size()
+                , headers, m_local.maxHeaderListSize)){
+        return connectionError(Http2Error::COMPRESSION_ERROR, "decode header block fail");
+    }
+    m_headerBlock.clear();
+
+    MutexType::Lock lock(m_mutex);
+    auto it = m_streams.find(stream_id);
+    Http2Stream::ptr stream = it == m_streams.end() ? nullptr : it->second;
+    if(m_isClient){
+        if(!stream){
+            // 超时被重置的流
+            if(isIdle(stream_id)){
+                return connectionError(Http2Error::PROTOCOL_ERROR, "HEADERS on idle stream");
+            }
+            return true;
+        }
+        if(!handleResponseHeaders(stream, headers)){
+            resetStream(stream, Http2Error::PROTOCOL_ERROR, true);
+            return true;
+        }
+        if(end_stream){
+            onRemoteEnd(stream);
+        }
+        return true;
+    }
+
+    if(stream){
+        // 请求体之后的trailer, 必须结束流
+        if(stream->m_remoteClosed || !end_stream){
+            resetStream(stream, Http2Error::PROTOCOL_ERROR, true);
+            return true;
+        }
+        onRemoteEnd(stream);
+        return true;
+    }
+    if(stream_id % 2 == 0 || stream_id <= m_lastStreamId){
+        return connectionError(Http2Error::PROTOCOL_ERROR, "invalid stream id: " + std::to_string(stream_id));
+    }
+    m_lastStreamId = stream_id;
+    if(m_goawaySent || m_closed){
+        return true;
+    }
+    // 被重置的流在处理协程返回前仍然占用资源, 按处理协程数限制并发
+    if(m_streams.size() >= m_local.maxConcurrentStreams || m_activeHandlers >= m_local.maxConcurrentStreams){
+        if(!countReset() || isControlFlooded()){
+            lock.unlock();
+            return connectionError(Http2Error::ENHANCE_YOUR_CALM, "too many refused streams");
+        }
+        writeRstStream(stream_id, Http2Error::REFUSED_STREAM);
+        return true;
+    }
+    http::HttpRequest::ptr req = createRequest(headers);
+    if(!req){
+        writeRstStream(stream_id, Http2Error::PROTOCOL_ERROR);
+        return true;
+    }
+
+    stream = std::make_shared<Http2Stream>(this, stream_id);
+    stream->m_request = req;
+    stream->m_recvWindow = m_local.initialWindowSize;
+    stream->m_sendWindow = m_remote.initialWindowSize;
+    stream->m_remoteClosed = end_stream;
+    if(!end_stream){
+        req->setBodyStream(std::make_shared<Http2BodyStream>(stream));
+    }
+    m_streams[stream_id] = stream;
+    ++m_activeHandlers;
+
+    auto self = shared_from_this();
+    m_iom->schedule([self, stream](){
+        self->m_handler(stream);
+        MutexType::Lock lock(self->m_mutex);
+        --self->m_activeHandlers;
+        if(!stream->m_localClosed){
+            // 没有发出完整的响应
+            self->resetStream(stream, Http2Error::INTERNAL_ERROR, true);
+        } else if(!stream->m_remoteClosed){
+            // 响应已经完成, 不再需要剩余的请求体(RFC 7540 8.1)
+            self->resetStream(stream, Http2Error::NO_ERROR, true);
+        }
+    });
+    return true;
+}
+
+
+http::HttpRequest::ptr Http2Session::createRequest(const HeaderList& headers){
+    http::HttpRequest::ptr req = std::make_shared<http::HttpRequest>(0x20, false);
+    std::string method;
+    std::string path;
+    std::string authority;
+    bool regular = false;
+    for(auto& i : headers){
+        const std::string& name = i.first;
+        if(!name.empty() && name[0] == ':'){
+            // 伪头部必须在普通头部之前
+            if(regular){
+                return nullptr;
+            }
+            if(name == ":method"){
+                method = i.second;
+            } else if(name == ":path"){
+                path = i.second;
+            } else if(name == ":authority"){
+                authority = i.second;
+            } else if(name != ":scheme"){
+                return nullptr;
+            }
+            continue;
+        }
+        regular = true;
+        if(name == "connection" || (name == "te" && i.second != "trailers")){
+            return nullptr;
+        }
+        // 同名头部合并, cookie可以拆成多个头部(RFC 7540 8.1.2.5)
+        std::string_view old = req->getHeaderView(name);
+        if(old.empty()){
+            req->setHeader(name, i.second);
+        } else {
+            req->setHeader(name, std::string(old) + (name == "cookie" ? "; " : ", ") + i.second);
+        }
+    }
+
+    http::HttpMethod m = http::StringToHttpMethod(method);
+    if(m == http::HttpMethod::INVALID_METHOD || path.empty()){
+        return nullptr;
+    }
+    req->setMethod(m);
+    size_t pos = path.find('#');
+    if(pos != std::string::npos){
+        req->setFragment(path.substr(pos + 1));
+        path.resize(pos);
+    }
+    pos = path.find('?');
+    if(pos != std::string::npos){
+        req->setQuery(path.substr(pos + 1));
+        path.resize(pos);
+    }
+    req->setPath(path);
+    if(!authority.empty() && req->getHeaderView("host").empty()){
+        req->setHeader("Host", authority);
+    }
+    return req;
+}
+
+
+bool Http2Session::handleResponseHeaders(Http2Stream::ptr stream, const HeaderList& headers){
+    if(stream->m_response){
+        // trailer, 不合并到响应头
+        return true;
+    }
+    int status = 0;
+    for(auto& i : headers){
+        if(i.first == ":status"){
+            status = atoi(i.second.c_str());
+            break;
+        }
+    }
+    if(status < 100 || status > 999){
+        return false;
+    }
+    if(status < 200){
+        // 1xx中间响应
+        return true;
+    }
+    http::HttpResponse::ptr rsp = std::make_shared<http::HttpResponse>(0x20, false);
+    rsp->setStatus((http::HttpStatus)status);
+    for(auto& i : headers){
+        if(!i.first.empty() && i.first[0] == ':'){
+            continue;
+        }
+        std::string old = rsp->getHeader(i.first);
+        rsp->setHeader(i.first, old.empty() ? i.second : old + ", " + i.second);
+    }
+    stream->m_response = rsp;
+    return true;
+}
+
+
+void Http2Session::onRemoteEnd(Http2Stream::ptr stream){
+    stream->m_remoteClosed = true;
+    if(m_isClient){
+        finishRequest(stream, http::HttpResult::Error::OK, "ok");
+    } else {
+        stream->m_cond.notifyAll();
+    }
+    tryRemove(stream);
+}
+
+
+bool Http2Session::handleRstStream(const FrameHeader& header, const uint8_t* payload){
+    if(header.streamId == 0){
+        return connectionError(Http2Error::PROTOCOL_ERROR, "RST_STREAM on stream 0");
+    }
+    if(header.length != 4){
+        return connectionError(Http2Error::FRAME_SIZE_ERROR, "invalid RST_STREAM");
+    }
+    Http2Error error = (Http2Error)ReadUint32(payload);
+    if(!m_isClient && !countReset()){
+        return connectionError(Http2Error::ENHANCE_YOUR_CALM, "too many stream resets");
+    }
+    MutexType::Lock lock(m_mutex);
+    auto it = m_streams.find(header.streamId);
+    if(it == m_streams.end()){
+        if(isIdle(header.streamId)){
+            return connectionError(Http2Error::PROTOCOL_ERROR, "RST_STREAM on idle stream");
+        }
+        return true;
+    }
+    auto stream = it->second;
+    if(m_isClient && error == Http2Error::NO_ERROR && stream->m_remoteClosed){
+        return true;
+    }
+    if(m_isClient){
+        finishRequest(stream, http::HttpResult::Error::SEND_CLOSE_BY_PEER
+                , std::string("http2 stream reset by peer: ") + Http2ErrorToString(error));
+    }
+    resetStream(stream, error, false);
+    return true;
+}
+
+
+bool Http2Session::handleSettings(const FrameHeader& header, const uint8_t* payload){
+    if(header.streamId != 0){
+        return connectionError(Http2Error::PROTOCOL_ERROR, "SETTINGS on stream " + std::to_string(header.streamId));
+    }
+    if(header.hasFlag(FLAG_ACK)){
+        if(header.length != 0){
+            return connectionError(Http2Error::FRAME_SIZE_ERROR, "invalid SETTINGS ack");
+        }
+        return true;
+    }
+    if(header.length % 6 != 0){
+        return connectionError(Http2Error::FRAME_SIZE_ERROR, "invalid SETTINGS");
+    }
+
+    MutexType::Lock lock(m_mutex);
+    for(size_t i = 0; i < header.length; i += 6){
+        SettingsId id = (SettingsId)ReadUint16(payload + i);
+        uint32_t value = ReadUint32(payload + i + 2);
+        switch(id){
+            case SettingsId::HEADER_TABLE_SIZE:
+                m_remote.headerTableSize = value;
+                m_encoder.setMaxTableSize(value);
+                break;
+            case SettingsId::ENABLE_PUSH:
+                if(value > 1){
+                    return connectionError(Http2Error::PROTOCOL_ERROR, "invalid SETTINGS_ENABLE_PUSH");
+                }
+                m_remote.enablePush = value;
+                break;
+            case SettingsId::MAX_CONCURRENT_STREAMS:
+                m_remote.maxConcurrentStreams = value;
+                break;
+            case SettingsId::INITIAL_WINDOW_SIZE:{
+                if(value > MAX_WINDOW_SIZE){
+                    return connectionError(Http2Error::FLOW_CONTROL_ERROR, "invalid SETTINGS_INITIAL_WINDOW_SIZE");
+                }
+                // 变化量作用到所有流的发送窗口(RFC 7540 6.9.2)
+                int64_t delta = (int64_t)value - m_remote.initialWindowSize;
+                for(auto& s : m_streams){
+                    s.second->m_sendWindow += delta;
+                    if(s.second->m_sendWindow > MAX_WINDOW_SIZE){
+                        return connectionError(Http2Error::FLOW_CONTROL_ERROR, "stream window overflow");
+                    }
+                }
+                m_remote.initialWindowSize = value;
+                break;
+            }
+            case SettingsId::MAX_FRAME_SIZE:
+                if(value < DEFAULT_MAX_FRAME_SIZE || value > MAX_MAX_FRAME_SIZE){
+                    return connectionError(Http2Error::PROTOCOL_ERROR, "invalid SETTINGS_MAX_FRAME_SIZE");
+                }
+                m_remote.maxFrameSize = value;
+                break;
+            case SettingsId::MAX_HEADER_LIST_SIZE:
+                m_remote.maxHeaderListSize = value;
+                break;
+            default:
+                // 忽略未知参数
+                break;
+        }
+    }
+    if(isControlFlooded()){
+        lock.unlock();
+        return connectionError(Http2Error::ENHANCE_YOUR_CALM, "too many unsent control frames");
+    }
+    writeFrame(FrameType::SETTINGS, FLAG_ACK, 0, nullptr, 0);
+    m_sendCond.notifyAll();
+    startWaiting();
+    return true;
+}
+
+
+bool Http2Session::handlePing(const FrameHeader& header, const uint8_t* payload){
+    if(header.streamId != 0){
+        return connectionError(Http2Error::PROTOCOL_ERROR, "PING on stream " + std::to_string(header.streamId));
+    }
+    if(header.length != 8){
+        return connectionError(Http2Error::FRAME_SIZE_ERROR, "invalid PING");
+    }
+    if(!header.hasFlag(FLAG_ACK)){
+        MutexType::Lock lock(m_mutex);
+        // 对方只发PING不读回复时, 发送缓冲会一直增长
+        if(isControlFlooded()){
+            lock.unlock();
+            return connectionError(Http2Error::ENHANCE_YOUR_CALM, "too many unsent control frames");
+        }
+        writeFrame(FrameType::PING, FLAG_ACK, 0, payload, 8);
+    }
+    return true;
+}
+
+
+bool Http2Session::handleGoaway(const FrameHeader& header, const uint8_t* payload){
+    if(header.streamId != 0){
+        return connectionError(Http2Error::PROTOCOL_ERROR, "GOAWAY on stream " + std::to_string(header.streamId));
+    }
+    if(header.length < 8){
+        return connectionError(Http2Error::FRAME_SIZE_ERROR, "invalid GOAWAY");
+    }
+    uint32_t last_id = ReadUint32(payload) & 0x7fffffff;
+    Http2Error error = (Http2Error)ReadUint32(payload + 4);
+    CXK_LOG_DEBUG(g_logger) << "http2 recv GOAWAY last_stream_id=" << last_id
+        << " error=" << Http2ErrorToString(error);
+
+    MutexType::Lock lock(m_mutex);
+    m_goawayReceived = true;
+    m_goawayId = std::min(m_goawayId, last_id);
+    if(m_isClient){
+        // 对方不会处理last_id之后的流, 可以在其他连接上重试
+        std::vector<Http2Stream::ptr> refused;
+        for(auto& i : m_streams){
+            if(i.first > last_id){
+                refused.push_back(i.second);
+            }
+        }
+        for(auto& i : refused){
+            finishRequest(i, http::HttpResult::Error::POOL_INVALID_CONNECTION, "http2 stream refused by GOAWAY");
+            resetStream(i, Http2Error::REFUSED_STREAM, false);
+        }
+        failWaiting("http2 connection GOAWAY");
+    }
+    // 已有的流处理完后关闭连接
+    return !m_streams.empty();
+}
+
+
+bool Http2Session::handleWindowUpdate(const FrameHeader& header, const uint8_t* payload){
+    if(header.length != 4){
+        return connectionError(Http2Error::FRAME_SIZE_ERROR, "invalid WINDOW_UPDATE");
+    }
+    uint32_t increment = ReadUint32(payload) & 0x7fffffff;
+    MutexType::Lock lock(m_mutex);
+    if(header.streamId == 0){
+        if(increment == 0){
+            return connectionError(Http2Error::PROTOCOL_ERROR, "WINDOW_UPDATE increment 0");
+        }
+        m_sendWindow += increment;
+        if(m_sendWindow > MAX_WINDOW_SIZE){
+            return connectionError(Http2Error::FLOW_CONTROL_ERROR, "connection window overflow");
+        }
+        m_sendCond.notifyAll();
+        return true;
+    }
+
+    auto it = m_streams.find(header.streamId);
+    if(it == m_streams.end()){
+        if(isIdle(header.streamId)){
+            return connectionError(Http2Error::PROTOCOL_ERROR, "WINDOW_UPDATE on idle stream");
+        }
+        return true;
+    }
+    auto stream = it->second;
+    if(increment == 0){
+        resetStream(stream, Http2Error::PROTOCOL_ERROR, true);
+        return true;
+    }
+    stream->m_sendWindow += increment;
+    if(stream->m_sendWindow > MAX_WINDOW_SIZE){
+        resetStream(stream, Http2Error::FLOW_CONTROL_ERROR, true);
+        return true;
+    }
+    m_sendCond.notifyAll();
+    return true;
+}
+
+
+bool Http2Session::connectionError(Http2Error error, const std::string& msg){
+    CXK_LOG_LIMIT_ERROR(g_logger, 10) << "http2 connection error " << Http2ErrorToString(error) << ": " << msg;
+    MutexType::Lock lock(m_mutex);
+    writeGoaway(error);
+    return false;
+}
+
+
+void Http2Session::streamError(uint32_t stream_id, Http2Error error){
+    MutexType::Lock lock(m_mutex);
+    auto it = m_streams.find(stream_id);
+    if(it == m_streams.end()){
+        writeRstStream(stream_id, error);
+        return;
+    }
+    auto stream = it->second;
+    if(m_isClient){
+        finishRequest(stream, http::HttpResult::Error::SEND_CLOSE_BY_PEER
+                , std::string("http2 stream error: ") + Http2ErrorToString(error));
+    }
+    resetStream(stream, error, true);
+}
+
+
+bool Http2Session::isIdle(uint32_t stream_id) const{
+    // 本端发起的流id和m_nextStreamId奇偶相同
+    if((stream_id % 2) == (m_nextStreamId % 2)){
+        return stream_id >= m_nextStreamId;
+    }
+    return stream_id > m_lastStreamId;
+}
+
+
+void Http2Session::writeFrame(FrameType type, uint8_t flags, uint32_t stream_id, const void* payload, size_t length){
+    if(m_closed){
+        return;
+    }
+    FrameHeader header;
+    header.length = length;
+    header.type = type;
+    header.flags = flags;
+    header.streamId = stream_id;
+    header.write(m_sendBuf);
+    if(length > 0){
+        m_sendBuf.append((const char*)payload, length);
+    }
+    if(type != FrameType::DATA && type != FrameType::HEADERS && type != FrameType::CONTINUATION){
+        m_controlBufSize += FRAME_HEADER_SIZE + length;
+    }
+    if(!m_writing){
+        m_writing = true;
+        m_iom->schedule(std::bind(&Http2Session::doWrite, shared_from_this()));
+    }
+}
+
+
+void Http2Session::writeHeaders(uint32_t stream_id, const HeaderList& headers, bool end_stream){
+    std::string block;
+    m_encoder.encode(headers, block);
+    // 超过对方最大帧长度的部分用CONTINUATION发送
+    size_t max_size = m_remote.maxFrameSize;
+    size_t len = std::min(max_size, block.size());
+    uint8_t flags = (end_stream ? FLAG_END_STREAM : 0) | (len == block.size() ? FLAG_END_HEADERS : 0);
+    writeFrame(FrameType::HEADERS, flags, stream_id, block.c_str(), len);
+    for(size_t pos = len; pos < block.size(); pos += len){
+        len = std::min(max_size, block.size() - pos);
+        writeFrame(FrameType::CONTINUATION, pos + len == block.size() ? FLAG_END_HEADERS : 0
+                , stream_id, block.c_str() + pos, len);
+    }
+}
+
+
+void Http2Session::writeRstStream(uint32_t stream_id, Http2Error error){
+    std::string payload;
+    AppendUint32(payload, (uint32_t)error);
+    writeFrame(FrameType::RST_STREAM, 0, stream_id, payload.c_str(), payload.size());
+}
+
+
+void Http2Session::writeGoaway(Http2Error error){
+    if(m_goawaySent || m_closed){
+        return;
+    }
+    m_goawaySent = true;
+    std::string payload;
+    AppendUint32(payload, m_lastStreamId);
+    AppendUint32(payload, (uint32_t)error);
+    writeFrame(FrameType::GOAWAY, 0, 0, payload.c_str(), payload.size());
+    failWaiting("http2 connection GOAWAY");
+}
+
+
+void Http2Session::onLocalEnd(Http2Stream::ptr stream){
+    stream->m_localClosed = true;
+    tryRemove(stream);
+}
+
+
+void Http2Session::resetStream(Http2Stream::ptr stream, Http2Error error, bool send){
+    if(stream->m_reset){
+        return;
+    }
+    if(send && !(stream->m_localClosed && stream->m_remoteClosed)){
+        writeRstStream(stream->m_id, error);
+    }
+    if(m_isClient && stream->m_future){
+        finishRequest(stream, http::HttpResult::Error::SEND_CLOSE_BY_PEER
+                , std::string("http2 stream reset: ") + Http2ErrorToString(error));
+    }
+    stream->m_reset = true;
+    stream->m_error = error;
+    stream->m_localClosed = true;
+    stream->m_remoteClosed = true;
+    stream->m_cond.notifyAll();
+    m_sendCond.notifyAll();
+    tryRemove(stream);
+}
+
+
+void Http2Session::tryRemove(Http2Stream::ptr stream){
+    if(!stream->isClosed()){
+        return;
+    }
+    auto it = m_streams.find(stream->m_id);
+    if(it == m_streams.end() || it->second != stream){
+        return;
+    }
+    m_streams.erase(it);
+    if(m_isClient){
+        startWaiting();
+    }
+}
+
+
+void Http2Session::consume(Http2Stream::ptr stream, size_t length){
+    stream->m_recvUnacked += length;
+    if(!stream->m_remoteClosed && stream->m_recvUnacked >= m_local.initialWindowSize / 2){
+        writeWindowUpdate(stream->m_id, stream->m_recvUnacked);
+        stream->m_recvWindow += stream->m_recvUnacked;
+        stream->m_recvUnacked = 0;
+    }
+}
+
+
+void Http2Session::startRequest(const Task& task){
+    if(m_nextStreamId > MAX_WINDOW_SIZE){
+        // 流id用完, 需要新的连接
+        task.future->set(std::make_shared<http::HttpResult>((int)http::HttpResult::Error::POOL_INVALID_CONNECTION
+                    , nullptr, "http2 stream id exhausted"));
+        m_goawaySent = true;
+        return;
+    }
+    uint32_t id = m_nextStreamId;
+    m_nextStreamId += 2;
+
+    http::HttpRequest::ptr req = task.request;
+    auto stream = std::make_shared<Http2Stream>(this, id);
+    stream->m_request = req;
+    stream->m_future = task.future;
+    stream->m_maxBodySize = http::HttpResponseParser::GetHttpResponseMaxBodySize();
+    stream->m_recvWindow = m_local.initialWindowSize;
+    stream->m_sendWindow = m_remote.initialWindowSize;
+    m_streams[id] = stream;
+
+    HeaderList headers;
+    headers.reserve(req->getHeaders().size() + 4);
+    std::string path = req->getPath().empty() ? "/" : req->getPath();
+    if(!req->getQuery().empty()){
+        path += "?" + req->getQuery();
+    }
+    std::string authority = req->getHeader("Host");
+    headers.emplace_back(":method", http::HttpMethodToString(req->getMethod()));
+    headers.emplace_back(":scheme", m_isHttps ? "https" : "http");
+    headers.emplace_back(":authority", authority.empty() ? m_host : authority);
+    headers.emplace_back(":path", path);
+    for(auto& i : req->getHeaders()){
+        std::string name = i.first;
+        for(auto& c : name){
+            c = tolower(c);
+        }
+        if(name == "host" || name == "connection" || name == "keep-alive" || name == "proxy-connection"
+                || name == "transfer-encoding" || name == "upgrade" || name == "te"){
+            continue;
+        }
+        headers.emplace_back(std::move(name), i.second);
+    }
+    const std::string& body = req->getBody();
+    if(!body.empty() && req->getHeader("Content-Length").empty()){
+        headers.emplace_back("content-length", std::to_string(body.size()));
+    }
+    writeHeaders(id, headers, body.empty());
+    if(body.empty()){
+        stream->m_localClosed = true;
+    }
+
+    if(task.timeout_ms){
+        std::weak_ptr<Http2Session> weak_self(shared_from_this());
+        std::weak_ptr<Http2Stream> weak_stream(stream);
+        stream->m_timer = m_iom->addConditionTimer(task.timeout_ms, [weak_self, weak_stream](){
+            auto self = weak_self.lock();
+            auto stream = weak_stream.lock();
+            if(!self || !stream){
+                return;
+            }
+            MutexType::Lock lock(self->m_mutex);
+            if(!stream->m_future){
+                return;
+            }
+            self->finishRequest(stream, http::HttpResult::Error::TIMEOUT, "http2 request timeout");
+            self->resetStream(stream, Http2Error::CANCEL, true);
+        }, weak_stream);
+    }
+
+    if(!body.empty()){
+        // 请求体受流量控制, 在单独的协程中发送
+        auto self = shared_from_this();
+        m_iom->schedule([self, stream, req](){
+            const std::string& body = req->getBody();
+            stream->sendData(body.c_str(), body.size(), true);
+        });
+    }
+}
+
+
+bool Http2Session::countReset(){
+    uint64_t now = cxk::GetCoarseMonotonicMS();
+    if(now >= m_resetTime + 1000){
+        m_resetTime = now;
+        m_resetCount = 0;
+    }
+    return ++m_resetCount <= m_maxResets;
+}
+
+
+void Http2Session::startWaiting(){
+    while(!m_waiting.empty() && !m_closed && !m_goawaySent && !m_goawayReceived
+            && m_streams.size() < m_remote.maxConcurrentStreams){
+        Task task = m_waiting.front();
+        m_waiting.pop_front();
+        startRequest(task);
+    }
+}
+
+
+void Http2Session::failWaiting(const std::string& msg){
+    while(!m_waiting.empty()){
+        m_waiting.front().future->set(std::make_shared<http::HttpResult>(
+                    (int)http::HttpResult::Error::POOL_INVALID_CONNECTION, nullptr, msg));
+        m_waiting.pop_front();
+    }
+}
+
+
+void Http2Session::finishRequest(Http2Stream::ptr stream, http::HttpResult::Error error, const std::string& msg){
+    if(!stream->m_future){
+        return;
+    }
+    if(stream->m_timer){
+        stream->m_timer->cancel();
+        stream->m_timer = nullptr;
+    }
+    http::HttpFuture::ptr future = stream->m_future;
+    stream->m_future = nullptr;
+    if(error == http::HttpResult::Error::OK){
+        http::HttpResponse::ptr rsp = stream->m_response;
+        if(!rsp){
+            future->set(std::make_shared<http::HttpResult>((int)http::HttpResult::Error::SEND_CLOSE_BY_PEER
+                        , nullptr, "http2 response without headers"));
+            return;
+        }
+        rsp->setBody(std::move(stream->m_recvBuf));
+        stream->m_recvBuf.clear();
+        future->set(std::make_shared<http::HttpResult>((int)error, rsp, msg));
+        // 响应已经完整, 不再发送剩余的请求体
+        if(!stream->m_localClosed){
+            resetStream(stream, Http2Error::CANCEL, true);
+        }
+        return;
+    }
+    future->set(std::make_shared<http::HttpResult>((int)error, nullptr, msg));
+}
+
+
+void Http2Session::onClose(){
+    MutexType::Lock lock(m_mutex);
+    std::vector<Http2Stream::ptr> streams;
+    for(auto& i : m_streams){
+        streams.push_back(i.second);
+    }
+    for(auto& i : streams){
+        if(m_isClient){
+            finishRequest(i, http::HttpResult::Error::SEND_CLOSE_BY_PEER, "http2 connection closed");
+        }
+        resetStream(i, Http2Error::CANCEL, false);
+    }
+    m_streams.clear();
+    failWaiting("http2 connection closed");
+    // 之后不再追加帧, 已经在发送缓冲中的GOAWAY由写协程写出
+    m_closed = true;
+    m_sendCond.notifyAll();
+    if(!m_closing){
+        closeLocked();
+    }
+}
+
+
+}
+}
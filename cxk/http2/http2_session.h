@@ -0,0 +1,249 @@
+#pragma once
+
+#include "http2_stream.h"
+#include "cxk/iomanager.h"
+#include "cxk/stream/buffered_stream.h"
+#include "cxk/uri.h"
+#include <deque>
+#include <functional>
+#include <unordered_map>
+
+
+namespace cxk{
+namespace http2{
+
+
+/// @brief HTTP/2连接(RFC 7540), 服务端和客户端共用
+/// @details 一个读协程顺序处理收到的帧; 要发送的帧在锁内追加到发送缓冲, 由写协程合并成一次写出,
+///          HPACK编码和帧的顺序因此一致, 多个流的小帧也能合并发送。
+///          服务端每个请求在IOManager上启动一个协程处理, 客户端的多个请求在一个连接上并发。
+///          服务端的并发流数按还在运行的处理协程计算, 流被对方重置后在处理函数返回前仍然占用名额;
+///          对方重置流过快(Rapid Reset)或者不读取PING/SETTINGS等控制帧的回复时, 发送GOAWAY(ENHANCE_YOUR_CALM)关闭连接
+class Http2Session : public std::enable_shared_from_this<Http2Session>{
+friend class Http2Stream;
+public:
+    using ptr = std::shared_ptr<Http2Session>;
+    using MutexType = Mutex;
+    /// @brief 服务端处理一个请求, 在单独的协程中调用
+    using RequestHandler = std::function<void(Http2Stream::ptr stream)>;
+
+    /// @brief 连接参数, 本端的值来自http2.*配置
+    struct Settings{
+        uint32_t headerTableSize = 4096;
+        uint32_t enablePush = 1;
+        uint32_t maxConcurrentStreams = (uint32_t)-1;
+        uint32_t initialWindowSize = DEFAULT_WINDOW_SIZE;
+        uint32_t maxFrameSize = DEFAULT_MAX_FRAME_SIZE;
+        uint32_t maxHeaderListSize = (uint32_t)-1;
+    };
+
+    /// @brief              构造函数
+    /// @param stream       连接的流, 服务端是已经读到前言的HttpSession
+    /// @param is_client    是否是客户端
+    /// @param iom          运行写协程、客户端读协程和服务端请求协程的IOManager
+    Http2Session(Stream::ptr stream, bool is_client, IOManager* iom = IOManager::GetThis());
+
+    ~Http2Session();
+
+    /// @brief          服务端: 在当前协程中读取并处理帧, 直到连接关闭
+    /// @param handler  处理请求
+    void serve(RequestHandler handler);
+
+    /// @brief          客户端: 发送前言和SETTINGS, 在IOManager上启动读协程
+    bool start();
+
+    /// @brief              客户端: 发出请求, 立即返回
+    /// @details            对方的并发流数达到上限时请求排队。可以在任意线程调用
+    /// @param req          请求, 没有Host头部时使用连接的主机
+    /// @param timeout_ms   等待响应的超时时间, 超时后重置流
+    http::HttpFuture::ptr request(http::HttpRequest::ptr req, uint64_t timeout_ms);
+
+    /// @brief              客户端: 建立连接
+    /// @details            https通过ALPN协商h2, 否则直接发送前言(prior knowledge)。
+    ///                     读协程持有连接, 不再使用时要调用close
+    /// @param uri          scheme/host/port
+    /// @param timeout_ms   连接超时时间
+    /// @return             失败返回nullptr
+    static Http2Session::ptr Connect(Uri::ptr uri, uint64_t timeout_ms, IOManager* iom = IOManager::GetThis());
+
+    /// @brief          发送GOAWAY, 不再接受新的流, 已有的流继续处理
+    void shutdown(Http2Error error = Http2Error::NO_ERROR);
+
+    /// @brief          关闭连接, 所有流被重置, 未完成的请求返回错误
+    void close();
+
+    /// @brief          是否还可以发出新的请求
+    bool isActive();
+
+    /// @brief          当前的流数
+    size_t getStreamCount();
+
+    /// @brief          对方的参数
+    const Settings& getRemoteSettings() const { return m_remote;}
+
+    void setHost(const std::string& v) { m_host = v;}
+    const std::string& getHost() const { return m_host;}
+
+private:
+    /// @brief 排队等待发出的请求
+    struct Task{
+        http::HttpRequest::ptr request;
+        http::HttpFuture::ptr future;
+        uint64_t timeout_ms;
+    };
+
+    /// @brief  读取并处理帧直到连接关闭
+    void doRead();
+
+    /// @brief  写协程, 发出发送缓冲中的全部数据
+    void doWrite();
+
+    /// @brief  处理一个帧
+    /// @return 是否继续, 返回false时连接出错
+    bool handleFrame(const FrameHeader& header, const uint8_t* payload);
+
+    bool handleData(const FrameHeader& header, const uint8_t* payload);
+    bool handleHeaders(const FrameHeader& header, const uint8_t* payload);
+    bool handleContinuation(const FrameHeader& header, const uint8_t* payload);
+    bool handleRstStream(const FrameHeader& header, const uint8_t* payload);
+    bool handleSettings(const FrameHeader& header, const uint8_t* payload);
+    bool handlePing(const FrameHeader& header, const uint8_t* payload);
+    bool handleGoaway(const FrameHeader& header, const uint8_t* payload);
+    bool handleWindowUpdate(const FrameHeader& header, const uint8_t* payload);
+
+    /// @brief  收到完整的头部块
+    bool handleHeaderBlock(uint32_t stream_id, bool end_stream);
+
+    /// @brief  服务端: 由头部创建请求
+    /// @return 头部不合法时返回nullptr
+    http::HttpRequest::ptr createRequest(const HeaderList& headers);
+
+    /// @brief  客户端: 收到响应头部
+    bool handleResponseHeaders(Http2Stream::ptr stream, const HeaderList& headers);
+
+    /// @brief  对方结束发送, 需要持有锁
+    void onRemoteEnd(Http2Stream::ptr stream);
+
+    /// @brief  连接错误, 发送GOAWAY并关闭连接
+    bool connectionError(Http2Error error, const std::string& msg);
+
+    /// @brief  流出错, 重置流
+    void streamError(uint32_t stream_id, Http2Error error);
+
+    /// @brief  追加一个帧到发送缓冲并唤醒写协程, 需要持有锁
+    void writeFrame(FrameType type, uint8_t flags, uint32_t stream_id, const void* payload, size_t length);
+
+    /// @brief  编码头部并追加HEADERS和CONTINUATION帧, 需要持有锁
+    void writeHeaders(uint32_t stream_id, const HeaderList& headers, bool end_stream);
+
+    /// @brief  本端结束发送, 需要持有锁
+    void onLocalEnd(Http2Stream::ptr stream);
+
+    /// @brief  重置流并从流表中去掉, 需要持有锁
+    void resetStream(Http2Stream::ptr stream, Http2Error error, bool send);
+
+    /// @brief  两个方向都结束的流从流表中去掉, 需要持有锁
+    void tryRemove(Http2Stream::ptr stream);
+
+    /// @brief  读取了流的数据, 需要时发送WINDOW_UPDATE, 需要持有锁
+    void consume(Http2Stream::ptr stream, size_t length);
+
+    /// @brief  客户端: 发出请求, 需要持有锁
+    void startRequest(const Task& task);
+
+    /// @brief  客户端: 请求完成, 需要持有锁
+    void finishRequest(Http2Stream::ptr stream, http::HttpResult::Error error, const std::string& msg);
+
+    /// @brief  连接关闭后重置所有流
+    void onClose();
+
+    /// @brief  发送缓冲写完后关闭连接, 需要持有锁
+    void closeLocked();
+
+    /// @brief  追加本端SETTINGS和连接的WINDOW_UPDATE, 需要持有锁
+    void writeSettings();
+
+    /// @brief  追加控制帧, 需要持有锁
+    void writeWindowUpdate(uint32_t stream_id, uint32_t increment);
+    void writeRstStream(uint32_t stream_id, Http2Error error);
+    void writeGoaway(Http2Error error);
+
+    /// @brief  流id是否还没有被使用过(idle状态), 需要持有锁
+    bool isIdle(uint32_t stream_id) const;
+
+    /// @brief  客户端: 并发流数低于上限时发出排队的请求, 需要持有锁
+    void startWaiting();
+
+    /// @brief  客户端: 排队的请求全部失败, 需要持有锁
+    void failWaiting(const std::string& msg);
+
+    /// @brief  服务端: 记录一个被重置或者拒绝的流, 只在读协程中调用
+    /// @return 一秒内超过http2.max_reset_streams时返回false
+    bool countReset();
+
+    /// @brief  还没有写出的控制帧是否超过http2.max_control_buffer, 需要持有锁
+    bool isControlFlooded() const { return m_controlBufSize > m_maxControlBuf;}
+
+private:
+    Stream::ptr m_stream;
+    BufferedStream::ptr m_reader;
+    bool m_isClient;
+    IOManager* m_iom;
+    std::string m_host;
+    bool m_isHttps = false;
+    RequestHandler m_handler;
+
+    MutexType m_mutex;
+    std::unordered_map<uint32_t, Http2Stream::ptr> m_streams;
+    // 客户端: 下一个流id
+    uint32_t m_nextStreamId = 1;
+    // 收到的最大的对方发起的流id
+    uint32_t m_lastStreamId = 0;
+    // 收到的GOAWAY中的最后一个流id
+    uint32_t m_goawayId = MAX_WINDOW_SIZE;
+    bool m_goawaySent = false;
+    bool m_goawayReceived = false;
+    bool m_closed = false;
+    // 正在关闭, 写协程写完后关闭socket
+    bool m_closing = false;
+
+    Settings m_local;
+    Settings m_remote;
+    HPackEncoder m_encoder;
+    HPackDecoder m_decoder;
+
+    // 连接的发送窗口
+    int64_t m_sendWindow = DEFAULT_WINDOW_SIZE;
+    // 连接的接收窗口和没有归还的数据量
+    int64_t m_recvWindow = DEFAULT_WINDOW_SIZE;
+    uint32_t m_recvUnacked = 0;
+    uint32_t m_connectionWindow;
+
+    // 正在接收的头部块(HEADERS之后的CONTINUATION)
+    uint32_t m_headerStreamId = 0;
+    bool m_headerEndStream = false;
+    std::string m_headerBlock;
+
+    // 发送缓冲和写协程是否在运行
+    std::string m_sendBuf;
+    bool m_writing = false;
+    // 发送缓冲中回复对方的控制帧的大小和上限
+    size_t m_controlBufSize = 0;
+    size_t m_maxControlBuf;
+    // 等待发送窗口或者发送缓冲写出的协程
+    FiberCondition m_sendCond;
+
+    // 客户端: 等待并发流数低于上限的请求
+    std::deque<Task> m_waiting;
+
+    // 服务端: 还在运行的处理协程数
+    uint32_t m_activeHandlers = 0;
+    // 服务端: 当前一秒内被重置或者拒绝的流数, 只在读协程中访问
+    uint64_t m_resetTime = 0;
+    uint32_t m_resetCount = 0;
+    uint32_t m_maxResets;
+};
+
+
+}
+}
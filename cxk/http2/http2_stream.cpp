@@ -0,0 +1,356 @@
+#include "http2_stream.h"
+#include "http2_session.h"
+#include "cxk/http/http_compress.h"
+#include "cxk/http/http_parser.h"
+#include "cxk/http/http_session.h"
+#include "cxk/logger.h"
+#include <string.h>
+#include <unistd.h>
+
+
+namespace cxk{
+namespace http2{
+
+
+static Logger::ptr g_logger = CXK_LOG_NAME("system");
+
+
+Http2BodyStream::Http2BodyStream(Http2Stream::ptr stream)
+    : m_stream(stream){
+}
+
+
+int Http2BodyStream::read(void* buffer, size_t length){
+    auto stream = m_stream.lock();
+    if(!stream){
+        return -1;
+    }
+    return stream->readBody(buffer, length);
+}
+
+
+int Http2BodyStream::read(ByteArray::ptr ba, size_t length){
+    std::vector<iovec> iovs;
+    ba->getWriteBuffers(iovs, length);
+    if(iovs.empty()){
+        return 0;
+    }
+    int rt = read(iovs[0].iov_base, iovs[0].iov_len);
+    if(rt > 0){
+        ba->setPosition(ba->getPosition() + rt);
+    }
+    return rt;
+}
+
+
+/// @brief  响应体的输出流, 交给HttpResponse::BodyWriter
+/// @details 写入的数据经过压缩器(可选)后作为DATA帧发出, finish发送END_STREAM
+class Http2DataStream : public Stream{
+public:
+    Http2DataStream(Http2Stream::ptr stream, CompressCodec::Compressor::ptr compressor)
+        : m_stream(stream)
+        , m_compressor(compressor){
+    }
+
+    virtual int read(void* buffer, size_t length) override { return -1; }
+
+    virtual int read(ByteArray::ptr ba, size_t length) override { return -1; }
+
+    virtual int write(const void* buffer, size_t length) override{
+        if(m_finished){
+            return -1;
+        }
+        if(length == 0){
+            return 0;
+        }
+        if(!m_compressor){
+            return m_stream->sendData(buffer, length, false) <= 0 ? -1 : length;
+        }
+        m_out.clear();
+        if(!m_compressor->update(buffer, length, m_out)){
+            return -1;
+        }
+        if(!m_out.empty() && m_stream->sendData(m_out.c_str(), m_out.size(), false) <= 0){
+            return -1;
+        }
+        return length;
+    }
+
+    virtual int write(ByteArray::ptr ba, size_t length) override{
+        std::vector<iovec> iovs;
+        ba->getReadBuffers(iovs, length);
+        size_t total = 0;
+        for(auto& i : iovs){
+            if(write(i.iov_base, i.iov_len) < 0){
+                return -1;
+            }
+            total += i.iov_len;
+        }
+        ba->setPosition(ba->getPosition() + total);
+        return total;
+    }
+
+    /// @brief  不关闭流
+    virtual void close() override {}
+
+    /// @brief  写出压缩器剩余的数据并结束流
+    int finish(){
+        if(m_finished){
+            return -1;
+        }
+        m_finished = true;
+        m_out.clear();
+        if(m_compressor && !m_compressor->finish(m_out)){
+            return -1;
+        }
+        return m_stream->sendData(m_out.c_str(), m_out.size(), true);
+    }
+
+private:
+    Http2Stream::ptr m_stream;
+    CompressCodec::Compressor::ptr m_compressor;
+    bool m_finished = false;
+    std::string m_out;
+};
+
+
+Http2Stream::Http2Stream(Http2Session* session, uint32_t id)
+    : m_session(session)
+    , m_id(id){
+}
+
+
+int Http2Stream::readBody(void* buffer, size_t length){
+    Http2Session::MutexType::Lock lock(m_session->m_mutex);
+    while(m_recvPos == m_recvBuf.size()){
+        if(m_reset || m_session->m_closed){
+            return -1;
+        }
+        if(m_remoteClosed){
+            return 0;
+        }
+        m_cond.wait(lock);
+    }
+    size_t len = std::min(length, m_recvBuf.size() - m_recvPos);
+    memcpy(buffer, m_recvBuf.c_str() + m_recvPos, len);
+    m_recvPos += len;
+    if(m_recvPos == m_recvBuf.size()){
+        m_recvBuf.clear();
+        m_recvPos = 0;
+    }
+    m_session->consume(shared_from_this(), len);
+    return len;
+}
+
+
+bool Http2Stream::recvBody(){
+    Stream::ptr body_stream = m_request->getBodyStream();
+    if(body_stream){
+        uint64_t max_size = http::HttpRequestParser::GetHttpRequestMaxBodySize();
+        uint64_t length = m_request->getHeaderAs<uint64_t>("content-length");
+        if(length > max_size){
+            CXK_LOG_LIMIT_ERROR(g_logger, 10) << "http2 request body too large, content-length: " << length;
+            reset(Http2Error::CANCEL);
+            return false;
+        }
+        // 预分配的上限, content-length由对方决定
+        static const uint64_t s_reserve = 1024 * 1024;
+        std::string body;
+        body.reserve(std::min<uint64_t>(length, s_reserve));
+        static const size_t s_step = 16 * 1024;
+        int rt = 0;
+        do{
+            size_t pos = body.size();
+            body.resize(pos + s_step);
+            rt = readBody(&body[pos], s_step);
+            body.resize(pos + std::max(rt, 0));
+            if(body.size() > max_size){
+                CXK_LOG_LIMIT_ERROR(g_logger, 10) << "http2 request body too large";
+                reset(Http2Error::CANCEL);
+                rt = -1;
+            }
+        } while(rt > 0);
+        if(rt < 0){
+            return false;
+        }
+        m_request->setBodyStream(nullptr);
+        m_request->setBody(std::move(body));
+    }
+    if(!http::HttpSession::DecodeBody(m_request)){
+        reset(Http2Error::CANCEL);
+        return false;
+    }
+    return true;
+}
+
+
+// HTTP/2中不允许出现的连接相关头部(RFC 7540 8.1.2.2)
+static bool IsConnectionHeader(const std::string& name){
+    return strcasecmp(name.c_str(), "connection") == 0
+        || strcasecmp(name.c_str(), "keep-alive") == 0
+        || strcasecmp(name.c_str(), "proxy-connection") == 0
+        || strcasecmp(name.c_str(), "transfer-encoding") == 0
+        || strcasecmp(name.c_str(), "upgrade") == 0;
+}
+
+
+// 头部名字转成小写
+static std::string ToLower(const std::string& name){
+    std::string rt(name);
+    for(auto& c : rt){
+        c = tolower(c);
+    }
+    return rt;
+}
+
+
+int Http2Stream::sendResponse(http::HttpResponse::ptr rsp, CompressCodec::ptr codec){
+    int status = (int)rsp->getStatus();
+    bool head = m_request && m_request->getMethod() == http::HttpMethod::HEAD;
+    bool no_body = head || (status >= 100 && status < 200) || status == 204 || status == 304;
+
+    const http::HttpResponse::BodyWriter& writer = rsp->getBodyWriter();
+    http::HttpFileBody::ptr file = rsp->getFileBody();
+    CompressCodec::Compressor::ptr compressor;
+    if(codec && !no_body && !file){
+        compressor = codec->createCompressor();
+        if(compressor){
+            http::HttpCompress::SetEncoding(rsp, codec);
+        } else if(!writer){
+            // 不支持流式压缩, 压缩完整的响应体, 失败时发送原始数据
+            http::HttpCompress::Compress(m_request, rsp, codec);
+        }
+    }
+    bool stream_body = writer || compressor;
+
+    HeaderList headers;
+    headers.reserve(rsp->getHeaders().size() + 2);
+    headers.emplace_back(":status", std::to_string(status));
+    for(auto& i : rsp->getHeaders()){
+        if(IsConnectionHeader(i.first)
+                || (strcasecmp(i.first.c_str(), "content-length") == 0)){
+            continue;
+        }
+        headers.emplace_back(ToLower(i.first), i.second);
+    }
+    // 流式响应体的长度事先不知道; HEAD响应给出响应体的长度, servlet没有设置响应体时保留它设置的值
+    uint64_t length = file ? file->getLength() : rsp->getBody().size();
+    std::string content_length = rsp->getHeader("content-length");
+    if(!stream_body && (!no_body || head) && (length > 0 || content_length.empty())){
+        content_length = std::to_string(length);
+    }
+    if(!stream_body && !content_length.empty()){
+        headers.emplace_back("content-length", content_length);
+    }
+
+    if(no_body || (!stream_body && length == 0)){
+        return sendHeaders(headers, true);
+    }
+    if(sendHeaders(headers, false) <= 0){
+        return -1;
+    }
+
+    if(stream_body){
+        auto out = std::make_shared<Http2DataStream>(shared_from_this(), compressor);
+        if(writer){
+            if(writer(out) != 0){
+                CXK_LOG_LIMIT_ERROR(g_logger, 10) << "write http2 response body error";
+                reset(Http2Error::INTERNAL_ERROR);
+                return -1;
+            }
+        } else {
+            static const size_t s_step = 32 * 1024;
+            const std::string& body = rsp->getBody();
+            for(size_t pos = 0; pos < body.size(); pos += s_step){
+                if(out->write(body.c_str() + pos, std::min(s_step, body.size() - pos)) < 0){
+                    return -1;
+                }
+            }
+        }
+        return out->finish();
+    }
+
+    if(file){
+        // DATA帧要经过发送缓冲, 不能用sendfile, 分块读出文件
+        static const size_t s_step = 64 * 1024;
+        std::string buf;
+        buf.resize(std::min<uint64_t>(s_step, length));
+        uint64_t offset = file->getOffset();
+        uint64_t left = length;
+        while(left > 0){
+            ssize_t n = pread(file->getFd(), &buf[0], std::min<uint64_t>(buf.size(), left), offset);
+            if(n <= 0){
+                CXK_LOG_ERROR(g_logger) << "read http2 response file error, errno=" << errno
+                    << " errstr=" << strerror(errno);
+                reset(Http2Error::INTERNAL_ERROR);
+                return -1;
+            }
+            offset += n;
+            left -= n;
+            if(sendData(buf.c_str(), n, left == 0) <= 0){
+                return -1;
+            }
+        }
+        return 1;
+    }
+    return sendData(rsp->getBody().c_str(), length, true);
+}
+
+
+int Http2Stream::sendHeaders(const HeaderList& headers, bool end){
+    auto self = shared_from_this();
+    Http2Session::MutexType::Lock lock(m_session->m_mutex);
+    if(m_reset || m_localClosed || m_session->m_closed){
+        return -1;
+    }
+    m_session->writeHeaders(m_id, headers, end);
+    if(end){
+        m_session->onLocalEnd(self);
+    }
+    return 1;
+}
+
+
+int Http2Stream::sendData(const void* data, size_t length, bool end){
+    static const size_t s_max_buffer = 1024 * 1024;
+    auto self = shared_from_this();
+    const char* ptr = (const char*)data;
+    size_t left = length;
+    Http2Session::MutexType::Lock lock(m_session->m_mutex);
+    do{
+        // 等待流和连接的发送窗口, 发送缓冲太大时等写协程写出
+        while(true){
+            if(m_reset || m_localClosed || m_session->m_closed){
+                return -1;
+            }
+            if(left == 0 || (m_sendWindow > 0 && m_session->m_sendWindow > 0
+                        && m_session->m_sendBuf.size() < s_max_buffer)){
+                break;
+            }
+            m_session->m_sendCond.wait(lock);
+        }
+        size_t len = std::min<int64_t>({(int64_t)left, m_sendWindow, m_session->m_sendWindow
+                , (int64_t)m_session->m_remote.maxFrameSize});
+        bool last = end && len == left;
+        m_session->writeFrame(FrameType::DATA, last ? FLAG_END_STREAM : 0, m_id, ptr, len);
+        m_sendWindow -= len;
+        m_session->m_sendWindow -= len;
+        ptr += len;
+        left -= len;
+        if(last){
+            m_session->onLocalEnd(self);
+        }
+    } while(left > 0);
+    return 1;
+}
+
+
+void Http2Stream::reset(Http2Error error){
+    auto self = shared_from_this();
+    Http2Session::MutexType::Lock lock(m_session->m_mutex);
+    m_session->resetStream(self, error, true);
+}
+
+
+}
+}
@@ -0,0 +1,133 @@
+#pragma once
+
+#include "frame.h"
+#include "hpack.h"
+#include "cxk/http/http.h"
+#include "cxk/http/http_client.h"
+#include "cxk/stream/compress_codec.h"
+#include "cxk/timer.h"
+
+
+namespace cxk{
+namespace http2{
+
+
+class Http2Session;
+
+
+/// @brief HTTP/2的一个流, 对应一个请求和它的响应
+/// @details 接收到的DATA先放在流的缓冲中, 被读取后才给对方发送WINDOW_UPDATE, 所以每个流缓存的数据不超过
+///          本端的初始窗口。发送DATA时等待流和连接的发送窗口, 窗口为0时挂起当前协程。
+///          除了id, 成员都由所属连接的锁保护
+class Http2Stream : public std::enable_shared_from_this<Http2Stream>{
+friend class Http2Session;
+public:
+    using ptr = std::shared_ptr<Http2Stream>;
+
+    /// @brief          构造函数
+    /// @param session  所属连接
+    /// @param id       流id
+    Http2Stream(Http2Session* session, uint32_t id);
+
+    uint32_t getId() const { return m_id;}
+
+    /// @brief  服务端收到的请求, 请求头在流创建时就已经完整
+    http::HttpRequest::ptr getRequest() const { return m_request;}
+
+    /// @brief  客户端收到的响应
+    http::HttpResponse::ptr getResponse() const { return m_response;}
+
+    /// @brief          读取请求体(服务端)
+    /// @return         @retval > 0  读到的数据大小, @retval = 0  请求体已经读完, @retval < 0  流被重置或者连接关闭
+    int readBody(void* buffer, size_t length);
+
+    /// @brief          读取完整的请求体并按Content-Encoding解压, 设置到请求(服务端)
+    /// @details        请求体超过http.reauest.max_body_size时重置流
+    /// @return         是否成功
+    bool recvBody();
+
+    /// @brief          发送响应(服务端)
+    /// @details        响应头编码成HEADERS帧, 响应体按对方的最大帧长度和流量控制窗口分成DATA帧;
+    ///                 支持HttpResponse的BodyWriter和文件响应体。codec不为空时按它压缩响应体
+    /// @return         @retval > 0 成功, @retval <= 0 流被重置或者连接关闭
+    int sendResponse(http::HttpResponse::ptr rsp, CompressCodec::ptr codec = nullptr);
+
+    /// @brief          发送头部
+    /// @param end      是否同时结束本端发送
+    int sendHeaders(const HeaderList& headers, bool end);
+
+    /// @brief          发送数据, 等待流量控制窗口
+    /// @param end      是否同时结束本端发送
+    /// @return         @retval > 0 成功, @retval <= 0 流被重置或者连接关闭
+    int sendData(const void* data, size_t length, bool end);
+
+    /// @brief          重置流(RST_STREAM)
+    void reset(Http2Error error);
+
+    /// @brief          流是否被重置或者连接已经关闭
+    bool isReset() const { return m_reset;}
+
+    /// @brief          流被重置的错误码
+    Http2Error getError() const { return m_error;}
+
+private:
+    /// @brief          是否两个方向都已经结束, 需要持有连接的锁
+    bool isClosed() const { return m_localClosed && m_remoteClosed;}
+
+private:
+    Http2Session* m_session;
+    uint32_t m_id;
+
+    http::HttpRequest::ptr m_request;
+    http::HttpResponse::ptr m_response;
+
+    // 对方是否已经结束发送(END_STREAM)
+    bool m_remoteClosed = false;
+    // 本端是否已经结束发送
+    bool m_localClosed = false;
+    bool m_reset = false;
+    Http2Error m_error = Http2Error::NO_ERROR;
+
+    // 接收到还没有被读取的数据
+    std::string m_recvBuf;
+    size_t m_recvPos = 0;
+    // 对方还可以发送的数据量
+    int64_t m_recvWindow = 0;
+    // 已经读取还没有通过WINDOW_UPDATE归还的数据量
+    uint32_t m_recvUnacked = 0;
+    // 本端还可以发送的数据量, SETTINGS_INITIAL_WINDOW_SIZE变化时可能为负
+    int64_t m_sendWindow = 0;
+    // 等待请求体数据的协程, 等待发送窗口的协程在连接的m_sendCond上
+    FiberCondition m_cond;
+
+    // 客户端: 请求的结果和超时定时器
+    http::HttpFuture::ptr m_future;
+    Timer::ptr m_timer;
+    // 客户端: 响应体的大小上限
+    uint64_t m_maxBodySize = 0;
+};
+
+
+/// @brief 请求体的输入流, 设置为HttpRequest::getBodyStream, 供流式读取请求体的servlet使用
+/// @details 只持有流的弱引用, 避免请求和流互相引用
+class Http2BodyStream : public Stream{
+public:
+    Http2BodyStream(Http2Stream::ptr stream);
+
+    virtual int read(void* buffer, size_t length) override;
+
+    virtual int read(ByteArray::ptr ba, size_t length) override;
+
+    virtual int write(const void* buffer, size_t length) override { return -1; }
+
+    virtual int write(ByteArray::ptr ba, size_t length) override { return -1; }
+
+    virtual void close() override {}
+
+private:
+    std::weak_ptr<Http2Stream> m_stream;
+};
+
+
+}
+}
@@ -354,7 +354,7 @@ void IOManager::idel(){
             FdContext* fd_ctx = (FdContext*)event.data.ptr;
             FdContext::MutexType::Lock lock(fd_ctx->mutex);
             if(event.events & (EPOLLERR | EPOLLHUP)){
-                events->events |= EPOLLIN | EPOLLOUT;
+                event.events |= (EPOLLIN | EPOLLOUT) & fd_ctx->events;
             }
 
             int real_events = NONE;
@@ -380,12 +380,13 @@ void IOManager::idel(){
                 continue;
             }
 
-            if(fd_ctx->events & READ){             //触发读事件
+            // 只触发就绪的事件, 另一个事件仍然留在epoll中等待
+            if(fd_ctx->events & real_events & READ){             //触发读事件
                 fd_ctx->triggerEvent(READ);
                 --m_appendingEventCount;
             }
 
-            if(fd_ctx->events & WRITE){            //触发写事件
+            if(fd_ctx->events & real_events & WRITE){            //触发写事件
                 fd_ctx->triggerEvent(WRITE);
                 --m_appendingEventCount;
             }
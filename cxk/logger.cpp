@@ -1,5 +1,11 @@
 #include "logger.h"
 #include "config.h"
+#include "binlog.h"
+#include "stream/zlib_stream.h"
+#include <algorithm>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 namespace cxk
 {
 
@@ -166,6 +172,19 @@ namespace cxk
     {
     }
 
+    std::string LogEvent::get_content() const
+    {
+        if (m_fmtId)
+        {
+            auto fmt = BinLogFormatMgr::GetInstance()->get(m_fmtId);
+            if (fmt)
+            {
+                return BinLogArgs::Render(fmt->fmt, m_args) + m_ss.str();
+            }
+        }
+        return m_ss.str();
+    }
+
     void LogEvent::format(const char *fmt, ...)
     {
         va_list al;
@@ -204,6 +223,168 @@ namespace cxk
         return m_event->getSS();
     }
 
+    // 所有存活的限流器, FlushAll遍历。限流器是各个编译单元中的静态变量, 不依赖本文件静态变量的析构顺序, 不释放
+    struct LogLimiterRegistry
+    {
+        Spinlock mutex;
+        std::vector<LogLimiter *> limiters;
+    };
+
+    static LogLimiterRegistry &GetLogLimiterRegistry()
+    {
+        static LogLimiterRegistry *s_registry = new LogLimiterRegistry;
+        return *s_registry;
+    }
+
+    LogLimiter::LogLimiter(uint32_t limit, uint32_t period_ms, const char *file, int32_t line)
+        : m_limit(limit), m_period(period_ms ? period_ms : 1), m_file(file), m_line(line)
+    {
+        m_window = GetCoarseMonotonicMS() / m_period;
+        LogLimiterRegistry &registry = GetLogLimiterRegistry();
+        Spinlock::Lock lock(registry.mutex);
+        registry.limiters.push_back(this);
+    }
+
+    LogLimiter::~LogLimiter()
+    {
+        {
+            LogLimiterRegistry &registry = GetLogLimiterRegistry();
+            Spinlock::Lock lock(registry.mutex);
+            auto it = std::find(registry.limiters.begin(), registry.limiters.end(), this);
+            if (it != registry.limiters.end())
+            {
+                registry.limiters.erase(it);
+            }
+        }
+        uint32_t n = m_count.exchange(0, std::memory_order_relaxed);
+        if (n > m_limit)
+        {
+            m_suppressed.fetch_add(n - m_limit, std::memory_order_relaxed);
+        }
+        auto event = takeReport();
+        if (event)
+        {
+            event->get_logger()->log(event->get_level(), event);
+        }
+    }
+
+    bool LogLimiter::settle()
+    {
+        uint64_t window = GetCoarseMonotonicMS() / m_period;
+        uint64_t old = m_window.load(std::memory_order_relaxed);
+        if (window == old || !m_window.compare_exchange_strong(old, window, std::memory_order_relaxed))
+        {
+            return false;
+        }
+        // 进入新的时间窗口, 由切换窗口的线程结算上一个窗口被抑制的条数
+        uint32_t n = m_count.exchange(0, std::memory_order_relaxed);
+        if (n > m_limit)
+        {
+            m_suppressed.fetch_add(n - m_limit, std::memory_order_relaxed);
+        }
+        return true;
+    }
+
+    LogEvent::ptr LogLimiter::takeReport()
+    {
+        if (!m_suppressed.load(std::memory_order_relaxed))
+        {
+            return nullptr;
+        }
+        std::shared_ptr<Logger> logger;
+        LogLevel::Level level;
+        {
+            MutexType::Lock lock(m_mutex);
+            logger = m_logger;
+            level = m_level;
+        }
+        if (!logger)
+        {
+            return nullptr;
+        }
+        uint64_t n = m_suppressed.exchange(0, std::memory_order_relaxed);
+        if (!n)
+        {
+            return nullptr;
+        }
+        LogEvent::ptr event(new LogEvent(logger, level, m_file ? m_file : "", m_line, 0,
+                                         getThreadId(), getFiberId(), time(0), Thread::GetName()));
+        event->getSS() << "[suppressed " << n << "] log events in the last " << m_period << "ms";
+        return event;
+    }
+
+    bool LogLimiter::allow(std::shared_ptr<Logger> logger, LogLevel::Level level)
+    {
+        if (settle())
+        {
+            auto event = takeReport();
+            if (event)
+            {
+                event->get_logger()->log(event->get_level(), event);
+            }
+        }
+
+        uint32_t count = m_count.fetch_add(1, std::memory_order_relaxed);
+        if (count < m_limit)
+        {
+            return true;
+        }
+        if (count == m_limit)
+        {
+            MutexType::Lock lock(m_mutex);
+            m_logger = logger;
+            m_level = level;
+        }
+        return false;
+    }
+
+    void LogLimiter::FlushAll()
+    {
+        // 在锁外输出, 输出日志时可能构造新的限流器
+        std::vector<LogEvent::ptr> events;
+        {
+            LogLimiterRegistry &registry = GetLogLimiterRegistry();
+            Spinlock::Lock lock(registry.mutex);
+            for (auto i : registry.limiters)
+            {
+                i->settle();
+                auto event = i->takeReport();
+                if (event)
+                {
+                    events.push_back(event);
+                }
+            }
+        }
+        for (auto &i : events)
+        {
+            i->get_logger()->log(i->get_level(), i);
+        }
+    }
+
+    LogEvent::ptr LogLimiter::Mark(LogEvent::ptr event, uint64_t suppressed)
+    {
+        if (suppressed)
+        {
+            event->getSS() << "[suppressed " << suppressed << "] ";
+        }
+        return event;
+    }
+
+    LogSampler::LogSampler(uint32_t rate) : m_rate(rate ? rate : 1)
+    {
+    }
+
+    bool LogSampler::allow(uint64_t &suppressed)
+    {
+        uint64_t n = m_count.fetch_add(1, std::memory_order_relaxed);
+        if (n % m_rate)
+        {
+            return false;
+        }
+        suppressed = n ? m_rate - 1 : 0;
+        return true;
+    }
+
     Logger::Logger(const std::string &name) : m_name(name), m_level(LogLevel::DEBUG)
     {
         m_format.reset(new LogFormat("%d%T%t%T%N%T%F%T[%p]%T[%c]%T%f:%l%T%m\n"));
@@ -276,19 +457,40 @@ namespace cxk
 
     void FileAppender::log(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event){
         if (level >= m_level){
-            uint64_t now = time(0);
-            if(now != m_lastTime){
-                reOpen();
-                m_lastTime = now;
-            }
             MutexType::Lock lock(m_mutex);
-            if(!(m_filestream << m_format->format(logger, level, event))) {
-                // std::cout << "is open: " << m_filestream.is_open() << std::endl;
+            std::string msg = m_format->format(logger, level, event);
+            checkFile(time(0), msg.size());
+            if(!writeFile(msg.c_str(), msg.size())) {
                 std::cout << "log errror"  << std::endl;
             }
         }
     }
 
+    void FileAppender::checkFile(uint64_t now, size_t len){
+        if(now != m_lastTime){
+            // 每秒检查一次文件是否被外部删除或移走, 只有inode变化时才重新打开
+            struct stat st;
+            if(m_fd < 0 || ::stat(m_filename.c_str(), &st) != 0 || (uint64_t)st.st_ino != m_inode){
+                openFile();
+            }
+            if(m_nextRotate && now >= m_nextRotate){
+                rotateFile(now);
+            }
+            m_lastTime = now;
+        }
+        if(m_maxSize && m_curSize && m_curSize + len > m_maxSize){
+            rotateFile(now);
+        }
+    }
+
+    bool FileAppender::writeFile(const void *data, size_t len){
+        if(m_fd < 0 || ::write(m_fd, data, len) < 0){
+            return false;
+        }
+        m_curSize += len;
+        return true;
+    }
+
     void StdOutAppender::log(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event)
     {
         if (level >= m_level){
@@ -297,20 +499,207 @@ namespace cxk
         }
     }
 
+    // 将滚动出去的日志文件压缩为.gz, 在后台线程中执行
+    static bool GzipFile(const std::string &path){
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if(fd < 0){
+            return false;
+        }
+        ZlibStream::ptr zs = ZlibStream::CreateGzip(true, 64 * 1024);
+        if(!zs){
+            ::close(fd);
+            return false;
+        }
+
+        std::vector<char> buf(64 * 1024);
+        ssize_t n = 0;
+        while((n = ::read(fd, &buf[0], buf.size())) > 0){
+            zs->write(&buf[0], n);
+        }
+        ::close(fd);
+        if(n < 0 || zs->flush() != Z_OK){
+            return false;
+        }
+
+        std::string tmp = path + ".gz.tmp";
+        fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if(fd < 0){
+            return false;
+        }
+        bool ok = true;
+        for(auto &i : zs->getBUffers()){
+            if(::write(fd, i.iov_base, i.iov_len) != (ssize_t)i.iov_len){
+                ok = false;
+                break;
+            }
+        }
+        ::close(fd);
+        if(!ok || ::rename(tmp.c_str(), (path + ".gz").c_str()) != 0){
+            ::unlink(tmp.c_str());
+            return false;
+        }
+        return ::unlink(path.c_str()) == 0;
+    }
+
+    // 只保留最新的max_files个历史文件(文件名中带有时间, 按名字排序即按时间排序)
+    static void RemoveOldLogFiles(const std::string &filename, uint32_t max_files){
+        std::string dir = FSUtil::Dirname(filename);
+        std::string prefix = FSUtil::Basename(filename) + ".";
+        std::vector<std::string> files;
+        FSUtil::ListAllFile(files, dir, "");
+
+        std::vector<std::string> history;
+        for(auto &i : files){
+            std::string name = FSUtil::Basename(i);
+            if(FSUtil::Dirname(i) == dir && name.compare(0, prefix.size(), prefix) == 0
+                    && name.find(".gz.tmp") == std::string::npos){
+                history.push_back(i);
+            }
+        }
+        if(history.size() <= max_files){
+            return;
+        }
+        // 压缩后的文件名多了.gz后缀, 排序时忽略
+        auto key = [](const std::string &name){
+            return name.size() > 3 && name.compare(name.size() - 3, 3, ".gz") == 0
+                ? name.substr(0, name.size() - 3) : name;
+        };
+        std::sort(history.begin(), history.end(), [&key](const std::string &a, const std::string &b){
+            return key(a) < key(b);
+        });
+        for(size_t i = 0; i < history.size() - max_files; ++i){
+            FSUtil::Unlink(history[i]);
+        }
+    }
+
+    FileAppender::RotateType FileAppender::RotateTypeFromString(const std::string &str){
+        if(str == "hourly"){
+            return HOURLY;
+        } else if(str == "daily"){
+            return DAILY;
+        }
+        return NONE;
+    }
+
+    const char *FileAppender::RotateTypeToString(RotateType type){
+        switch(type){
+            case HOURLY:
+                return "hourly";
+            case DAILY:
+                return "daily";
+            default:
+                return "none";
+        }
+    }
+
     bool FileAppender::reOpen(){
         MutexType::Lock lock(m_mutex);
-        if (m_filestream){
-            m_filestream.close();
+        return openFile();
+    }
+
+    bool FileAppender::rotate(){
+        MutexType::Lock lock(m_mutex);
+        return rotateFile(time(0));
+    }
+
+    bool FileAppender::openFile(){
+        if(m_fd >= 0){
+            ::close(m_fd);
+            m_fd = -1;
+        }
+        m_fd = ::open(m_filename.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if(m_fd < 0){
+            FSUtil::Mkdir(FSUtil::Dirname(m_filename));
+            m_fd = ::open(m_filename.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        }
+        if(m_fd < 0){
+            return false;
+        }
+
+        struct stat st;
+        if(::fstat(m_fd, &st) == 0){
+            m_inode = st.st_ino;
+            m_curSize = st.st_size;
+        }
+        ++m_openCount;
+        return true;
+    }
+
+    bool FileAppender::rotateFile(uint64_t now){
+        if(m_fd >= 0){
+            ::close(m_fd);
+            m_fd = -1;
+        }
+
+        // 同一秒内多次滚动时追加序号, 避免覆盖
+        std::string target = m_filename + "." + Time2Str(now, "%Y%m%d-%H%M%S");
+        if(now != m_lastRotate){
+            m_lastRotate = now;
+            m_rotateSeq = 0;
+        }
+        std::string path;
+        do{
+            path = m_rotateSeq ? StringUtil::format("%s.%03u", target.c_str(), m_rotateSeq) : target;
+            ++m_rotateSeq;
+        }while(::access(path.c_str(), F_OK) == 0 || ::access((path + ".gz").c_str(), F_OK) == 0);
+
+        bool renamed = ::rename(m_filename.c_str(), path.c_str()) == 0;
+        if(m_rotate != NONE){
+            m_nextRotate = nextRotateTime(now);
+        }
+        bool rt = openFile();
+        if(!renamed){
+            return false;
         }
-        m_filestream.open(m_filename, std::ios::app);
-        // std::cout << "open file: " << m_filename << " " << m_filestream.is_open() << std::endl;
 
-        return !!m_filestream;
+        if(m_compress || m_maxFiles){
+            std::string filename = m_filename;
+            bool compress = m_compress;
+            uint32_t max_files = m_maxFiles;
+            Thread::ptr thr(new Thread([filename, path, compress, max_files](){
+                if(compress){
+                    GzipFile(path);
+                }
+                if(max_files){
+                    RemoveOldLogFiles(filename, max_files);
+                }
+            }, "log_rotate"));
+        }
+        return rt;
     }
 
-    FileAppender::FileAppender(const std::string &filename) : m_filename(filename)
+    uint64_t FileAppender::nextRotateTime(uint64_t now) const{
+        time_t t = now;
+        struct tm tm;
+        localtime_r(&t, &tm);
+        tm.tm_min = 0;
+        tm.tm_sec = 0;
+        if(m_rotate == HOURLY){
+            tm.tm_hour += 1;
+        } else if(m_rotate == DAILY){
+            tm.tm_hour = 0;
+            tm.tm_mday += 1;
+        } else {
+            return 0;
+        }
+        tm.tm_isdst = -1;
+        return mktime(&tm);
+    }
+
+    FileAppender::FileAppender(const std::string &filename, RotateType rotate, uint64_t max_size,
+                               bool compress, uint32_t max_files)
+        : m_filename(filename), m_rotate(rotate), m_maxSize(max_size), m_compress(compress), m_maxFiles(max_files)
+    {
+        m_lastTime = time(0);
+        m_nextRotate = nextRotateTime(m_lastTime);
+        openFile();
+    }
+
+    FileAppender::~FileAppender()
     {
-        int ret = reOpen();
+        if(m_fd >= 0){
+            ::close(m_fd);
+        }
     }
 
     LogFormat::LogFormat(const std::string &parttern) : m_pattern(parttern)
@@ -519,14 +908,20 @@ namespace cxk
 
     struct LogAppenderDefine
     {
-        int type = 0; // 1:file, 2:stdout
+        int type = 0; // 1:file, 2:stdout, 3:binary file
         LogLevel::Level level = LogLevel::UNKONWING;
         std::string formatter;
         std::string file;
+        FileAppender::RotateType rotate = FileAppender::NONE;
+        uint64_t max_size = 0;
+        bool compress = false;
+        uint32_t max_files = 0;
 
         bool operator==(const LogAppenderDefine &rhs) const
         {
-            return type == rhs.type && level == rhs.level && formatter == rhs.formatter && file == rhs.file;
+            return type == rhs.type && level == rhs.level && formatter == rhs.formatter && file == rhs.file
+                && rotate == rhs.rotate && max_size == rhs.max_size && compress == rhs.compress
+                && max_files == rhs.max_files;
         }
     };
 
@@ -645,13 +1040,25 @@ namespace cxk
                         }
                         std::string type = a["type"].as<std::string>();
                         LogAppenderDefine lad;
-                        if(type == "FileLogAppender"){
-                            lad.type = 1;
+                        if(type == "FileLogAppender" || type == "BinaryLogAppender"){
+                            lad.type = type == "FileLogAppender" ? 1 : 3;
                             if(!a["file"].IsDefined()) {
                                 std::cout << "logConfig file error" << std::endl;
                                 continue;
                             }
                             lad.file = a["file"].as<std::string>();
+                            if(a["rotate"].IsDefined()){
+                                lad.rotate = FileAppender::RotateTypeFromString(a["rotate"].as<std::string>());
+                            }
+                            if(a["max_size"].IsDefined()){
+                                lad.max_size = a["max_size"].as<uint64_t>();
+                            }
+                            if(a["compress"].IsDefined()){
+                                lad.compress = a["compress"].as<bool>();
+                            }
+                            if(a["max_files"].IsDefined()){
+                                lad.max_files = a["max_files"].as<uint32_t>();
+                            }
                             if(a["formatter"].IsDefined()){
                                 lad.formatter = a["formatter"].as<std::string>();
                             }
@@ -692,9 +1099,21 @@ namespace cxk
 
                 for(auto& a : i.appenders){
                     YAML::Node na;
-                    if(a.type == 1){
-                        na["type"] = "FileLogAppender";
+                    if(a.type == 1 || a.type == 3){
+                        na["type"] = a.type == 1 ? "FileLogAppender" : "BinaryLogAppender";
                         na["file"] = a.file;
+                        if(a.rotate != FileAppender::NONE){
+                            na["rotate"] = FileAppender::RotateTypeToString(a.rotate);
+                        }
+                        if(a.max_size){
+                            na["max_size"] = a.max_size;
+                        }
+                        if(a.compress){
+                            na["compress"] = a.compress;
+                        }
+                        if(a.max_files){
+                            na["max_files"] = a.max_files;
+                        }
                     }else if(a.type == 2){
                         na["type"] = "StdoutLogAppender";
                     }
@@ -793,6 +1212,18 @@ namespace cxk
         YAML::Node node;
         node["type"] = "FileLogAppender";
         node["file"] = m_filename;
+        if(m_rotate != NONE){
+            node["rotate"] = RotateTypeToString(m_rotate);
+        }
+        if(m_maxSize){
+            node["max_size"] = m_maxSize;
+        }
+        if(m_compress){
+            node["compress"] = m_compress;
+        }
+        if(m_maxFiles){
+            node["max_files"] = m_maxFiles;
+        }
 
         if(m_level != LogLevel::UNKONWING){
             node["level"] = LogLevel::ToString(m_level);
@@ -839,9 +1270,11 @@ namespace cxk
                     for(auto& a : i.appenders){
                         cxk::LogAppender::ptr ap;
                         if(a.type == 1){
-                            ap.reset(new cxk::FileAppender(a.file));
+                            ap.reset(new cxk::FileAppender(a.file, a.rotate, a.max_size, a.compress, a.max_files));
                         }else if(a.type == 2){
                             ap.reset(new cxk::StdOutAppender);
+                        }else if(a.type == 3){
+                            ap.reset(new cxk::BinaryFileAppender(a.file, a.rotate, a.max_size, a.compress, a.max_files));
                         }
                         ap->setLogLevel(a.level);
                         if(!a.formatter.empty()){
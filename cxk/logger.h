@@ -15,6 +15,7 @@
 #include <ctime>
 #include <vector>
 #include <sstream>
+#include <atomic>
 #include "Thread.h"
 
 // 使用流式方式将日志写入到logger
@@ -45,6 +46,51 @@
 #define CXK_LOG_FMT_ERROR(logger, fmt, ...) CXK_LOG_FMT_LEVEL(logger, cxk::LogLevel::ERROR, fmt, __VA_ARGS__)
 #define CXK_LOG_FMT_FATAL(logger, fmt, ...) CXK_LOG_FMT_LEVEL(logger, cxk::LogLevel::FATAL, fmt, __VA_ARGS__)
 
+// 限流方式写入日志, 每个调用点每period_ms毫秒最多输出n条, 被抑制的条数在时间窗口结束后单独输出一条日志报告
+#define CXK_LOG_LIMIT_LEVEL_PERIOD(logger, level, n, period_ms)                                                         \
+    if (static cxk::LogLimiter s_cxk_log_limiter(n, period_ms, __FILE__, __LINE__); logger->getLogLevel() <= level)    \
+    if (s_cxk_log_limiter.allow(logger, level))                                                                         \
+    cxk::LogEventWrap(cxk::LogEvent::ptr(new cxk::LogEvent(logger, level, __FILE__, __LINE__, 0,                        \
+                            cxk::getThreadId(), cxk::getFiberId(), time(0), cxk::Thread::GetName())))                   \
+        .getSS()
+
+#define CXK_LOG_LIMIT_LEVEL(logger, level, n) CXK_LOG_LIMIT_LEVEL_PERIOD(logger, level, n, 1000)
+#define CXK_LOG_LIMIT_DEBUG(logger, n) CXK_LOG_LIMIT_LEVEL(logger, cxk::LogLevel::DEBUG, n)
+#define CXK_LOG_LIMIT_INFO(logger, n) CXK_LOG_LIMIT_LEVEL(logger, cxk::LogLevel::INFO, n)
+#define CXK_LOG_LIMIT_WARN(logger, n) CXK_LOG_LIMIT_LEVEL(logger, cxk::LogLevel::WARN, n)
+#define CXK_LOG_LIMIT_ERROR(logger, n) CXK_LOG_LIMIT_LEVEL(logger, cxk::LogLevel::ERROR, n)
+#define CXK_LOG_LIMIT_FATAL(logger, n) CXK_LOG_LIMIT_LEVEL(logger, cxk::LogLevel::FATAL, n)
+
+// 采样方式写入日志, 每个调用点每n条输出1条
+#define CXK_LOG_SAMPLE_LEVEL(logger, level, n)                                                                          \
+    if (static cxk::LogSampler s_cxk_log_sampler(n); logger->getLogLevel() <= level)                                    \
+    if (uint64_t s_cxk_log_suppressed = 0; s_cxk_log_sampler.allow(s_cxk_log_suppressed))                               \
+    cxk::LogEventWrap(cxk::LogLimiter::Mark(cxk::LogEvent::ptr(new cxk::LogEvent(logger, level, __FILE__, __LINE__, 0, \
+                            cxk::getThreadId(), cxk::getFiberId(), time(0), cxk::Thread::GetName())),                   \
+                            s_cxk_log_suppressed))                                                                       \
+        .getSS()
+
+#define CXK_LOG_SAMPLE_DEBUG(logger, n) CXK_LOG_SAMPLE_LEVEL(logger, cxk::LogLevel::DEBUG, n)
+#define CXK_LOG_SAMPLE_INFO(logger, n) CXK_LOG_SAMPLE_LEVEL(logger, cxk::LogLevel::INFO, n)
+#define CXK_LOG_SAMPLE_WARN(logger, n) CXK_LOG_SAMPLE_LEVEL(logger, cxk::LogLevel::WARN, n)
+#define CXK_LOG_SAMPLE_ERROR(logger, n) CXK_LOG_SAMPLE_LEVEL(logger, cxk::LogLevel::ERROR, n)
+#define CXK_LOG_SAMPLE_FATAL(logger, n) CXK_LOG_SAMPLE_LEVEL(logger, cxk::LogLevel::FATAL, n)
+
+// 限流方式格式化写入日志
+#define CXK_LOG_FMT_LIMIT_LEVEL(logger, level, n, fmt, ...)                                                             \
+    if (static cxk::LogLimiter s_cxk_log_limiter(n, 1000, __FILE__, __LINE__); logger->getLogLevel() <= level)         \
+    if (s_cxk_log_limiter.allow(logger, level))                                                                         \
+    cxk::LogEventWrap(cxk::LogEvent::ptr(new cxk::LogEvent(logger, level, __FILE__, __LINE__, 0,                        \
+                            cxk::getThreadId(), cxk::getFiberId(), time(0), cxk::Thread::GetName())))                   \
+        .getEvent()                                                                                                     \
+        ->format(fmt, __VA_ARGS__)
+
+#define CXK_LOG_FMT_LIMIT_DEBUG(logger, n, fmt, ...) CXK_LOG_FMT_LIMIT_LEVEL(logger, cxk::LogLevel::DEBUG, n, fmt, __VA_ARGS__)
+#define CXK_LOG_FMT_LIMIT_INFO(logger, n, fmt, ...) CXK_LOG_FMT_LIMIT_LEVEL(logger, cxk::LogLevel::INFO, n, fmt, __VA_ARGS__)
+#define CXK_LOG_FMT_LIMIT_WARN(logger, n, fmt, ...) CXK_LOG_FMT_LIMIT_LEVEL(logger, cxk::LogLevel::WARN, n, fmt, __VA_ARGS__)
+#define CXK_LOG_FMT_LIMIT_ERROR(logger, n, fmt, ...) CXK_LOG_FMT_LIMIT_LEVEL(logger, cxk::LogLevel::ERROR, n, fmt, __VA_ARGS__)
+#define CXK_LOG_FMT_LIMIT_FATAL(logger, n, fmt, ...) CXK_LOG_FMT_LIMIT_LEVEL(logger, cxk::LogLevel::FATAL, n, fmt, __VA_ARGS__)
+
 #define CXK_LOG_ROOT() cxk::LoggerMar::GetInstance()->getRoot()
 #define CXK_LOG_NAME(name) cxk::LoggerMar::GetInstance()->getLogger(name)
 
@@ -106,13 +152,27 @@ namespace cxk
         int32_t get_line() const { return m_line; }
         uint32_t get_threadID() const { return m_threadID; }
         uint32_t get_fiberID() const { return m_fiberID; }
-        std::string get_content() const { return m_ss.str(); }
+        std::string get_content() const;
         uint32_t get_elapse() const { return m_elapse; }
         uint64_t get_time() const { return m_time; }
         std::shared_ptr<Logger> get_logger() const { return m_logger; }
         LogLevel::Level get_level() const { return m_level; }
         std::string get_threadName() const { return m_threadName; }
 
+        /// @brief 二进制日志的格式串id, 0表示流式/格式化写入的日志
+        uint32_t get_fmtId() const { return m_fmtId; }
+        /// @brief 二进制日志编码后的参数
+        const std::string &get_args() const { return m_args; }
+
+        /// @brief 设置二进制日志内容, 只保存格式串id和参数, 由appender决定何时格式化
+        /// @param fmt_id 格式串id
+        /// @param args 编码后的参数(见BinLogArgs::Encode)
+        void setBinary(uint32_t fmt_id, std::string &&args)
+        {
+            m_fmtId = fmt_id;
+            m_args.swap(args);
+        }
+
         
         std::stringstream &getSS() { return m_ss; }
 
@@ -131,6 +191,8 @@ namespace cxk
         uint64_t m_time;              // 当前时间
         LogLevel::Level m_level;      // 日志级别
         std::string m_threadName;     // 线程名
+        uint32_t m_fmtId = 0;         // 二进制日志格式串id
+        std::string m_args;           // 二进制日志参数
 
         std::stringstream m_ss; // 日志内容
 
@@ -138,6 +200,82 @@ namespace cxk
     };
 
 
+    /*
+    日志限流器，每个调用点一个(CXK_LOG_LIMIT_*宏中的静态变量)。
+    按period_ms划分时间窗口，每个窗口最多放行limit条。快速路径是一次粗粒度时钟读取(vDSO, 不进内核)、
+    一次relaxed的原子读和一次relaxed的原子自增，只有切换窗口的线程做CAS。
+    被抑制的条数在时间窗口结束后以该调用点的名义单独输出一条日志：调用点再次调用时由切换窗口的线程输出；
+    调用点不再被调用时由FlushAll(Application的定时器定期调用)输出，程序退出时限流器析构也会输出。
+    */
+    class LogLimiter
+    {
+    public:
+        using MutexType = Spinlock;
+
+        /// @brief 构造函数
+        /// @param limit 每个时间窗口最多输出的条数
+        /// @param period_ms 时间窗口长度(毫秒)
+        /// @param file 调用点的文件名, 报告被抑制条数时使用
+        /// @param line 调用点的行号
+        LogLimiter(uint32_t limit, uint32_t period_ms = 1000, const char *file = nullptr, int32_t line = 0);
+
+        /// @brief 析构时报告尚未报告的被抑制条数
+        ~LogLimiter();
+
+        /// @brief 是否允许输出, 进入新的时间窗口时先报告上一个窗口被抑制的条数
+        /// @param logger 被抑制时记录下来, 报告时使用
+        bool allow(std::shared_ptr<Logger> logger, LogLevel::Level level);
+
+        /// @brief 报告所有限流器中已经结束的时间窗口被抑制的条数
+        static void FlushAll();
+
+        /// @brief 在日志内容前标注被抑制的条数(采样器使用)
+        static LogEvent::ptr Mark(LogEvent::ptr event, uint64_t suppressed);
+
+    private:
+        /// @brief 时间窗口结束时结算被抑制的条数
+        /// @return 是否由当前线程切换了窗口
+        bool settle();
+
+        /// @brief 取出尚未报告的被抑制条数, 生成报告用的日志事件, 没有时返回nullptr
+        LogEvent::ptr takeReport();
+
+    private:
+        uint32_t m_limit;
+        uint32_t m_period;
+        const char *m_file;
+        int32_t m_line;
+        // 当前时间窗口
+        std::atomic<uint64_t> m_window{0};
+        // 当前窗口内的调用次数
+        std::atomic<uint32_t> m_count{0};
+        // 尚未报告的被抑制条数
+        std::atomic<uint64_t> m_suppressed{0};
+        // 每个窗口第一次被抑制时记录的日志器和级别
+        MutexType m_mutex;
+        std::shared_ptr<Logger> m_logger;
+        LogLevel::Level m_level = LogLevel::INFO;
+    };
+
+    /*
+    日志采样器，每个调用点一个(CXK_LOG_SAMPLE_*宏中的静态变量)，每rate条放行1条。
+    */
+    class LogSampler
+    {
+    public:
+        /// @brief 构造函数
+        /// @param rate 采样间隔, 每rate条输出1条
+        LogSampler(uint32_t rate);
+
+        /// @brief 是否允许输出
+        /// @param[out] suppressed 放行时返回之前被抑制的条数
+        bool allow(uint64_t &suppressed);
+
+    private:
+        uint32_t m_rate;
+        std::atomic<uint64_t> m_count{0};
+    };
+
     /*
     日志事件包装类，在日志现场构造，包装了日志器和日志事件两个对象，
     在日志记录结束后，LogEventWrap析构时，调用日志器的log方法输出日志事件。
@@ -235,7 +373,7 @@ namespace cxk
     public:
         using ptr = std::shared_ptr<LogAppender>;
         using MutexType = Spinlock;
-        ~LogAppender() {}
+        virtual ~LogAppender() {}
 
         /// @brief 写入日志
         /// @param ptr 日志器
@@ -337,23 +475,91 @@ namespace cxk
     {
     public:
         using ptr = std::shared_ptr<FileAppender>;
-        void log(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) override;
 
-        std::string toYamlString() override;
+        /// @brief 按时间滚动的方式
+        enum RotateType
+        {
+            NONE = 0,   // 不按时间滚动
+            HOURLY = 1, // 每小时滚动
+            DAILY = 2   // 每天滚动
+        };
 
+        void log(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) override;
 
-        FileAppender(const std::string &filename);
+        std::string toYamlString() override;
 
+        /// @brief 构造函数
+        /// @param filename 日志文件名
+        /// @param rotate   按时间滚动的方式
+        /// @param max_size 单个日志文件的最大字节数, 0表示不按大小滚动
+        /// @param compress 滚动后的文件是否在后台压缩为gzip
+        /// @param max_files 保留的历史文件数量, 0表示不清理
+        FileAppender(const std::string &filename, RotateType rotate = NONE, uint64_t max_size = 0,
+                     bool compress = false, uint32_t max_files = 0);
+        ~FileAppender();
 
         /// @brief 重新打开日志文件
         /// @return 成功返回True
         bool reOpen();
 
+        /// @brief 立即滚动日志文件
+        /// @return 成功返回True
+        bool rotate();
+
+        RotateType getRotateType() const { return m_rotate; }
+        uint64_t getMaxSize() const { return m_maxSize; }
+        bool isCompress() const { return m_compress; }
+        uint32_t getMaxFiles() const { return m_maxFiles; }
+
+        static RotateType RotateTypeFromString(const std::string &str);
+        static const char *RotateTypeToString(RotateType type);
+
+    protected:
+        /// @brief 写入前检查文件, 必要时重新打开或滚动(需持有锁)
+        /// @param now 当前时间(秒)
+        /// @param len 将要写入的字节数
+        void checkFile(uint64_t now, size_t len);
+
+        /// @brief 追加写入数据(需持有锁)
+        bool writeFile(const void *data, size_t len);
+
+        /// @brief 当前文件的大小
+        uint64_t getCurSize() const { return m_curSize; }
+
+        /// @brief 文件被(重新)打开的次数, 变化说明已切换到新文件
+        uint32_t getOpenCount() const { return m_openCount; }
+
+    private:
+        /// @brief 打开日志文件(需持有锁)
+        bool openFile();
+
+        /// @brief 滚动日志文件(需持有锁)
+        bool rotateFile(uint64_t now);
+
+        /// @brief 计算下一次按时间滚动的时间点
+        uint64_t nextRotateTime(uint64_t now) const;
+
     private:
         std::string m_filename;
-        std::ofstream m_filestream;
-        // 上次打开的时间
-        uint64_t m_lastTime;    
+        // O_APPEND打开的文件句柄
+        int m_fd = -1;
+        // 当前文件的inode, 用于发现文件被外部移走
+        uint64_t m_inode = 0;
+        // 当前文件的大小
+        uint64_t m_curSize = 0;
+        // 文件被打开的次数
+        uint32_t m_openCount = 0;
+        // 上次检查文件的时间
+        uint64_t m_lastTime = 0;
+        // 下一次按时间滚动的时间点
+        uint64_t m_nextRotate = 0;
+        // 上次滚动的时间和同一秒内的滚动序号
+        uint64_t m_lastRotate = 0;
+        uint32_t m_rotateSeq = 0;
+        RotateType m_rotate;
+        uint64_t m_maxSize;
+        bool m_compress;
+        uint32_t m_maxFiles;
     };
 
 
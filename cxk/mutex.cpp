@@ -87,5 +87,28 @@ void FiberSemaphore::notify(){
     }
 }
 
+
+void FiberCondition::wait(Mutex::Lock& lock){
+    CXK_ASSERT(Scheduler::GetThis());
+    {
+        MutexType::Lock l(m_mutex);
+        m_waiters.push_back(std::make_pair(Scheduler::GetThis(), Fiber::GetThis()));
+    }
+    lock.unlock();
+    Fiber::YieldToHold();
+    lock.lock();
 }
 
+
+void FiberCondition::notifyAll(){
+    std::vector<std::pair<Scheduler*, Fiber::ptr> > waiters;
+    {
+        MutexType::Lock l(m_mutex);
+        waiters.swap(m_waiters);
+    }
+    for(auto& i : waiters){
+        i.first->schedule(i.second);
+    }
+}
+
+}
@@ -2,6 +2,7 @@
 
 
 #include <list>
+#include <vector>
 #include <thread>
 #include <pthread.h>
 #include <unistd.h>
@@ -373,4 +374,30 @@ private:
 };
 
 
+/**
+ * @brief 协程条件变量
+ * @details 和Mutex一起使用: 持有锁检查条件, 不满足时wait释放锁并挂起当前协程, 被唤醒后重新加锁再检查。
+ *          修改条件的一方在同一把锁内修改后调用notifyAll, 不会丢失唤醒
+ */
+class FiberCondition : Noncopyable{
+public:
+    using MutexType = Spinlock;
+
+    /**
+     * @brief 释放lock并挂起当前协程, 被唤醒后重新加锁
+     * @pre   在协程中调用, lock已经加锁
+     */
+    void wait(Mutex::Lock& lock);
+
+    /**
+     * @brief 唤醒全部等待的协程
+     */
+    void notifyAll();
+
+private:
+    MutexType m_mutex;
+    std::vector<std::pair<Scheduler*, Fiber::ptr> > m_waiters;
+};
+
+
 }
\ No newline at end of file
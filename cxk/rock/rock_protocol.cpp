@@ -1,7 +1,7 @@
 #include "rock_protocol.h"
 #include "cxk/logger.h"
 #include "cxk/config.h"
-#include "cxk/stream/zlib_stream.h"
+#include "cxk/stream/compress_codec.h"
 #include "cxk/util.h"
 #include "cxk/endian.h"
 
@@ -14,7 +14,52 @@ static cxk::ConfigVar<uint32_t>::ptr g_rock_protocol_max_length =
     cxk::Config::Lookup("rock.protocol.max_length", (uint32_t)(1024 * 1024 * 64), "rock protocol min length");
 
 static cxk::ConfigVar<uint32_t>::ptr g_rock_protocol_gzip_min_length = 
-    cxk::Config::Lookup("rock.protocol.gzip_min_length", (uint32_t)(1024 * 4), "rock protocol gzip min length");
+    cxk::Config::Lookup("rock.protocol.gzip_min_length", (uint32_t)(1024 * 4), "rock protocol compress min length");
+
+static cxk::ConfigVar<std::string>::ptr g_rock_protocol_codec =
+    cxk::Config::Lookup("rock.protocol.codec", std::string("gzip"), "rock protocol compress codec: none, gzip, zstd, lz4, deflate");
+
+// 配置的压缩算法, 没有编译进来的算法退回gzip
+static std::atomic<int> s_rock_codec{CompressCodec::GZIP};
+
+static void SetRockCodec(const std::string& name){
+    if(name.empty() || name == "none"){
+        s_rock_codec = CompressCodec::NONE;
+        return;
+    }
+    CompressCodec::ptr codec = CompressCodec::Get(name);
+    if(!codec){
+        CXK_LOG_ERROR(g_logger) << "rock.protocol.codec=" << name << " not supported, use gzip";
+        s_rock_codec = CompressCodec::GZIP;
+        return;
+    }
+    s_rock_codec = codec->getType();
+}
+
+struct _RockProtocolIniter{
+    _RockProtocolIniter(){
+        SetRockCodec(g_rock_protocol_codec->getValue());
+        g_rock_protocol_codec->addListener([](const std::string& old_val, const std::string& new_val){
+            SetRockCodec(new_val);
+        });
+    }
+};
+
+static _RockProtocolIniter s_rock_protocol_initer;
+
+// 本端可以解压的算法, 放在flag的高4位
+static uint8_t GetLocalCodecs(){
+    static uint8_t s_codecs = [](){
+        uint8_t rt = 0;
+        for(int i = CompressCodec::GZIP; i < CompressCodec::TYPE_COUNT; ++i){
+            if(CompressCodec::Get((CompressCodec::Type)i)){
+                rt |= 1 << (i - 1);
+            }
+        }
+        return rt;
+    }();
+    return s_codecs;
+}
 
 
 bool RockBody::serializeToByteArray(ByteArray::ptr bytearray){
@@ -225,18 +270,22 @@ Message::ptr RockMessageDecoder::parseFrom(Stream::ptr stream){
         }
 
         ba->setPosition(0);
-        if(header.flag & 0x1){
-            auto zstream = cxk::ZlibStream::CreateGzip(false);
-            if(zstream->write(ba, -1) != Z_OK){
-                CXK_LOG_ERROR(g_logger) << "gzip error";
+        m_peerCodecs |= header.flag >> 4;
+        uint8_t codec_type = header.flag & 0x7;
+        if(codec_type != CompressCodec::NONE){
+            auto codec = CompressCodec::Get((CompressCodec::Type)codec_type);
+            if(!codec){
+                CXK_LOG_ERROR(g_logger) << "unsupported codec: " << (uint32_t)codec_type;
                 return nullptr;
             }
-            if(zstream->flush() != Z_OK){
-                CXK_LOG_ERROR(g_logger) << "gzip error";
+            cxk::ByteArray::ptr out(new cxk::ByteArray);
+            // 解压后的大小同样受rock.protocol.max_length限制
+            if(!codec->decompress(ba, out, g_rock_protocol_max_length->getValue())){
+                CXK_LOG_ERROR(g_logger) << codec->getName() << " decompress error";
                 return nullptr;
             }
-
-            ba  = zstream->getByteArray();
+            out->setPosition(0);
+            ba = out;
         }
 
         uint8_t type = ba->readFuint8_t();
@@ -276,28 +325,34 @@ int32_t RockMessageDecoder::serializeTo(Stream::ptr stream, Message::ptr msg){
     ba->setPosition(0);
 
     header.length = ba->getSize();
-    if((uint32_t)header.length >= g_rock_protocol_gzip_min_length->getValue()){
-        auto zstream = cxk::ZlibStream::CreateGzip(true);
-        if(zstream->write(ba, -1) != Z_OK){
-            CXK_LOG_ERROR(g_logger) << "gzip error";
-            return -1;
+    int codec_type = s_rock_codec;
+    if(codec_type != CompressCodec::NONE
+            && (uint32_t)header.length >= g_rock_protocol_gzip_min_length->getValue()){
+        // 旧版本只能解压gzip, 对方没有声明支持时退回gzip
+        if(codec_type != CompressCodec::GZIP && !(m_peerCodecs & (1 << (codec_type - 1)))){
+            codec_type = CompressCodec::GZIP;
         }
-        if(zstream->flush() != Z_OK){
-            CXK_LOG_ERROR(g_logger) << "gzip error";
+        auto codec = CompressCodec::Get((CompressCodec::Type)codec_type);
+        cxk::ByteArray::ptr out(new cxk::ByteArray);
+        if(!codec->compress(ba, out)){
+            CXK_LOG_ERROR(g_logger) << codec->getName() << " compress error";
             return -1;
         }
-        ba = zstream->getByteArray();
-        header.flag |= 0x1;
+        out->setPosition(0);
+        ba = out;
+        header.flag |= codec_type;
         header.length = ba->getSize();
     }
+    header.flag |= GetLocalCodecs() << 4;
 
     header.length = cxk::byteswapOnLittleEndian(header.length);
-    if(stream->writeFixSize(&header, sizeof(header)) <= 0){
-        CXK_LOG_ERROR(g_logger) << "writeFixSize error";
-        return -1;
-    }
-    if(stream->writeFixSize(ba, ba->getReadSize()) <= 0){
-        CXK_LOG_ERROR(g_logger) << "writeFixSize error";
+    // 消息头和body的各个内存块一次writev写出
+    std::vector<iovec> iovs(1);
+    iovs[0].iov_base = &header;
+    iovs[0].iov_len = sizeof(header);
+    ba->getReadBuffers(iovs, ba->getReadSize());
+    if(stream->writevFixSize(&iovs[0], iovs.size()) <= 0){
+        CXK_LOG_ERROR(g_logger) << "writevFixSize error";
         return -1;
     }
     return sizeof(header) + ba->getSize();
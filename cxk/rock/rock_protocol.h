@@ -3,6 +3,7 @@
 
 #include "cxk/protocol.h"
 #include "google/protobuf/message.h"
+#include <atomic>
 
 
 namespace cxk{
@@ -96,17 +97,26 @@ struct RockMsgHeader{
     RockMsgHeader();
     uint8_t magic[2];
     uint8_t version;
-    uint8_t flag;       // 是否压缩
+    // 低3位为消息体的压缩算法(CompressCodec::Type, 1为gzip, 兼容旧版本的压缩标志),
+    // 高4位为发送方可以解压的算法, 第4 + (type - 1)位对应type
+    uint8_t flag;
     int32_t length;
 };
 
 
+/// @brief Rock协议编解码, 每个连接一个
+/// @details 压缩算法由rock.protocol.codec配置, gzip以外的算法只在对方的消息声明可以解压后使用,
+///          否则退回gzip
 class RockMessageDecoder : public MessageDecoder{
 public:
     using ptr = std::shared_ptr<RockMessageDecoder>;
 
     virtual Message::ptr parseFrom(Stream::ptr stream) override;
     virtual int32_t serializeTo(Stream::ptr stream, Message::ptr msg) override;
+
+private:
+    // 对方可以解压的算法, 同flag的高4位
+    std::atomic<uint8_t> m_peerCodecs{0};
 };
 
 }
\ No newline at end of file
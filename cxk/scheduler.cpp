@@ -49,6 +49,12 @@ void Scheduler::switchTo(int thread){
     Fiber::YieldToHold();
 }
 
+
+size_t Scheduler::getTaskCount(){
+    return m_taskCount.load(std::memory_order_relaxed);
+}
+
+
 std::ostream& Scheduler::dump(std::ostream& os) {
     os << "[Scheduler name=" << m_name
        << " size=" << m_threadCount
@@ -101,6 +107,7 @@ void Scheduler::run(){
 
                 ft = *it;
                 m_fibers.erase(it++);            
+                m_taskCount.store(m_fibers.size(), std::memory_order_relaxed);
                 ++m_activeThreadCount;
                 is_active = true;
                 break;
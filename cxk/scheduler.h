@@ -3,6 +3,7 @@
 #include "fiber.h"
 #include "Thread.h"
 #include <list>
+#include <atomic>
 #include "logger.h"
 #include <vector>
 
@@ -38,6 +39,13 @@ public:
 
     /// @brief  停止协程调度器
     void stop();
+
+    /// @brief  等待执行的协程和函数数量, 用于判断调度器是否积压
+    /// @details 不加锁, 结果可能稍微滞后
+    size_t getTaskCount();
+
+    /// @brief  线程数量, 包括use_caller的调用线程
+    size_t getThreadCount() const { return m_threadCount + (m_rootThread == -1 ? 0 : 1);}
  
 
     /// @brief                  调度协程
@@ -111,6 +119,7 @@ private:
         FiberAndThread ft(fc, thread);
         if(ft.fiber || ft.cb){
             m_fibers.push_back(ft);
+            m_taskCount.store(m_fibers.size(), std::memory_order_relaxed);
         }
         return need_tickle;
     }
@@ -167,6 +176,7 @@ private:
     MutexType m_mutex;
     std::vector<Thread::ptr> m_threads;     // 线程池
     std::list<FiberAndThread> m_fibers;     // 计划要执行的协程队列
+    std::atomic<size_t> m_taskCount{0};     // m_fibers的大小, 在锁内更新, getTaskCount不加锁读取
     std::string m_name;                     // 协程调度器名称
     Fiber::ptr m_rootFiber;                 // use_calller时有效，调度协程
 
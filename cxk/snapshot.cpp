@@ -0,0 +1,58 @@
+#include "snapshot.h"
+#include <vector>
+
+
+namespace cxk{
+
+
+// 其他编译单元的静态配置项在初始化时就会分配下标, 析构时释放下标,
+// 不能依赖本文件静态变量的初始化和析构顺序, 第一次使用时创建并且不释放
+struct SnapshotIndexes{
+    Spinlock mutex;
+    size_t next = 0;
+    std::vector<size_t> free;
+};
+
+static SnapshotIndexes& GetSnapshotIndexes(){
+    static SnapshotIndexes* s_indexes = new SnapshotIndexes;
+    return *s_indexes;
+}
+
+static std::atomic<uint64_t> s_snapshot_version{0};
+
+static thread_local std::vector<SnapshotCache::Slot> t_snapshot_slots;
+
+
+size_t SnapshotCache::NewIndex(){
+    SnapshotIndexes& indexes = GetSnapshotIndexes();
+    Spinlock::Lock lock(indexes.mutex);
+    if(!indexes.free.empty()){
+        size_t index = indexes.free.back();
+        indexes.free.pop_back();
+        return index;
+    }
+    return indexes.next++;
+}
+
+
+void SnapshotCache::FreeIndex(size_t index){
+    SnapshotIndexes& indexes = GetSnapshotIndexes();
+    Spinlock::Lock lock(indexes.mutex);
+    indexes.free.push_back(index);
+}
+
+
+uint64_t SnapshotCache::NewVersion(){
+    return s_snapshot_version.fetch_add(1, std::memory_order_relaxed) + 1;
+}
+
+
+SnapshotCache::Slot& SnapshotCache::GetSlot(size_t index){
+    if(index >= t_snapshot_slots.size()){
+        t_snapshot_slots.resize(index + 1);
+    }
+    return t_snapshot_slots[index];
+}
+
+
+}
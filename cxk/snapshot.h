@@ -0,0 +1,95 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include "mutex.h"
+
+
+namespace cxk{
+
+
+/// @brief AtomicSnapshot的线程本地缓存, 与类型无关的部分
+class SnapshotCache{
+public:
+    /// @brief 一个AtomicSnapshot在当前线程缓存的值
+    struct Slot{
+        uint64_t version = 0;
+        std::shared_ptr<const void> value;
+    };
+
+    /// @brief      分配一个缓存下标, 优先复用已经释放的下标
+    static size_t NewIndex();
+
+    /// @brief      释放缓存下标
+    static void FreeIndex(size_t index);
+
+    /// @brief      分配一个全局唯一的版本号, 复用下标时旧的缓存不会被误认为有效
+    static uint64_t NewVersion();
+
+    /// @brief      当前线程中下标为index的缓存
+    static Slot& GetSlot(size_t index);
+};
+
+
+/// @brief 只整体替换的不可变值, 读多写少时代替std::atomic_load/atomic_store(shared_ptr)
+/// @details libstdc++的atomic shared_ptr函数通过全局的互斥量池实现, 每次读取都要加锁。
+///          这里每个线程缓存一份(版本号, 值), 读取时只有一次acquire load比较版本号和一次引用计数自增;
+///          版本号变化后第一次读取才在自旋锁下取新值。
+///          每个对象占用每个线程缓存中的一个位置, 析构后位置由新对象复用; 其他线程缓存的旧值要到位置被复用
+///          或者线程退出时才释放, 适合配置、路由表这样长期存在的对象
+/// @tparam T   值的类型
+template<class T>
+class AtomicSnapshot : Noncopyable{
+public:
+    using ptr = std::shared_ptr<const T>;
+    using MutexType = Spinlock;
+
+    AtomicSnapshot(ptr value = nullptr)
+        : m_index(SnapshotCache::NewIndex())
+        , m_value(value)
+        , m_version(SnapshotCache::NewVersion()){
+    }
+
+    ~AtomicSnapshot(){
+        SnapshotCache::FreeIndex(m_index);
+    }
+
+    /// @brief      读取当前的值, 快速路径不加锁
+    ptr load() const {
+        uint64_t version = m_version.load(std::memory_order_acquire);
+        SnapshotCache::Slot* slot = &SnapshotCache::GetSlot(m_index);
+        if(slot->version == version){
+            return std::static_pointer_cast<const T>(slot->value);
+        }
+        // 先读版本号再取值, 缓存的值不会比版本号旧, 最多多刷新一次
+        std::shared_ptr<const void> value;
+        {
+            MutexType::Lock lock(m_mutex);
+            value = m_value;
+        }
+        // 换出的旧值留在value中, 在锁外、更新完缓存后才析构;
+        // 旧值的析构函数可能读取其他AtomicSnapshot使缓存扩容, 之后不能再使用slot
+        slot->value.swap(value);
+        slot->version = version;
+        ptr rt = std::static_pointer_cast<const T>(slot->value);
+        value.reset();
+        return rt;
+    }
+
+    /// @brief      替换为新的值, 其他线程下一次load时看到
+    void store(ptr value){
+        MutexType::Lock lock(m_mutex);
+        m_value = value;
+        m_version.store(SnapshotCache::NewVersion(), std::memory_order_release);
+    }
+
+private:
+    size_t m_index;
+    mutable MutexType m_mutex;
+    ptr m_value;
+    // 全局唯一, 从1开始, 线程缓存的初始版本号0总是不匹配
+    std::atomic<uint64_t> m_version;
+};
+
+
+}
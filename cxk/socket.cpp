@@ -3,6 +3,7 @@
 #include "logger.h"
 #include "hook.h"
 #include "iomanager.h"
+#include <sys/sendfile.h>
 
 
 namespace cxk{
@@ -150,6 +151,18 @@ bool Socket::init(int sock){
 }
 
 
+bool Socket::setReusePort(){
+    if(CXK_UNLIKELY(!isValid())){
+        newSock();
+        if(CXK_UNLIKELY(!isValid())){
+            return false;
+        }
+    }
+    int val = 1;
+    return setOption(SOL_SOCKET, SO_REUSEPORT, val);
+}
+
+
 // 将socket绑定到对应的地址
 bool Socket::bind(const Address::ptr addr){
     m_localAddr = addr;
@@ -180,6 +193,8 @@ bool Socket::bind(const Address::ptr addr){
         return false;
     }
 
+    // 重新获取实际绑定的地址, 端口为0时由内核分配
+    m_localAddr.reset();
     getLocalAddress();
     return true;
 }
@@ -295,6 +310,13 @@ int Socket::sendto(const iovec* buffers, size_t count, const Address::ptr addr,
     return -1;
 }
 
+int Socket::sendFile(int fd, off_t* offset, size_t length){
+    if(isConnected()){
+        return ::sendfile(m_socket, fd, offset, length);
+    }
+    return -1;
+}
+
 int Socket::recv(void* buffer, size_t length, int flags){
     if(isConnected()){
         int rt = ::recv(m_socket, buffer, length, flags);
@@ -512,6 +534,7 @@ Socket::ptr SSLSocket::accept(){
     }
 
     sock->m_ctx = m_ctx;
+    sock->m_alpn = m_alpn;
     if(sock->init(newsock)){
         return sock;
     }
@@ -533,6 +556,9 @@ bool SSLSocket::connect(const Address::ptr addr, uint64_t timeout_ms){
         m_ssl.reset(SSL_new(m_ctx.get()), SSL_free);
         // 绑定socket到SSL对象上
         SSL_set_fd(m_ssl.get(), m_socket);
+        if(m_alpn){
+            SSL_set_alpn_protos(m_ssl.get(), (const unsigned char*)m_alpn->c_str(), m_alpn->size());
+        }
         // 进行SSL握手连接
         v = (SSL_connect(m_ssl.get()) == 1);
     }
@@ -593,6 +619,23 @@ int SSLSocket::sendto(const iovec* buffers, size_t length, const Address::ptr to
 }
 
 
+int SSLSocket::sendFile(int fd, off_t* offset, size_t length){
+    if(!m_ssl){
+        return -1;
+    }
+    char buffer[16 * 1024];
+    ssize_t len = pread(fd, buffer, std::min(length, sizeof(buffer)), *offset);
+    if(len <= 0){
+        return len;
+    }
+    int rt = SSL_write(m_ssl.get(), buffer, len);
+    if(rt > 0){
+        *offset += rt;
+    }
+    return rt;
+}
+
+
 int SSLSocket::recv(void* buffer, size_t length, int flags){
     CXK_LOG_DEBUG(g_logger) << "SSLSocket::recv";
     if(m_ssl){
@@ -634,6 +677,18 @@ int SSLSocket::recvfrom(iovec* buffers, size_t length, Address::ptr from, int fl
 
 
 
+// 服务端按本端的优先级选择ALPN协议, 没有共同的协议时不协商
+static int AlpnSelect(SSL* ssl, const unsigned char** out, unsigned char* outlen
+        , const unsigned char* in, unsigned int inlen, void* arg){
+    const std::string* protocols = (const std::string*)arg;
+    if(SSL_select_next_proto((unsigned char**)out, outlen, (const unsigned char*)protocols->c_str()
+                , protocols->size(), in, inlen) != OPENSSL_NPN_NEGOTIATED){
+        return SSL_TLSEXT_ERR_NOACK;
+    }
+    return SSL_TLSEXT_ERR_OK;
+}
+
+
 bool SSLSocket::loadCertificates(const std::string& cert_file, const std::string& key_file){
     m_ctx.reset(SSL_CTX_new(SSLv23_server_method()), SSL_CTX_free);
 
@@ -654,10 +709,43 @@ bool SSLSocket::loadCertificates(const std::string& cert_file, const std::string
         CXK_LOG_ERROR(g_logger) << "SSL_CTX_check_private_key failed";
         return false;
     }
+    if(m_alpn){
+        SSL_CTX_set_alpn_select_cb(m_ctx.get(), AlpnSelect, m_alpn.get());
+    }
     return true;
 }
 
 
+void SSLSocket::setAlpnProtocols(const std::vector<std::string>& protocols){
+    auto alpn = std::make_shared<std::string>();
+    for(auto& i : protocols){
+        if(i.empty() || i.size() > 255){
+            continue;
+        }
+        alpn->push_back((char)i.size());
+        alpn->append(i);
+    }
+    m_alpn = alpn;
+    if(m_ctx){
+        SSL_CTX_set_alpn_select_cb(m_ctx.get(), AlpnSelect, m_alpn.get());
+    }
+}
+
+
+std::string SSLSocket::getAlpnProtocol() const{
+    if(!m_ssl){
+        return "";
+    }
+    const unsigned char* data = nullptr;
+    unsigned int len = 0;
+    SSL_get0_alpn_selected(m_ssl.get(), &data, &len);
+    if(!data){
+        return "";
+    }
+    return std::string((const char*)data, len);
+}
+
+
 std::ostream& SSLSocket::dump(std::ostream& os) const{
     os << "[SSLSocket=" << m_socket
         << " is_connected=" << m_isConnected
@@ -107,6 +107,10 @@ public:
         return setOption(level, option, &data, sizeof(T));
     }
 
+    /// @brief      设置SO_REUSEPORT, 多个socket可以监听同一个地址, 由内核分配新连接
+    /// @pre        必须在bind之前调用
+    bool setReusePort();
+
 
     /// @brief  接受connect连接
     /// @return 成功返回新连接的socket， 失败返回nullptr
@@ -172,6 +176,14 @@ public:
     virtual int sendto(const iovec* buffers, size_t count, const Address::ptr addr, int flags = 0);
 
 
+    /// @brief          把文件的一段直接发送到socket(sendfile), 数据不经过用户态
+    /// @param fd       文件描述符
+    /// @param offset   文件偏移, 按发送的字节数后移
+    /// @param length   最多发送的长度
+    /// @return         @retval >0 成功发送的字节数， @retval =0 文件已经读完， @retval <0 出错
+    virtual int sendFile(int fd, off_t* offset, size_t length);
+
+
     /// @brief          接收数据
     /// @param buffer   待接收数据的内存
     /// @param length   待接收数据长度
@@ -220,6 +232,9 @@ public:
     /// @brief  是否已经连接
     int isConnected() const {return m_isConnected;}
 
+    /// @brief  获取socket句柄
+    int getSocket() const {return m_socket;}
+
     /// @brief  是否有效(m_socket != -1)
     bool isValid() const;
 
@@ -301,6 +316,8 @@ public:
     virtual int send(const iovec* buffers, size_t length, int flags = 0) override;
     virtual int sendto(const void* buffer, size_t length, const Address::ptr to, int flags = 0) override;
     virtual int sendto(const iovec* buffers, size_t length, const Address::ptr to, int flags = 0) override;
+    /// @brief 需要加密, 读出文件后用SSL_write发送
+    virtual int sendFile(int fd, off_t* offset, size_t length) override;
     virtual int recv(void* buffer, size_t length, int flags = 0) override;
     virtual int recv(iovec* buffers, size_t length, int flags = 0) override;
     virtual int recvfrom(void* buffer, size_t length, Address::ptr from, int flags = 0) override;
@@ -316,6 +333,15 @@ public:
      * @return 加载成功返回true，否则返回false
      */
     bool loadCertificates(const std::string& cert_file, const std::string& key_file);
+
+    /// @brief          设置ALPN协议列表, 按优先级排列
+    /// @details        客户端在connect前设置, 握手时提供给服务端; 服务端在loadCertificates之后设置,
+    ///                 从客户端提供的协议中按本端的优先级选择
+    void setAlpnProtocols(const std::vector<std::string>& protocols);
+
+    /// @brief          握手时协商出的ALPN协议, 没有协商时为空
+    std::string getAlpnProtocol() const;
+
     virtual std::ostream& dump(std::ostream& os) const override;
 
 protected:
@@ -323,6 +349,8 @@ protected:
 private:
     std::shared_ptr<SSL_CTX> m_ctx;
     std::shared_ptr<SSL> m_ssl;
+    // ALPN协议列表(长度前缀格式), 和m_ctx一起复制给accept出的socket
+    std::shared_ptr<std::string> m_alpn;
 };
 
 
@@ -1,4 +1,6 @@
 #include "stream.h"
+#include <limits.h>
+#include <algorithm>
 
 namespace cxk{
 
@@ -60,4 +62,92 @@ int Stream::writeFixSize(ByteArray::ptr ba, size_t length){
 }
 
 
+
+int Stream::readv(const iovec* buffers, size_t count){
+    for(size_t i = 0; i < count; ++i){
+        if(buffers[i].iov_len > 0){
+            return read(buffers[i].iov_base, buffers[i].iov_len);
+        }
+    }
+    return 0;
+}
+
+
+int Stream::writev(const iovec* buffers, size_t count){
+    int64_t total = 0;
+    for(size_t i = 0; i < count; ++i){
+        if(buffers[i].iov_len == 0){
+            continue;
+        }
+        int64_t len = write(buffers[i].iov_base, buffers[i].iov_len);
+        if(len <= 0){
+            return total ? total : len;
+        }
+        total += len;
+        if((size_t)len < buffers[i].iov_len){
+            break;
+        }
+    }
+    return total;
+}
+
+
+// 循环调用readv/writev直到处理完所有的iovec, 每次调用最多IOV_MAX个
+template<class Fun>
+static int DoFixSizeV(const iovec* buffers, size_t count, Fun fun){
+    std::vector<iovec> iovs(buffers, buffers + count);
+    size_t idx = 0;
+    int64_t total = 0;
+    while(true){
+        while(idx < iovs.size() && iovs[idx].iov_len == 0){
+            ++idx;
+        }
+        if(idx == iovs.size()){
+            break;
+        }
+        int64_t len = fun(&iovs[idx], std::min(iovs.size() - idx, (size_t)IOV_MAX));
+        if(len <= 0){
+            return len;
+        }
+        total += len;
+        // 跳过已经处理完的iovec, 调整处理了一部分的iovec
+        while(len > 0 && (size_t)len >= iovs[idx].iov_len){
+            len -= iovs[idx].iov_len;
+            ++idx;
+        }
+        if(len > 0){
+            iovs[idx].iov_base = (char*)iovs[idx].iov_base + len;
+            iovs[idx].iov_len -= len;
+        }
+    }
+    return total;
+}
+
+
+int Stream::readvFixSize(const iovec* buffers, size_t count){
+    return DoFixSizeV(buffers, count, [this](const iovec* iovs, size_t n){
+        return readv(iovs, n);
+    });
+}
+
+
+int Stream::writevFixSize(const iovec* buffers, size_t count){
+    return DoFixSizeV(buffers, count, [this](const iovec* iovs, size_t n){
+        return writev(iovs, n);
+    });
+}
+
+
+int Stream::writeBatch(const std::vector<ByteArray::ptr>& bas){
+    std::vector<iovec> iovs;
+    for(auto& i : bas){
+        i->getReadBuffers(iovs, i->getReadSize(), i->getPosition());
+    }
+    if(iovs.empty()){
+        return 0;
+    }
+    return writevFixSize(&iovs[0], iovs.size());
+}
+
+
 }
\ No newline at end of file
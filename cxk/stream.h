@@ -2,6 +2,8 @@
 
 
 #include <memory>
+#include <vector>
+#include <sys/uio.h>
 #include "bytearray.h"
 
 namespace cxk{
@@ -68,6 +70,34 @@ public:
     virtual int writeFixSize(ByteArray::ptr ba, size_t length);
 
 
+    /// @brief          分散读数据
+    /// @param buffers  接收数据的iovec数组
+    /// @param count    iovec数组的长度
+    /// @return         @retval > 0  读到的数据大小, @retval = 0  被关闭, @retval < 0  出错
+    /// @details        默认实现只读入第一个非空的iovec, 子类可以用一次系统调用填满多个iovec
+    virtual int readv(const iovec* buffers, size_t count);
+
+    /// @brief          聚集写数据
+    /// @param buffers  写数据的iovec数组
+    /// @param count    iovec数组的长度
+    /// @return         @retval >= 0  写的数据大小, @retval < 0  出错
+    /// @details        默认实现依次写每一个iovec, 子类可以用一次系统调用写出
+    virtual int writev(const iovec* buffers, size_t count);
+
+    /// @brief          读满所有的iovec
+    /// @return         @retval > 0  读到的数据大小, @retval = 0  被关闭, @retval < 0  出错
+    virtual int readvFixSize(const iovec* buffers, size_t count);
+
+    /// @brief          写完所有的iovec
+    /// @return         @retval > 0  写的数据大小, @retval < 0  出错
+    virtual int writevFixSize(const iovec* buffers, size_t count);
+
+    /// @brief          把多个消息合并为尽量少的writev写出
+    /// @param bas      消息列表, 写出每个ByteArray从当前位置开始的可读数据, 不改变其位置
+    /// @return         @retval > 0  写的数据大小, @retval < 0  出错
+    virtual int writeBatch(const std::vector<ByteArray::ptr>& bas);
+
+
     /// @brief          关闭流
     virtual void close() = 0;
 };
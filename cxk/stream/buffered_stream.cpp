@@ -0,0 +1,186 @@
+#include "buffered_stream.h"
+#include "cxk/block_pool.h"
+#include <string.h>
+#include <algorithm>
+
+
+namespace cxk{
+
+BufferedStream::BufferedStream(Stream::ptr stream, size_t capacity)
+    : m_stream(stream)
+    , m_capacity(capacity){
+    // 保留一个字节保证缓冲数据以'\0'结尾。capacity正好是分级大小时(默认的4096)减去这个字节,
+    // 否则多出的1字节会落到下一个分级, 每个连接的读缓冲翻倍
+    int32_t cls = BlockPool::GetClass(capacity);
+    if(cls >= 0 && BlockPool::GetClass(capacity + 1) != cls){
+        m_capacity = capacity - 1;
+    }
+    m_buffer = BlockPool::GetInstance()->alloc(m_capacity + 1);
+    m_buffer.get()[0] = '\0';
+}
+
+
+int BufferedStream::fill(){
+    char* buf = m_buffer.get();
+    if(m_begin == m_end){
+        m_begin = m_end = 0;
+    } else if(m_end == m_capacity && m_begin > 0){
+        // 尾部没有空间时才移动未读数据
+        memmove(buf, buf + m_begin, m_end - m_begin);
+        m_end -= m_begin;
+        m_begin = 0;
+    }
+    if(m_end == m_capacity){
+        return -1;
+    }
+
+    int rt = m_stream->read(buf + m_end, m_capacity - m_end);
+    if(rt > 0){
+        m_end += rt;
+        buf[m_end] = '\0';
+    }
+    return rt;
+}
+
+
+std::string_view BufferedStream::peek(size_t len){
+    len = std::min(len, m_capacity);
+    while(getReadSize() < len){
+        if(fill() <= 0){
+            break;
+        }
+    }
+    return std::string_view(m_buffer.get() + m_begin, getReadSize());
+}
+
+
+// 查找分隔符, 单字节分隔符用memchr, 其他用memmem, 两者在glibc中都有向量化实现
+static const char* FindDelim(const char* begin, size_t len, std::string_view delim){
+    if(delim.size() == 1){
+        return (const char*)memchr(begin, delim[0], len);
+    }
+    return (const char*)memmem(begin, len, delim.data(), delim.size());
+}
+
+
+std::string_view BufferedStream::readUntil(std::string_view delim){
+    if(delim.empty()){
+        return std::string_view();
+    }
+
+    // 已经查找过的长度, 读到新数据后从这里继续查找
+    size_t searched = 0;
+    do{
+        size_t size = getReadSize();
+        if(size >= delim.size()){
+            const char* data = m_buffer.get() + m_begin;
+            const char* pos = FindDelim(data + searched, size - searched, delim);
+            if(pos){
+                size_t len = pos - data + delim.size();
+                std::string_view rt(data, len);
+                consume(len);
+                return rt;
+            }
+            searched = size - delim.size() + 1;
+        }
+    } while(fill() > 0);
+    return std::string_view();
+}
+
+
+void BufferedStream::consume(size_t len){
+    m_begin += std::min(len, getReadSize());
+}
+
+
+size_t BufferedStream::copyOut(void* buffer, size_t length){
+    size_t len = std::min(length, getReadSize());
+    memcpy(buffer, m_buffer.get() + m_begin, len);
+    consume(len);
+    return len;
+}
+
+
+int BufferedStream::read(void* buffer, size_t length){
+    if(length == 0){
+        return 0;
+    }
+    if(getReadSize() == 0){
+        if(length >= m_capacity){
+            return m_stream->read(buffer, length);
+        }
+        int rt = fill();
+        if(rt <= 0){
+            return rt;
+        }
+    }
+    return copyOut(buffer, length);
+}
+
+
+int BufferedStream::read(ByteArray::ptr ba, size_t length){
+    if(length == 0){
+        return 0;
+    }
+    if(getReadSize() == 0){
+        if(length >= m_capacity){
+            return m_stream->read(ba, length);
+        }
+        int rt = fill();
+        if(rt <= 0){
+            return rt;
+        }
+    }
+    size_t len = std::min(length, getReadSize());
+    ba->write(m_buffer.get() + m_begin, len);
+    consume(len);
+    return len;
+}
+
+
+int BufferedStream::readv(const iovec* buffers, size_t count){
+    if(getReadSize() == 0){
+        size_t total = 0;
+        for(size_t i = 0; i < count; ++i){
+            total += buffers[i].iov_len;
+        }
+        if(total == 0){
+            return 0;
+        }
+        if(total >= m_capacity){
+            return m_stream->readv(buffers, count);
+        }
+        int rt = fill();
+        if(rt <= 0){
+            return rt;
+        }
+    }
+
+    size_t total = 0;
+    for(size_t i = 0; i < count && getReadSize() > 0; ++i){
+        total += copyOut(buffers[i].iov_base, buffers[i].iov_len);
+    }
+    return total;
+}
+
+
+int BufferedStream::write(const void* buffer, size_t length){
+    return m_stream->write(buffer, length);
+}
+
+
+int BufferedStream::write(ByteArray::ptr ba, size_t length){
+    return m_stream->write(ba, length);
+}
+
+
+int BufferedStream::writev(const iovec* buffers, size_t count){
+    return m_stream->writev(buffers, count);
+}
+
+
+void BufferedStream::close(){
+    m_stream->close();
+}
+
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "cxk/stream.h"
+#include <string_view>
+#include <memory>
+
+
+namespace cxk{
+
+/// @brief  带读缓冲的流, 包装任意Stream
+/// @details 缓冲区在构造时分配一次并重复使用, 已读数据之后的空间不足时才把未读数据移到缓冲区开头。
+///          协议解析可以通过peek/readUntil直接在缓冲区上解析, 解析完成后consume, 多读到的数据留在缓冲区中,
+///          read/readFixSize优先读取缓冲区中的数据。写操作直接转发给底层流
+class BufferedStream : public Stream{
+public:
+    using ptr = std::shared_ptr<BufferedStream>;
+
+    /// @brief          构造函数
+    /// @param stream   底层流
+    /// @param capacity 缓冲区大小, 正好是内存块池的分级大小时要留出结尾的'\0', 实际容量少1字节(4096为4095)
+    BufferedStream(Stream::ptr stream, size_t capacity = 4096);
+
+
+    /// @brief          读数据, 缓冲区为空且length不小于缓冲区时直接从底层流读取
+    /// @return         @retval > 0  读到的数据大小, @retval = 0  被关闭, @retval < 0  出错
+    virtual int read(void* buffer, size_t length) override;
+
+    virtual int read(ByteArray::ptr ba, size_t length) override;
+
+    virtual int readv(const iovec* buffers, size_t count) override;
+
+    virtual int write(const void* buffer, size_t length) override;
+
+    virtual int write(ByteArray::ptr ba, size_t length) override;
+
+    virtual int writev(const iovec* buffers, size_t count) override;
+
+    virtual void close() override;
+
+
+    /// @brief          从底层流读一次数据追加到缓冲区
+    /// @return         @retval > 0  读到的数据大小, @retval = 0  被关闭, @retval < 0  出错或者缓冲区已满
+    /// @attention      之前返回的视图失效
+    int fill();
+
+    /// @brief          查看缓冲区中的数据, 不足len字节时从底层流读取
+    /// @param len      至少需要的数据大小, 超过缓冲区大小时按缓冲区大小处理
+    /// @return         缓冲区中全部的未读数据, 读取失败时可能少于len
+    /// @details        返回的数据之后总有一个'\0', 可以直接交给要求以'\0'结尾的解析器
+    std::string_view peek(size_t len = 0);
+
+    /// @brief          读取到分隔符为止的数据
+    /// @param delim    分隔符
+    /// @return         包含分隔符的数据, 在下一次读取之前有效; 流关闭、出错或者缓冲区满仍未找到时返回空
+    std::string_view readUntil(std::string_view delim);
+
+    /// @brief          丢弃缓冲区中前len字节的数据
+    void consume(size_t len);
+
+    /// @brief          缓冲区中未读数据的大小
+    size_t getReadSize() const { return m_end - m_begin; }
+
+    /// @brief          缓冲区大小
+    size_t getCapacity() const { return m_capacity; }
+
+    /// @brief          缓冲区是否已满
+    bool isFull() const { return m_begin == 0 && m_end == m_capacity; }
+
+    /// @brief          底层流
+    Stream::ptr getStream() const { return m_stream; }
+
+private:
+    /// @brief          把缓冲区中的数据拷贝到buffer并丢弃
+    size_t copyOut(void* buffer, size_t length);
+
+private:
+    Stream::ptr m_stream;
+    std::shared_ptr<char> m_buffer;
+    size_t m_capacity;
+    // 未读数据的起始位置
+    size_t m_begin = 0;
+    // 未读数据的结束位置
+    size_t m_end = 0;
+};
+
+}
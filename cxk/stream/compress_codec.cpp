@@ -0,0 +1,498 @@
+#include "compress_codec.h"
+#include "zlib_stream.h"
+#include "cxk/config.h"
+#include "cxk/logger.h"
+#include <strings.h>
+#include <string.h>
+#include <algorithm>
+
+#ifdef CXK_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#ifdef CXK_HAVE_LZ4
+#include <lz4frame.h>
+#endif
+
+
+namespace cxk{
+
+static cxk::Logger::ptr g_logger = CXK_LOG_NAME("system");
+
+static cxk::ConfigVar<int32_t>::ptr g_compress_zstd_level =
+    cxk::Config::Lookup("compress.zstd.level", (int32_t)1, "zstd compression level");
+
+static int32_t s_zstd_level = 1;
+
+struct _CompressCodecIniter{
+    _CompressCodecIniter(){
+        s_zstd_level = g_compress_zstd_level->getValue();
+        g_compress_zstd_level->addListener([](const int32_t& old_val, const int32_t& new_val){
+            s_zstd_level = new_val;
+        });
+    }
+};
+
+static _CompressCodecIniter s_compress_codec_initer;
+
+
+// 压缩/解压时使用的线程本地输出缓冲
+static std::string& GetScratch(size_t size){
+    static thread_local std::string s_buf;
+    if(s_buf.size() < size){
+        s_buf.resize(size);
+    }
+    return s_buf;
+}
+
+
+/// @brief gzip/deflate的流式压缩器
+class ZlibCompressor : public CompressCodec::Compressor{
+public:
+    ZlibCompressor(ZlibStream::ptr zs)
+        : m_zs(zs){
+    }
+
+    bool update(const void* data, size_t len, std::string& out) override{
+        if(m_zs->write(data, len) != Z_OK){
+            return false;
+        }
+        m_zs->takeResult(out);
+        return true;
+    }
+
+    bool finish(std::string& out) override{
+        if(m_zs->flush() != Z_OK){
+            return false;
+        }
+        m_zs->takeResult(out);
+        return true;
+    }
+
+private:
+    ZlibStream::ptr m_zs;
+};
+
+
+/// @brief gzip/deflate, 基于ZlibStream, zlib上下文由ZlibStream池化
+class ZlibCodec : public CompressCodec{
+public:
+    ZlibCodec(Type type, const std::string& name, ZlibStream::Type ztype)
+        : CompressCodec(type, name)
+        , m_ztype(ztype){
+    }
+
+    bool compress(const iovec* buffers, size_t count, ByteArray::ptr out) override{
+        return process(true, buffers, count, out, 0);
+    }
+
+    bool decompress(const iovec* buffers, size_t count, ByteArray::ptr out, uint64_t max_size = 0) override{
+        return process(false, buffers, count, out, max_size);
+    }
+
+    Compressor::ptr createCompressor() override{
+        auto zs = ZlibStream::Create(true, 16 * 1024, m_ztype);
+        if(!zs){
+            return nullptr;
+        }
+        return std::make_shared<ZlibCompressor>(zs);
+    }
+
+private:
+    bool process(bool encode, const iovec* buffers, size_t count, ByteArray::ptr out, uint64_t max_size){
+        auto zs = ZlibStream::Create(encode, 4096, m_ztype);
+        if(!zs){
+            return false;
+        }
+        zs->setMaxOutput(max_size);
+        int rt = Z_OK;
+        for(size_t i = 0; i < count && rt == Z_OK; ++i){
+            rt = zs->write(buffers[i].iov_base, buffers[i].iov_len);
+        }
+        if(rt == Z_OK){
+            rt = zs->flush();
+        }
+        if(rt != Z_OK){
+            if(zs->isOutputExceeded()){
+                CXK_LOG_ERROR(g_logger) << getName() << " decompressed size exceeds " << max_size;
+            } else {
+                CXK_LOG_ERROR(g_logger) << getName() << (encode ? " compress" : " decompress") << " error";
+            }
+            return false;
+        }
+        // 输出缓冲直接作为out的内存块
+        out->append(zs->getByteArray());
+        return true;
+    }
+
+private:
+    ZlibStream::Type m_ztype;
+};
+
+
+#ifdef CXK_HAVE_ZSTD
+/// @brief 流式压缩器空闲的zstd上下文, 按线程缓存
+struct ZstdCCtxCache{
+    static constexpr size_t MAX_COUNT = 4;
+
+    ~ZstdCCtxCache();
+
+    std::vector<ZSTD_CCtx*> contexts;
+};
+
+static thread_local bool t_zstd_cache_destroyed = false;
+
+ZstdCCtxCache::~ZstdCCtxCache(){
+    t_zstd_cache_destroyed = true;
+    for(auto i : contexts){
+        ZSTD_freeCCtx(i);
+    }
+}
+
+static ZstdCCtxCache* GetZstdCCtxCache(){
+    static thread_local ZstdCCtxCache s_cache;
+    return t_zstd_cache_destroyed ? nullptr : &s_cache;
+}
+
+
+/// @brief zstd的流式压缩器, 一个压缩器的数据可能跨协程切换, 单独持有上下文
+class ZstdCompressor : public CompressCodec::Compressor{
+public:
+    ZstdCompressor(){
+        ZstdCCtxCache* cache = GetZstdCCtxCache();
+        if(cache && !cache->contexts.empty()){
+            m_ctx = cache->contexts.back();
+            cache->contexts.pop_back();
+        } else {
+            m_ctx = ZSTD_createCCtx();
+        }
+        ZSTD_CCtx_reset(m_ctx, ZSTD_reset_session_only);
+        ZSTD_CCtx_setParameter(m_ctx, ZSTD_c_compressionLevel, s_zstd_level);
+    }
+
+    ~ZstdCompressor(){
+        ZstdCCtxCache* cache = GetZstdCCtxCache();
+        if(cache && cache->contexts.size() < ZstdCCtxCache::MAX_COUNT){
+            cache->contexts.push_back(m_ctx);
+        } else {
+            ZSTD_freeCCtx(m_ctx);
+        }
+    }
+
+    bool update(const void* data, size_t len, std::string& out) override{
+        ZSTD_inBuffer input = {data, len, 0};
+        return process(input, ZSTD_e_continue, out);
+    }
+
+    bool finish(std::string& out) override{
+        ZSTD_inBuffer input = {nullptr, 0, 0};
+        return process(input, ZSTD_e_end, out);
+    }
+
+private:
+    bool process(ZSTD_inBuffer& input, ZSTD_EndDirective mode, std::string& out){
+        std::string& buf = GetScratch(ZSTD_CStreamOutSize());
+        bool finished = false;
+        do{
+            ZSTD_outBuffer output = {&buf[0], buf.size(), 0};
+            size_t rt = ZSTD_compressStream2(m_ctx, &output, &input, mode);
+            if(ZSTD_isError(rt)){
+                CXK_LOG_ERROR(g_logger) << "zstd compress error: " << ZSTD_getErrorName(rt);
+                return false;
+            }
+            out.append(buf.c_str(), output.pos);
+            finished = mode == ZSTD_e_end ? rt == 0 : input.pos == input.size;
+        } while(!finished);
+        return true;
+    }
+
+private:
+    ZSTD_CCtx* m_ctx = nullptr;
+};
+
+
+/// @brief zstd, 压缩和解压上下文按线程复用
+class ZstdCodec : public CompressCodec{
+public:
+    ZstdCodec()
+        : CompressCodec(ZSTD, "zstd"){
+    }
+
+    bool compress(const iovec* buffers, size_t count, ByteArray::ptr out) override{
+        static thread_local std::unique_ptr<ZSTD_CCtx, size_t(*)(ZSTD_CCtx*)> s_ctx(ZSTD_createCCtx(), ZSTD_freeCCtx);
+        ZSTD_CCtx* ctx = s_ctx.get();
+        ZSTD_CCtx_reset(ctx, ZSTD_reset_session_only);
+        ZSTD_CCtx_setParameter(ctx, ZSTD_c_compressionLevel, s_zstd_level);
+
+        // 原始大小写进帧头, 解压时可以一次分配
+        size_t total = 0;
+        for(size_t i = 0; i < count; ++i){
+            total += buffers[i].iov_len;
+        }
+        ZSTD_CCtx_setPledgedSrcSize(ctx, total);
+
+        std::string& buf = GetScratch(ZSTD_CStreamOutSize());
+        size_t i = 0;
+        do{
+            ZSTD_inBuffer input = {nullptr, 0, 0};
+            if(i < count){
+                input.src = buffers[i].iov_base;
+                input.size = buffers[i].iov_len;
+            }
+            ZSTD_EndDirective mode = (i + 1 >= count) ? ZSTD_e_end : ZSTD_e_continue;
+            bool finished = false;
+            do{
+                ZSTD_outBuffer output = {&buf[0], buf.size(), 0};
+                size_t rt = ZSTD_compressStream2(ctx, &output, &input, mode);
+                if(ZSTD_isError(rt)){
+                    CXK_LOG_ERROR(g_logger) << "zstd compress error: " << ZSTD_getErrorName(rt);
+                    return false;
+                }
+                out->write(buf.c_str(), output.pos);
+                finished = mode == ZSTD_e_end ? rt == 0 : input.pos == input.size;
+            } while(!finished);
+        } while(++i < count);
+        return true;
+    }
+
+    bool decompress(const iovec* buffers, size_t count, ByteArray::ptr out, uint64_t max_size = 0) override{
+        static thread_local std::unique_ptr<ZSTD_DCtx, size_t(*)(ZSTD_DCtx*)> s_ctx(ZSTD_createDCtx(), ZSTD_freeDCtx);
+        ZSTD_DCtx* ctx = s_ctx.get();
+        ZSTD_DCtx_reset(ctx, ZSTD_reset_session_only);
+
+        std::string& buf = GetScratch(ZSTD_DStreamOutSize());
+        // 0表示一个帧解压完成
+        size_t rt = 1;
+        uint64_t total = 0;
+        for(size_t i = 0; i < count; ++i){
+            ZSTD_inBuffer input = {buffers[i].iov_base, buffers[i].iov_len, 0};
+            bool more = false;
+            while(input.pos < input.size || more){
+                ZSTD_outBuffer output = {&buf[0], buf.size(), 0};
+                rt = ZSTD_decompressStream(ctx, &output, &input);
+                if(ZSTD_isError(rt)){
+                    CXK_LOG_ERROR(g_logger) << "zstd decompress error: " << ZSTD_getErrorName(rt);
+                    return false;
+                }
+                total += output.pos;
+                if(max_size && total > max_size){
+                    CXK_LOG_ERROR(g_logger) << "zstd decompressed size exceeds " << max_size;
+                    return false;
+                }
+                out->write(buf.c_str(), output.pos);
+                // 输出缓冲写满时可能还有数据没有输出
+                more = output.pos == output.size;
+            }
+        }
+        return rt == 0;
+    }
+
+    Compressor::ptr createCompressor() override{
+        return std::make_shared<ZstdCompressor>();
+    }
+};
+#endif
+
+
+#ifdef CXK_HAVE_LZ4
+/// @brief lz4帧格式, 和lz4命令行工具兼容, 上下文按线程复用
+class Lz4Codec : public CompressCodec{
+public:
+    // 每次交给LZ4F_compressUpdate的最大数据长度
+    static constexpr size_t CHUNK_SIZE = 64 * 1024;
+
+    Lz4Codec()
+        : CompressCodec(LZ4, "lz4"){
+    }
+
+    bool compress(const iovec* buffers, size_t count, ByteArray::ptr out) override{
+        static thread_local std::unique_ptr<LZ4F_cctx, LZ4F_errorCode_t(*)(LZ4F_cctx*)> s_ctx(CreateCCtx(), LZ4F_freeCompressionContext);
+        LZ4F_cctx* ctx = s_ctx.get();
+        if(!ctx){
+            return false;
+        }
+
+        LZ4F_preferences_t prefs;
+        memset(&prefs, 0, sizeof(prefs));
+        prefs.frameInfo.blockSizeID = LZ4F_max64KB;
+        for(size_t i = 0; i < count; ++i){
+            prefs.frameInfo.contentSize += buffers[i].iov_len;
+        }
+
+        std::string& buf = GetScratch(std::max(LZ4F_compressBound(CHUNK_SIZE, &prefs), (size_t)LZ4F_HEADER_SIZE_MAX));
+        size_t rt = LZ4F_compressBegin(ctx, &buf[0], buf.size(), &prefs);
+        if(LZ4F_isError(rt)){
+            CXK_LOG_ERROR(g_logger) << "lz4 compress error: " << LZ4F_getErrorName(rt);
+            return false;
+        }
+        out->write(buf.c_str(), rt);
+
+        for(size_t i = 0; i < count; ++i){
+            const char* src = (const char*)buffers[i].iov_base;
+            size_t left = buffers[i].iov_len;
+            while(left > 0){
+                size_t len = std::min(left, CHUNK_SIZE);
+                rt = LZ4F_compressUpdate(ctx, &buf[0], buf.size(), src, len, nullptr);
+                if(LZ4F_isError(rt)){
+                    CXK_LOG_ERROR(g_logger) << "lz4 compress error: " << LZ4F_getErrorName(rt);
+                    return false;
+                }
+                out->write(buf.c_str(), rt);
+                src += len;
+                left -= len;
+            }
+        }
+
+        rt = LZ4F_compressEnd(ctx, &buf[0], buf.size(), nullptr);
+        if(LZ4F_isError(rt)){
+            CXK_LOG_ERROR(g_logger) << "lz4 compress error: " << LZ4F_getErrorName(rt);
+            return false;
+        }
+        out->write(buf.c_str(), rt);
+        return true;
+    }
+
+    bool decompress(const iovec* buffers, size_t count, ByteArray::ptr out, uint64_t max_size = 0) override{
+        static thread_local std::unique_ptr<LZ4F_dctx, LZ4F_errorCode_t(*)(LZ4F_dctx*)> s_ctx(CreateDCtx(), LZ4F_freeDecompressionContext);
+        LZ4F_dctx* ctx = s_ctx.get();
+        if(!ctx){
+            return false;
+        }
+        LZ4F_resetDecompressionContext(ctx);
+
+        std::string& buf = GetScratch(CHUNK_SIZE);
+        // 0表示一个帧解压完成
+        size_t rt = 1;
+        uint64_t total = 0;
+        for(size_t i = 0; i < count; ++i){
+            const char* src = (const char*)buffers[i].iov_base;
+            size_t left = buffers[i].iov_len;
+            bool more = false;
+            while(left > 0 || more){
+                size_t dst_size = buf.size();
+                size_t src_size = left;
+                rt = LZ4F_decompress(ctx, &buf[0], &dst_size, src, &src_size, nullptr);
+                if(LZ4F_isError(rt)){
+                    CXK_LOG_ERROR(g_logger) << "lz4 decompress error: " << LZ4F_getErrorName(rt);
+                    return false;
+                }
+                total += dst_size;
+                if(max_size && total > max_size){
+                    CXK_LOG_ERROR(g_logger) << "lz4 decompressed size exceeds " << max_size;
+                    return false;
+                }
+                out->write(buf.c_str(), dst_size);
+                src += src_size;
+                left -= src_size;
+                // 输出缓冲写满时可能还有数据没有输出
+                more = dst_size == buf.size();
+                if(src_size == 0 && dst_size == 0){
+                    break;
+                }
+            }
+        }
+        return rt == 0;
+    }
+
+private:
+    static LZ4F_cctx* CreateCCtx(){
+        LZ4F_cctx* ctx = nullptr;
+        if(LZ4F_isError(LZ4F_createCompressionContext(&ctx, LZ4F_VERSION))){
+            return nullptr;
+        }
+        return ctx;
+    }
+
+    static LZ4F_dctx* CreateDCtx(){
+        LZ4F_dctx* ctx = nullptr;
+        if(LZ4F_isError(LZ4F_createDecompressionContext(&ctx, LZ4F_VERSION))){
+            return nullptr;
+        }
+        return ctx;
+    }
+};
+#endif
+
+
+// 编解码器按Type下标存放, 没有编译进来的为nullptr
+static CompressCodec::ptr* GetCodecs(){
+    static CompressCodec::ptr s_codecs[CompressCodec::TYPE_COUNT] = {
+        nullptr,
+        std::make_shared<ZlibCodec>(CompressCodec::GZIP, "gzip", ZlibStream::GZIP),
+#ifdef CXK_HAVE_ZSTD
+        std::make_shared<ZstdCodec>(),
+#else
+        nullptr,
+#endif
+#ifdef CXK_HAVE_LZ4
+        std::make_shared<Lz4Codec>(),
+#else
+        nullptr,
+#endif
+        std::make_shared<ZlibCodec>(CompressCodec::DEFLATE, "deflate", ZlibStream::DEFLATE)
+    };
+    return s_codecs;
+}
+
+
+CompressCodec::ptr CompressCodec::Get(Type type){
+    if(type <= NONE || type >= TYPE_COUNT){
+        return nullptr;
+    }
+    return GetCodecs()[type];
+}
+
+
+CompressCodec::ptr CompressCodec::Get(const std::string& name){
+    CompressCodec::ptr* codecs = GetCodecs();
+    for(int i = 0; i < TYPE_COUNT; ++i){
+        if(codecs[i] && strcasecmp(codecs[i]->getName().c_str(), name.c_str()) == 0){
+            return codecs[i];
+        }
+    }
+    return nullptr;
+}
+
+
+bool CompressCodec::compress(ByteArray::ptr in, ByteArray::ptr out){
+    std::vector<iovec> buffers;
+    in->getReadBuffers(buffers, in->getReadSize(), in->getPosition());
+    return compress(buffers.data(), buffers.size(), out);
+}
+
+
+bool CompressCodec::decompress(ByteArray::ptr in, ByteArray::ptr out, uint64_t max_size){
+    std::vector<iovec> buffers;
+    in->getReadBuffers(buffers, in->getReadSize(), in->getPosition());
+    return decompress(buffers.data(), buffers.size(), out, max_size);
+}
+
+
+bool CompressCodec::compress(const std::string& in, std::string& out){
+    iovec buffer;
+    buffer.iov_base = (void*)in.c_str();
+    buffer.iov_len = in.size();
+    ByteArray::ptr ba(new ByteArray);
+    if(!compress(&buffer, 1, ba)){
+        return false;
+    }
+    ba->setPosition(0);
+    out = ba->toString();
+    return true;
+}
+
+
+bool CompressCodec::decompress(const std::string& in, std::string& out, uint64_t max_size){
+    iovec buffer;
+    buffer.iov_base = (void*)in.c_str();
+    buffer.iov_len = in.size();
+    ByteArray::ptr ba(new ByteArray);
+    if(!decompress(&buffer, 1, ba, max_size)){
+        return false;
+    }
+    ba->setPosition(0);
+    out = ba->toString();
+    return true;
+}
+
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include "cxk/bytearray.h"
+#include <sys/uio.h>
+#include <memory>
+#include <string>
+
+
+namespace cxk{
+
+/// @brief 压缩算法的抽象, 一次压缩/解压一个完整的消息
+/// @details 编解码器是无状态的单例, 压缩上下文按线程复用。
+///          zstd和lz4在编译时找到对应的库才可用(CXK_HAVE_ZSTD/CXK_HAVE_LZ4)
+class CompressCodec{
+public:
+    using ptr = std::shared_ptr<CompressCodec>;
+
+    /// @brief 压缩算法, 取值用于Rock协议头的flag, 不能修改
+    enum Type{
+        NONE = 0,
+        GZIP = 1,
+        ZSTD = 2,
+        LZ4 = 3,
+        DEFLATE = 4,
+        TYPE_COUNT
+    };
+
+    /// @brief 流式压缩器, 分多次输入数据, 每次取出已经压缩好的部分
+    /// @details 持有自己的压缩上下文, 可以跨协程切换使用, 不能多线程同时使用
+    class Compressor{
+    public:
+        using ptr = std::shared_ptr<Compressor>;
+        virtual ~Compressor() {}
+
+        /// @brief          输入数据
+        /// @param out      已经压缩好的数据追加到out, 可能没有输出
+        /// @return         是否成功
+        virtual bool update(const void* data, size_t len, std::string& out) = 0;
+
+        /// @brief          结束压缩, 剩余的数据追加到out
+        virtual bool finish(std::string& out) = 0;
+    };
+
+    virtual ~CompressCodec() {}
+
+    /// @brief          压缩数据
+    /// @param buffers  待压缩的数据
+    /// @param count    iovec数量
+    /// @param out      结果写到out的当前位置, 之后out的位置在结果末尾
+    /// @return         是否成功
+    virtual bool compress(const iovec* buffers, size_t count, ByteArray::ptr out) = 0;
+
+    /// @brief          解压数据, 参数同compress
+    /// @param max_size 解压结果的大小上限, 0不限制。超过时立即停止解压并返回false,
+    ///                 防止很小的压缩数据解压出巨大的结果
+    /// @return         是否成功, 数据损坏、不完整或者超过max_size返回false
+    virtual bool decompress(const iovec* buffers, size_t count, ByteArray::ptr out, uint64_t max_size = 0) = 0;
+
+    /// @brief          创建流式压缩器
+    /// @return         不支持流式压缩返回nullptr
+    virtual Compressor::ptr createCompressor() { return nullptr; }
+
+    /// @brief          压缩in中从当前位置开始的全部数据, 不改变in的位置
+    bool compress(ByteArray::ptr in, ByteArray::ptr out);
+
+    /// @brief          解压in中从当前位置开始的全部数据, 不改变in的位置
+    bool decompress(ByteArray::ptr in, ByteArray::ptr out, uint64_t max_size = 0);
+
+    /// @brief          压缩字符串
+    bool compress(const std::string& in, std::string& out);
+
+    /// @brief          解压字符串
+    bool decompress(const std::string& in, std::string& out, uint64_t max_size = 0);
+
+    Type getType() const { return m_type; }
+
+    /// @brief          名称, 同HTTP的Content-Encoding
+    const std::string& getName() const { return m_name; }
+
+    /// @brief          获取编解码器
+    /// @return         不支持或者没有编译进来返回nullptr
+    static CompressCodec::ptr Get(Type type);
+
+    /// @brief          根据名称(不区分大小写)获取编解码器, 如"gzip"、"zstd"
+    static CompressCodec::ptr Get(const std::string& name);
+
+protected:
+    CompressCodec(Type type, const std::string& name)
+        : m_type(type)
+        , m_name(name){
+    }
+
+private:
+    Type m_type;
+    std::string m_name;
+};
+
+}
@@ -56,6 +56,18 @@ int SocketStream::write(ByteArray::ptr ba, size_t length) {
 }
 
 
+int SocketStream::readv(const iovec* buffers, size_t count){
+    if(!isConnected()) return -1;
+    return m_socket->recv((iovec*)buffers, count);
+}
+
+
+int SocketStream::writev(const iovec* buffers, size_t count){
+    if(!isConnected()) return -1;
+    return m_socket->send(buffers, count);
+}
+
+
 bool SocketStream::isConnected() const{
     return m_socket && m_socket->isConnected();
 }
@@ -50,6 +50,12 @@ public:
     /// @return         @retval >= 0  写的数据大小, @retval < 0  出错
     virtual int write(ByteArray::ptr ba, size_t length) override;
 
+    /// @brief          分散读数据, 一次recvmsg填充多个iovec
+    virtual int readv(const iovec* buffers, size_t count) override;
+
+    /// @brief          聚集写数据, 一次sendmsg写出多个iovec
+    virtual int writev(const iovec* buffers, size_t count) override;
+
 
     /// @brief          是否连接
     bool isConnected() const;
@@ -1,9 +1,77 @@
 #include "zlib_stream.h"
 #include "cxk/macro.h"
+#include "cxk/config.h"
+#include <unordered_map>
 
 
 namespace cxk{
 
+static cxk::ConfigVar<uint32_t>::ptr g_zlib_pool_thread_cache =
+    cxk::Config::Lookup("zlib.pool.thread_cache_count", (uint32_t)4,
+            "max zlib contexts cached per parameter set per thread");
+
+static uint32_t s_zlib_pool_thread_cache = 4;
+
+struct _ZlibPoolIniter{
+    _ZlibPoolIniter(){
+        s_zlib_pool_thread_cache = g_zlib_pool_thread_cache->getValue();
+        g_zlib_pool_thread_cache->addListener([](const uint32_t& old_val, const uint32_t& new_val){
+            s_zlib_pool_thread_cache = new_val;
+        });
+    }
+};
+
+static _ZlibPoolIniter s_zlib_pool_initer;
+
+
+/// @brief 线程本地的zlib上下文池, 每个上下文deflateInit2/inflateInit2需要分配两三百KB内存,
+///        按压缩/解压和初始化参数分组, 放回时重置状态, 线程退出时释放
+struct ZlibContextPool{
+    ~ZlibContextPool();
+
+    static bool IsEncode(uint32_t key){ return key >> 31; }
+
+    static void End(uint32_t key, z_stream* z){
+        if(IsEncode(key)){
+            deflateEnd(z);
+        } else {
+            inflateEnd(z);
+        }
+        delete z;
+    }
+
+    std::unordered_map<uint32_t, std::vector<z_stream*>> contexts;
+};
+
+// 上下文池析构之后, 其他线程局部对象析构时归还的上下文直接释放
+static thread_local bool t_zlib_pool_destroyed = false;
+
+ZlibContextPool::~ZlibContextPool(){
+    for(auto& i : contexts){
+        for(auto& z : i.second){
+            End(i.first, z);
+        }
+    }
+    t_zlib_pool_destroyed = true;
+}
+
+static ZlibContextPool* GetZlibContextPool(){
+    if(t_zlib_pool_destroyed){
+        return nullptr;
+    }
+    static thread_local ZlibContextPool s_pool;
+    return &s_pool;
+}
+
+// 编码上下文参数, 解压只和window_bits有关
+static uint32_t MakeContextKey(bool encode, int level, int window_bits, int memlevel, int strategy){
+    uint32_t key = (uint32_t)(window_bits + 64) & 0xff;
+    if(encode){
+        key |= (1u << 31) | ((uint32_t)(level + 1) << 8) | ((uint32_t)memlevel << 16) | ((uint32_t)strategy << 24);
+    }
+    return key;
+}
+
 
 ZlibStream::ptr ZlibStream::CreateGzip(bool encode, std::uint32_t buff_size){
     return Create(encode, buff_size, GZIP);
@@ -37,19 +105,30 @@ ZlibStream::ZlibStream(bool encode, std::uint32_t buff_size) : m_buffsize(buff_s
 
 ZlibStream::~ZlibStream(){
     // 是否需要释放内存
+    // 已经交给ByteArray共享的缓冲由引用计数释放
     if(m_free){
-        for(auto& i : m_buffs){
-            free(i.iov_base);
+        for(size_t i = m_blocks.size(); i < m_buffs.size(); ++i){
+            free(m_buffs[i].iov_base);
         }
     }
 
-    if(m_encode){
-        // 压缩操作释放资源
-        deflateEnd(&m_zstream);
+    releaseContext();
+}
+
+
+void ZlibStream::releaseContext(){
+    if(!m_zstream){
+        return;
+    }
+    ZlibContextPool* pool = GetZlibContextPool();
+    std::vector<z_stream*>* contexts = pool ? &pool->contexts[m_contextKey] : nullptr;
+    if(contexts && contexts->size() < s_zlib_pool_thread_cache
+            && (m_encode ? deflateReset(m_zstream) : inflateReset(m_zstream)) == Z_OK){
+        contexts->push_back(m_zstream);
     } else {
-        // 解压操作释放资源
-        inflateEnd(&m_zstream);
+        ZlibContextPool::End(m_contextKey, m_zstream);
     }
+    m_zstream = nullptr;
 }
 
 
@@ -116,25 +195,39 @@ std::string ZlibStream::getResult() const {
 
 cxk::ByteArray::ptr ZlibStream::getByteArray(){
     cxk::ByteArray::ptr ba(new cxk::ByteArray);
-    for(auto& i : m_buffs){
-        ba->write(i.iov_base, i.iov_len);
+    // 输出缓冲直接作为ByteArray的内存块, 不拷贝数据
+    for(size_t i = 0; i < m_buffs.size(); ++i){
+        if(i == m_blocks.size()){
+            if(m_free){
+                m_blocks.emplace_back((char*)m_buffs[i].iov_base, free);
+            } else {
+                m_blocks.emplace_back((char*)m_buffs[i].iov_base, [](char*){});
+            }
+        }
+        ba->appendBlock(m_blocks[i], m_buffs[i].iov_len);
     }
     ba->setPosition(0);
     return ba;
 }
 
 
+void ZlibStream::takeResult(std::string& out){
+    for(size_t i = 0; i < m_buffs.size(); ++i){
+        out.append((const char*)m_buffs[i].iov_base, m_buffs[i].iov_len);
+        if(m_free && i >= m_blocks.size()){
+            free(m_buffs[i].iov_base);
+        }
+    }
+    m_buffs.clear();
+    m_blocks.clear();
+}
+
+
 int ZlibStream::init(Type type, int level ,int window_bits, int memlevel, Strategy strategy){
     CXK_ASSERT((level >= 0 && level <= 9) || level == DEFAULT_COMPRESSION );
     CXK_ASSERT(window_bits >= 8 && window_bits <= 15);
     CXK_ASSERT(memlevel >= 1 && memlevel <= 9);
 
-    memset(&m_zstream, 0, sizeof(m_zstream));
-
-    m_zstream.zalloc = Z_NULL;
-    m_zstream.zfree = Z_NULL;
-    m_zstream.opaque = Z_NULL;
-
     switch(type){
         case DEFLATE:
             window_bits = -window_bits;
@@ -147,23 +240,50 @@ int ZlibStream::init(Type type, int level ,int window_bits, int memlevel, Strate
             break;
     }
 
+    m_contextKey = MakeContextKey(m_encode, level, window_bits, memlevel, strategy);
+    ZlibContextPool* pool = GetZlibContextPool();
+    if(pool){
+        std::vector<z_stream*>& contexts = pool->contexts[m_contextKey];
+        if(!contexts.empty()){
+            m_zstream = contexts.back();
+            contexts.pop_back();
+            return Z_OK;
+        }
+    }
+
+    z_stream* z = new z_stream;
+    memset(z, 0, sizeof(z_stream));
+    z->zalloc = Z_NULL;
+    z->zfree = Z_NULL;
+    z->opaque = Z_NULL;
+
+    int rt = 0;
     if(m_encode){
-        return deflateInit2(&m_zstream, level, Z_DEFLATED, window_bits, memlevel, (int)strategy);
+        rt = deflateInit2(z, level, Z_DEFLATED, window_bits, memlevel, (int)strategy);
     } else {
-        return inflateInit2(&m_zstream, window_bits);
+        rt = inflateInit2(z, window_bits);
     }
+    if(rt != Z_OK){
+        delete z;
+        return rt;
+    }
+    m_zstream = z;
+    return Z_OK;
 }
 
     
 int ZlibStream::encode(const iovec* v, const uint64_t& size, bool finish){
+    if(!m_zstream){
+        return Z_STREAM_ERROR;
+    }
     int ret = 0;
     int flush = 0;
 
     // 遍历所有的数据块进行压缩操作
     for(uint64_t i = 0; i < size; ++i){
         // 指定下一次压缩的数据长度和数据指针位置
-        m_zstream.avail_in = v[i].iov_len;
-        m_zstream.next_in = (Bytef*)v[i].iov_base;
+        m_zstream->avail_in = v[i].iov_len;
+        m_zstream->next_in = (Bytef*)v[i].iov_base;
 
         // 判断是否在最后一个数据库结束后完成压缩操作
         flush = finish ? (i == size - 1 ? Z_FINISH : Z_NO_FLUSH) : Z_NO_FLUSH;
@@ -182,34 +302,37 @@ int ZlibStream::encode(const iovec* v, const uint64_t& size, bool finish){
             }
 
             // 设置输出缓存区域大小和位置
-            m_zstream.avail_out = m_buffsize - ivc->iov_len;
-            m_zstream.next_out = (Bytef*)ivc->iov_base + ivc->iov_len;
+            m_zstream->avail_out = m_buffsize - ivc->iov_len;
+            m_zstream->next_out = (Bytef*)ivc->iov_base + ivc->iov_len;
 
             // 执行压缩操作
-            ret = deflate(&m_zstream, flush);
+            ret = deflate(m_zstream, flush);
             if(ret == Z_STREAM_ERROR){
                 return ret;
             }
 
             // 更新输出缓存区域大小和数据长度
-            ivc->iov_len = m_buffsize - m_zstream.avail_out;
-        }while(m_zstream.avail_out == 0);   // 输出缓冲区已满时，继续循环压缩操作
+            ivc->iov_len = m_buffsize - m_zstream->avail_out;
+        }while(m_zstream->avail_out == 0);   // 输出缓冲区已满时，继续循环压缩操作
     }
 
     if(flush == Z_FINISH){
-        // 压缩完成释放资源
-        deflateEnd(&m_zstream);
+        // 压缩完成, 上下文放回上下文池
+        releaseContext();
     }
     return Z_OK;
 }
 
 
 int ZlibStream::decode(const iovec* v, const uint64_t& size, bool finish){
+    if(!m_zstream){
+        return Z_STREAM_ERROR;
+    }
     int ret = 0;
     int flush = 0;
     for(uint64_t i = 0; i < size; ++i) {
-        m_zstream.avail_in = v[i].iov_len;
-        m_zstream.next_in = (Bytef*)v[i].iov_base;
+        m_zstream->avail_in = v[i].iov_len;
+        m_zstream->next_in = (Bytef*)v[i].iov_base;
 
         flush = finish ? (i == size - 1 ? Z_FINISH : Z_NO_FLUSH) : Z_NO_FLUSH;
 
@@ -225,19 +348,25 @@ int ZlibStream::decode(const iovec* v, const uint64_t& size, bool finish){
                 ivc = &m_buffs.back();
             }
 
-            m_zstream.avail_out = m_buffsize - ivc->iov_len;
-            m_zstream.next_out = (Bytef*)ivc->iov_base + ivc->iov_len;
+            m_zstream->avail_out = m_buffsize - ivc->iov_len;
+            m_zstream->next_out = (Bytef*)ivc->iov_base + ivc->iov_len;
 
-            ret = inflate(&m_zstream, flush);
-            if(ret == Z_STREAM_ERROR) {
+            ret = inflate(m_zstream, flush);
+            // 数据损坏时返回错误, 避免把不完整的结果当作解压成功
+            if(ret == Z_STREAM_ERROR || ret == Z_DATA_ERROR || ret == Z_NEED_DICT || ret == Z_MEM_ERROR) {
                 return ret;
             }
-            ivc->iov_len = m_buffsize - m_zstream.avail_out;
-        } while(m_zstream.avail_out == 0);
+            m_outputSize += m_buffsize - m_zstream->avail_out - ivc->iov_len;
+            ivc->iov_len = m_buffsize - m_zstream->avail_out;
+            // 超过上限立即停止, 压缩炸弹不会继续占用内存
+            if(isOutputExceeded()) {
+                return Z_BUF_ERROR;
+            }
+        } while(m_zstream->avail_out == 0);
     }
 
     if(flush == Z_FINISH) {
-        inflateEnd(&m_zstream);
+        releaseContext();
     }
     return Z_OK;
 }
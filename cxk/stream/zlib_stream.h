@@ -46,6 +46,9 @@ public:
     static ZlibStream::ptr CreateGzip(bool encode, std::uint32_t buff_size = 4096);
     static ZlibStream::ptr CreateDeflate(bool encode, std::uint32_t buff_size = 4096);
     static ZlibStream::ptr CreateZlib(bool encode, std::uint32_t buff_size = 4096);
+    /// @brief 创建压缩/解压流
+    /// @details zlib上下文从当前线程的上下文池中取出, 相同参数的上下文deflateReset/inflateReset后重复使用,
+    ///          流结束或者析构时放回当前线程的上下文池
     static ZlibStream::ptr Create(bool encode, std::uint32_t buff_size = 4096, Type type = DEFLATE, int level = DEFAULT_COMPRESSION, int window_bits = 15, 
         int memlevel = 8, Strategy strategy = DEFAULT);
 
@@ -73,6 +76,15 @@ public:
 
     cxk::ByteArray::ptr getByteArray();
 
+    /// @brief 解压输出的大小上限, 0不限制, 超过时write/flush返回Z_BUF_ERROR
+    void setMaxOutput(uint64_t v) { m_maxOutput = v; }
+
+    /// @brief 是否因为超过解压输出上限而失败
+    bool isOutputExceeded() const { return m_maxOutput && m_outputSize > m_maxOutput; }
+
+    /// @brief 把已经输出的数据追加到out, 然后清空输出缓冲, 用于边压缩边发送
+    void takeResult(std::string& out);
+
 private:
     int init(Type type = DEFLATE, int level = DEFAULT_COMPRESSION
         ,int window_bits = 15, int memlevel = 8, Strategy strategy = DEFAULT);
@@ -80,12 +92,23 @@ private:
     int encode(const iovec* v, const uint64_t& size, bool finish);
     int decode(const iovec* v, const uint64_t& size, bool finish);
 
+    /// @brief 把zlib上下文放回上下文池
+    void releaseContext();
+
 private:
-    z_stream m_zstream;
+    // 池化的zlib上下文, 流结束后为nullptr
+    z_stream* m_zstream = nullptr;
+    // 上下文参数, 作为上下文池的键
+    uint32_t m_contextKey = 0;
     std::uint32_t m_buffsize;
     bool m_encode;
     bool m_free;
     std::vector<iovec> m_buffs;
+    // getByteArray时交给ByteArray共享的缓冲, 和m_buffs前面的部分一一对应
+    std::vector<std::shared_ptr<char>> m_blocks;
+    // 解压输出的大小上限和已经输出的大小
+    uint64_t m_maxOutput = 0;
+    uint64_t m_outputSize = 0;
 };
 
 
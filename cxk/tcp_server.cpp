@@ -1,15 +1,35 @@
 #include "tcp_server.h"
 #include "config.h"
 #include "logger.h"
+#include "util.h"
+#include <linux/filter.h>
 
 namespace cxk{
 
 static cxk::ConfigVar<uint64_t>::ptr g_tcp_server_read_timeout = cxk::Config::Lookup("tcp_server.read_timeout", (uint64_t)(60 * 1000 * 2), "tcp server read timeout");
 
+static cxk::ConfigVar<uint32_t>::ptr g_tcp_server_max_connections = cxk::Config::Lookup("tcp_server.max_connections", (uint32_t)0, "tcp server max connections, 0 for unlimited");
+
+static cxk::ConfigVar<uint32_t>::ptr g_tcp_server_accept_backoff_queue = cxk::Config::Lookup("tcp_server.accept_backoff_queue", (uint32_t)0, "tcp server pause accept when worker has so many pending tasks, 0 for never");
+
+static cxk::ConfigVar<uint32_t>::ptr g_tcp_server_accept_backoff_time = cxk::Config::Lookup("tcp_server.accept_backoff_time", (uint32_t)10, "tcp server accept pause time ms");
+
+static cxk::ConfigVar<uint32_t>::ptr g_tcp_server_max_queue_time = cxk::Config::Lookup("tcp_server.max_queue_time", (uint32_t)0, "tcp server drop connections waiting in worker queue longer than this ms, 0 for never");
+
+static cxk::ConfigVar<int32_t>::ptr g_tcp_server_reuseport = cxk::Config::Lookup("tcp_server.reuseport", (int32_t)0, "tcp server SO_REUSEPORT listeners per address, -1 for one per accept thread, 0 for off");
+
+static cxk::ConfigVar<bool>::ptr g_tcp_server_reuseport_cbpf = cxk::Config::Lookup("tcp_server.reuseport_cbpf", false, "tcp server steer connections to SO_REUSEPORT listeners by cpu");
+
 static cxk::Logger::ptr g_logger = CXK_LOG_NAME("system");
 
 TcpServer::TcpServer(IOManager* worker,  IOManager* acceptWorker) : m_worker(worker),
-        m_acceptWorker(acceptWorker) , m_readTimeOut(g_tcp_server_read_timeout->getValue()), m_name("cxk/1.0.0"), m_isStop(true){
+        m_acceptWorker(acceptWorker) , m_readTimeOut(g_tcp_server_read_timeout->getValue()), m_name("cxk/1.0.0"), m_isStop(true)
+        , m_maxConnections(g_tcp_server_max_connections->getValue())
+        , m_acceptBackoffQueue(g_tcp_server_accept_backoff_queue->getValue())
+        , m_acceptBackoffTime(std::max(g_tcp_server_accept_backoff_time->getValue(), 1u))
+        , m_maxQueueTime(g_tcp_server_max_queue_time->getValue())
+        , m_reusePort(g_tcp_server_reuseport->getValue())
+        , m_reusePortCbpf(g_tcp_server_reuseport_cbpf->getValue()){
 
 }
 
@@ -22,6 +42,21 @@ TcpServer::~TcpServer(){
 
 void TcpServer::setConf(const TcpServerConf& v) {
     m_conf.reset(new TcpServerConf(v));
+    if(v.max_connections > 0){
+        setMaxConnections(v.max_connections);
+    }
+    if(v.accept_backoff_queue > 0){
+        setAcceptBackoffQueue(v.accept_backoff_queue);
+    }
+    if(v.max_queue_time > 0){
+        setMaxQueueTime(v.max_queue_time);
+    }
+    if(v.reuseport){
+        m_reusePort = v.reuseport;
+    }
+    if(v.reuseport_cbpf){
+        m_reusePortCbpf = v.reuseport_cbpf > 0;
+    }
 }
 
 bool TcpServer::bind(cxk::Address::ptr addr, bool ssl){
@@ -35,20 +70,45 @@ bool TcpServer::bind(cxk::Address::ptr addr, bool ssl){
 bool TcpServer::bind(const std::vector<cxk::Address::ptr>& addrs, std::vector<cxk::Address::ptr> fails, bool ssl){
     m_ssl = ssl;
     for(auto& addr : addrs){
-        Socket::ptr sock = ssl ? SSLSocket::CreateTCP(addr) : Socket::CreateTCP(addr);
-        if(!sock->bind(addr)){
-            CXK_LOG_ERROR(g_logger) << "bind " << addr->toString() << " failed";
-            fails.push_back(addr);
-            continue;
+        // unix地址bind时会删除已有的文件, 只能有一个监听socket
+        bool reuse = m_reusePort && std::dynamic_pointer_cast<IPAddress>(addr);
+        size_t count = 1;
+        if(reuse && m_reusePort > 0){
+            count = m_reusePort;
+        } else if(reuse){
+            count = std::max<size_t>(m_acceptWorker->getThreadCount(), 1);
+        }
+
+        std::vector<Socket::ptr> socks;
+        Address::ptr bind_addr = addr;
+        for(size_t i = 0; i < count; ++i){
+            Socket::ptr sock = ssl ? SSLSocket::CreateTCP(addr) : Socket::CreateTCP(addr);
+            if(reuse && !sock->setReusePort()){
+                CXK_LOG_ERROR(g_logger) << "set SO_REUSEPORT " << addr->toString() << " failed";
+                break;
+            }
+            if(!sock->bind(bind_addr)){
+                CXK_LOG_ERROR(g_logger) << "bind " << addr->toString() << " failed";
+                break;
+            }
+
+            if(!sock->listen()){
+                CXK_LOG_ERROR(g_logger) << "listen " << addr->toString() << " failed";
+                break;
+            }
+            // 端口为0时后面的socket要绑定到第一个socket分配到的端口
+            bind_addr = sock->getLocalAddress();
+            socks.push_back(sock);
         }
 
-        if(!sock->listen()){
-            CXK_LOG_ERROR(g_logger) << "listen " << addr->toString() << " failed";
+        if(socks.size() != count){
             fails.push_back(addr);
             continue;
         }
-
-        m_socks.push_back(sock);
+        if(count > 1 && m_reusePortCbpf){
+            attachReusePortCbpf(socks[0], count);
+        }
+        m_socks.insert(m_socks.end(), socks.begin(), socks.end());
     }
 
     if(!fails.empty()){
@@ -111,15 +171,75 @@ void TcpServer::handleClient(Socket::ptr client){
 }
 
 
+bool TcpServer::attachReusePortCbpf(Socket::ptr sock, uint32_t count){
+#ifdef SO_ATTACH_REUSEPORT_CBPF
+    // A = cpu; A %= count; return A
+    // 返回值是socket在组中的下标(按listen的顺序), 超出范围时内核退回到哈希分配
+    struct sock_filter code[] = {
+        {BPF_LD | BPF_W | BPF_ABS, 0, 0, (uint32_t)(SKF_AD_OFF + SKF_AD_CPU)},
+        {BPF_ALU | BPF_MOD | BPF_K, 0, 0, count},
+        {BPF_RET | BPF_A, 0, 0, 0},
+    };
+    struct sock_fprog prog;
+    prog.len = sizeof(code) / sizeof(code[0]);
+    prog.filter = code;
+    if(sock->setOption(SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, prog)){
+        return true;
+    }
+    CXK_LOG_WARN(g_logger) << "attach reuseport cbpf failed, errno=" << errno
+        << " errstr=" << strerror(errno) << ": " << sock;
+#else
+    CXK_LOG_WARN(g_logger) << "SO_ATTACH_REUSEPORT_CBPF not supported: " << sock;
+#endif
+    return false;
+}
+
+
+void TcpServer::handleOverload(Socket::ptr client){
+    client->close();
+}
+
+
+void TcpServer::onClient(Socket::ptr client, uint64_t accept_ms){
+    // 排队太久的连接对方可能已经超时放弃, 处理它只会让后面的连接等得更久
+    uint32_t max_queue_time = getMaxQueueTime();
+    if(max_queue_time && cxk::GetCurrentMS() - accept_ms > max_queue_time){
+        ++m_shed;
+        CXK_LOG_LIMIT_WARN(g_logger, 10) << "shed connection waiting " << (cxk::GetCurrentMS() - accept_ms)
+            << "ms in worker queue: " << client;
+        handleOverload(client);
+    } else {
+        handleClient(client);
+    }
+    --m_connections;
+}
+
+
 
 void TcpServer::startAccept(Socket::ptr sock){
     while(!m_isStop){
+        // 工作调度器积压时暂停accept, 新连接留在内核的backlog中, 不再放大队列
+        uint32_t backoff_queue = getAcceptBackoffQueue();
+        if(backoff_queue && m_worker->getTaskCount() >= backoff_queue){
+            ++m_backoffs;
+            usleep(m_acceptBackoffTime * 1000);
+            continue;
+        }
+
         Socket::ptr client = sock->accept();
         if(client){
+            uint32_t max_connections = getMaxConnections();
+            if(max_connections && m_connections >= max_connections){
+                ++m_rejected;
+                CXK_LOG_LIMIT_WARN(g_logger, 10) << "too many connections, reject: " << client;
+                handleOverload(client);
+                continue;
+            }
+            ++m_connections;
             client->setRecvTimeout(m_readTimeOut);
-            m_worker->schedule(std::bind(&TcpServer::handleClient, shared_from_this(), client));
+            m_worker->schedule(std::bind(&TcpServer::onClient, shared_from_this(), client, cxk::GetCurrentMS()));
         } else {
-            CXK_LOG_ERROR(g_logger) << "accept failed";
+            CXK_LOG_LIMIT_ERROR(g_logger, 10) << "accept failed";
         }
 
     }
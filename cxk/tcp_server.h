@@ -1,4 +1,5 @@
 #pragma once
+#include <atomic>
 #include <memory>
 #include <functional>
 #include "iomanager.h"
@@ -26,6 +27,14 @@ struct TcpServerConf{
     std::string key_file;
     std::string accept_worker;
     std::string process_worker;
+    // 过载保护, 为0时使用tcp_server.*配置
+    int max_connections = 0;
+    int accept_backoff_queue = 0;
+    int max_queue_time = 0;
+    // 每个地址的SO_REUSEPORT监听socket数, -1每个accept线程一个, 0使用tcp_server.reuseport配置
+    int reuseport = 0;
+    // 按处理连接的CPU选择监听socket, 0使用tcp_server.reuseport_cbpf配置
+    int reuseport_cbpf = 0;
     std::map<std::string, std::string> args;
 
     bool isValid() const{
@@ -43,6 +52,11 @@ struct TcpServerConf{
             key_file == conf.key_file &&
             accept_worker == conf.accept_worker &&
             process_worker == conf.process_worker &&
+            max_connections == conf.max_connections &&
+            accept_backoff_queue == conf.accept_backoff_queue &&
+            max_queue_time == conf.max_queue_time &&
+            reuseport == conf.reuseport &&
+            reuseport_cbpf == conf.reuseport_cbpf &&
             args == conf.args &&
             id == conf.id &&
             type == conf.type;
@@ -66,6 +80,11 @@ TcpServerConf operator()(const std::string& v){
         conf.key_file = node["key_file"].as<std::string>(conf.key_file);
         conf.accept_worker = node["accept_worker"].as<std::string>();
         conf.process_worker = node["process_worker"].as<std::string>();
+        conf.max_connections = node["max_connections"].as<int>(conf.max_connections);
+        conf.accept_backoff_queue = node["accept_backoff_queue"].as<int>(conf.accept_backoff_queue);
+        conf.max_queue_time = node["max_queue_time"].as<int>(conf.max_queue_time);
+        conf.reuseport = node["reuseport"].as<int>(conf.reuseport);
+        conf.reuseport_cbpf = node["reuseport_cbpf"].as<int>(conf.reuseport_cbpf);
         conf.args = LexicalCast<std::string, std::map<std::string, std::string>>()(node["args"].as<std::string>(""));
 
         if(node["address"].IsDefined()){
@@ -94,6 +113,11 @@ public:
         node["key_file"] = conf.key_file;
         node["accept_worker"] = conf.accept_worker;
         node["process_worker"] = conf.process_worker;
+        node["max_connections"] = conf.max_connections;
+        node["accept_backoff_queue"] = conf.accept_backoff_queue;
+        node["max_queue_time"] = conf.max_queue_time;
+        node["reuseport"] = conf.reuseport;
+        node["reuseport_cbpf"] = conf.reuseport_cbpf;
         node["args"] = YAML::Load(LexicalCast<std::map<std::string, std::string>, std::string>()(conf.args));
         for(auto& i : conf.address){
             node["address"].push_back(i);
@@ -162,19 +186,75 @@ public:
     /// @brief      是否停止
     bool isStop() const { return m_isStop; }
 
+    /// @brief      最大连接数, 达到后新连接交给handleOverload, 0不限制
+    uint32_t getMaxConnections() const { return m_maxConnections.load(std::memory_order_relaxed); }
+    void setMaxConnections(uint32_t v) { m_maxConnections.store(v, std::memory_order_relaxed); }
+
+    /// @brief      工作调度器等待执行的任务数达到该值时暂停accept, 0不限制
+    uint32_t getAcceptBackoffQueue() const { return m_acceptBackoffQueue.load(std::memory_order_relaxed); }
+    void setAcceptBackoffQueue(uint32_t v) { m_acceptBackoffQueue.store(v, std::memory_order_relaxed); }
+
+    /// @brief      连接在工作调度器队列中等待超过该时间(毫秒)时不再处理, 交给handleOverload, 0不限制
+    uint32_t getMaxQueueTime() const { return m_maxQueueTime.load(std::memory_order_relaxed); }
+    void setMaxQueueTime(uint32_t v) { m_maxQueueTime.store(v, std::memory_order_relaxed); }
+
+    /// @brief      每个地址的SO_REUSEPORT监听socket数, -1每个accept线程一个, 0不使用SO_REUSEPORT
+    /// @details    每个监听socket有自己的accept协程和内核accept队列, 新连接由内核分到各个socket。
+    ///             在bind之前设置, unix地址不受影响
+    int getReusePort() const { return m_reusePort; }
+    void setReusePort(int v) { m_reusePort = v; }
+
+    /// @brief      是否给SO_REUSEPORT监听socket挂载cBPF程序, 按处理SYN的CPU选择socket(CPU编号对socket数取模)
+    /// @details    默认按四元组哈希分配。在bind之前设置
+    bool isReusePortCbpf() const { return m_reusePortCbpf; }
+    void setReusePortCbpf(bool v) { m_reusePortCbpf = v; }
+
+    /// @brief      当前正在处理的连接数
+    uint64_t getConnectionCount() const { return m_connections; }
+
+    /// @brief      因为超过最大连接数被拒绝的连接数
+    uint64_t getRejectedCount() const { return m_rejected; }
+
+    /// @brief      因为排队太久被丢弃的连接数
+    uint64_t getShedCount() const { return m_shed; }
+
+    /// @brief      因为工作调度器积压暂停accept的次数
+    uint64_t getBackoffCount() const { return m_backoffs; }
+
+    /// @brief      监听socket, 每个地址一个或者SO_REUSEPORT时多个
+    std::vector<Socket::ptr> getSocks() const { return m_socks; }
+
     TcpServerConf::ptr getConf() const { return m_conf; }
 
     void setConf(TcpServerConf::ptr conf){
         m_conf = conf;
     }
 
+    /// @brief      保存配置, 并应用其中的过载保护和SO_REUSEPORT参数
+    /// @details    SO_REUSEPORT参数在bind时生效
     void setConf(const TcpServerConf& v);
 
+protected:
+
+    /// @brief        过载时处理新连接, 默认直接关闭
+    /// @details      在accept协程或者工作协程中调用, 不能阻塞太久
+    virtual void handleOverload(Socket::ptr client);
+
+    /// @brief        给一个地址的SO_REUSEPORT监听socket挂载按CPU选择socket的cBPF程序
+    /// @details      失败时只记录日志, 内核按四元组哈希分配连接
+    /// @param sock   组中的任意一个socket
+    /// @param count  组中的socket数
+    virtual bool attachReusePortCbpf(Socket::ptr sock, uint32_t count);
+
 private:
 
     /// @brief        处理新连接的socket类
     virtual void handleClient(Socket::ptr client);
 
+    /// @brief        在工作调度器中处理连接, 维护连接数
+    /// @param accept_ms accept的时间, 用于判断排队时间
+    void onClient(Socket::ptr client, uint64_t accept_ms);
+
 
     /// @brief        启动接受socket连接
     virtual void startAccept(Socket::ptr sock);
@@ -192,6 +272,18 @@ protected:
     std::string m_type = "tcp";
     bool m_ssl = false;
     TcpServerConf::ptr m_conf;
+
+    // 运行中可以从其他线程修改
+    std::atomic<uint32_t> m_maxConnections;
+    std::atomic<uint32_t> m_acceptBackoffQueue;
+    uint32_t m_acceptBackoffTime;
+    std::atomic<uint32_t> m_maxQueueTime;
+    int m_reusePort;
+    bool m_reusePortCbpf;
+    std::atomic<uint64_t> m_connections{0};
+    std::atomic<uint64_t> m_rejected{0};
+    std::atomic<uint64_t> m_shed{0};
+    std::atomic<uint64_t> m_backoffs{0};
 };
 
 
@@ -7,6 +7,7 @@
 #include <cstring>
 #include "fiber.h"
 #include <sys/time.h>
+#include <time.h>
 #include <dirent.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -65,6 +66,12 @@ uint64_t GetCurrentUS(){
     return tv.tv_sec * 1000ul * 1000ul + tv.tv_usec;
 }
 
+uint64_t GetCoarseMonotonicMS(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return ts.tv_sec * 1000ul + ts.tv_nsec / 1000000;
+}
+
 
 std::string Time2Str(time_t ts, const std::string& format){
     struct tm tm;
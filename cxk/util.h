@@ -36,6 +36,10 @@ uint64_t GetCurrentMS();
 /// @brief  获取当前时间的微秒
 uint64_t GetCurrentUS();
 
+/// @brief  获取单调时钟的毫秒, 精度为一个时钟节拍(1~4ms)
+/// @details CLOCK_MONOTONIC_COARSE, 由vDSO读取内核缓存的时间, 比GetCurrentMS便宜, 用于频繁调用的热路径
+uint64_t GetCoarseMonotonicMS();
+
 
 std::string Time2Str(time_t ts = time(0), const std::string& format = "%Y-%m-%d %H:%M:%S");
 
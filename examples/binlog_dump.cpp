@@ -0,0 +1,29 @@
+#include "cxk/binlog.h"
+
+
+// 把BinaryLogAppender写出的二进制日志解码为文本
+int main(int argc, char* argv[]){
+    if(argc < 2){
+        std::cout << "usage: " << argv[0] << " binlog_file [pattern]" << std::endl;
+        std::cout << "    pattern default: %d%T%t%T%N%T%F%T[%p]%T[%c]%T%f:%l%T%m%n" << std::endl;
+        return 1;
+    }
+
+    cxk::BinLogReader::ptr reader;
+    if(argc > 2){
+        reader.reset(new cxk::BinLogReader(argv[2]));
+    } else {
+        reader.reset(new cxk::BinLogReader);
+    }
+
+    if(!reader->open(argv[1])){
+        std::cout << "open binlog file error: " << argv[1] << std::endl;
+        return 1;
+    }
+
+    std::string line;
+    while(reader->next(line)){
+        std::cout << line;
+    }
+    return 0;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <atomic>
+#include <iostream>
+#include <string>
+
+
+/// @brief 检查失败的次数, 检查可能在多个线程中进行
+inline std::atomic<int>& check_failures(){
+    static std::atomic<int> s_failures{0};
+    return s_failures;
+}
+
+
+/// @brief 打印一项检查的结果, 失败时记录下来
+inline void check(bool v, const std::string& name){
+    std::cout << (v ? "ok   " : "FAIL ") << name << std::endl;
+    if(!v){
+        ++check_failures();
+    }
+}
+
+
+/// @brief main的返回值, 有检查失败时非0
+inline int check_result(){
+    return check_failures() ? 1 : 0;
+}
@@ -0,0 +1,100 @@
+#include "cxk/block_pool.h"
+#include "cxk/bytearray.h"
+#include "cxk/logger.h"
+#include "cxk/util.h"
+#include <thread>
+
+static cxk::Logger::ptr g_logger = CXK_LOG_ROOT();
+
+// 统计operator new的调用次数
+static std::atomic<uint64_t> s_new_count{0};
+
+void* operator new(size_t size){
+    ++s_new_count;
+    void* ptr = malloc(size ? size : 1);
+    if(!ptr){
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void operator delete(void* ptr) noexcept{
+    free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept{
+    free(ptr);
+}
+
+
+void test_alloc(){
+    auto pool = cxk::BlockPool::GetInstance();
+    {
+        auto b1 = pool->alloc(4096);
+        auto b2 = pool->alloc(100);
+        auto b3 = pool->alloc(1024 * 1024);
+        CXK_LOG_INFO(g_logger) << pool->getStats().toString();
+    }
+    auto stats = pool->getStats();
+    CXK_LOG_INFO(g_logger) << stats.toString();
+
+    // 归还到本地缓存的内存块可以被再次使用
+    auto b = pool->alloc(4000);
+    std::cout << "test_alloc: " << (pool->getStats().allocated == stats.allocated) << std::endl;
+}
+
+
+// 本地缓存命中时分配不调用operator new, 控制块放在内存块头部
+void test_no_malloc(){
+    auto pool = cxk::BlockPool::GetInstance();
+    pool->alloc(4096).reset();
+    uint64_t count = s_new_count;
+    for(int i = 0; i < 100; ++i){
+        auto b = pool->alloc(4096);
+        b.get()[4095] = 'a';
+        std::weak_ptr<char> w = b;
+    }
+    std::cout << "test_no_malloc: " << (s_new_count == count) << std::endl;
+}
+
+
+void test_cross_thread(){
+    auto pool = cxk::BlockPool::GetInstance();
+    int64_t in_use = pool->getStats().in_use;
+    std::vector<cxk::ByteArray::ptr> bas;
+    for(int i = 0; i < 100; ++i){
+        cxk::ByteArray::ptr ba(new cxk::ByteArray);
+        ba->write(cxk::random_string(10000).c_str(), 10000);
+        bas.push_back(ba);
+    }
+    CXK_LOG_INFO(g_logger) << "before: " << pool->getStats().toString();
+
+    // 在另一个线程释放
+    std::thread t([&bas](){
+        bas.clear();
+    });
+    t.join();
+    auto stats = pool->getStats();
+    CXK_LOG_INFO(g_logger) << "after: " << stats.toString();
+    std::cout << "test_cross_thread: " << (stats.in_use == in_use) << std::endl;
+}
+
+
+void bench(){
+    uint64_t begin = cxk::GetCurrentMS();
+    for(int i = 0; i < 1000000; ++i){
+        cxk::ByteArray::ptr ba(new cxk::ByteArray);
+        ba->writeFuint64_t(i);
+    }
+    CXK_LOG_INFO(g_logger) << "1000000 ByteArray used: " << (cxk::GetCurrentMS() - begin) << "ms "
+                           << cxk::BlockPool::GetInstance()->getStats().toString();
+}
+
+
+int main(int argc, char* argv[]){
+    test_alloc();
+    test_no_malloc();
+    test_cross_thread();
+    bench();
+    return 0;
+}
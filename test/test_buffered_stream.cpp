@@ -0,0 +1,140 @@
+#include "cxk/stream/buffered_stream.h"
+#include "cxk/http/http_parser.h"
+#include "cxk/http/http_session.h"
+#include <iostream>
+#include <string.h>
+
+
+/// @brief 内存中的流, 每次最多读出step字节, 模拟分多次到达的网络数据
+class MemoryStream : public cxk::Stream{
+public:
+    MemoryStream(const std::string& data, size_t step)
+        : m_data(data)
+        , m_step(step){
+    }
+
+    int read(void* buffer, size_t length) override{
+        size_t len = std::min(std::min(length, m_step), m_data.size() - m_pos);
+        memcpy(buffer, &m_data[m_pos], len);
+        m_pos += len;
+        return len;
+    }
+
+    int read(cxk::ByteArray::ptr ba, size_t length) override{
+        std::string tmp(std::min(length, m_step), '\0');
+        int len = read(&tmp[0], tmp.size());
+        ba->write(tmp.c_str(), len);
+        return len;
+    }
+
+    int write(const void* buffer, size_t length) override { return length; }
+    int write(cxk::ByteArray::ptr ba, size_t length) override { return length; }
+    void close() override {}
+
+private:
+    std::string m_data;
+    size_t m_step;
+    size_t m_pos = 0;
+};
+
+
+void test_read_until(){
+    std::cout << "===================readUntil" << std::endl;
+    cxk::BufferedStream::ptr bs(new cxk::BufferedStream(
+            std::make_shared<MemoryStream>("line1\r\nline2\r\nab|cd", 3), 16));
+    std::string a(bs->readUntil("\r\n"));
+    std::string b(bs->readUntil("\r\n"));
+    std::string c(bs->readUntil("|"));
+    std::string d(bs->peek(2));
+    bs->consume(1);
+    char buf[8] = {0};
+    int len = bs->read(buf, sizeof(buf));
+    std::string e(bs->readUntil("\r\n"));
+    std::cout << "test_read_until: " << (a == "line1\r\n" && b == "line2\r\n" && c == "ab|"
+            && d == "cd" && len == 1 && buf[0] == 'd' && e.empty()) << std::endl;
+}
+
+
+void test_pipeline(){
+    std::cout << "===================pipeline" << std::endl;
+    // 两个请求一起到达, 第一个带请求体
+    std::string data = "POST /a HTTP/1.1\r\nContent-Length: 5\r\n\r\nhello"
+                       "GET /b HTTP/1.1\r\nHost: cxk\r\n\r\n";
+    cxk::BufferedStream::ptr bs(new cxk::BufferedStream(std::make_shared<MemoryStream>(data, 7), 64));
+
+    std::vector<std::string> paths;
+    std::string body;
+    for(int i = 0; i < 2; ++i){
+        cxk::http::HttpRequestParser::ptr parser;
+        while(true){
+            std::string_view view = bs->peek();
+            parser.reset(new cxk::http::HttpRequestParser);
+            size_t nparse = parser->parse(view.data(), view.size());
+            if(parser->isFinished()){
+                bs->consume(nparse);
+                break;
+            }
+            if(parser->hasError() || bs->fill() <= 0){
+                break;
+            }
+        }
+        paths.push_back(parser->getData()->getPath());
+        uint64_t length = parser->getContentLength();
+        if(length > 0){
+            body.resize(length);
+            bs->readFixSize(&body[0], length);
+        }
+    }
+    std::cout << "test_pipeline: " << (paths.size() == 2 && paths[0] == "/a" && paths[1] == "/b"
+            && body == "hello" && bs->getReadSize() == 0) << std::endl;
+}
+
+
+void test_chunked_body(){
+    std::cout << "===================chunked body" << std::endl;
+    // chunk头部带扩展, 结尾带trailer, 后面紧跟下一个请求
+    std::string data = "5;name=v\r\nhello\r\n0B\r\n, chunked!!\r\n0\r\nX-Trailer: 1\r\n\r\n"
+                       "GET /b HTTP/1.1\r\n\r\n";
+    cxk::BufferedStream::ptr bs(new cxk::BufferedStream(std::make_shared<MemoryStream>(data, 5), 32));
+    cxk::http::HttpBodyStream body(bs, 0, true);
+
+    std::string out;
+    char buf[4];
+    int len = 0;
+    while((len = body.read(buf, sizeof(buf))) > 0){
+        out.append(buf, len);
+    }
+    std::string next(bs->readUntil("\r\n"));
+    std::cout << "test_chunked_body: " << (out == "hello, chunked!!" && len == 0 && body.isFinished()
+            && next == "GET /b HTTP/1.1\r\n") << std::endl;
+
+    // 按Content-Length读取, 不会读到下一个请求
+    bs.reset(new cxk::BufferedStream(std::make_shared<MemoryStream>("0123456789GET", 4), 32));
+    cxk::http::HttpBodyStream fixed(bs, 10, false);
+    bool drained = fixed.drain();
+    std::cout << "test_fixed_body: " << (drained && fixed.isFinished() && bs->peek(3) == "GET") << std::endl;
+
+    bs.reset(new cxk::BufferedStream(std::make_shared<MemoryStream>("zz\r\nab\r\n", 4), 32));
+    cxk::http::HttpBodyStream bad(bs, 0, true);
+    std::cout << "test_bad_chunk: " << (bad.read(buf, sizeof(buf)) < 0) << std::endl;
+}
+
+
+// 结尾'\0'不能让缓冲区落到下一个内存块分级
+void test_capacity(){
+    std::cout << "===================capacity" << std::endl;
+    auto cap = [](size_t capacity){
+        return cxk::BufferedStream(std::make_shared<MemoryStream>("", 1), capacity).getCapacity();
+    };
+    std::cout << "test_capacity: " << (cap(4096) == 4095 && cap(256) == 255 && cap(32) == 32
+            && cap(5000) == 5000) << std::endl;
+}
+
+
+int main(int argc, char* argv[]){
+    test_read_until();
+    test_capacity();
+    test_pipeline();
+    test_chunked_body();
+    return 0;
+}
@@ -42,8 +42,125 @@ void test(){
 }
 
 
+void test_slice(){
+    cxk::ByteArray::ptr ba(new cxk::ByteArray(7));
+    for(int i = 0; i < 100; ++i){
+        ba->writeFuint32_t(i);
+    }
+    ba->setPosition(40);
+
+    // 切片和原ByteArray共享内存块
+    cxk::ByteArray::ptr slice = ba->slice(40);
+    CXK_ASSERT(slice->getSize() == 40);
+    for(int i = 10; i < 20; ++i){
+        CXK_ASSERT(slice->readFuint32_t() == (uint32_t)i);
+    }
+
+    // 写入共享的内存块时先复制, 不影响原ByteArray
+    slice->setPosition(0);
+    slice->writeFuint32_t(1000);
+    slice->setPosition(0);
+    CXK_ASSERT(slice->readFuint32_t() == 1000);
+    CXK_ASSERT(ba->readFuint32_t() == 10);
+
+    // 追加到另一个ByteArray的末尾后继续写入
+    cxk::ByteArray::ptr out(new cxk::ByteArray(5));
+    out->writeFuint8_t(0xff);
+    out->append(ba, 8);
+    out->writeFuint8_t(0xee);
+    out->setPosition(0);
+    CXK_ASSERT(out->getSize() == 10);
+    CXK_ASSERT(out->readFuint8_t() == 0xff);
+    CXK_ASSERT(out->readFuint32_t() == 11);
+    CXK_ASSERT(out->readFuint32_t() == 12);
+    CXK_ASSERT(out->readFuint8_t() == 0xee);
+
+    std::vector<iovec> iovs;
+    CXK_ASSERT(out->getReadBuffers(iovs, 10, 0) == 10);
+    out->setPosition(0);
+    CXK_LOG_INFO(g_logger) << "test_slice ok iovs=" << iovs.size() << " " << out->toHexString();
+}
+
+
+void test_array(){
+    for(size_t base_len : {1, 7, 64, 4096}){
+        std::vector<uint32_t> v32(1000);
+        std::vector<uint64_t> v64(1000);
+        std::vector<int16_t> f16(1000);
+        for(size_t i = 0; i < v32.size(); ++i){
+            v32[i] = i % 3 ? rand() % 128 : rand();
+            v64[i] = i % 5 ? rand() % 128 : ((uint64_t)rand() << (i % 40));
+            f16[i] = rand();
+        }
+
+        cxk::ByteArray::ptr ba(new cxk::ByteArray(base_len));
+        ba->writeVarintArray(&v32[0], v32.size());
+        ba->writeVarintArray(&v64[0], v64.size());
+        ba->writeFixedArray(&f16[0], f16.size());
+        ba->setPosition(0);
+
+        // 批量写入的数据可以逐个读出
+        for(size_t i = 0; i < 10; ++i){
+            CXK_ASSERT(ba->readUint32() == v32[i]);
+        }
+        std::vector<uint32_t> r32(v32.size() - 10);
+        std::vector<uint64_t> r64(v64.size());
+        std::vector<int16_t> r16(f16.size());
+        ba->readVarintArray(&r32[0], r32.size());
+        ba->readVarintArray(&r64[0], r64.size());
+        ba->readFixedArray(&r16[0], r16.size());
+        CXK_ASSERT(std::equal(r32.begin(), r32.end(), v32.begin() + 10));
+        CXK_ASSERT(r64 == v64);
+        CXK_ASSERT(r16 == f16);
+        CXK_ASSERT(ba->getReadSize() == 0);
+    }
+    CXK_LOG_INFO(g_logger) << "test_array ok";
+}
+
+
+void test_mmap(){
+    cxk::ByteArray::ptr ba(new cxk::ByteArray(100));
+    for(int i = 0; i < 10000; ++i){
+        ba->writeFuint32_t(i);
+    }
+    ba->setPosition(0);
+    ba->writeToFile("/tmp/cxk_mmap_test.dat");
+
+    // 只读映射, 写入不影响文件
+    cxk::ByteArray::ptr rd = cxk::ByteArray::MapFile("/tmp/cxk_mmap_test.dat", false, 4000 * 4);
+    CXK_ASSERT(rd->getSize() == 6000 * 4);
+    CXK_ASSERT(rd->readFuint32_t() == 4000);
+    rd->setPosition(0);
+    rd->writeFuint32_t(1);
+
+    std::vector<iovec> iovs;
+    CXK_ASSERT(rd->getReadBuffers(iovs, 8) == 8);
+    CXK_ASSERT(iovs.size() == 1);
+
+    // 读写映射, 写入直接修改文件
+    cxk::ByteArray::ptr rw = cxk::ByteArray::MapFile("/tmp/cxk_mmap_test.dat", true);
+    CXK_ASSERT(rw->readFuint32_t() == 0);
+    CXK_ASSERT(rw->readFuint32_t() == 1);
+    rw->setPosition(0);
+    rw->writeFuint32_t(12345);
+    rw.reset();
+
+    cxk::ByteArray::ptr check(new cxk::ByteArray);
+    check->readFromFile("/tmp/cxk_mmap_test.dat");
+    check->setPosition(0);
+    CXK_ASSERT(check->getSize() == 40000);
+    CXK_ASSERT(check->readFuint32_t() == 12345);
+    check->setPosition(4000 * 4);
+    CXK_ASSERT(check->readFuint32_t() == 4000);
+    CXK_LOG_INFO(g_logger) << "test_mmap ok";
+}
+
+
 int main(int argc, char *argv[]){
     test();
+    test_slice();
+    test_array();
+    test_mmap();
 
     return 0;
 }
\ No newline at end of file
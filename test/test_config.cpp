@@ -5,6 +5,8 @@
 #include "cxk/util.h"
 #include <yaml-cpp/yaml.h>
 #include "cxk/env.h"
+#include "cxk/iomanager.h"
+#include <fstream>
 
 
 
@@ -12,12 +14,129 @@ void test_loadconf(){
     cxk::Config::LoadFromConfDir("conf");
 }
 
+
+void test_snapshot(){
+    auto int_var = cxk::Config::Lookup("test.snapshot.int", 10, "snapshot int");
+    auto vec_var = cxk::Config::Lookup("test.snapshot.vec", std::vector<int>{1, 2}, "snapshot vec");
+
+    int_var->addListener([](const int& old_val, const int& new_val){
+        CXK_LOG_INFO(CXK_LOG_ROOT()) << "int changed " << old_val << " -> " << new_val;
+    });
+
+    auto old_snapshot = vec_var->getSnapshot();
+    vec_var->setValue({1, 2, 3});
+    int_var->fromString("20");
+
+    // 旧快照在持有期间保持不变
+    std::cout << "old_snapshot size: " << old_snapshot->size()
+              << " new_snapshot size: " << vec_var->getSnapshot()->size()
+              << " int: " << int_var->getValue() << std::endl;
+
+    std::vector<std::thread> threads;
+    uint64_t begin = cxk::GetCurrentMS();
+    for(int i = 0; i < 4; ++i){
+        threads.emplace_back([int_var](){
+            int64_t sum = 0;
+            for(int n = 0; n < 10000000; ++n){
+                sum += int_var->getValue();
+            }
+            std::cout << "sum: " << sum << std::endl;
+        });
+    }
+    for(auto& i : threads){
+        i.join();
+    }
+    std::cout << "getValue used: " << (cxk::GetCurrentMS() - begin) << "ms" << std::endl;
+
+    // 并发读快照的同时修改, 读到的快照总是完整的某一个值, 修改后其他线程能看到
+    threads.clear();
+    // 每个元素都等于元素个数的值才是完整的, 从空数组开始
+    vec_var->setValue({});
+    std::atomic<bool> stop{false};
+    std::atomic<int> bad{0};
+    begin = cxk::GetCurrentMS();
+    for(int i = 0; i < 4; ++i){
+        threads.emplace_back([vec_var, &stop, &bad](){
+            while(!stop){
+                auto v = vec_var->getSnapshot();
+                for(size_t n = 0; n < v->size(); ++n){
+                    if((*v)[n] != (int)v->size()){
+                        ++bad;
+                    }
+                }
+            }
+        });
+    }
+    for(int n = 1; n <= 1000; ++n){
+        vec_var->setValue(std::vector<int>(n, n));
+    }
+    stop = true;
+    for(auto& i : threads){
+        i.join();
+    }
+    std::thread([vec_var, &bad](){
+        bad += vec_var->getSnapshot()->size() != 1000;
+    }).join();
+    std::cout << "snapshot concurrent: " << (bad == 0) << " used: " << (cxk::GetCurrentMS() - begin) << "ms" << std::endl;
+
+    // 缓存中被替换的旧值析构时读取下标更大的快照, 线程缓存会扩容
+    struct Reader{
+        cxk::AtomicSnapshot<int>* other;
+        ~Reader(){ other->load(); }
+    };
+    std::vector<std::unique_ptr<cxk::AtomicSnapshot<int>>> others;
+    cxk::AtomicSnapshot<Reader> reader;
+    for(int i = 0; i < 1000; ++i){
+        others.emplace_back(new cxk::AtomicSnapshot<int>(std::make_shared<int>(i)));
+    }
+    reader.store(std::make_shared<Reader>(Reader{others.back().get()}));
+    int value = 0;
+    std::thread([&reader, &others, &value](){
+        reader.load();
+        reader.store(std::make_shared<Reader>(Reader{others.back().get()}));
+        value = reader.load()->other == others.back().get() ? *others.back()->load() : -1;
+    }).join();
+    std::cout << "snapshot reentrant: " << (value == 999) << std::endl;
+}
+
+static void write_conf(const std::string& file, int port, int timeout){
+    std::ofstream ofs(file);
+    ofs << "test:\n    watch:\n        port: " << port << "\n        timeout: " << timeout << "\n";
+}
+
+void test_watch(){
+    cxk::FSUtil::Rm("/tmp/cxk_conf_test");
+    cxk::FSUtil::Mkdir("/tmp/cxk_conf_test/sub");
+    auto port = cxk::Config::Lookup("test.watch.port", 0, "watch port");
+    auto timeout = cxk::Config::Lookup("test.watch.timeout", 0, "watch timeout");
+    int port_changed = 0;
+    int timeout_changed = 0;
+    port->addListener([&port_changed](const int&, const int&){ ++port_changed; });
+    timeout->addListener([&timeout_changed](const int&, const int&){ ++timeout_changed; });
+
+    write_conf("/tmp/cxk_conf_test/sub/watch.yml", 80, 1000);
+    cxk::Config::LoadFromConfDir("/tmp/cxk_conf_test");
+
+    cxk::IOManager iom(1, false, "watch");
+    cxk::Config::WatchConfDir("/tmp/cxk_conf_test", &iom);
+    usleep(100 * 1000);
+    // 只有port变化, timeout的监听函数不应该被调用
+    write_conf("/tmp/cxk_conf_test/sub/watch.yml", 8080, 1000);
+    usleep(200 * 1000);
+    std::cout << "test_watch: " << (port->getValue() == 8080 && port_changed == 2
+                                    && timeout_changed == 1) << std::endl;
+    cxk::Config::UnwatchConfDir("/tmp/cxk_conf_test");
+    iom.stop();
+}
+
 int main(int argc, char *argv[])
 {
     cxk::EnvMgr::GetInstance()->init(argc, argv);
     test_loadconf();
     std::cout << "=================" << std::endl;
     test_loadconf();
+    test_snapshot();
+    test_watch();
 
     return 0;
     cxk::Config::Visit([](cxk::ConfigVarBase::ptr var){
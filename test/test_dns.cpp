@@ -0,0 +1,236 @@
+#include "cxk/cxk.h"
+#include <fstream>
+#include <iostream>
+#include "check.h"
+
+static cxk::Logger::ptr g_logger = CXK_LOG_ROOT();
+
+static const int PORT = 15353;
+// 本地DNS桩服务器收到的查询数
+static std::atomic<int> s_queries{0};
+static std::atomic<bool> s_stop{false};
+
+
+static void append16(std::string& buf, uint16_t v){
+    buf.push_back(v >> 8);
+    buf.push_back(v & 0xff);
+}
+
+
+static void append32(std::string& buf, uint32_t v){
+    append16(buf, v >> 16);
+    append16(buf, v & 0xffff);
+}
+
+
+// 指向问题中域名的压缩指针
+static void appendRecord(std::string& buf, uint16_t type, uint32_t ttl, const std::string& rdata){
+    append16(buf, 0xc00c);
+    append16(buf, type);
+    append16(buf, 1);
+    append32(buf, ttl);
+    append16(buf, rdata.size());
+    buf.append(rdata);
+}
+
+
+static std::string soa(uint32_t minimum){
+    std::string rdata;
+    rdata.append("\x02ns\x00", 4);
+    rdata.append("\x04root\x00", 6);
+    for(uint32_t v : {1u, 3600u, 600u, 86400u}){
+        append32(rdata, v);
+    }
+    append32(rdata, minimum);
+    return rdata;
+}
+
+
+/// @brief 按域名返回固定的记录:
+///        test.local       A 1.2.3.4 ttl 1, AAAA无记录
+///        cname.local      CNAME + A 5.6.7.8
+///        host.corp.local  A 9.9.9.9
+///        slow.local       100ms后返回A 7.7.7.7
+///        drop.local       不响应
+///        其他             NXDOMAIN, SOA minimum 2
+static std::string answer(const std::string& query, bool& drop, uint64_t& delay){
+    size_t pos = 12;
+    std::string name;
+    while(pos < query.size() && query[pos]){
+        uint8_t len = query[pos];
+        if(!name.empty()){
+            name.push_back('.');
+        }
+        name.append(query, pos + 1, len);
+        pos += len + 1;
+    }
+    uint16_t type = ((uint8_t)query[pos + 1] << 8) | (uint8_t)query[pos + 2];
+    std::string question = query.substr(12, pos + 5 - 12);
+
+    std::string body;
+    int an = 0, ns = 0, rcode = 0;
+    if(name == "test.local"){
+        if(type == 1){
+            appendRecord(body, 1, 1, std::string("\x01\x02\x03\x04", 4));
+            an = 1;
+        }
+    } else if(name == "cname.local"){
+        std::string target("\x04real\x05local\x00", 12);
+        appendRecord(body, 5, 60, target);
+        body.append(target);
+        append16(body, 1);
+        append16(body, 1);
+        append32(body, 60);
+        append16(body, 4);
+        body.append("\x05\x06\x07\x08", 4);
+        an = 2;
+    } else if(name == "host.corp.local"){
+        appendRecord(body, 1, 60, std::string("\x09\x09\x09\x09", 4));
+        an = 1;
+    } else if(name == "slow.local"){
+        appendRecord(body, 1, 60, std::string("\x07\x07\x07\x07", 4));
+        an = 1;
+        delay = 100;
+    } else if(name == "drop.local"){
+        drop = true;
+    } else {
+        rcode = 3;
+        appendRecord(body, 6, 60, soa(2));
+        ns = 1;
+    }
+
+    std::string rsp = query.substr(0, 2);
+    append16(rsp, 0x8180 | rcode);
+    append16(rsp, 1);
+    append16(rsp, an);
+    append16(rsp, ns);
+    append16(rsp, 0);
+    return rsp + question + body;
+}
+
+
+static void run_server(cxk::Socket::ptr sock){
+    sock->setRecvTimeout(100);
+    char buf[512];
+    while(!s_stop){
+        cxk::Address::ptr from(new cxk::IPv4Address);
+        int rt = sock->recvfrom(buf, sizeof(buf), from);
+        if(rt <= 12){
+            continue;
+        }
+        ++s_queries;
+        bool drop = false;
+        uint64_t delay = 0;
+        std::string rsp = answer(std::string(buf, rt), drop, delay);
+        if(drop){
+            continue;
+        }
+        cxk::IOManager::GetThis()->schedule([sock, from, rsp, delay](){
+            if(delay){
+                usleep(delay * 1000);
+            }
+            sock->sendto(rsp.c_str(), rsp.size(), from);
+        });
+    }
+    sock->close();
+}
+
+
+static void write_file(const std::string& path, const std::string& content){
+    std::ofstream ofs(path);
+    ofs << content;
+}
+
+
+static std::string lookup(const std::string& host, int family = AF_INET){
+    auto addr = cxk::Address::LookupAnyIpAddr(host, family);
+    return addr ? addr->toString() : "";
+}
+
+
+void test_resolve(){
+    auto dns = cxk::DnsMgr::GetInstance();
+
+    int n = s_queries;
+    check(lookup("MyHost:80") == "10.0.0.1:80" && s_queries == n, "hosts file");
+
+    check(lookup("test.local:8080") == "1.2.3.4:8080" && s_queries == n + 1, "query A");
+    check(lookup("test.local") == "1.2.3.4:0" && s_queries == n + 1, "cached");
+    usleep(1100 * 1000);
+    check(lookup("test.local") == "1.2.3.4:0" && s_queries == n + 2, "ttl expired");
+
+    // AF_UNSPEC同时查询A和AAAA, AAAA没有记录
+    std::vector<cxk::IPAddress::ptr> addrs;
+    check(dns->resolve("test.local", AF_UNSPEC, addrs) && addrs.size() == 1 && s_queries == n + 4, "query A and AAAA");
+
+    // 不存在时再加上search后缀查询一次
+    n = s_queries;
+    check(lookup("none.local") == "" && s_queries == n + 2, "nxdomain");
+    check(lookup("none.local") == "" && s_queries == n + 2, "negative cached");
+    usleep(2100 * 1000);
+    check(lookup("none.local") == "" && s_queries == n + 4, "negative ttl from soa");
+
+    check(lookup("cname.local") == "5.6.7.8:0", "cname");
+    check(lookup("host") == "9.9.9.9:0", "search domain");
+
+    // 并发解析同一个域名只发出一次查询
+    n = s_queries;
+    std::atomic<int> ok{0};
+    cxk::Semaphore sem;
+    for(int i = 0; i < 10; ++i){
+        cxk::IOManager::GetThis()->schedule([&ok, &sem](){
+            ok += lookup("slow.local") == "7.7.7.7:0";
+            sem.notify();
+        });
+    }
+    for(int i = 0; i < 10; ++i){
+        sem.wait();
+    }
+    check(ok == 10 && s_queries == n + 1, "coalesce concurrent queries");
+
+    uint64_t begin = cxk::GetCurrentMS();
+    check(lookup("drop.local") == "" && cxk::GetCurrentMS() - begin < 1000, "timeout");
+}
+
+
+int main(int argc, char* argv[]){
+    CXK_LOG_NAME("system")->setLogLevel(cxk::LogLevel::FATAL);
+    write_file("/tmp/test_dns_hosts", "# test\n10.0.0.1 myhost alias\n::1 ip6-localhost\n");
+    write_file("/tmp/test_dns_resolv.conf", "search corp.local\noptions ndots:1\n");
+    cxk::Config::Lookup<std::string>("dns.hosts_file")->setValue("/tmp/test_dns_hosts");
+    cxk::Config::Lookup<std::string>("dns.resolv_conf")->setValue("/tmp/test_dns_resolv.conf");
+    cxk::Config::Lookup<std::vector<std::string>>("dns.servers")->setValue({"127.0.0.1:" + std::to_string(PORT)});
+    cxk::Config::Lookup<uint32_t>("dns.timeout")->setValue(200);
+    cxk::Config::Lookup<uint32_t>("dns.attempts")->setValue(2);
+
+    cxk::IOManager iom(2, false);
+    std::atomic<int> started{0};
+    iom.schedule([&](){
+        auto addr = cxk::IPAddress::Create("127.0.0.1", PORT);
+        auto sock = cxk::Socket::CreateUDP(addr);
+        if(!sock->bind(addr)){
+            started = -1;
+            return;
+        }
+        started = 1;
+        run_server(sock);
+    });
+    while(started == 0){
+        usleep(1000);
+    }
+    if(started < 0){
+        CXK_LOG_ERROR(g_logger) << "bind " << PORT << " fail";
+        return 1;
+    }
+
+    cxk::Semaphore done;
+    iom.schedule([&](){
+        test_resolve();
+        done.notify();
+    });
+    done.wait();
+
+    s_stop = true;
+    iom.stop();
+    return check_result();
+}
@@ -0,0 +1,411 @@
+#include "cxk/cxk.h"
+#include <iostream>
+#include "check.h"
+
+static cxk::Logger::ptr g_logger = CXK_LOG_ROOT();
+
+static cxk::http::HttpServer::ptr s_server;
+
+
+static std::string to_hex(const std::string& data){
+    static const char s_hex[] = "0123456789abcdef";
+    std::string rt;
+    for(unsigned char c : data){
+        rt.push_back(s_hex[c >> 4]);
+        rt.push_back(s_hex[c & 0xf]);
+    }
+    return rt;
+}
+
+
+static std::string from_hex(const std::string& hex){
+    std::string rt;
+    for(size_t i = 0; i + 1 < hex.size(); i += 2){
+        rt.push_back((char)strtol(hex.substr(i, 2).c_str(), nullptr, 16));
+    }
+    return rt;
+}
+
+
+// 第i个字节的内容, 用于校验大的请求体和响应体
+static std::string pattern(size_t len){
+    std::string rt;
+    rt.resize(len);
+    for(size_t i = 0; i < len; ++i){
+        rt[i] = 'a' + (i * 7 + i / 1000) % 26;
+    }
+    return rt;
+}
+
+
+// RFC 7541 C.4: 使用Huffman编码的三个请求, 编码器和解码器共享动态表状态
+void test_hpack(){
+    cxk::http2::HeaderList reqs[3] = {
+        {{":method", "GET"}, {":scheme", "http"}, {":path", "/"}, {":authority", "www.example.com"}},
+        {{":method", "GET"}, {":scheme", "http"}, {":path", "/"}, {":authority", "www.example.com"}
+            , {"cache-control", "no-cache"}},
+        {{":method", "GET"}, {":scheme", "https"}, {":path", "/index.html"}, {":authority", "www.example.com"}
+            , {"custom-key", "custom-value"}},
+    };
+    const char* expect[3] = {
+        "828684418cf1e3c2e5f23a6ba0ab90f4ff",
+        "828684be5886a8eb10649cbf",
+        "828785bf408825a849e95ba97d7f8925a849e95bb8e8b4bf",
+    };
+    cxk::http2::HPackEncoder encoder;
+    cxk::http2::HPackDecoder decoder;
+    bool ok = true;
+    for(int i = 0; i < 3; ++i){
+        std::string out;
+        encoder.encode(reqs[i], out);
+        ok = ok && to_hex(out) == expect[i];
+        std::string in = from_hex(expect[i]);
+        cxk::http2::HeaderList headers;
+        ok = ok && decoder.decode((const uint8_t*)in.c_str(), in.size(), headers) && headers == reqs[i];
+    }
+    check(ok && encoder.getTable().getSize() == 164 && decoder.getTable().getSize() == 164, "hpack rfc7541 c.4");
+
+    // 动态表大小更新和淘汰
+    encoder.setMaxTableSize(64);
+    std::string out;
+    encoder.encode(reqs[2], out);
+    cxk::http2::HeaderList headers;
+    ok = decoder.decode((const uint8_t*)out.c_str(), out.size(), headers) && headers == reqs[2]
+        && decoder.getTable().getSize() <= 64 && decoder.getTable().getSize() == encoder.getTable().getSize();
+    check(ok, "hpack table size update");
+
+    std::string data;
+    for(int i = 0; i < 256; ++i){
+        data.push_back((char)i);
+    }
+    std::string encoded;
+    std::string decoded;
+    cxk::http2::Huffman::Encode(data, encoded);
+    ok = encoded.size() == cxk::http2::Huffman::EncodedLength(data)
+        && cxk::http2::Huffman::Decode((const uint8_t*)encoded.c_str(), encoded.size(), decoded)
+        && decoded == data;
+    check(ok, "huffman round trip");
+}
+
+
+static bool start_server(cxk::IOManager* iom){
+    s_server.reset(new cxk::http::HttpServer(true, iom, iom));
+    auto dispatch = s_server->getServletDispatch();
+    dispatch->addServlet("/sleep/:ms", [](cxk::http::HttpRequest::ptr request
+                , cxk::http::HttpResponse::ptr response, cxk::http::HttpSession::ptr session){
+        usleep(atoi(request->getRouteParam("ms").c_str()) * 1000);
+        response->setBody("slept");
+        return 0;
+    });
+    dispatch->addServlet("/echo", [](cxk::http::HttpRequest::ptr request
+                , cxk::http::HttpResponse::ptr response, cxk::http::HttpSession::ptr session){
+        response->setHeader("X-Version", std::to_string(request->getVersion()));
+        response->setBody(request->getQuery() + "|" + request->getHeader("cookie"));
+        return 0;
+    });
+    dispatch->addServlet("/body", [](cxk::http::HttpRequest::ptr request
+                , cxk::http::HttpResponse::ptr response, cxk::http::HttpSession::ptr session){
+        const std::string& body = request->getBody();
+        response->setBody(body == pattern(body.size()) ? std::to_string(body.size()) : "mismatch");
+        return 0;
+    });
+    dispatch->addServlet("/big/:n", [](cxk::http::HttpRequest::ptr request
+                , cxk::http::HttpResponse::ptr response, cxk::http::HttpSession::ptr session){
+        response->setBody(pattern(atoi(request->getRouteParam("n").c_str())));
+        return 0;
+    });
+    dispatch->addServlet("/stream", [](cxk::http::HttpRequest::ptr request
+                , cxk::http::HttpResponse::ptr response, cxk::http::HttpSession::ptr session){
+        response->setBodyWriter([](cxk::Stream::ptr out){
+            for(int i = 0; i < 100; ++i){
+                std::string line = "chunk " + std::to_string(i) + "\n";
+                if(out->writeFixSize(line.c_str(), line.size()) <= 0){
+                    return -1;
+                }
+            }
+            return 0;
+        });
+        return 0;
+    });
+    auto addr = cxk::Address::LookupAnyIpAddr("127.0.0.1:8092");
+    return s_server->bind(addr) && s_server->start();
+}
+
+
+static cxk::http::HttpRequest::ptr make_request(cxk::http::HttpMethod method, const std::string& path
+        , const std::string& query = ""){
+    cxk::http::HttpRequest::ptr req(new cxk::http::HttpRequest(0x20, false));
+    req->setMethod(method);
+    req->setPath(path);
+    req->setQuery(query);
+    return req;
+}
+
+
+void test_basic(cxk::http2::Http2Session::ptr session){
+    auto req = make_request(cxk::http::HttpMethod::GET, "/echo", "a=1");
+    req->setHeader("Cookie", "x=1");
+    auto r = session->request(req, 1000)->get();
+    check(r->result == 0 && r->response->getStatus() == cxk::http::HttpStatus::OK
+            && r->response->getBody() == "a=1|x=1" && r->response->getHeader("x-version") == "32"
+            && !r->response->getHeader("server").empty(), "basic get");
+
+    r = session->request(make_request(cxk::http::HttpMethod::GET, "/not_found"), 1000)->get();
+    check(r->result == 0 && r->response->getStatus() == cxk::http::HttpStatus::NOT_FOUND, "not found");
+
+    r = session->request(make_request(cxk::http::HttpMethod::HEAD, "/big/1000"), 1000)->get();
+    check(r->result == 0 && r->response->getBody().empty()
+            && r->response->getHeader("content-length") == "1000", "head");
+}
+
+
+// 多个请求在一个连接上并发, 总耗时接近一个请求的耗时
+void test_multiplex(cxk::http2::Http2Session::ptr session){
+    uint64_t begin = cxk::GetCurrentMS();
+    std::vector<cxk::http::HttpFuture::ptr> futures;
+    for(int i = 0; i < 20; ++i){
+        futures.push_back(session->request(make_request(cxk::http::HttpMethod::GET, "/sleep/200"), 2000));
+    }
+    bool ok = true;
+    for(auto& r : cxk::http::HttpFuture::WaitAll(futures)){
+        ok = ok && r->result == 0 && r->response->getBody() == "slept";
+    }
+    uint64_t used = cxk::GetCurrentMS() - begin;
+    check(ok && used < 1000, "multiplex 20 x 200ms in " + std::to_string(used) + "ms");
+}
+
+
+// 超过初始窗口的请求体和响应体, 需要WINDOW_UPDATE才能传完
+void test_flow_control(cxk::http2::Http2Session::ptr session){
+    auto r = session->request(make_request(cxk::http::HttpMethod::GET, "/big/5000000"), 5000)->get();
+    check(r->result == 0 && r->response->getBody() == pattern(5000000), "large response body");
+
+    auto req = make_request(cxk::http::HttpMethod::POST, "/body");
+    req->setBody(pattern(3000000));
+    r = session->request(req, 5000)->get();
+    check(r->result == 0 && r->response->getBody() == "3000000", "large request body");
+
+    // 几个大响应同时传输, 共享连接窗口
+    std::vector<cxk::http::HttpFuture::ptr> futures;
+    for(int i = 0; i < 4; ++i){
+        futures.push_back(session->request(make_request(cxk::http::HttpMethod::GET, "/big/2000000"), 5000));
+    }
+    bool ok = true;
+    for(auto& r : cxk::http::HttpFuture::WaitAll(futures)){
+        ok = ok && r->result == 0 && r->response->getBody().size() == 2000000;
+    }
+    check(ok, "concurrent large bodies");
+}
+
+
+void test_stream_body(cxk::http2::Http2Session::ptr session){
+    auto r = session->request(make_request(cxk::http::HttpMethod::GET, "/stream"), 1000)->get();
+    std::string expect;
+    for(int i = 0; i < 100; ++i){
+        expect += "chunk " + std::to_string(i) + "\n";
+    }
+    check(r->result == 0 && r->response->getBody() == expect, "body writer");
+}
+
+
+// 超时的请求被重置, 连接继续可用
+void test_timeout(cxk::http2::Http2Session::ptr session){
+    auto r = session->request(make_request(cxk::http::HttpMethod::GET, "/sleep/300"), 100)->get();
+    check(r->result == (int)cxk::http::HttpResult::Error::TIMEOUT, "timeout");
+    r = session->request(make_request(cxk::http::HttpMethod::GET, "/echo", "b=2"), 1000)->get();
+    check(r->result == 0 && r->response->getBody() == "b=2|" && session->isActive(), "after timeout");
+}
+
+
+// 同一个端口仍然接受HTTP/1.1
+void test_http1(){
+    auto r = cxk::http::HttpClientMgr::GetInstance()->get("http://127.0.0.1:8092/echo?c=3", 1000)->get();
+    check(r->result == 0 && r->response->getBody() == "c=3|" && r->response->getHeader("X-Version") == "17"
+            , "http/1.1 on same port");
+}
+
+
+static void append_frame(std::string& out, cxk::http2::FrameType type, uint8_t flags, uint32_t stream_id
+        , const std::string& payload = ""){
+    cxk::http2::FrameHeader header;
+    header.length = payload.size();
+    header.type = type;
+    header.flags = flags;
+    header.streamId = stream_id;
+    header.write(out);
+    out.append(payload);
+}
+
+
+static bool send_all(cxk::Socket::ptr sock, const std::string& data){
+    size_t offset = 0;
+    while(offset < data.size()){
+        int rt = sock->send(data.c_str() + offset, data.size() - offset);
+        if(rt <= 0){
+            return false;
+        }
+        offset += rt;
+    }
+    return true;
+}
+
+
+// 不经过Http2Session的连接, 用来发送异常的帧序列
+static cxk::Socket::ptr raw_connect(int rcvbuf = 0){
+    auto addr = cxk::Address::LookupAnyIpAddr("127.0.0.1:8092");
+    auto sock = cxk::Socket::CreateTCP(addr);
+    if(rcvbuf){
+        sock->setOption(SOL_SOCKET, SO_RCVBUF, rcvbuf);
+    }
+    if(!sock->connect(addr)){
+        return nullptr;
+    }
+    sock->setRecvTimeout(1000);
+    sock->setSendTimeout(200);
+    std::string out(cxk::http2::CONNECTION_PREFACE, cxk::http2::CONNECTION_PREFACE_SIZE);
+    append_frame(out, cxk::http2::FrameType::SETTINGS, 0, 0);
+    return send_all(sock, out) ? sock : nullptr;
+}
+
+
+// 读取帧直到连接关闭或者超时, 统计REFUSED_STREAM的个数和GOAWAY的错误码(没有时为-1)
+static void read_frames(cxk::Socket::ptr sock, int& refused, int& goaway){
+    refused = 0;
+    goaway = -1;
+    std::string buf;
+    std::vector<char> tmp(64 * 1024);
+    while(true){
+        int rt = sock->recv(&tmp[0], tmp.size());
+        if(rt <= 0){
+            break;
+        }
+        buf.append(&tmp[0], rt);
+        size_t pos = 0;
+        while(buf.size() - pos >= cxk::http2::FRAME_HEADER_SIZE){
+            cxk::http2::FrameHeader header;
+            header.parse((const uint8_t*)buf.c_str() + pos);
+            if(buf.size() - pos < cxk::http2::FRAME_HEADER_SIZE + header.length){
+                break;
+            }
+            const uint8_t* payload = (const uint8_t*)buf.c_str() + pos + cxk::http2::FRAME_HEADER_SIZE;
+            if(header.type == cxk::http2::FrameType::RST_STREAM
+                    && cxk::http2::ReadUint32(payload) == (uint32_t)cxk::http2::Http2Error::REFUSED_STREAM){
+                ++refused;
+            } else if(header.type == cxk::http2::FrameType::GOAWAY){
+                goaway = cxk::http2::ReadUint32(payload + 4);
+            }
+            pos += cxk::http2::FRAME_HEADER_SIZE + header.length;
+        }
+        buf.erase(0, pos);
+    }
+}
+
+
+// 每个流发出请求后立即重置
+static std::string open_and_reset(cxk::http2::HPackEncoder& encoder, uint32_t first_id, int count, const std::string& path){
+    std::string out;
+    std::string rst;
+    cxk::http2::AppendUint32(rst, (uint32_t)cxk::http2::Http2Error::CANCEL);
+    for(int i = 0; i < count; ++i){
+        uint32_t id = first_id + i * 2;
+        std::string block;
+        encoder.encode({{":method", "GET"}, {":scheme", "http"}, {":authority", "127.0.0.1:8092"}, {":path", path}}, block);
+        append_frame(out, cxk::http2::FrameType::HEADERS
+                , cxk::http2::FLAG_END_HEADERS | cxk::http2::FLAG_END_STREAM, id, block);
+        append_frame(out, cxk::http2::FrameType::RST_STREAM, 0, id, rst);
+    }
+    return out;
+}
+
+
+void test_abuse(){
+    cxk::Config::Lookup<uint32_t>("http2.max_concurrent_streams")->setValue(10);
+    cxk::Config::Lookup<uint32_t>("http2.max_reset_streams")->setValue(50);
+    cxk::Config::Lookup<uint32_t>("http2.max_control_buffer")->setValue(4096);
+    int refused = 0;
+    int goaway = -1;
+
+    // 被重置的流在处理函数返回前仍然占用并发名额
+    auto sock = raw_connect();
+    cxk::http2::HPackEncoder encoder;
+    bool ok = sock && send_all(sock, open_and_reset(encoder, 1, 20, "/sleep/300"));
+    if(ok){
+        read_frames(sock, refused, goaway);
+    }
+    check(ok && refused == 10 && goaway == -1, "reset streams hold concurrency until handler returns");
+
+    // Rapid Reset
+    sock = raw_connect();
+    cxk::http2::HPackEncoder encoder2;
+    ok = sock && send_all(sock, open_and_reset(encoder2, 1, 200, "/echo"));
+    if(ok){
+        read_frames(sock, refused, goaway);
+    }
+    check(ok && goaway == (int)cxk::http2::Http2Error::ENHANCE_YOUR_CALM, "rapid reset goaway");
+
+    // 只发PING不读回复, 发送缓冲达到上限后关闭连接
+    sock = raw_connect(4096);
+    std::string pings;
+    for(int i = 0; i < 1000; ++i){
+        append_frame(pings, cxk::http2::FrameType::PING, 0, 0, "12345678");
+    }
+    ok = sock != nullptr;
+    for(int i = 0; ok && i < 1000 && send_all(sock, pings); ++i);
+    if(ok){
+        read_frames(sock, refused, goaway);
+    }
+    check(ok && goaway == (int)cxk::http2::Http2Error::ENHANCE_YOUR_CALM, "ping flood goaway");
+
+    cxk::Config::Lookup<uint32_t>("http2.max_concurrent_streams")->setValue(100);
+    cxk::Config::Lookup<uint32_t>("http2.max_reset_streams")->setValue(200);
+    cxk::Config::Lookup<uint32_t>("http2.max_control_buffer")->setValue(64 * 1024);
+}
+
+
+int main(int argc, char* argv[]){
+    CXK_LOG_NAME("system")->setLogLevel(cxk::LogLevel::ERROR);
+    test_hpack();
+
+    cxk::IOManager iom(2, false);
+    cxk::http::HttpClientMgr::GetInstance()->setIOManager(&iom);
+    std::atomic<int> started{0};
+    iom.schedule([&](){
+        started = start_server(&iom) ? 1 : -1;
+    });
+    while(started == 0){
+        usleep(1000);
+    }
+    if(started < 0){
+        CXK_LOG_ERROR(g_logger) << "bind 8092 fail";
+        return 1;
+    }
+
+    auto session = cxk::http2::Http2Session::Connect(cxk::Uri::Create("http://127.0.0.1:8092"), 1000, &iom);
+    check(session != nullptr, "connect");
+    if(!session){
+        return 1;
+    }
+
+    // 在协程中等待
+    cxk::Semaphore done;
+    iom.schedule([&](){
+        test_basic(session);
+        test_multiplex(session);
+        done.notify();
+    });
+    done.wait();
+
+    // 在普通线程中等待
+    test_flow_control(session);
+    test_stream_body(session);
+    test_timeout(session);
+    test_http1();
+    check(session->getStreamCount() == 0, "no stream left");
+    test_abuse();
+
+    session->close();
+    cxk::http::HttpClientMgr::GetInstance()->close();
+    s_server->stop();
+    iom.stop();
+    return check_result();
+}
@@ -0,0 +1,264 @@
+#include "cxk/cxk.h"
+#include <iostream>
+#include <signal.h>
+#include "check.h"
+
+static cxk::Logger::ptr g_logger = CXK_LOG_ROOT();
+
+static const std::string HOST = "http://127.0.0.1:8091";
+static cxk::http::HttpServer::ptr s_server;
+
+
+static bool start_server(cxk::IOManager* iom){
+    s_server.reset(new cxk::http::HttpServer(true, iom, iom));
+    auto dispatch = s_server->getServletDispatch();
+    dispatch->addServlet("/sleep/:ms", [](cxk::http::HttpRequest::ptr request
+                , cxk::http::HttpResponse::ptr response, cxk::http::HttpSession::ptr session){
+        usleep(atoi(request->getRouteParam("ms").c_str()) * 1000);
+        response->setBody("slept");
+        return 0;
+    });
+    dispatch->addServlet("/echo", [](cxk::http::HttpRequest::ptr request
+                , cxk::http::HttpResponse::ptr response, cxk::http::HttpSession::ptr session){
+        response->setBody(request->getQuery());
+        return 0;
+    });
+    dispatch->addServlet("/close", [](cxk::http::HttpRequest::ptr request
+                , cxk::http::HttpResponse::ptr response, cxk::http::HttpSession::ptr session){
+        response->setClose(true);
+        response->setBody("bye");
+        return 0;
+    });
+    auto addr = cxk::Address::LookupAnyIpAddr("127.0.0.1:8091");
+    return s_server->bind(addr) && s_server->start();
+}
+
+
+// 并发请求: 总耗时接近一个请求的耗时
+void test_fanout(){
+    auto& client = *cxk::http::HttpClientMgr::GetInstance();
+    uint64_t begin = cxk::GetCurrentMS();
+    std::vector<cxk::http::HttpFuture::ptr> futures;
+    for(int i = 0; i < 10; ++i){
+        futures.push_back(client.get(HOST + "/sleep/200", 1000));
+    }
+    bool ok = true;
+    for(auto& r : cxk::http::HttpFuture::WaitAll(futures)){
+        ok = ok && r->result == 0 && r->response->getBody() == "slept";
+    }
+    uint64_t used = cxk::GetCurrentMS() - begin;
+    check(ok && used < 1000, "fanout 10 x 200ms in " + std::to_string(used) + "ms");
+}
+
+
+// 一个连接上pipelining, 响应按请求顺序对应
+void test_pipeline(){
+    cxk::http::HttpClientPool::Options options;
+    options.max_connections = 1;
+    options.max_pipeline = 8;
+    auto pool = std::make_shared<cxk::http::HttpClientPool>("127.0.0.1", 8091, false, options);
+    std::vector<cxk::http::HttpFuture::ptr> futures;
+    for(int i = 0; i < 50; ++i){
+        futures.push_back(pool->request(cxk::http::HttpMethod::GET, "/echo?" + std::to_string(i), 1000));
+    }
+    bool ok = true;
+    for(size_t i = 0; i < futures.size(); ++i){
+        auto r = futures[i]->get();
+        ok = ok && r->result == 0 && r->response->getBody() == std::to_string(i);
+    }
+    check(ok && pool->getConnectionCount() == 1, "pipeline");
+
+    // 对方关闭连接后, 排在后面的请求在新连接上重发
+    futures.clear();
+    futures.push_back(pool->request(cxk::http::HttpMethod::GET, "/close", 1000));
+    for(int i = 0; i < 5; ++i){
+        futures.push_back(pool->request(cxk::http::HttpMethod::GET, "/echo?" + std::to_string(i), 1000));
+    }
+    ok = futures[0]->get()->result == 0;
+    for(int i = 0; i < 5; ++i){
+        auto r = futures[i + 1]->get();
+        ok = ok && r->result == 0 && r->response->getBody() == std::to_string(i);
+    }
+    check(ok, "retry after connection close");
+
+    // 已经发出的非幂等请求不重发, 幂等的请求重发
+    pool = std::make_shared<cxk::http::HttpClientPool>("127.0.0.1", 8091, false, options);
+    futures.clear();
+    futures.push_back(pool->request(cxk::http::HttpMethod::GET, "/sleep/50", 1000));
+    futures.push_back(pool->request(cxk::http::HttpMethod::GET, "/close", 1000));
+    futures.push_back(pool->request(cxk::http::HttpMethod::POST, "/echo?post", 1000));
+    futures.push_back(pool->request(cxk::http::HttpMethod::GET, "/echo?get", 1000));
+    auto results = cxk::http::HttpFuture::WaitAll(futures);
+    check(results[0]->result == 0 && results[1]->result == 0
+            && results[2]->result == (int)cxk::http::HttpResult::Error::SEND_CLOSE_BY_PEER
+            && results[3]->result == 0 && results[3]->response->getBody() == "get", "no retry for post");
+
+    // 排队等待连接的请求也按自己的超时时间返回
+    options.max_pipeline = 1;
+    pool = std::make_shared<cxk::http::HttpClientPool>("127.0.0.1", 8091, false, options);
+    auto slow = pool->request(cxk::http::HttpMethod::GET, "/sleep/300", 1000);
+    uint64_t begin = cxk::GetCurrentMS();
+    auto r = pool->request(cxk::http::HttpMethod::GET, "/echo", 50)->get();
+    uint64_t used = cxk::GetCurrentMS() - begin;
+    check(r->result == (int)cxk::http::HttpResult::Error::TIMEOUT && used < 250 && pool->getPendingCount() == 0
+            && slow->get()->result == 0, "waiting request timeout in " + std::to_string(used) + "ms");
+
+    options.max_idle_time = 10;
+    pool = std::make_shared<cxk::http::HttpClientPool>("127.0.0.1", 8091, false, options);
+    pool->request(cxk::http::HttpMethod::GET, "/echo", 1000)->get();
+    usleep(20 * 1000);
+    pool->checkIdle();
+    check(pool->getConnectionCount() == 0, "idle connection closed");
+}
+
+
+// 每个连接读取请求后回复固定的原始数据并关闭, 用于构造不合法的响应
+class RawServer{
+public:
+    typedef std::shared_ptr<RawServer> ptr;
+
+    RawServer(cxk::IOManager* iom, const std::string& response)
+        : m_iom(iom), m_response(response){
+        cxk::Semaphore done;
+        // accept协程在stop之后才退出, 不引用this
+        m_iom->schedule([this, &done](){
+            auto sock = cxk::Socket::CreateTCPSocket();
+            sock->bind(cxk::Address::LookupAnyIpAddr("127.0.0.1:0"));
+            sock->listen();
+            m_sock = sock;
+            std::string response = m_response;
+            done.notify();
+            while(auto client = sock->accept()){
+                char buf[4096];
+                client->recv(buf, sizeof(buf));
+                client->send(response.c_str(), response.size());
+                client->close();
+            }
+        });
+        done.wait();
+    }
+
+    uint32_t getPort() const {
+        return std::dynamic_pointer_cast<cxk::IPAddress>(m_sock->getLocalAddress())->getPort();
+    }
+
+    /// 在调度器中关闭, 唤醒accept协程
+    void stop(){
+        cxk::Semaphore done;
+        m_iom->schedule([this, &done](){
+            m_sock->close();
+            done.notify();
+        });
+        done.wait();
+    }
+
+private:
+    cxk::IOManager* m_iom;
+    std::string m_response;
+    cxk::Socket::ptr m_sock;
+};
+
+
+// 对方给出的长度超过max_body_size时直接失败, 不按这个长度分配内存
+void test_body_too_large(cxk::IOManager* iom){
+    const char* responses[] = {
+        "HTTP/1.1 200 OK\r\nContent-Length: 100000000000\r\n\r\nabc",
+        "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\nfffffffff\r\nabc",
+        "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n3\r\nabc\r\n7fffffff\r\nabc",
+    };
+    bool ok = true;
+    for(auto rsp : responses){
+        RawServer server(iom, rsp);
+        cxk::http::HttpClientPool::Options options;
+        auto pool = std::make_shared<cxk::http::HttpClientPool>("127.0.0.1", server.getPort(), false, options, iom);
+        auto r = pool->request(cxk::http::HttpMethod::POST, "/", 1000)->get();
+        ok = ok && r->result == (int)cxk::http::HttpResult::Error::INVALID_RESPONSE && !r->response;
+        server.stop();
+    }
+    check(ok, "response body too large");
+}
+
+
+// 读响应失败时按原因返回, 超时的请求之后的幂等请求在新连接上重发
+void test_recv_error(cxk::IOManager* iom){
+    using cxk::http::HttpMethod;
+    using Error = cxk::http::HttpResult::Error;
+    cxk::http::HttpClientPool::Options options;
+    auto request = [&options, iom](RawServer& server, HttpMethod method, uint64_t timeout_ms){
+        auto pool = std::make_shared<cxk::http::HttpClientPool>("127.0.0.1", server.getPort(), false, options, iom);
+        return pool->request(method, "/", timeout_ms)->get()->result;
+    };
+
+    RawServer closed(iom, "");
+    check(request(closed, HttpMethod::GET, 1000) == (int)Error::SEND_CLOSE_BY_PEER
+            && request(closed, HttpMethod::POST, 1000) == (int)Error::SEND_CLOSE_BY_PEER, "closed by peer");
+    closed.stop();
+
+    RawServer garbage(iom, "garbage\r\n\r\n");
+    check(request(garbage, HttpMethod::GET, 1000) == (int)Error::INVALID_RESPONSE, "invalid response");
+    garbage.stop();
+
+    // 0表示不超时
+    RawServer ok(iom, "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok");
+    check(request(ok, HttpMethod::GET, 0) == (int)Error::OK, "zero timeout");
+    ok.stop();
+
+    options.max_connections = 1;
+    options.max_pipeline = 2;
+    auto pool = std::make_shared<cxk::http::HttpClientPool>("127.0.0.1", 8091, false, options, iom);
+    auto slow = pool->request(HttpMethod::GET, "/sleep/300", 100);
+    auto next = pool->request(HttpMethod::GET, "/echo?next", 1000);
+    auto r = next->get();
+    check(slow->get()->result == (int)Error::TIMEOUT && r->result == 0
+            && r->response->getBody() == "next", "retry after timeout");
+}
+
+
+void test_error(){
+    auto r = cxk::http::HttpClientMgr::GetInstance()->get("http://127.0.0.1:1/", 1000)->get();
+    check(r->result == (int)cxk::http::HttpResult::Error::CONNECT_FALT, "connect fail");
+
+    r = cxk::http::HttpClientMgr::GetInstance()->get(HOST + "/sleep/500", 100)->get();
+    check(r->result == (int)cxk::http::HttpResult::Error::TIMEOUT, "timeout");
+}
+
+
+int main(int argc, char* argv[]){
+    CXK_LOG_NAME("system")->setLogLevel(cxk::LogLevel::ERROR);
+    // 超时的请求关闭连接后服务器还会写响应
+    signal(SIGPIPE, SIG_IGN);
+    cxk::IOManager iom(2, false);
+    cxk::http::HttpClientMgr::GetInstance()->setIOManager(&iom);
+    std::atomic<int> started{0};
+    iom.schedule([&](){
+        started = start_server(&iom) ? 1 : -1;
+    });
+    while(started == 0){
+        usleep(1000);
+    }
+    if(started < 0){
+        CXK_LOG_ERROR(g_logger) << "bind 8091 fail";
+        return 1;
+    }
+
+    // 在协程中等待
+    cxk::Semaphore done;
+    iom.schedule([&](){
+        test_fanout();
+        test_pipeline();
+        done.notify();
+    });
+    done.wait();
+
+    // 在普通线程中等待
+    test_fanout();
+    test_error();
+    test_body_too_large(&iom);
+    test_recv_error(&iom);
+
+    // 空闲连接和检查定时器会让IOManager无法停止
+    cxk::http::HttpClientMgr::GetInstance()->close();
+    s_server->stop();
+    iom.stop();
+    return check_result();
+}
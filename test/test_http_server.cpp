@@ -77,6 +77,17 @@ void run(){
         return 0;
     });
 
+    // 大响应体, 带Accept-Encoding请求时边压缩边用chunked发送
+    sd->addServlet("/cxk/big", [](cxk::http::HttpRequest::ptr req, cxk::http::HttpResponse::ptr rsp, cxk::http::HttpSession::ptr session){
+        std::string body;
+        while(body.size() < 1024 * 1024){
+            body += g_body;
+        }
+        rsp->setHeader("Content-Type", "text/html");
+        rsp->setBody(body);
+        return 0;
+    });
+
 
     server->start();
 }
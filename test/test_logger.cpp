@@ -0,0 +1,194 @@
+#include "cxk/logger.h"
+#include "cxk/binlog.h"
+#include "cxk/config.h"
+#include "cxk/util.h"
+#include <unistd.h>
+
+static cxk::Logger::ptr g_logger = CXK_LOG_NAME("rotate");
+
+
+void test_rotate_size(){
+    std::cout << "===================rotate by size" << std::endl;
+    cxk::FSUtil::Rm("/tmp/cxk_log_test");
+    cxk::FileAppender::ptr appender(new cxk::FileAppender("/tmp/cxk_log_test/size.log",
+            cxk::FileAppender::NONE, 4096, false, 3));
+    g_logger->addAppender(appender);
+    for(int i = 0; i < 1000; ++i){
+        CXK_LOG_INFO(g_logger) << "rotate by size " << i;
+    }
+    g_logger->delAppender(appender);
+    sleep(1);
+
+    std::vector<std::string> files;
+    cxk::FSUtil::ListAllFile(files, "/tmp/cxk_log_test", "");
+    for(auto& i : files){
+        std::cout << i << std::endl;
+    }
+    // 当前文件 + 最多3个历史文件
+    std::cout << "test_rotate_size: " << (files.size() <= 4) << std::endl;
+}
+
+
+void test_rotate_compress(){
+    std::cout << "===================rotate with compress" << std::endl;
+    cxk::FSUtil::Rm("/tmp/cxk_log_test");
+    cxk::FileAppender::ptr appender(new cxk::FileAppender("/tmp/cxk_log_test/gzip.log",
+            cxk::FileAppender::DAILY, 0, true));
+    g_logger->addAppender(appender);
+    for(int i = 0; i < 100; ++i){
+        CXK_LOG_INFO(g_logger) << "rotate with compress " << i;
+    }
+    std::cout << "rotate: " << appender->rotate() << std::endl;
+    CXK_LOG_INFO(g_logger) << "after rotate";
+    g_logger->delAppender(appender);
+    sleep(1);
+
+    std::vector<std::string> files;
+    cxk::FSUtil::ListAllFile(files, "/tmp/cxk_log_test", ".gz");
+    std::cout << "test_rotate_compress: " << (files.size() == 1) << std::endl;
+    std::cout << appender->toYamlString() << std::endl;
+}
+
+
+void test_rotate_config(){
+    std::cout << "===================rotate config" << std::endl;
+    YAML::Node root = YAML::Load(
+        "logs:\n"
+        "    - name: rotate\n"
+        "      level: info\n"
+        "      appenders:\n"
+        "          - type: FileLogAppender\n"
+        "            file: /tmp/cxk_log_test/config.log\n"
+        "            rotate: hourly\n"
+        "            max_size: 1048576\n"
+        "            compress: true\n"
+        "            max_files: 24\n");
+    cxk::Config::LoadFromYaml(root);
+    std::cout << g_logger->toYamlString() << std::endl;
+}
+
+
+void test_binlog(){
+    std::cout << "===================binlog" << std::endl;
+    cxk::FSUtil::Rm("/tmp/cxk_log_test");
+    cxk::Logger::ptr logger = CXK_LOG_NAME("binlog");
+    cxk::BinaryFileAppender::ptr appender(new cxk::BinaryFileAppender("/tmp/cxk_log_test/access.blog"));
+    logger->addAppender(appender);
+    for(int i = 0; i < 3; ++i){
+        CXK_LOG_BIN_INFO(logger, "request %d path=%s cost=%.3fms size=%lu", i, "/index.html", 1.5 * i, (size_t)1024 * i);
+    }
+    CXK_LOG_BIN_WARN(logger, "no args");
+    CXK_LOG_INFO(logger) << "stream log " << 100;
+    logger->delAppender(appender);
+
+    cxk::BinLogReader reader("[%p]%T[%c]%T%m%n");
+    std::cout << "open: " << reader.open("/tmp/cxk_log_test/access.blog") << std::endl;
+    std::string line;
+    std::stringstream ss;
+    while(reader.next(line)){
+        ss << line;
+    }
+    std::cout << ss.str();
+    std::cout << "test_binlog: " << (ss.str() ==
+        "[INFO]\t[binlog]\trequest 0 path=/index.html cost=0.000ms size=0\n"
+        "[INFO]\t[binlog]\trequest 1 path=/index.html cost=1.500ms size=1024\n"
+        "[INFO]\t[binlog]\trequest 2 path=/index.html cost=3.000ms size=2048\n"
+        "[WARN]\t[binlog]\tno args\n"
+        "[INFO]\t[binlog]\tstream log 100\n") << std::endl;
+}
+
+
+static void log_limit(cxk::Logger::ptr logger, int& limit_count, int& sample_count){
+    CXK_LOG_LIMIT_INFO(logger, 5) << "limit " << ++limit_count;
+    CXK_LOG_SAMPLE_INFO(logger, 200000) << "sample " << ++sample_count;
+}
+
+void test_limit(){
+    std::cout << "===================limit" << std::endl;
+    cxk::Logger::ptr logger = CXK_LOG_NAME("limit");
+    int limit_count = 0;
+    int sample_count = 0;
+    uint64_t begin = cxk::GetCurrentMS();
+    for(int i = 0; i < 1000000; ++i){
+        log_limit(logger, limit_count, sample_count);
+    }
+    uint64_t used = cxk::GetCurrentMS() - begin;
+    std::cout << "limit_count: " << limit_count << " sample_count: " << sample_count
+              << " used: " << used << "ms" << std::endl;
+    // 循环可能跨过窗口边界, 每个经过的窗口最多5条
+    int first = limit_count;
+    bool ok = first >= 5 && first <= 5 * (int)(used / 1000 + 2);
+
+    // 下一个时间窗口第一次调用时先单独输出一条被抑制条数的报告
+    usleep(1100 * 1000);
+    log_limit(logger, limit_count, sample_count);
+    std::cout << "test_limit: " << (ok && limit_count == first + 1 && sample_count == 6) << std::endl;
+    CXK_LOG_FMT_LIMIT_INFO(logger, 5, "fmt limit %d", 1);
+}
+
+
+// 记录日志内容
+class CollectAppender : public cxk::LogAppender{
+public:
+    void log(std::shared_ptr<cxk::Logger> logger, cxk::LogLevel::Level level, cxk::LogEvent::ptr event) override {
+        contents.push_back(event->get_content());
+    }
+    std::string toYamlString() override { return ""; }
+
+    std::vector<std::string> contents;
+};
+
+// 等到100ms时间窗口的前半段, 避免连续的几次调用跨过窗口边界
+static void align_window(){
+    while(cxk::GetCoarseMonotonicMS() % 100 >= 50){
+        usleep(5 * 1000);
+    }
+}
+
+static void log_limit_quiet(cxk::Logger::ptr logger, int i){
+    CXK_LOG_LIMIT_LEVEL_PERIOD(logger, cxk::LogLevel::WARN, 2, 100) << "quiet " << i;
+}
+
+void test_limit_report(){
+    cxk::Logger::ptr logger = CXK_LOG_NAME("limit_report");
+    std::shared_ptr<CollectAppender> appender(new CollectAppender);
+    logger->addAppender(appender);
+
+    // 窗口切换后再调用: 先输出上一个窗口的报告
+    align_window();
+    for(int i = 0; i < 10; ++i){
+        log_limit_quiet(logger, i);
+    }
+    usleep(150 * 1000);
+    log_limit_quiet(logger, 10);
+    bool rollover = appender->contents.size() == 4
+        && appender->contents[2] == "[suppressed 8] log events in the last 100ms"
+        && appender->contents[3] == "quiet 10";
+
+    // 调用点不再被调用: 由FlushAll报告, 窗口没有结束时不报告。从新的窗口开始, 放行2条, 抑制7条
+    usleep(100 * 1000);
+    align_window();
+    for(int i = 11; i < 20; ++i){
+        log_limit_quiet(logger, i);
+    }
+    appender->contents.clear();
+    cxk::LogLimiter::FlushAll();
+    bool early = appender->contents.empty();
+    usleep(150 * 1000);
+    cxk::LogLimiter::FlushAll();
+    bool quiet = appender->contents.size() == 1 && appender->contents[0] == "[suppressed 7] log events in the last 100ms";
+    cxk::LogLimiter::FlushAll();
+    std::cout << "test_limit_report: " << (rollover && early && quiet && appender->contents.size() == 1) << std::endl;
+    logger->delAppender(appender);
+}
+
+
+int main(int argc, char* argv[]){
+    test_rotate_size();
+    test_rotate_compress();
+    test_rotate_config();
+    test_binlog();
+    test_limit();
+    test_limit_report();
+    return 0;
+}
@@ -18,6 +18,28 @@ void test(){
     parser.getData()->dump(std::cout);
 }
 
+// 零拷贝解析, 请求持有自己的缓冲, 原数据释放后字段仍然有效
+void test_zero_copy(){
+    cxk::http::HttpRequestParser parser(true);
+    std::string data(test_http_parser);
+    size_t s = parser.parse(data.c_str(), data.size());
+    auto req = parser.getData();
+    req->setBodyView(std::string_view(data).substr(s, parser.getContentLength()));
+    req->adoptRaw(data.c_str(), data.size());
+    data.assign(data.size(), 'x');
+
+    CXK_LOG_DEBUG(g_logger) << "test_zero_copy: " << s << " " << parser.isFinished() << " " << parser.hasError()
+        << " path=" << req->getPathView()
+        << " host=" << req->getHeaderView("host")
+        << " body=" << req->getBodyView()
+        << " headers=" << req->getHeaderViews().size();
+
+    req->setHeader("X-Test", "1");
+    CXK_LOG_DEBUG(g_logger) << "test_zero_copy: headers=" << req->getHeaders().size()
+        << " host=" << req->getHeader("Host");
+    req->dump(std::cout);
+}
+
 const char test_http_response[] = "HTTP/1.1 403 Forbidden\r\n"
 "Server: nginx/1.12.2\r\n"
 "Date: Sun, 28 Jul 2024 06:07:02 GMT\r\n"
@@ -49,6 +71,7 @@ void test_response(){
 
 int main(){
     test();
+    test_zero_copy();
 
     test_response();
     return 0;
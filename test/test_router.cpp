@@ -0,0 +1,95 @@
+#include "cxk/http/servlet.h"
+#include <iostream>
+#include "check.h"
+
+
+/// @brief 只用来区分匹配结果的servlet
+class NameServlet : public cxk::http::Servlet{
+public:
+    NameServlet(const std::string& name) : Servlet(name) {}
+
+    int32_t handle(cxk::http::HttpRequest::ptr request, cxk::http::HttpResponse::ptr response,
+            cxk::http::HttpSession::ptr session) override{
+        return 0;
+    }
+};
+
+
+// 返回匹配到的servlet名和参数, 如"user id=1"
+static std::string match(cxk::http::RadixRouter& router, const std::string& path){
+    cxk::http::RadixRouter::Params params;
+    auto slt = router.match(path, &params);
+    if(!slt){
+        return "null";
+    }
+    std::string rt = slt->getName();
+    for(auto& i : params){
+        rt += " " + i.first + "=" + i.second;
+    }
+    return rt;
+}
+
+
+static void check(cxk::http::RadixRouter& router, const std::string& path, const std::string& expect){
+    std::string rt = match(router, path);
+    ::check(rt == expect, path + " -> " + rt);
+}
+
+
+void test_router(){
+    cxk::http::RadixRouter router;
+    router.add("/", std::make_shared<NameServlet>("root"));
+    router.add("/users", std::make_shared<NameServlet>("users"));
+    router.add("/users/new", std::make_shared<NameServlet>("new_user"));
+    router.add("/users/:id", std::make_shared<NameServlet>("user"));
+    router.add("/users/:id/posts/:post", std::make_shared<NameServlet>("post"));
+    router.add("/user_groups", std::make_shared<NameServlet>("groups"));
+    router.add("/static/*filepath", std::make_shared<NameServlet>("static"));
+    router.add("/files/:name/raw", std::make_shared<NameServlet>("raw"));
+    router.add("/files/*", std::make_shared<NameServlet>("files"));
+    std::cout << "invalid route: " << !router.add("/users/:uid/x", std::make_shared<NameServlet>("x"))
+              << !router.add("/a/*b/c", std::make_shared<NameServlet>("x")) << std::endl;
+
+    check(router, "/", "root");
+    check(router, "/users", "users");
+    check(router, "/users/new", "new_user");
+    check(router, "/users/12", "user id=12");
+    check(router, "/users/12/posts/7", "post id=12 post=7");
+    check(router, "/users/12/posts", "null");
+    check(router, "/user_groups", "groups");
+    check(router, "/user", "null");
+    check(router, "/static/js/app.js", "static filepath=js/app.js");
+    check(router, "/static/", "static filepath=");
+    // 参数段匹配失败后回溯到通配段
+    check(router, "/files/a/raw", "raw name=a");
+    check(router, "/files/a/b", "files =a/b");
+
+    router.del("/users/:id");
+    check(router, "/users/12", "null");
+    check(router, "/users/12/posts/7", "post id=12 post=7");
+}
+
+
+void test_dispatch(){
+    cxk::http::ServletDispatch dispatch;
+    dispatch.addServlet("/api/:version/ping", std::make_shared<NameServlet>("ping"));
+    dispatch.addGlobServlet("/assets/*", std::make_shared<NameServlet>("assets"));
+    dispatch.addGlobServlet("/img/*.png", std::make_shared<NameServlet>("png"));
+
+    auto req = std::make_shared<cxk::http::HttpRequest>();
+    req->setPath("/api/v2/ping");
+    auto rsp = std::make_shared<cxk::http::HttpResponse>();
+    dispatch.handle(req, rsp, nullptr);
+    check(req->getRouteParam("version") == "v2", "route param");
+
+    check(dispatch.getMatchedServlet("/assets/a.css")->getName() == "assets", "glob in router");
+    check(dispatch.getMatchedServlet("/img/a/b.png")->getName() == "png", "fnmatch glob");
+    check(dispatch.getMatchedServlet("/img/a.jpg") == dispatch.getDefault(), "default");
+}
+
+
+int main(int argc, char* argv[]){
+    test_router();
+    test_dispatch();
+    return check_result();
+}
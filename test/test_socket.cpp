@@ -19,8 +19,47 @@ void test_socket(){
     CXK_LOG_INFO(g_logger) << str ;
 }
 
+
+void test_writev(){
+    cxk::Address::ptr addr = cxk::IPAddress::Create("127.0.0.1", 18035);
+    cxk::Socket::ptr server = cxk::Socket::CreateTCP(addr);
+    server->bind(addr);
+    server->listen();
+
+    cxk::Socket::ptr client = cxk::Socket::CreateTCP(addr);
+    client->connect(addr);
+    cxk::SocketStream::ptr out(new cxk::SocketStream(client));
+    cxk::SocketStream::ptr in(new cxk::SocketStream(server->accept()));
+
+    // 多个ByteArray合并写出, 写出后位置不变
+    std::vector<cxk::ByteArray::ptr> msgs;
+    std::string expect;
+    for(int i = 0; i < 3; ++i){
+        cxk::ByteArray::ptr ba(new cxk::ByteArray(64));
+        std::string data = cxk::random_string(100 * (i + 1));
+        ba->write(data.c_str(), data.size());
+        ba->setPosition(0);
+        msgs.push_back(ba);
+        expect += data;
+    }
+    int rt = out->writeBatch(msgs);
+    CXK_LOG_INFO(g_logger) << "writeBatch rt=" << rt << " position=" << msgs[0]->getPosition();
+
+    // 分散读到两块缓冲区
+    std::string head(expect.size() / 3, '\0');
+    std::string tail(expect.size() - head.size(), '\0');
+    iovec iovs[2];
+    iovs[0].iov_base = &head[0];
+    iovs[0].iov_len = head.size();
+    iovs[1].iov_base = &tail[0];
+    iovs[1].iov_len = tail.size();
+    rt = in->readvFixSize(iovs, 2);
+    std::cout << "test_writev: " << (rt == (int)expect.size() && head + tail == expect) << std::endl;
+}
+
 int main(){
     cxk::IOManager iom;
+    iom.schedule(&test_writev);
     iom.schedule(&test_socket);
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,77 @@
+#include "cxk/http/static_file_servlet.h"
+#include "cxk/util.h"
+#include <fstream>
+#include <iostream>
+#include "check.h"
+
+
+static cxk::http::StaticFileServlet::ptr s_servlet;
+
+
+static cxk::http::HttpResponse::ptr get(const std::string& path, const std::map<std::string, std::string>& headers = {}
+        , cxk::http::HttpMethod method = cxk::http::HttpMethod::GET){
+    auto req = std::make_shared<cxk::http::HttpRequest>();
+    req->setMethod(method);
+    req->setPath(path);
+    for(auto& i : headers){
+        req->setHeader(i.first, i.second);
+    }
+    auto rsp = std::make_shared<cxk::http::HttpResponse>();
+    s_servlet->handle(req, rsp, nullptr);
+    return rsp;
+}
+
+
+int main(int argc, char* argv[]){
+    std::string root = "/tmp/cxk_test_static/";
+    cxk::FSUtil::Mkdir(root + "sub");
+    std::ofstream(root + "a.txt") << "0123456789";
+    std::ofstream(root + "sub/index.html") << "<html></html>";
+    s_servlet.reset(new cxk::http::StaticFileServlet(root));
+
+    auto rsp = get("/a.txt");
+    std::string etag = rsp->getHeader("ETag");
+    check(rsp->getStatus() == cxk::http::HttpStatus::OK && rsp->getBody() == "0123456789"
+            && rsp->getHeader("Content-Type") == "text/plain; charset=utf-8" && !etag.empty(), "get");
+
+    rsp = get("/a.txt", {{"If-None-Match", "W/" + etag}});
+    check(rsp->getStatus() == cxk::http::HttpStatus::NOT_MODIFIED && rsp->getBody().empty(), "if-none-match");
+
+    // 缓存的内容直接共享给响应, 不拷贝
+    auto rsp2 = get("/a.txt");
+    check(&rsp2->getBody() == &get("/a.txt")->getBody() && rsp2->toString().find("content-length: 10") != std::string::npos
+            , "shared body");
+
+    rsp = get("/a.txt", {{"Range", "bytes=2-4"}});
+    check(rsp->getStatus() == cxk::http::HttpStatus::PARTIAL_CONTENT && rsp->getBody() == "234"
+            && rsp->getHeader("Content-Range") == "bytes 2-4/10", "range");
+
+    rsp = get("/a.txt", {{"Range", "bytes=-3"}});
+    check(rsp->getBody() == "789", "suffix range");
+
+    rsp = get("/a.txt", {{"Range", "bytes=10-"}});
+    check(rsp->getStatus() == cxk::http::HttpStatus::RANGE_NOT_SATISFIABLE
+            && rsp->getHeader("Content-Range") == "bytes */10", "unsatisfiable range");
+
+    rsp = get("/a.txt", {{"Range", "bytes=2-4"}, {"If-Range", "\"other\""}});
+    check(rsp->getStatus() == cxk::http::HttpStatus::OK && rsp->getBody().size() == 10, "if-range mismatch");
+
+    rsp = get("/a.txt", {}, cxk::http::HttpMethod::HEAD);
+    check(rsp->getBody().empty() && rsp->getHeader("Content-Length") == "10", "head");
+
+    rsp = get("/sub");
+    check(rsp->getStatus() == cxk::http::HttpStatus::MOVED_PERMANENTLY && rsp->getHeader("Location") == "/sub/", "dir redirect");
+
+    rsp = get("/sub/");
+    check(rsp->getBody() == "<html></html>", "index");
+
+    rsp = get("/sub/..%2f..%2fetc/passwd");
+    check(rsp->getStatus() == cxk::http::HttpStatus::BAD_REQUEST, "path traversal");
+
+    rsp = get("/nope.txt");
+    check(rsp->getStatus() == cxk::http::HttpStatus::NOT_FOUND, "not found");
+
+    rsp = get("/a.txt", {}, cxk::http::HttpMethod::POST);
+    check(rsp->getStatus() == cxk::http::HttpStatus::METHOD_NOT_ALLOWED, "method");
+    return check_result();
+}
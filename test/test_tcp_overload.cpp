@@ -0,0 +1,232 @@
+#include "cxk/cxk.h"
+#include <iostream>
+#include "check.h"
+
+static cxk::Logger::ptr g_logger = CXK_LOG_ROOT();
+
+
+static cxk::Socket::ptr connect_to(cxk::Address::ptr addr){
+    auto sock = cxk::Socket::CreateTCP(addr);
+    if(!sock->connect(addr)){
+        return nullptr;
+    }
+    sock->setRecvTimeout(1000);
+    return sock;
+}
+
+
+// 读取直到连接关闭或者超时
+static std::string read_all(cxk::Socket::ptr sock){
+    std::string rt;
+    char buf[4096];
+    int len;
+    while((len = sock->recv(buf, sizeof(buf))) > 0){
+        rt.append(buf, len);
+    }
+    return rt;
+}
+
+
+static std::string get(cxk::Socket::ptr sock){
+    std::string req = "GET / HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: close\r\n\r\n";
+    sock->send(req.c_str(), req.size());
+    return read_all(sock);
+}
+
+
+static bool is_503(const std::string& rsp){
+    return rsp.compare(0, 12, "HTTP/1.1 503") == 0 && rsp.find("Retry-After: 1\r\n") != std::string::npos;
+}
+
+
+// 占住工作调度器的所有线程, 协程里忙等不会让出
+static void block_worker(cxk::IOManager* worker, uint64_t ms){
+    for(size_t i = 0; i < worker->getThreadCount(); ++i){
+        worker->schedule([ms](){
+            uint64_t end = cxk::GetCurrentMS() + ms;
+            while(cxk::GetCurrentMS() < end);
+        });
+    }
+}
+
+
+static bool wait_for(const std::function<bool()>& cond, uint64_t ms = 1000){
+    uint64_t end = cxk::GetCurrentMS() + ms;
+    while(!cond()){
+        if(cxk::GetCurrentMS() >= end){
+            return false;
+        }
+        usleep(1000);
+    }
+    return true;
+}
+
+
+// 绑定到内核分配的端口, 在调度器中创建监听socket才会使用hook的非阻塞accept
+static bool start_server(cxk::http::HttpServer::ptr server, cxk::IOManager* accept_worker){
+    server->getServletDispatch()->addServlet("/", [](cxk::http::HttpRequest::ptr req
+                , cxk::http::HttpResponse::ptr rsp, cxk::http::HttpSession::ptr session){
+        rsp->setBody("hello");
+        return 0;
+    });
+    bool ok = false;
+    cxk::Semaphore done;
+    accept_worker->schedule([&](){
+        ok = server->bind(cxk::Address::LookupAnyIpAddr("127.0.0.1:0")) && server->start();
+        done.notify();
+    });
+    done.wait();
+    if(!ok){
+        CXK_LOG_ERROR(g_logger) << "bind fail";
+    }
+    return ok;
+}
+
+
+static cxk::http::HttpServer::ptr start_server(cxk::IOManager* worker, cxk::IOManager* accept_worker){
+    cxk::http::HttpServer::ptr server(new cxk::http::HttpServer(true, worker, accept_worker));
+    return start_server(server, accept_worker) ? server : nullptr;
+}
+
+
+void test_max_connections(cxk::IOManager* iom){
+    auto server = start_server(iom, iom);
+    if(!server){
+        check(false, "max connections");
+        return;
+    }
+    auto addr = server->getSocks()[0]->getLocalAddress();
+    server->setMaxConnections(1);
+
+    auto first = connect_to(addr);
+    check(first && wait_for([server](){ return server->getConnectionCount() == 1; }), "first connection accepted");
+
+    auto second = connect_to(addr);
+    check(second && is_503(read_all(second)) && server->getRejectedCount() == 1, "reject over max connections");
+
+    // 第一个连接关闭后恢复接受
+    first->close();
+    check(wait_for([server](){ return server->getConnectionCount() == 0; }), "connection count released");
+    auto third = connect_to(addr);
+    std::string rsp = third ? get(third) : "";
+    check(rsp.compare(0, 12, "HTTP/1.1 200") == 0 && server->getRejectedCount() == 1, "accept after release");
+    server->stop();
+}
+
+
+void test_shed_and_backoff(cxk::IOManager* iom){
+    cxk::IOManager worker(1, false, "busy");
+    auto server = start_server(&worker, iom);
+    if(!server){
+        check(false, "shed");
+        worker.stop();
+        return;
+    }
+    auto addr = server->getSocks()[0]->getLocalAddress();
+
+    // 工作线程忙时进入队列的连接, 等待超过max_queue_time后直接返回503
+    server->setMaxQueueTime(50);
+    block_worker(&worker, 200);
+    auto sock = connect_to(addr);
+    std::string rsp = sock ? get(sock) : "";
+    check(is_503(rsp) && server->getShedCount() == 1, "shed after max queue time");
+
+    sock = connect_to(addr);
+    rsp = sock ? get(sock) : "";
+    check(rsp.compare(0, 12, "HTTP/1.1 200") == 0 && server->getShedCount() == 1, "no shed when idle");
+
+    // 工作调度器积压时accept之后暂停accept, 积压消化后连接正常处理
+    server->setMaxQueueTime(0);
+    server->setAcceptBackoffQueue(1);
+    block_worker(&worker, 200);
+    worker.schedule([](){});
+    sock = connect_to(addr);
+    check(sock && wait_for([server](){ return server->getBackoffCount() > 0; }), "accept backoff");
+    rsp = sock ? get(sock) : "";
+    check(rsp.compare(0, 12, "HTTP/1.1 200") == 0 && server->getShedCount() == 1, "accept after backoff");
+
+    server->stop();
+    worker.stop();
+}
+
+
+// 记录cBPF程序是否挂载成功, fail为true时用0作为socket数让内核拒绝(除数为0)
+class CbpfServer : public cxk::http::HttpServer{
+public:
+    typedef std::shared_ptr<CbpfServer> ptr;
+    CbpfServer(cxk::IOManager* iom, bool fail)
+        : cxk::http::HttpServer(true, iom, iom), m_fail(fail){
+    }
+
+    int calls = 0;
+    bool attached = false;
+
+protected:
+    virtual bool attachReusePortCbpf(cxk::Socket::ptr sock, uint32_t count) override {
+        ++calls;
+        attached = cxk::TcpServer::attachReusePortCbpf(sock, m_fail ? 0 : count);
+        return attached;
+    }
+
+private:
+    bool m_fail;
+};
+
+
+// 所有监听socket在同一个端口上, 每个连接都能得到响应
+static bool check_listeners(cxk::http::HttpServer::ptr server, size_t count){
+    auto socks = server->getSocks();
+    if(socks.size() != count){
+        return false;
+    }
+    auto addr = socks[0]->getLocalAddress();
+    uint32_t port = std::dynamic_pointer_cast<cxk::IPAddress>(addr)->getPort();
+    for(auto& i : socks){
+        if(port == 0 || std::dynamic_pointer_cast<cxk::IPAddress>(i->getLocalAddress())->getPort() != port){
+            return false;
+        }
+    }
+    for(int i = 0; i < 20; ++i){
+        auto sock = connect_to(addr);
+        std::string rsp = sock ? get(sock) : "";
+        if(rsp.compare(0, 12, "HTTP/1.1 200") != 0){
+            return false;
+        }
+    }
+    return true;
+}
+
+
+// 每个服务器有4个监听socket, 它们的accept协程分布在两个线程上, stop时要全部退出
+void test_reuseport(cxk::IOManager* iom){
+    cxk::http::HttpServer::ptr server(new cxk::http::HttpServer(true, iom, iom));
+    server->setReusePort(4);
+    check(start_server(server, iom) && check_listeners(server, 4), "reuseport listeners");
+    server->stop();
+
+    CbpfServer::ptr cbpf(new CbpfServer(iom, false));
+    cbpf->setReusePort(4);
+    cbpf->setReusePortCbpf(true);
+    check(start_server(cbpf, iom) && cbpf->calls == 1 && cbpf->attached
+            && check_listeners(cbpf, 4), "reuseport cbpf");
+    cbpf->stop();
+
+    // 挂载失败时退回内核的哈希分配, 监听socket照常工作
+    cbpf.reset(new CbpfServer(iom, true));
+    cbpf->setReusePort(4);
+    cbpf->setReusePortCbpf(true);
+    check(start_server(cbpf, iom) && cbpf->calls == 1 && !cbpf->attached
+            && check_listeners(cbpf, 4), "reuseport cbpf attach fail");
+    cbpf->stop();
+}
+
+
+int main(int argc, char* argv[]){
+    CXK_LOG_NAME("system")->setLogLevel(cxk::LogLevel::ERROR);
+    cxk::IOManager iom(2, false);
+    test_max_connections(&iom);
+    test_shed_and_backoff(&iom);
+    test_reuseport(&iom);
+    iom.stop();
+    return check_result();
+}
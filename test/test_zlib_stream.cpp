@@ -1,5 +1,8 @@
 #include "cxk/stream/zlib_stream.h"
+#include "cxk/stream/compress_codec.h"
 #include "cxk/util.h"
+#include "cxk/config.h"
+#include "cxk/http/http_session.h"
 
 
 void test_gzip(){
@@ -79,11 +82,115 @@ void test_zlib() {
 }
 
 
+void test_pool(){
+    std::cout << "===================pool===================" << std::endl;
+    std::string data = cxk::random_string(1024);
+
+    // 复用的上下文和新建的上下文压缩结果相同
+    std::string first;
+    bool ok = true;
+    uint64_t begin = cxk::GetCurrentUS();
+    for(int i = 0; i < 10000; ++i){
+        auto compress = cxk::ZlibStream::CreateGzip(true);
+        compress->write(data.c_str(), data.size());
+        compress->flush();
+        std::string result = compress->getResult();
+        if(i == 0){
+            first = result;
+        } else if(result != first){
+            ok = false;
+        }
+
+        auto uncompress = cxk::ZlibStream::CreateGzip(false);
+        uncompress->write(result.c_str(), result.size());
+        uncompress->flush();
+        if(uncompress->getResult() != data){
+            ok = false;
+        }
+    }
+    uint64_t used = cxk::GetCurrentUS() - begin;
+    std::cout << "test_pool: " << ok << " used: " << used / 1000.0 << "ms" << std::endl;
+}
+
+void test_codec(){
+    std::cout << "===================codec===================" << std::endl;
+    std::string data;
+    for(int i = 0; i < 10000; ++i){
+        data += "{\"id\":" + std::to_string(i) + ",\"name\":\"" + cxk::random_string(4) + "\"}";
+    }
+
+    for(int i = cxk::CompressCodec::GZIP; i < cxk::CompressCodec::TYPE_COUNT; ++i){
+        auto codec = cxk::CompressCodec::Get((cxk::CompressCodec::Type)i);
+        if(!codec){
+            continue;
+        }
+        std::string compressed;
+        std::string result;
+        bool ok = codec->compress(data, compressed) && codec->decompress(compressed, result) && result == data;
+
+        // 多个内存块的ByteArray
+        cxk::ByteArray::ptr in(new cxk::ByteArray(256));
+        in->write(data.c_str(), data.size());
+        in->setPosition(0);
+        cxk::ByteArray::ptr out(new cxk::ByteArray);
+        ok = ok && codec->compress(in, out);
+        out->setPosition(0);
+        cxk::ByteArray::ptr back(new cxk::ByteArray);
+        ok = ok && codec->decompress(out, back);
+        back->setPosition(0);
+        ok = ok && back->toString() == data;
+
+        // 损坏的数据
+        compressed.resize(compressed.size() / 2);
+        bool broken = !codec->decompress(compressed, result) || result != data;
+        std::cout << "test_codec " << codec->getName() << ": " << (ok && broken)
+                  << " ratio: " << (double)out->getSize() / data.size() << std::endl;
+    }
+}
+
+
+// 很小的压缩数据解压出很大的结果, 超过上限时立即失败
+void test_bomb(){
+    std::cout << "===================bomb===================" << std::endl;
+    std::string zeros(16 * 1024 * 1024, '\0');
+    for(int i = cxk::CompressCodec::GZIP; i < cxk::CompressCodec::TYPE_COUNT; ++i){
+        auto codec = cxk::CompressCodec::Get((cxk::CompressCodec::Type)i);
+        if(!codec){
+            continue;
+        }
+        std::string compressed;
+        std::string result;
+        bool ok = codec->compress(zeros, compressed);
+        bool limited = !codec->decompress(compressed, result, 1024 * 1024);
+        ok = ok && codec->decompress(compressed, result, zeros.size()) && result == zeros;
+        std::cout << "test_bomb " << codec->getName() << ": " << (ok && limited)
+                  << " compressed: " << compressed.size() << std::endl;
+    }
+
+    // 请求体按http.reauest.max_body_size限制解压后的大小
+    auto codec = cxk::CompressCodec::Get(cxk::CompressCodec::GZIP);
+    std::string compressed;
+    codec->compress(zeros, compressed);
+    cxk::http::HttpRequest::ptr req(new cxk::http::HttpRequest);
+    req->setHeader("Content-Encoding", "gzip");
+    req->setBody(compressed);
+    auto max_body = cxk::Config::Lookup<unsigned long long>("http.reauest.max_body_size", 0);
+    uint64_t old = max_body->getValue();
+    max_body->setValue(1024 * 1024);
+    bool limited = !cxk::http::HttpSession::DecodeBody(req);
+    max_body->setValue(old);
+    bool ok = cxk::http::HttpSession::DecodeBody(req) && req->getBody() == zeros;
+    std::cout << "test_bomb request body: " << (ok && limited) << std::endl;
+}
+
 
 int main(int argc, char* argv[]){
     srand(time(0));
     test_gzip();
     test_deflate();
     test_zlib();
+    test_pool();
+    test_codec();
+    test_bomb();
     return 0;
 }
\ No newline at end of file